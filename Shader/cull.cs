@@ -0,0 +1,99 @@
+#version 430 core
+layout (local_size_x = 64) in;
+
+struct DrawCommand {
+    uint count;
+    uint instanceCount;
+    uint first;
+    uint baseInstance;
+};
+
+struct Batch {
+    vec4 boundsMin;  // local mesh bounds, w unused
+    vec4 boundsMax;
+};
+
+layout (std430, binding = 0) readonly buffer InstancesIn { mat4 instancesIn[]; };
+layout (std430, binding = 1) readonly buffer BatchOf { uint batchOf[]; };
+layout (std430, binding = 2) readonly buffer Batches { Batch batches[]; };
+layout (std430, binding = 3) buffer Commands { DrawCommand commands[]; };
+layout (std430, binding = 4) writeonly buffer InstancesOut { mat4 instancesOut[]; };
+
+uniform uint instanceCount;
+uniform vec4 frustumPlanes[6];
+
+// previous frame's depth pyramid (max depth per texel)
+uniform bool useHiZ;
+uniform sampler2D hiZ;
+uniform vec2 hiZSize;
+uniform int hiZMaxLevel;
+uniform mat4 prevViewProjection;
+
+bool insideFrustum(vec3 center, vec3 extent)
+{
+    for (int i = 0; i < 6; i++) {
+        vec4 plane = frustumPlanes[i];
+        float radius = dot(extent, abs(plane.xyz));
+        if (dot(plane.xyz, center) + plane.w < -radius) return false;
+    }
+    return true;
+}
+
+bool passesHiZ(vec3 center, vec3 extent)
+{
+    vec2 minUV = vec2(1.0);
+    vec2 maxUV = vec2(0.0);
+    float nearestDepth = 1.0;
+    for (int i = 0; i < 8; i++) {
+        vec3 corner = center + extent * vec3((i & 1) != 0 ? 1.0 : -1.0,
+                                             (i & 2) != 0 ? 1.0 : -1.0,
+                                             (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = prevViewProjection * vec4(corner, 1.0);
+        if (clip.w <= 0.0) return true;  // straddles the camera, keep it
+        vec3 ndc = clip.xyz / clip.w;
+        vec2 uv = ndc.xy * 0.5 + 0.5;
+        minUV = min(minUV, uv);
+        maxUV = max(maxUV, uv);
+        nearestDepth = min(nearestDepth, ndc.z * 0.5 + 0.5);
+    }
+    minUV = clamp(minUV, 0.0, 1.0);
+    maxUV = clamp(maxUV, 0.0, 1.0);
+
+    // pick the level where the rect covers at most 2x2 texels
+    vec2 sizePx = (maxUV - minUV) * hiZSize;
+    float level = ceil(log2(max(max(sizePx.x, sizePx.y), 1.0)));
+    level = clamp(level, 0.0, float(hiZMaxLevel));
+
+    float d0 = textureLod(hiZ, minUV, level).r;
+    float d1 = textureLod(hiZ, vec2(maxUV.x, minUV.y), level).r;
+    float d2 = textureLod(hiZ, vec2(minUV.x, maxUV.y), level).r;
+    float d3 = textureLod(hiZ, maxUV, level).r;
+    float furthest = max(max(d0, d1), max(d2, d3));
+
+    return nearestDepth <= furthest;
+}
+
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if (id >= instanceCount) return;
+
+    mat4 model = instancesIn[id];
+    uint batch = batchOf[id];
+
+    // world space AABB of the transformed local bounds
+    vec3 localMin = batches[batch].boundsMin.xyz;
+    vec3 localMax = batches[batch].boundsMax.xyz;
+    vec3 localCenter = (localMin + localMax) * 0.5;
+    vec3 localExtent = (localMax - localMin) * 0.5;
+    vec3 center = (model * vec4(localCenter, 1.0)).xyz;
+    mat3 axes = mat3(model);
+    vec3 extent = abs(axes[0]) * localExtent.x + abs(axes[1]) * localExtent.y +
+                  abs(axes[2]) * localExtent.z;
+
+    if (!insideFrustum(center, extent)) return;
+    if (useHiZ && !passesHiZ(center, extent)) return;
+
+    uint slot = atomicAdd(commands[batch].instanceCount, 1u);
+    instancesOut[commands[batch].baseInstance + slot] = model;
+}
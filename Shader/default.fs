@@ -1,35 +1,65 @@
-#version 330 core
+#version 330 core
+#include "lighting.glsl"
 out vec4 FragColor;
 
 in vec2 TexCoord;
 in vec3 Normal;
 in vec3 FragPos;
+in float LodFade;
 
 uniform sampler2D ourTexture;
 uniform vec3 lightDir;
 uniform vec3 lightColor;
-uniform vec3 viewPos;
 uniform float ambientStrength;
 uniform float diffuseStrength;
 uniform float specularStrength;
 uniform float shininess;
 
+// ordered dither threshold in (0, 1) for the LOD crossfade
+float bayer4(vec2 fragCoord)
+{
+    const float m[16] = float[](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0,
+                                3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 p = ivec2(mod(fragCoord, 4.0));
+    return (m[p.x + p.y * 4] + 0.5) / 16.0;
+}
+
 void main()
 {
+    // LOD crossfade: the incoming level keeps pixels below the fade, the
+    // outgoing one (negative fade) the rest, 0 means no fade at all
+    if (LodFade != 0.0) {
+        float threshold = bayer4(gl_FragCoord.xy);
+        if (LodFade > 0.0 && threshold >= LodFade) discard;
+        if (LodFade < 0.0 && threshold < 1.0 + LodFade) discard;
+    }
+
     vec3 albedo = texture(ourTexture, TexCoord).rgb;
 
     vec3 norm = normalize(Normal);
     vec3 lightDirNorm = normalize(-lightDir);
     float diff = max(dot(norm, lightDirNorm), 0.0);
+    float moonLit = moonVisibility(FragPos, norm, lightDirNorm);
 
     vec3 viewDir = normalize(viewPos - FragPos);
     vec3 reflectDir = reflect(-lightDirNorm, norm);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
 
     vec3 ambient = ambientStrength * lightColor;
-    vec3 diffuse = diffuseStrength * diff * lightColor;
-    vec3 specular = specularStrength * spec * lightColor;
+    vec3 diffuse = diffuseStrength * diff * moonLit * lightColor;
+    vec3 specular = specularStrength * spec * moonLit * lightColor;
 
     vec3 color = (ambient + diffuse) * albedo + specular;
-    FragColor = vec4(color, 1.0);
+
+    vec3 toSpot;
+    vec3 spot = spotRadiance(FragPos, norm, toSpot);
+    if (spot != vec3(0.0)) {
+        float spotDiff = max(dot(norm, toSpot), 0.0);
+        float spotSpec = pow(max(dot(viewDir, reflect(-toSpot, norm)), 0.0),
+                             shininess);
+        color += spot * (spotDiff * albedo + spotSpec * specularStrength);
+    }
+    color += clusterLighting(FragPos, norm, viewDir, albedo,
+                             specularStrength, shininess, false);
+    FragColor = vec4(applyFog(color, FragPos), 1.0);
 }
@@ -1,12 +1,14 @@
-#version 330 core
+#version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
 layout (location = 2) in vec3 aNormal;
 layout (location = 3) in mat4 instancedMatrix;
+layout (location = 7) in vec4 instanceParams;  // x = LOD fade, 0 if unbound
 
 out vec2 TexCoord;
 out vec3 Normal;
 out vec3 FragPos;
+out float LodFade;
 
 uniform mat4 model;
 uniform mat4 view;
@@ -20,4 +22,5 @@ void main()
     Normal = normalize(transpose(inverse(mat3(world))) * aNormal);
     gl_Position = projection * view * worldPos;
     TexCoord = aTexCoord;
+    LodFade = instanceParams.x;
 }
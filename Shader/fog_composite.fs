@@ -0,0 +1,52 @@
+#version 330 core
+// FogVolume's light in front of each pixel, added onto the scene
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+uniform sampler2D sceneDepth;
+uniform sampler3D fogVolume;
+uniform vec2 fogPlanes;  // near and far of the scene's projection
+uniform float fogVolumeDistance;
+
+float viewDepth(float depth)
+{
+    float n = fogPlanes.x;
+    float f = fogPlanes.y;
+    return 2.0 * n * f / (f + n - (depth * 2.0 - 1.0) * (f - n));
+}
+
+// light gathered along the column at uv up to `depth` metres
+vec3 lightTo(vec2 uv, float depth)
+{
+    float slices = float(textureSize(fogVolume, 0).z);
+    // slice k holds the sum up to its far side, at distance * ((k+1)/n)^2
+    float s = sqrt(min(depth, fogVolumeDistance) / fogVolumeDistance) * slices;
+    vec3 light = texture(fogVolume, vec3(uv, max(s - 0.5, 0.5) / slices)).rgb;
+    // short of the first slice's far side, take the part of it we cover
+    return light * min(s, 1.0);
+}
+
+void main()
+{
+    float depth = viewDepth(texture(sceneDepth, TexCoord).r);
+
+    // bilateral: the 4 nearest columns, bilinear weights scaled down where
+    // the scene under a column's center is at another depth
+    vec2 size = vec2(textureSize(fogVolume, 0).xy);
+    vec2 p = TexCoord * size - 0.5;
+    vec2 base = floor(p);
+    vec2 f = p - base;
+    vec3 sum = vec3(0.0);
+    float total = 0.0;
+    for (int i = 0; i < 4; i++) {
+        vec2 offset = vec2(i & 1, i >> 1);
+        vec2 uv = (base + offset + 0.5) / size;
+        vec2 w2 = mix(1.0 - f, f, offset);
+        float other = viewDepth(texture(sceneDepth, uv).r);
+        float w = w2.x * w2.y / (1e-3 + abs(other - depth) / depth);
+        sum += lightTo(uv, depth) * w;
+        total += w;
+    }
+    FragColor = vec4(sum / max(total, 1e-6), 0.0);
+}
@@ -0,0 +1,63 @@
+#version 330 core
+#include "lighting.glsl"
+// one slice of FogVolume: light scattered in this froxel, added to what
+// the slices in front of it gathered
+layout (location = 0) out vec4 Slice;    // into the volume
+layout (location = 1) out vec4 Running;  // for the next slice
+
+in vec2 TexCoord;
+
+uniform sampler2D fogRunning;  // rgb light so far, a transmittance so far
+uniform int fogSlice;
+uniform int fogSlices;
+uniform float fogVolumeDistance;
+uniform vec3 fogEye;
+uniform mat3 fogBasis;  // camera right, up, back
+uniform vec2 fogTan;    // tan of the half fov across and up
+uniform vec3 fogParams;  // density, falloff, base height, see HeightFog
+uniform float fogScattering;
+uniform float fogAnisotropy;
+
+uniform vec3 lightDir;
+uniform vec3 lightColor;
+
+// Henyey-Greenstein, cosTheta between the light's travel and the view ray
+float phase(float cosTheta)
+{
+    float g = fogAnisotropy;
+    float denom = 1.0 + g * g - 2.0 * g * cosTheta;
+    return (1.0 - g * g) / (12.5663706 * denom * sqrt(denom));
+}
+
+void main()
+{
+    // slices sit at distance * t^2, finer near the eye
+    float t0 = float(fogSlice) / float(fogSlices);
+    float t1 = float(fogSlice + 1) / float(fogSlices);
+    float d0 = fogVolumeDistance * t0 * t0;
+    float d1 = fogVolumeDistance * t1 * t1;
+    // a metre of view depth along this froxel's column
+    vec3 ray = fogBasis * vec3((TexCoord * 2.0 - 1.0) * fogTan, -1.0);
+    vec3 pos = fogEye + ray * (0.5 * (d0 + d1));
+    float len = (d1 - d0) * length(ray);
+    vec3 viewRay = normalize(ray);
+
+    float density = fogParams.x * exp(-fogParams.y * (pos.y - fogParams.z));
+    vec3 toMoon = normalize(-lightDir);
+    vec3 light = lightColor * moonVisibility(pos, vec3(0.0), toMoon) *
+                 phase(dot(viewRay, toMoon));
+    vec3 toSpot;
+    vec3 spot = spotRadiance(pos, vec3(0.0), toSpot);
+    if (spot != vec3(0.0)) light += spot * phase(dot(viewRay, toSpot));
+
+    // scattering integrated over the froxel against its own extinction,
+    // so thick slices don't add more light than they let through
+    float extinction = max(density, 1e-6);
+    float transmit = exp(-extinction * len);
+    vec3 scattered = light * density * fogScattering;
+    vec3 integrated = (scattered - scattered * transmit) / extinction;
+    vec4 front = texelFetch(fogRunning, ivec2(gl_FragCoord.xy), 0);
+    vec4 sum = vec4(front.rgb + front.a * integrated, front.a * transmit);
+    Slice = sum;
+    Running = sum;
+}
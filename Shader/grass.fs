@@ -0,0 +1,40 @@
+#version 330 core
+#include "lighting.glsl"
+out vec4 FragColor;
+
+in vec3 FragPos;
+in vec3 Normal;
+in float BladeHeight;
+in vec2 GroundUV;
+
+uniform sampler2D ourTexture;
+uniform vec3 lightDir;
+uniform vec3 lightColor;
+uniform float ambientStrength;
+uniform float diffuseStrength;
+
+void main()
+{
+    // tint by the floor texture so the blades match the ground under them
+    vec3 ground = texture(ourTexture, GroundUV).rgb;
+    vec3 albedo = ground * mix(0.45, 1.1, BladeHeight);
+
+    vec3 norm = normalize(Normal);
+    if (!gl_FrontFacing) norm.xz = -norm.xz;
+    vec3 lightDirNorm = normalize(-lightDir);
+    float diff = max(dot(norm, lightDirNorm), 0.0);
+    float moonLit = moonVisibility(FragPos, norm, lightDirNorm);
+
+    vec3 ambient = ambientStrength * lightColor;
+    vec3 diffuse = diffuseStrength * diff * moonLit * lightColor;
+
+    vec3 color = (ambient + diffuse) * albedo;
+
+    // blades are thin, light coming through the back counts too
+    vec3 toSpot;
+    vec3 spot = spotRadiance(FragPos, norm, toSpot);
+    color += spot * (abs(dot(norm, toSpot)) * albedo);
+    color += clusterLighting(FragPos, norm, vec3(0.0), albedo, 0.0, 1.0,
+                             true);
+    FragColor = vec4(applyFog(color, FragPos), 1.0);
+}
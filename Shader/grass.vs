@@ -0,0 +1,106 @@
+#version 330 core
+// no attributes: blade = gl_InstanceID, vertex along the blade = gl_VertexID
+out vec3 FragPos;
+out vec3 Normal;
+out float BladeHeight;  // 0 at the root, 1 at the tip
+out vec2 GroundUV;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 viewPos;
+
+uniform vec2 patchOrigin;
+uniform uint patchSeed;
+uniform float patchSize;
+uniform vec2 areaMax;
+uniform float groundY;
+uniform bool useTerrain;
+uniform sampler2D heightMap;
+uniform vec2 terrainOrigin;
+uniform float terrainSpacing;
+uniform int terrainResolution;
+uniform int maxBlades;
+uniform float bladeHeight;
+uniform float fadeStart;
+uniform float fadeEnd;
+
+uniform float time;
+uniform vec2 windDir;
+uniform float windStrength;
+
+uint hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+float unit(uint h)
+{
+    return float(h >> 8) * (1.0 / 16777216.0);
+}
+
+// same as in terrain.vs
+float TerrainHeight(vec2 xz)
+{
+    float last = float(terrainResolution - 1);
+    vec2 t = clamp((xz - terrainOrigin) / terrainSpacing, vec2(0.0),
+                   vec2(last));
+    ivec2 i = min(ivec2(t), ivec2(terrainResolution - 2));
+    vec2 f = t - vec2(i);
+    float a = texelFetch(heightMap, i, 0).r;
+    float b = texelFetch(heightMap, i + ivec2(1, 0), 0).r;
+    float c = texelFetch(heightMap, i + ivec2(0, 1), 0).r;
+    float d = texelFetch(heightMap, i + ivec2(1, 1), 0).r;
+    return mix(mix(a, b, f.x), mix(c, d, f.x), f.y);
+}
+
+void main()
+{
+    uint h = hash(uint(gl_InstanceID) ^ hash(patchSeed));
+    vec2 pos = patchOrigin + vec2(unit(h), unit(hash(h + 1u))) * patchSize;
+    float yaw = unit(hash(h + 2u)) * 6.2831853;
+    float height = bladeHeight * (0.6 + 0.8 * unit(hash(h + 3u)));
+    float width = 0.03 + 0.03 * unit(hash(h + 4u));
+    float phase = unit(hash(h + 5u)) * 6.2831853;
+
+    // blades are thinned in id order with distance, shrink the ones about
+    // to be dropped so the cutoff never pops
+    float distance = length(pos - viewPos.xz);
+    float keep = 1.0 - clamp((distance - fadeStart) /
+                             max(fadeEnd - fadeStart, 0.001), 0.0, 1.0);
+    float rank = float(gl_InstanceID) / float(maxBlades);
+    float grow = clamp((keep - rank) / 0.15, 0.0, 1.0);
+    if (pos.x > areaMax.x || pos.y > areaMax.y) grow = 0.0;
+    height *= grow;
+    width *= grow;
+
+    // 3 segments as a strip: pairs of left/right vertices then the tip
+    int segment = gl_VertexID / 2;
+    float t = float(segment) / 3.0;
+    float side = gl_VertexID == 6 ? 0.0 : float(gl_VertexID & 1) * 2.0 - 1.0;
+
+    vec2 across = vec2(cos(yaw), sin(yaw));
+    vec2 facing = vec2(-across.y, across.x);
+
+    // slow swell along the wind plus a per blade flutter
+    float swell = sin(time * 1.3 + dot(pos, windDir) * 0.35) * 0.5 + 0.5;
+    float flutter = sin(time * 4.0 + phase) * 0.15;
+    float bend = windStrength * (swell + flutter) * t * t;
+
+    float ground = useTerrain ? TerrainHeight(pos) : groundY;
+    vec3 world = vec3(pos.x, ground, pos.y);
+    world.xz += across * side * width * (1.0 - t);
+    world.xz += windDir * bend * height;
+    world.y += t * height * (1.0 - 0.3 * bend);
+
+    FragPos = world;
+    // lean the normal up a bit so blades don't go black edge-on
+    Normal = normalize(vec3(facing.x, 0.6, facing.y));
+    BladeHeight = t;
+    GroundUV = pos * 0.25;
+    gl_Position = projection * view * vec4(world, 1.0);
+}
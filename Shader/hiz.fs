@@ -0,0 +1,39 @@
+#version 330 core
+layout (location = 0) out float FragDepth;
+
+// source is either the scene depth (level 0) or the previous pyramid level
+uniform sampler2D source;
+uniform int sourceLevel;
+uniform ivec2 sourceSize;
+
+float fetchDepth(ivec2 p)
+{
+    p = clamp(p, ivec2(0), sourceSize - 1);
+    return texelFetch(source, p, sourceLevel).r;
+}
+
+void main()
+{
+    ivec2 dst = ivec2(gl_FragCoord.xy);
+    ivec2 src = dst * 2;
+
+    // keep the furthest depth so a texel never claims more occlusion than
+    // any of the pixels it covers
+    float d = max(max(fetchDepth(src), fetchDepth(src + ivec2(1, 0))),
+                  max(fetchDepth(src + ivec2(0, 1)), fetchDepth(src + ivec2(1, 1))));
+
+    // odd sizes: the last column/row also has to cover the leftover texels
+    bool oddX = (sourceSize.x & 1) != 0 && src.x + 2 == sourceSize.x - 1;
+    bool oddY = (sourceSize.y & 1) != 0 && src.y + 2 == sourceSize.y - 1;
+    if (oddX) {
+        d = max(d, max(fetchDepth(src + ivec2(2, 0)), fetchDepth(src + ivec2(2, 1))));
+    }
+    if (oddY) {
+        d = max(d, max(fetchDepth(src + ivec2(0, 2)), fetchDepth(src + ivec2(1, 2))));
+    }
+    if (oddX && oddY) {
+        d = max(d, fetchDepth(src + ivec2(2, 2)));
+    }
+
+    FragDepth = d;
+}
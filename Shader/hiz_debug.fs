@@ -0,0 +1,19 @@
+#version 330 core
+out vec4 FragColor;
+in vec2 TexCoord;
+
+uniform sampler2D pyramid;
+uniform int level;
+uniform float nearPlane;
+uniform float farPlane;
+
+void main()
+{
+    float depth = textureLod(pyramid, TexCoord, float(level)).r;
+    // linearize so the distant forest isn't all white
+    float ndc = depth * 2.0 - 1.0;
+    float linear = (2.0 * nearPlane * farPlane) /
+                   (farPlane + nearPlane - ndc * (farPlane - nearPlane));
+    float shade = 1.0 - clamp(linear / farPlane, 0.0, 1.0);
+    FragColor = vec4(vec3(shade), 1.0);
+}
@@ -0,0 +1,76 @@
+#version 330 core
+#include "lighting.glsl"
+out vec4 FragColor;
+
+in vec3 FragPos;
+in vec2 FrameUV[4];
+flat in vec2 FrameCell[4];
+flat in vec4 FrameWeights;
+flat in mat3 NormalMatrix;
+flat in vec3 ViewDir;
+flat in float DepthScale;
+flat in float LodFade;
+
+uniform sampler2D albedoAtlas;
+uniform sampler2D normalDepthAtlas;
+uniform float frames;
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 lightDir;
+uniform vec3 lightColor;
+uniform float ambientStrength;
+uniform float diffuseStrength;
+uniform float specularStrength;
+uniform float shininess;
+
+// same pattern as default.fs so mesh and impostor crossfade cleanly
+float bayer4(vec2 fragCoord)
+{
+    const float m[16] = float[](0.0, 8.0, 2.0, 10.0, 12.0, 4.0, 14.0, 6.0,
+                                3.0, 11.0, 1.0, 9.0, 15.0, 7.0, 13.0, 5.0);
+    ivec2 p = ivec2(mod(fragCoord, 4.0));
+    return (m[p.x + p.y * 4] + 0.5) / 16.0;
+}
+
+void main()
+{
+    if (LodFade != 0.0) {
+        float threshold = bayer4(gl_FragCoord.xy);
+        if (LodFade > 0.0 && threshold >= LodFade) discard;
+        if (LodFade < 0.0 && threshold < 1.0 + LodFade) discard;
+    }
+
+    vec4 albedo = vec4(0.0);
+    vec4 normalDepth = vec4(0.0);
+    for (int k = 0; k < 4; k++)
+    {
+        vec2 uv = (FrameCell[k] + clamp(FrameUV[k], 0.0, 1.0)) / frames;
+        albedo += texture(albedoAtlas, uv) * FrameWeights[k];
+        normalDepth += texture(normalDepthAtlas, uv) * FrameWeights[k];
+    }
+    if (albedo.a < 0.5) discard;
+
+    // empty texels are zero, so dividing by coverage undoes the blend
+    albedo.rgb /= albedo.a;
+    normalDepth /= albedo.a;
+    vec3 norm = normalize(NormalMatrix * (normalDepth.xyz * 2.0 - 1.0));
+
+    // push the quad to the baked surface, 0.5 depth is the sphere center
+    vec3 surface = FragPos + ViewDir * (0.5 - normalDepth.w) * 2.0 * DepthScale;
+    vec4 clip = projection * view * vec4(surface, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+
+    vec3 lightDirNorm = normalize(-lightDir);
+    float diff = max(dot(norm, lightDirNorm), 0.0);
+
+    vec3 viewDir = normalize(viewPos - surface);
+    vec3 reflectDir = reflect(-lightDirNorm, norm);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), shininess);
+
+    vec3 ambient = ambientStrength * lightColor;
+    vec3 diffuse = diffuseStrength * diff * lightColor;
+    vec3 specular = specularStrength * spec * lightColor;
+
+    vec3 color = (ambient + diffuse) * albedo.rgb + specular;
+    FragColor = vec4(applyFog(color, surface), 1.0);
+}
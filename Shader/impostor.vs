@@ -0,0 +1,85 @@
+#version 330 core
+layout (location = 3) in mat4 instancedMatrix;
+layout (location = 7) in vec4 instanceParams;  // x = LOD fade
+
+out vec3 FragPos;
+out vec2 FrameUV[4];
+flat out vec2 FrameCell[4];
+flat out vec4 FrameWeights;
+flat out mat3 NormalMatrix;
+flat out vec3 ViewDir;
+flat out float DepthScale;
+flat out float LodFade;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 viewPos;
+uniform vec3 center;  // bounding sphere of the baked mesh
+uniform float radius;
+uniform float frames;
+
+// upper hemisphere <-> unit square, must match src/impostor.cpp
+vec2 HemiOctEncode(vec3 d)
+{
+    d /= abs(d.x) + abs(d.y) + abs(d.z);
+    return vec2(d.x + d.z, d.z - d.x) * 0.5 + 0.5;
+}
+
+vec3 HemiOctDecode(vec2 uv)
+{
+    vec2 e = uv * 2.0 - 1.0;
+    float x = (e.x - e.y) * 0.5;
+    float z = (e.x + e.y) * 0.5;
+    return normalize(vec3(x, 1.0 - abs(x) - abs(z), z));
+}
+
+void FrameBasis(vec3 d, out vec3 right, out vec3 up)
+{
+    right = abs(d.y) < 0.999 ? normalize(cross(vec3(0.0, 1.0, 0.0), d))
+                             : vec3(1.0, 0.0, 0.0);
+    up = cross(d, right);
+}
+
+void main()
+{
+    mat3 rotationScale = mat3(instancedMatrix);
+    float scale = length(rotationScale[0]);
+    vec3 centerWorld = (instancedMatrix * vec4(center, 1.0)).xyz;
+
+    // view direction in object space, clamped to the baked hemisphere
+    vec3 v = transpose(rotationScale) * (viewPos - centerWorld);
+    v.y = max(v.y, 0.0);
+    v = dot(v, v) > 0.0 ? normalize(v) : vec3(0.0, 1.0, 0.0);
+
+    vec3 right, up;
+    FrameBasis(v, right, up);
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+    vec3 offset = (right * corner.x + up * corner.y) * radius;
+
+    // four nearest frames with bilinear weights
+    vec2 grid = HemiOctEncode(v) * (frames - 1.0);
+    vec2 base = min(floor(grid), vec2(frames - 2.0));
+    vec2 f = grid - base;
+    FrameWeights = vec4((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y),
+                        (1.0 - f.x) * f.y, f.x * f.y);
+    for (int k = 0; k < 4; k++)
+    {
+        vec2 cell = base + vec2(k & 1, k >> 1);
+        vec3 d = HemiOctDecode(cell / (frames - 1.0));
+        vec3 frameRight, frameUp;
+        FrameBasis(d, frameRight, frameUp);
+        // follow the view ray through this corner onto the frame's plane
+        vec3 p = offset - v * (dot(offset, d) / max(dot(v, d), 0.1));
+        FrameUV[k] = vec2(dot(p, frameRight), dot(p, frameUp)) /
+                     (2.0 * radius) + 0.5;
+        FrameCell[k] = cell;
+    }
+
+    vec4 worldPos = instancedMatrix * vec4(center + offset, 1.0);
+    FragPos = worldPos.xyz;
+    NormalMatrix = rotationScale / scale;
+    ViewDir = normalize(viewPos - centerWorld);
+    DepthScale = radius * scale;
+    LodFade = instanceParams.x;
+    gl_Position = projection * view * worldPos;
+}
@@ -0,0 +1,15 @@
+#version 330 core
+layout (location = 0) out vec4 Albedo;
+layout (location = 1) out vec4 NormalDepth;
+
+in vec2 TexCoord;
+in vec3 Normal;
+
+uniform sampler2D ourTexture;
+
+void main()
+{
+    Albedo = vec4(texture(ourTexture, TexCoord).rgb, 1.0);
+    // ortho depth is linear across the bounding sphere
+    NormalDepth = vec4(normalize(Normal) * 0.5 + 0.5, gl_FragCoord.z);
+}
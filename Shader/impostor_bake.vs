@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec3 aNormal;
+
+out vec2 TexCoord;
+out vec3 Normal;
+
+uniform mat4 viewProjection;
+
+void main()
+{
+    // baked in object space, the draw shader rotates normals per instance
+    TexCoord = aTexCoord;
+    Normal = aNormal;
+    gl_Position = viewProjection * vec4(aPos, 1.0);
+}
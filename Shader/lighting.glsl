@@ -0,0 +1,167 @@
+// Lighting shared by the forward stages (default.fs, grass.fs,
+// impostor.fs) and the fog ones (fog_volume.fs, volumetric_march.fs).
+// Shader pastes it in where a stage says #include "lighting.glsl", right
+// after its #version. What a stage doesn't use the compiler drops, so a
+// stage declares none of these itself.
+
+// flashlight, see SpotLight / SpotShadow
+uniform bool spotOn;
+uniform vec3 spotPos;
+uniform vec3 spotDir;
+uniform vec3 spotColor;  // times intensity
+uniform vec2 spotCone;   // cos of the inner and outer half angle
+uniform float spotRange;
+uniform mat4 spotCookieMatrix;
+uniform sampler2D spotCookie;
+uniform sampler2DArrayShadow spotShadow;  // 0 static casters, 1 moving ones
+uniform mat4 spotShadowMatrix;
+uniform bool spotShadowDynamic;
+
+// moon, see CascadedShadowMap
+uniform bool moonShadowOn;
+uniform sampler2DArrayShadow moonShadow;  // one layer per cascade
+uniform mat4 moonShadowMatrix[4];
+uniform float moonTexelSize[4];           // metres per texel
+uniform int moonCascades;
+
+// local lights, see ClusteredLights
+uniform bool clusterOn;
+uniform samplerBuffer clusterLights;    // position and radius, color
+uniform usamplerBuffer clusterCells;    // first index and count per cluster
+uniform usamplerBuffer clusterIndices;  // into clusterLights
+uniform ivec3 clusterDims;              // tiles across, tiles up, slices
+uniform vec2 clusterDepth;              // slice = log(depth) * x + y
+uniform vec2 clusterScreen;             // target size in pixels
+uniform mat4 clusterView;
+
+// height fog, see HeightFog; viewPos is the eye it's seen from
+uniform vec3 viewPos;
+uniform bool fogOn;
+uniform sampler2D fogLut;  // fog amount by direction y across, sqrt(dist) up
+uniform vec3 fogColor;
+uniform float fogDistance;  // the lookup's far edge
+
+// fraction of the moon reaching worldPos: the first cascade whose map
+// covers it, 4 taps of 2x2 PCF, lit past the last one
+float moonVisibility(vec3 worldPos, vec3 norm, vec3 toLight)
+{
+    if (!moonShadowOn) return 1.0;
+    float grazing = 1.0 - max(dot(norm, toLight), 0.0);
+    vec2 texel = 1.0 / vec2(textureSize(moonShadow, 0).xy);
+    for (int c = 0; c < moonCascades; c++) {
+        // the offset grows with the texel so far cascades don't acne
+        vec3 offset = norm * moonTexelSize[c] * (0.5 + 1.5 * grazing);
+        vec3 p = (moonShadowMatrix[c] * vec4(worldPos + offset, 1.0)).xyz;
+        p = p * 0.5 + 0.5;
+        if (any(lessThan(p.xy, texel)) ||
+            any(greaterThan(p.xy, 1.0 - texel)) || p.z > 1.0) {
+            continue;
+        }
+        float lit = 0.0;
+        for (int i = 0; i < 4; i++) {
+            vec2 uv = p.xy + vec2((i & 1) != 0 ? 0.75 : -0.75,
+                                  (i & 2) != 0 ? 0.75 : -0.75) * texel;
+            lit += texture(moonShadow, vec4(uv, float(c), p.z));
+        }
+        return lit * 0.25;
+    }
+    return 1.0;
+}
+
+// fraction of the flashlight reaching worldPos, 4 taps of 2x2 PCF per layer
+float spotVisibility(vec3 worldPos, vec3 norm, vec3 toLight)
+{
+    // push along the normal, more at grazing angles where acne starts
+    float grazing = 1.0 - max(dot(norm, toLight), 0.0);
+    vec4 clip = spotShadowMatrix * vec4(worldPos + norm * 0.03 * grazing, 1.0);
+    if (clip.w <= 0.0) return 1.0;
+    vec3 p = clip.xyz / clip.w * 0.5 + 0.5;
+    if (any(lessThan(p.xy, vec2(0.0))) || any(greaterThan(p.xy, vec2(1.0)))) {
+        return 1.0;
+    }
+    vec2 texel = 1.0 / vec2(textureSize(spotShadow, 0).xy);
+    float lit = 0.0;
+    for (int i = 0; i < 4; i++) {
+        vec2 uv = p.xy + vec2((i & 1) != 0 ? 0.75 : -0.75,
+                              (i & 2) != 0 ? 0.75 : -0.75) * texel;
+        float tap = texture(spotShadow, vec4(uv, 0.0, p.z));
+        if (spotShadowDynamic) {
+            tap = min(tap, texture(spotShadow, vec4(uv, 1.0, p.z)));
+        }
+        lit += tap;
+    }
+    return lit * 0.25;
+}
+
+// cone, falloff, cookie and shadow of the flashlight at worldPos
+vec3 spotRadiance(vec3 worldPos, vec3 norm, out vec3 toLight)
+{
+    toLight = spotPos - worldPos;
+    float dist = length(toLight);
+    toLight /= max(dist, 1e-4);
+    if (!spotOn || dist > spotRange) return vec3(0.0);
+    float cone = smoothstep(spotCone.y, spotCone.x, dot(-toLight, spotDir));
+    if (cone <= 0.0) return vec3(0.0);
+    // inverse square, windowed so it reaches zero at the range
+    float window = clamp(1.0 - pow(dist / spotRange, 4.0), 0.0, 1.0);
+    float falloff = window * window / (dist * dist + 1.0);
+    vec4 cookieClip = spotCookieMatrix * vec4(worldPos, 1.0);
+    float cookie =
+        texture(spotCookie, cookieClip.xy / cookieClip.w * 0.5 + 0.5).r;
+    return spotColor * (cone * falloff * cookie *
+                        spotVisibility(worldPos, norm, toLight));
+}
+
+// the local lights in this fragment's cluster, at most the cluster's few
+// however many there are in the world. specular and power are the
+// highlight's strength and shininess; twoSided surfaces, thin ones like
+// grass blades, take light through their back as well
+vec3 clusterLighting(vec3 worldPos, vec3 norm, vec3 viewDir, vec3 albedo,
+                     float specular, float power, bool twoSided)
+{
+    if (!clusterOn) return vec3(0.0);
+    float depth = -(clusterView * vec4(worldPos, 1.0)).z;
+    int slice = int(floor(log(max(depth, 1e-4)) * clusterDepth.x +
+                          clusterDepth.y));
+    if (slice < 0 || slice >= clusterDims.z) return vec3(0.0);
+    ivec2 tile = ivec2(gl_FragCoord.xy / clusterScreen * vec2(clusterDims.xy));
+    tile = clamp(tile, ivec2(0), clusterDims.xy - 1);
+    int cluster = (slice * clusterDims.y + tile.y) * clusterDims.x + tile.x;
+    uvec2 cell = texelFetch(clusterCells, cluster).rg;
+    vec3 sum = vec3(0.0);
+    for (uint i = 0u; i < cell.y; i++) {
+        int light = int(texelFetch(clusterIndices, int(cell.x + i)).r);
+        vec4 sphere = texelFetch(clusterLights, light * 2);
+        vec3 toLight = sphere.xyz - worldPos;
+        float dist = length(toLight);
+        if (dist >= sphere.w) continue;
+        toLight /= max(dist, 1e-4);
+        // same falloff as the flashlight, windowed to zero at the radius
+        float window = clamp(1.0 - pow(dist / sphere.w, 4.0), 0.0, 1.0);
+        float falloff = window * window / (dist * dist + 1.0);
+        vec3 color = texelFetch(clusterLights, light * 2 + 1).rgb * falloff;
+        float facing = dot(norm, toLight);
+        vec3 lit = (twoSided ? abs(facing) : max(facing, 0.0)) * albedo;
+        if (specular > 0.0) {
+            float spec = pow(max(dot(viewDir, reflect(-toLight, norm)), 0.0),
+                             power);
+            lit += spec * specular;
+        }
+        sum += color * lit;
+    }
+    return sum;
+}
+
+// the scene seen through the height fog from viewPos
+vec3 applyFog(vec3 color, vec3 worldPos)
+{
+    if (!fogOn) return color;
+    vec3 ray = worldPos - viewPos;
+    float dist = max(length(ray), 1e-4);
+    vec2 at = vec2(ray.y / dist * 0.5 + 0.5,
+                   sqrt(min(dist / fogDistance, 1.0)));
+    // texel centers, the bake put the ends of both ranges on them
+    float n = float(textureSize(fogLut, 0).x);
+    float amount = texture(fogLut, (at * (n - 1.0) + 0.5) / n).r;
+    return mix(color, fogColor, amount);
+}
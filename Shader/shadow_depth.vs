@@ -0,0 +1,13 @@
+#version 330 core
+// depth only, for shadow maps; same instancing layout as default.vs
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in mat4 instancedMatrix;
+
+uniform mat4 model;
+uniform mat4 lightViewProjection;
+
+void main()
+{
+    gl_Position = lightViewProjection * model * instancedMatrix *
+                  vec4(aPos, 1.0);
+}
@@ -4,7 +4,18 @@ in vec3 TexCoords;
 
 uniform samplerCube skybox;
 
+// height fog, see HeightFog; the sky is at the lookup's far edge
+uniform bool fogOn;
+uniform sampler2D fogLut;
+uniform vec3 fogColor;
+
 void main() {
-   vec3 color = texture(skybox, TexCoords).rgb;
-   FragColor = vec4(color * 0.05, 1.0); // 0.05 to make it dark
-}
\ No newline at end of file
+   vec3 color = texture(skybox, TexCoords).rgb * 0.05; // 0.05 to make it dark
+   if (fogOn) {
+      float n = float(textureSize(fogLut, 0).x);
+      vec2 at = vec2(normalize(TexCoords).y * 0.5 + 0.5, 1.0);
+      float amount = texture(fogLut, (at * (n - 1.0) + 0.5) / n).r;
+      color = mix(color, fogColor, amount);
+   }
+   FragColor = vec4(color, 1.0);
+}
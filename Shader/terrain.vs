@@ -0,0 +1,69 @@
+#version 330 core
+// one (GRID + 1)^2 grid shared by every node, placed per instance
+layout (location = 0) in vec2 aGrid;  // 0..1 across the node
+layout (location = 1) in vec4 aNode;  // x, z of the min corner, size, level
+
+out vec2 TexCoord;
+out vec3 Normal;
+out vec3 FragPos;
+out float LodFade;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 viewPos;
+
+uniform sampler2D heightMap;
+uniform vec2 terrainOrigin;
+uniform float terrainSpacing;
+uniform int terrainResolution;
+
+uniform float lodDistance;
+uniform float morphStart;
+uniform float gridCellsPerLeaf;
+uniform float uvScale;
+
+// bilinear by hand, the same as Terrain::HeightAt on the CPU
+float TerrainHeight(vec2 xz)
+{
+    float last = float(terrainResolution - 1);
+    vec2 t = clamp((xz - terrainOrigin) / terrainSpacing, vec2(0.0),
+                   vec2(last));
+    ivec2 i = min(ivec2(t), ivec2(terrainResolution - 2));
+    vec2 f = t - vec2(i);
+    float a = texelFetch(heightMap, i, 0).r;
+    float b = texelFetch(heightMap, i + ivec2(1, 0), 0).r;
+    float c = texelFetch(heightMap, i + ivec2(0, 1), 0).r;
+    float d = texelFetch(heightMap, i + ivec2(1, 1), 0).r;
+    return mix(mix(a, b, f.x), mix(c, d, f.x), f.y);
+}
+
+void main()
+{
+    float scale = exp2(aNode.w);
+    // grid cell of this node's level, in meters
+    float cell = scale / gridCellsPerLeaf;
+    vec2 pos = aNode.xy + aGrid * aNode.z;
+
+    // morph toward the next level over the outer part of the ring: odd
+    // vertices slide onto their even neighbour, so at k = 1 this node
+    // matches the coarser node next to it. Parity comes from the vertex
+    // index, not the world position, so rounding can't flip it.
+    float range = lodDistance * scale;
+    float distance = length(vec3(pos.x, TerrainHeight(pos), pos.y) - viewPos);
+    float k = clamp((distance - morphStart * range) /
+                    ((1.0 - morphStart) * range), 0.0, 1.0);
+    vec2 index = floor(aGrid * aNode.z / cell + 0.5);
+    pos -= mod(index, 2.0) * cell * k;
+
+    float height = TerrainHeight(pos);
+    float dx = TerrainHeight(pos + vec2(terrainSpacing, 0.0)) -
+               TerrainHeight(pos - vec2(terrainSpacing, 0.0));
+    float dz = TerrainHeight(pos + vec2(0.0, terrainSpacing)) -
+               TerrainHeight(pos - vec2(0.0, terrainSpacing));
+
+    FragPos = vec3(pos.x, height, pos.y);
+    Normal = normalize(vec3(-dx, 2.0 * terrainSpacing, -dz));
+    TexCoord = pos * uvScale;
+    LodFade = 0.0;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
@@ -0,0 +1,82 @@
+#version 330 core
+#include "lighting.glsl"
+// VolumetricLight's march: light scattered toward the eye between it and
+// the scene, for one low resolution pixel
+out vec4 Marched;  // rgb light, a view depth of the scene behind
+
+in vec2 TexCoord;
+
+uniform sampler2D sceneDepth;
+uniform sampler2D blueNoise;
+uniform int volScale;  // scene pixels per marched pixel, each way
+uniform int volSteps;
+uniform float volDistance;
+uniform float volOffset;  // of the noise, moves every frame
+uniform vec2 volPlanes;   // near and far of the scene's projection
+uniform vec3 volEye;
+uniform vec3 volFront;
+uniform mat4 volInverseViewProjection;
+uniform float volScattering;
+uniform float volAnisotropy;
+uniform vec3 fogParams;  // density, falloff, base height, see HeightFog
+
+uniform vec3 lightDir;
+uniform vec3 lightColor;
+
+// Henyey-Greenstein, cosTheta between the light's travel and the view ray
+float phase(float cosTheta)
+{
+    float g = volAnisotropy;
+    float denom = 1.0 + g * g - 2.0 * g * cosTheta;
+    return (1.0 - g * g) / (12.5663706 * denom * sqrt(denom));
+}
+
+float viewDepth(float depth)
+{
+    float n = volPlanes.x;
+    float f = volPlanes.y;
+    return 2.0 * n * f / (f + n - (depth * 2.0 - 1.0) * (f - n));
+}
+
+void main()
+{
+    // the scene pixel in the middle of the ones this pixel stands for
+    ivec2 sceneSize = textureSize(sceneDepth, 0);
+    ivec2 low = ivec2(gl_FragCoord.xy);
+    ivec2 pixel = min(low * volScale + volScale / 2, sceneSize - 1);
+    float depth = viewDepth(texelFetch(sceneDepth, pixel, 0).r);
+
+    vec2 ndc = (vec2(pixel) + 0.5) / vec2(sceneSize) * 2.0 - 1.0;
+    vec4 far = volInverseViewProjection * vec4(ndc, 1.0, 1.0);
+    vec3 dir = normalize(far.xyz / far.w - volEye);
+    float along = min(depth, volDistance) / max(dot(dir, volFront), 1e-3);
+    float stepLength = along / float(volSteps);
+    // one blue noise offset for the whole ray, a different one next door
+    // and next frame
+    ivec2 noiseSize = textureSize(blueNoise, 0);
+    float jitter = fract(texelFetch(blueNoise, low % noiseSize, 0).r +
+                         volOffset);
+
+    vec3 toMoon = normalize(-lightDir);
+    float moonPhase = phase(dot(dir, toMoon));
+    vec3 sum = vec3(0.0);
+    float transmittance = 1.0;
+    for (int i = 0; i < volSteps; i++) {
+        vec3 pos = volEye + dir * ((float(i) + jitter) * stepLength);
+        float density =
+            fogParams.x * exp(-fogParams.y * (pos.y - fogParams.z));
+        vec3 light = lightColor * moonVisibility(pos, vec3(0.0), toMoon) *
+                     moonPhase;
+        vec3 toSpot;
+        vec3 spot = spotRadiance(pos, vec3(0.0), toSpot);
+        if (spot != vec3(0.0)) light += spot * phase(dot(dir, toSpot));
+
+        // as in FogVolume, each step against its own extinction
+        float extinction = max(density, 1e-6);
+        float transmit = exp(-extinction * stepLength);
+        vec3 scattered = light * density * volScattering;
+        sum += transmittance * (scattered - scattered * transmit) / extinction;
+        transmittance *= transmit;
+    }
+    Marched = vec4(sum, depth);
+}
@@ -0,0 +1,62 @@
+#version 330 core
+// VolumetricLight's resolve: this frame's march blended with last frame's
+// result where that saw the same point
+out vec4 Resolved;  // rgb light, a view depth
+
+in vec2 TexCoord;
+
+uniform sampler2D marched;
+uniform sampler2D history;
+uniform bool historyValid;
+uniform float historyWeight;
+uniform vec3 volEye;
+uniform vec3 volFront;
+uniform mat4 volInverseViewProjection;
+uniform mat4 volPreviousViewProjection;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 last = textureSize(marched, 0) - 1;
+    vec4 current = texelFetch(marched, pixel, 0);
+    if (!historyValid) {
+        Resolved = current;
+        return;
+    }
+
+    // the range of light around the pixel, history outside it is stale
+    vec3 lo = current.rgb;
+    vec3 hi = current.rgb;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            ivec2 at = clamp(pixel + ivec2(x, y), ivec2(0), last);
+            vec3 c = texelFetch(marched, at, 0).rgb;
+            lo = min(lo, c);
+            hi = max(hi, c);
+        }
+    }
+
+    // the scene point behind the pixel, where last frame saw it
+    vec2 ndc = TexCoord * 2.0 - 1.0;
+    vec4 far = volInverseViewProjection * vec4(ndc, 1.0, 1.0);
+    vec3 dir = normalize(far.xyz / far.w - volEye);
+    vec3 pos = volEye + dir * (current.a / max(dot(dir, volFront), 1e-3));
+    vec4 previous = volPreviousViewProjection * vec4(pos, 1.0);
+    if (previous.w <= 0.0) {
+        Resolved = current;
+        return;
+    }
+    vec2 uv = previous.xy / previous.w * 0.5 + 0.5;
+    if (any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0)))) {
+        Resolved = current;
+        return;
+    }
+    vec4 past = texture(history, uv);
+    // disoccluded: last frame's pixel there was in front of or behind it
+    if (abs(past.a - previous.w) > 0.1 * previous.w) {
+        Resolved = current;
+        return;
+    }
+    vec3 light = mix(current.rgb, clamp(past.rgb, lo, hi), historyWeight);
+    Resolved = vec4(light, current.a);
+}
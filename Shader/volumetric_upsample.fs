@@ -0,0 +1,40 @@
+#version 330 core
+// VolumetricLight's resolved light, added onto the scene
+out vec4 FragColor;
+
+in vec2 TexCoord;
+
+uniform sampler2D sceneDepth;
+uniform sampler2D resolved;  // rgb light, a view depth
+uniform vec2 volPlanes;      // near and far of the scene's projection
+
+float viewDepth(float depth)
+{
+    float n = volPlanes.x;
+    float f = volPlanes.y;
+    return 2.0 * n * f / (f + n - (depth * 2.0 - 1.0) * (f - n));
+}
+
+void main()
+{
+    float depth = viewDepth(texture(sceneDepth, TexCoord).r);
+
+    // the 4 nearest marched pixels, bilinear weights scaled down where one
+    // marched to another depth, so light doesn't bleed around silhouettes
+    ivec2 size = textureSize(resolved, 0);
+    vec2 p = TexCoord * vec2(size) - 0.5;
+    vec2 base = floor(p);
+    vec2 f = p - base;
+    vec3 sum = vec3(0.0);
+    float total = 0.0;
+    for (int i = 0; i < 4; i++) {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 at = clamp(ivec2(base) + offset, ivec2(0), size - 1);
+        vec4 s = texelFetch(resolved, at, 0);
+        vec2 w2 = mix(1.0 - f, f, vec2(offset));
+        float w = w2.x * w2.y / (1e-3 + abs(s.a - depth) / depth);
+        sum += s.rgb * w;
+        total += w;
+    }
+    FragColor = vec4(sum / max(total, 1e-6), 0.0);
+}
@@ -0,0 +1,37 @@
+#version 330 core
+// packed by VoxelVertex: x, y, z 6 bits each, face 3 bits, block 11 bits
+layout (location = 0) in uint aPacked;
+
+out vec2 TexCoord;
+out vec3 Normal;
+out vec3 FragPos;
+out float LodFade;
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 origin;  // world position of the chunk's corner
+uniform float blockSize;
+
+const vec3 faceNormals[6] = vec3[](
+    vec3(-1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0),
+    vec3(0.0, -1.0, 0.0), vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, -1.0), vec3(0.0, 0.0, 1.0));
+
+void main()
+{
+    vec3 local = vec3(aPacked & 63u, (aPacked >> 6) & 63u,
+                      (aPacked >> 12) & 63u);
+    int face = int((aPacked >> 18) & 7u);
+
+    // texture repeats once per block across merged quads
+    int axis = face / 2;
+    if (axis == 0) TexCoord = local.zy;
+    else if (axis == 1) TexCoord = local.xz;
+    else TexCoord = local.xy;
+
+    vec3 worldPos = origin + local * blockSize;
+    FragPos = worldPos;
+    Normal = faceNormals[face];
+    LodFade = 0.0;
+    gl_Position = projection * view * vec4(worldPos, 1.0);
+}
@@ -0,0 +1,129 @@
+#ifndef AI_SCHEDULER_HPP
+#define AI_SCHEDULER_HPP
+
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+
+#include "job_system.hpp"
+
+struct FlowField;
+class NavMesh;
+class RaycastQueue;
+
+enum AiLod {
+  AI_LOD_FULL = 0,  // every frame
+  AI_LOD_NEAR,
+  AI_LOD_MID,
+  AI_LOD_FAR,
+  AI_LOD_COUNT,
+};
+
+// frames between ticks per LOD; powers of two so the slots nest
+constexpr int AI_LOD_INTERVAL[AI_LOD_COUNT] = {1, 2, 4, 16};
+
+struct AiSettings {
+  // distances to the player where agents drop to the next LOD
+  float fullDistance = 15.0f;
+  float nearDistance = 35.0f;
+  float midDistance = 80.0f;
+  float offscreenScale = 2.0f;  // behind the camera counts this much further
+  float hysteresis = 0.1f;      // fraction to go past a line before switching
+};
+
+// What agents may read while they think. Filled on the main thread before
+// the ticks and left alone until they're done, so any number of them can
+// look at it from job threads.
+struct AiSnapshot {
+  uint64_t frame = 0;
+  float time = 0.0f;
+  glm::vec3 playerPosition = glm::vec3(0.0f);
+  glm::vec3 cameraPosition = glm::vec3(0.0f);
+  glm::vec3 cameraFront = glm::vec3(0.0f, 0.0f, -1.0f);
+  const NavMesh* navMesh = nullptr;
+  std::shared_ptr<const FlowField> playerField;
+  RaycastQueue* rays = nullptr;  // Submit is the only thing to call
+  // every agent's position as of the start of the frame, by agent id
+  std::vector<glm::vec3> agentPositions;
+};
+
+// Decides how often each AI agent thinks and runs the thinking on the job
+// system. An agent's LOD comes from its distance to the player divided by
+// its relevance (the monster matters more than a bird), and further when
+// it's off screen. Ticks of slower LODs are given the frame in their cycle
+// with the fewest ticks already, so a hundred agents at 1 in 16 spread
+// over 16 frames instead of all waking together.
+//
+// think(snapshot, position, dt) gets the agent's own position from the
+// snapshot and the time since its last tick. It runs on a job thread next
+// to other agents: it may read the snapshot and change its own agent, but
+// not read the game's live state; anything else goes through the game on
+// the main thread afterwards.
+class AiScheduler {
+ public:
+  // null jobs thinks on the calling thread
+  explicit AiScheduler(JobSystem* jobs,
+                       const AiSettings& settings = AiSettings());
+
+  AiSettings settings;
+
+  uint32_t Add(
+      std::function<glm::vec3()> position,
+      std::function<void(const AiSnapshot&, const glm::vec3&, float)> think,
+      float relevance = 1.0f);
+  void Remove(uint32_t id);
+  AiLod Lod(uint32_t id) const { return agents[id].lod; }
+
+  // main thread, once per frame: fills the snapshot's frame, time and
+  // agent positions, updates LODs and runs the agents that are due
+  void Update(AiSnapshot& snapshot, float deltaTime);
+
+  int AgentCount() const { return agentCount; }
+  int TicksLastFrame() const { return ticksLastFrame; }
+  int AgentsAt(AiLod lod) const { return lodCounts[lod]; }
+  double WallMs() const { return wallMs; }    // Update, last frame
+  double ThinkMs() const { return thinkMs; }  // summed over threads
+  // WallMs of the last HISTORY frames, oldest at HistoryOffset()
+  static const int HISTORY = 120;
+  const float* History() const { return history; }
+  int HistoryOffset() const { return historyAt; }
+  float PeakMs() const;
+
+ private:
+  struct Agent {
+    bool alive = false;
+    std::function<glm::vec3()> position;
+    std::function<void(const AiSnapshot&, const glm::vec3&, float)> think;
+    float relevance = 1.0f;
+    AiLod lod = AI_LOD_FULL;
+    int phase = 0;
+    float lastTick = 0.0f;
+    double ms = 0.0;  // last think, written by its job
+  };
+
+  AiLod PickLod(const Agent& agent, const glm::vec3& position,
+                const AiSnapshot& snapshot) const;
+  void Place(Agent& agent, AiLod lod);
+  void Unplace(const Agent& agent);
+
+  JobSystem* jobs;
+  std::vector<Agent> agents;
+  std::vector<uint32_t> freeIds;
+  int agentCount = 0;
+  // ticks per frame of the longest cycle
+  int slotLoad[AI_LOD_INTERVAL[AI_LOD_COUNT - 1]] = {};
+  uint64_t frame = 0;
+  float time = 0.0f;
+  std::vector<uint32_t> due;
+
+  int ticksLastFrame = 0;
+  int lodCounts[AI_LOD_COUNT] = {};
+  double wallMs = 0.0;
+  double thinkMs = 0.0;
+  float history[HISTORY] = {};
+  int historyAt = 0;
+};
+
+#endif
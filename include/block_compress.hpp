@@ -0,0 +1,17 @@
+#ifndef BLOCK_COMPRESS_HPP
+#define BLOCK_COMPRESS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// LZ4 block format (no frame header), greedy single-probe matcher. Output
+// decodes with the reference LZ4_decompress_safe and vice versa; we keep our
+// own small codec so the build needs no extra library.
+std::vector<uint8_t> CompressLZ4(const uint8_t* src, size_t size);
+
+// dstSize must be the exact uncompressed size, false on corrupt input
+bool DecompressLZ4(const uint8_t* src, size_t srcSize, uint8_t* dst,
+                   size_t dstSize);
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef BROADPHASE_HPP
+#define BROADPHASE_HPP
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "job_system.hpp"
+
+enum BroadphaseType {
+  BROADPHASE_SWEEP_AND_PRUNE = 0,
+  BROADPHASE_SPATIAL_HASH = 1,
+};
+
+// two bodies whose boxes overlap, a < b
+struct BroadphasePair {
+  uint32_t a;
+  uint32_t b;
+  bool operator==(const BroadphasePair& o) const {
+    return a == o.a && b == o.b;
+  }
+  bool operator<(const BroadphasePair& o) const {
+    return a != o.a ? a < o.a : b < o.b;
+  }
+};
+
+// Overlapping pairs among moving boxes (items, props, creatures, the
+// player), for narrowphase tests and trigger events. Boxes are kept as
+// structure of arrays. Two interchangeable methods:
+//
+// - sweep and prune keeps the bodies sorted by min x, re-sorted with an
+//   insertion sort every FindPairs (nearly free while motion is coherent),
+//   copies the sorted boxes into linear arrays and sweeps them. The y/z
+//   test runs over a contiguous run of candidates so it vectorizes.
+// - the spatial hash buckets bodies into x/z cells with a counting sort
+//   over a power of two table; a pair is only reported by the cell holding
+//   the min corner of the two boxes' overlap, so there are no duplicates.
+//
+// Sweep and prune suits clustered or elongated scenes, the hash suits
+// evenly spread bodies of similar size. Both go wide on the job system.
+class Broadphase {
+ public:
+  explicit Broadphase(BroadphaseType type = BROADPHASE_SWEEP_AND_PRUNE,
+                      float cellSize = 4.0f);
+
+  BroadphaseType type;
+  float cellSize;  // spatial hash only, about the size of a typical body
+
+  // ids stay valid until removed, freed ids get reused
+  uint32_t Add(const glm::vec3& min, const glm::vec3& max);
+  void Move(uint32_t id, const glm::vec3& min, const glm::vec3& max);
+  void Remove(uint32_t id);
+
+  // rebuilds the pair list; jobs may be null for a single threaded run
+  void FindPairs(JobSystem* jobs);
+
+  // all overlapping pairs, sorted
+  const std::vector<BroadphasePair>& Pairs() const { return pairs; }
+  // pairs that started / stopped overlapping in the last FindPairs, pairs
+  // with a removed body end too
+  const std::vector<BroadphasePair>& Began() const { return began; }
+  const std::vector<BroadphasePair>& Ended() const { return ended; }
+
+  glm::vec3 BodyMin(uint32_t id) const {
+    return glm::vec3(minX[id], minY[id], minZ[id]);
+  }
+  glm::vec3 BodyMax(uint32_t id) const {
+    return glm::vec3(maxX[id], maxY[id], maxZ[id]);
+  }
+  int BodyCount() const { return (int)(alive.size() - freeIds.size()); }
+  double LastMs() const { return lastMs; }
+
+ private:
+  void SweepAndPrune(JobSystem* jobs);
+  void SpatialHash(JobSystem* jobs);
+
+  // boxes by id
+  std::vector<float> minX, minY, minZ;
+  std::vector<float> maxX, maxY, maxZ;
+  std::vector<uint8_t> alive;
+  std::vector<uint32_t> freeIds;
+
+  // sweep and prune: ids ordered by min x, and the boxes in that order
+  std::vector<uint32_t> order;
+  bool orderDirty = false;  // bodies added or removed since the last sort
+  std::vector<float> sortedMinX, sortedMaxX;
+  std::vector<float> sortedMinY, sortedMaxY;
+  std::vector<float> sortedMinZ, sortedMaxZ;
+
+  // spatial hash: (cell, id) entries grouped by table slot
+  struct CellEntry {
+    uint64_t cell;
+    uint32_t id;
+  };
+  std::vector<CellEntry> entries;
+  std::vector<CellEntry> bucketed;
+  std::vector<uint32_t> slotStart;
+
+  // one list per job so the threads never share one
+  std::vector<std::vector<BroadphasePair>> partial;
+
+  std::vector<BroadphasePair> pairs;
+  std::vector<BroadphasePair> previous;
+  std::vector<BroadphasePair> began;
+  std::vector<BroadphasePair> ended;
+  double lastMs = 0.0;
+};
+
+// Puts `bodies` boxes of mixed sizes in both kinds of broadphase, for two
+// frames with moves, removes and re-adds in between, and compares their
+// pairs against testing every pair of boxes. Returns how many pairs either
+// got wrong. Headless.
+int VerifyBroadphase(int bodies, JobSystem* jobs);
+
+// Moves `bodies` 1 m boxes around a square sized for a few neighbours each
+// and returns the average FindPairs time in milliseconds (including the
+// moves). Headless.
+double BenchmarkBroadphase(BroadphaseType type, int bodies, int frames,
+                           JobSystem* jobs);
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef CASCADED_SHADOW_HPP
+#define CASCADED_SHADOW_HPP
+
+#include <functional>
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+#include "gpu_timer.hpp"
+#include "shader.hpp"
+
+const int CSM_MAX_CASCADES = 4;
+
+struct CascadeSettings {
+  int cascades = 4;            // 1 to CSM_MAX_CASCADES
+  int size = 2048;             // texels per side of a layer, fixed once built
+  float lambda = 0.7f;         // 0 splits evenly, 1 logarithmically
+  float maxDistance = 300.0f;  // no shadows past this (or the far plane)
+  float casterReach = 150.0f;  // metres toward the moon casters may be
+  // frames between redraws per cascade; the far ones barely change
+  int interval[CSM_MAX_CASCADES] = {1, 1, 2, 4};
+};
+
+// Cascaded shadow maps for a directional light (the moon). The view
+// frustum up to maxDistance is split into slices, each covered by an
+// orthographic map fitted to the slice's bounding sphere. The sphere's size
+// doesn't change as the camera turns, and the map's origin is snapped to
+// whole texels, so shadow edges stay put instead of crawling.
+//
+// Cascade c is redrawn every interval[c] frames, staggered so the slow ones
+// don't land on the same frame. Between redraws it keeps the matrix it was
+// drawn with, and receivers pick the first cascade whose map covers them,
+// so a stale cascade is still correct where it reaches.
+//
+// Casters are drawn by drawCasters(cascade, frustum, min, max), with the
+// depth shader bound and the cascade's view-projection set: `min`/`max` is
+// the world box around the cascade's volume, to walk the chunk grid with.
+// It returns how many casters it drew.
+class CascadedShadowMap {
+ public:
+  explicit CascadedShadowMap(
+      const CascadeSettings& settings = CascadeSettings());
+  ~CascadedShadowMap();
+  CascadedShadowMap(const CascadedShadowMap&) = delete;
+  CascadedShadowMap& operator=(const CascadedShadowMap&) = delete;
+
+  CascadeSettings settings;
+  std::function<int(int, const Frustum&, const glm::vec3&, const glm::vec3&)>
+      drawCasters;
+
+  // fits and redraws the cascades due this frame; leaves the default
+  // framebuffer bound, callers rebind their target and viewport
+  void Update(const glm::vec3& lightDir, const glm::vec3& cameraPos,
+              const glm::vec3& cameraFront, const glm::vec3& cameraUp,
+              float fovY, float aspect, float nearPlane, float farPlane);
+
+  // binds the maps to `unit` and sets moonShadow, moonShadowMatrix[],
+  // moonTexelSize[] and moonCascades on a shader that's in use
+  void Bind(const Shader& shader, int unit) const;
+
+  unsigned int texture = 0;  // GL_TEXTURE_2D_ARRAY, depth compare on
+  int CascadeCount() const { return cascadeCount; }
+  float SplitFar(int cascade) const { return cascades[cascade].splitFar; }
+  int Casters(int cascade) const { return cascades[cascade].casters; }
+  bool Redrawn(int cascade) const { return cascades[cascade].redrawn; }
+  double GpuMs(int cascade) const { return timers[cascade].Ms(); }
+
+ private:
+  struct Cascade {
+    float splitFar = 0.0f;
+    glm::mat4 viewProjection = glm::mat4(1.0f);  // as last drawn
+    float texelSize = 0.0f;                      // metres per texel
+    int casters = 0;
+    bool drawn = false;
+    bool redrawn = false;  // this frame
+  };
+
+  Shader depthShader;
+  unsigned int FBO = 0;
+  int cascadeCount = 0;  // as last fitted
+  Cascade cascades[CSM_MAX_CASCADES];
+  GpuTimer timers[CSM_MAX_CASCADES];
+  unsigned long long frame = 0;
+};
+
+#endif
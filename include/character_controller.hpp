@@ -0,0 +1,46 @@
+#ifndef CHARACTER_CONTROLLER_HPP
+#define CHARACTER_CONTROLLER_HPP
+
+#include <glm/glm.hpp>
+
+#include "collision.hpp"
+
+// Upright capsule moved by swept collide-and-slide against a CollisionWorld.
+// Horizontal motion slides along walls and tries a lifted copy of the move
+// to climb steps up to stepHeight; the heightfield and box tops only count
+// as ground when they're flatter than maxSlope, steeper ground can't be
+// walked up and slides the capsule back down.
+class CharacterController {
+ public:
+  glm::vec3 position = glm::vec3(0.0f);  // bottom of the capsule (feet)
+  float radius = 0.3f;
+  float height = 1.2f;  // feet to top of the head
+  float stepHeight = 0.35f;
+  float maxSlope = 45.0f;  // degrees
+  float skin = 0.02f;      // kept between the capsule and what it touches
+
+  bool grounded = false;
+  glm::vec3 groundNormal = glm::vec3(0.0f, 1.0f, 0.0f);
+
+  // moves by velocity * deltaTime; velocity loses what walls, floors and
+  // ceilings take away
+  void Move(const CollisionWorld& world, glm::vec3& velocity,
+            float deltaTime);
+
+ private:
+  glm::vec3 Bottom(const glm::vec3& feet) const;
+  glm::vec3 Top(const glm::vec3& feet) const;
+  // sweeps and slides along what it hits, returns where it ended up
+  glm::vec3 Slide(const CollisionWorld& world, glm::vec3 feet,
+                  glm::vec3 motion, glm::vec3* velocity) const;
+  // straight sweep, no sliding; `hit` gets the contact if there was one
+  glm::vec3 Sweep(const CollisionWorld& world, const glm::vec3& feet,
+                  const glm::vec3& motion, SweepHit& hit) const;
+};
+
+// Headless: moves the default capsule at a wall head on, at an angle and
+// away from it, and checks where it stops and what velocity is left.
+// Returns how many came out wrong.
+int VerifyCharacterSlides();
+
+#endif
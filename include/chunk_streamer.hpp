@@ -0,0 +1,89 @@
+#ifndef CHUNK_STREAMER_HPP
+#define CHUNK_STREAMER_HPP
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <glm/glm.hpp>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "forest.hpp"
+#include "job_system.hpp"
+#include "world.hpp"
+#include "world_file.hpp"
+
+struct StreamingSettings {
+  float loadRadius = 320.0f;  // chunks whose center is this close are wanted
+  size_t memoryBudget = 16u << 20;  // resident chunks beyond this get evicted
+  double uploadBudgetMs = 1.0;      // main thread time for finished chunks
+  int maxInFlight = 8;              // chunks generating at once
+};
+
+// Keeps the chunks around the camera resident in a World. Wanted chunks are
+// ordered by distance (with a bonus for being in front of the camera) and
+// generated on the job system; finished ones are moved into the world on the
+// main thread within a per-frame time budget. Resident chunks are stamped
+// every frame they're still wanted, and once memory goes over the budget the
+// least recently wanted ones are evicted first.
+class ChunkStreamer {
+ public:
+  // meshMin/meshMax are the tree mesh bounds, for the chunk render data
+  ChunkStreamer(World& world, JobSystem& jobs, const ForestSettings& forest,
+                const glm::vec3& meshMin, const glm::vec3& meshMax);
+  ~ChunkStreamer();  // waits for loads still running
+  ChunkStreamer(const ChunkStreamer&) = delete;
+  ChunkStreamer& operator=(const ChunkStreamer&) = delete;
+
+  StreamingSettings settings;
+
+  void Update(const glm::vec3& cameraPos, const glm::vec3& cameraFront);
+
+  // chunks found in the file are read from it instead of generated; set it
+  // before the first Update and keep it open while the streamer lives
+  void UseWorldFile(const WorldFileReader* file) { worldFile = file; }
+
+  // called on the main thread as chunks enter and leave the world, e.g. to
+  // keep collision shapes in step with what's resident
+  std::function<void(const Chunk&)> onLoaded;
+  std::function<void(const Chunk&)> onEvicted;
+
+  int Resident() const { return (int)world.chunks.size(); }
+  int Loading() const { return (int)inFlight.size(); }
+  int Queued() const { return queued; }
+  size_t MemoryBytes() const { return memoryBytes; }
+  int UploadedLastFrame() const { return uploadedLastFrame; }
+  int Evicted() const { return evicted; }
+  double GenerateMs() const { return generateMs.load(); }  // last chunk
+
+ private:
+  void Load(ChunkCoord coord);
+  void Integrate();
+  void Evict();
+
+  World& world;
+  JobSystem& jobs;
+  ForestSettings forest;
+  glm::vec3 meshMin;
+  glm::vec3 meshMax;
+  const WorldFileReader* worldFile = nullptr;
+
+  // finished on a worker, waiting for the main thread
+  std::mutex doneMutex;
+  std::deque<std::unique_ptr<Chunk>> done;
+  JobCounter counter;
+
+  std::unordered_set<ChunkCoord, ChunkCoordHash> inFlight;
+  std::unordered_map<ChunkCoord, uint64_t, ChunkCoordHash> lastWanted;
+  uint64_t frame = 0;
+
+  size_t memoryBytes = 0;
+  int queued = 0;
+  int uploadedLastFrame = 0;
+  int evicted = 0;
+  std::atomic<double> generateMs{0.0};
+};
+
+#endif
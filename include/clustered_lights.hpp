@@ -0,0 +1,141 @@
+#ifndef CLUSTERED_LIGHTS_HPP
+#define CLUSTERED_LIGHTS_HPP
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "job_system.hpp"
+#include "shader.hpp"
+
+// a lantern, a campfire, a lit window: falls off with the inverse square,
+// windowed so it reaches zero at `radius`
+struct PointLight {
+  glm::vec3 position = glm::vec3(0.0f);
+  float radius = 10.0f;
+  glm::vec3 color = glm::vec3(1.0f);
+  float intensity = 1.0f;
+  float flicker = 0.0f;  // 0 steady, 1 a campfire
+  float phase = 0.0f;    // so neighbours don't flicker in step
+};
+
+struct ClusterSettings {
+  int tilesX = 16;
+  int tilesY = 9;
+  int slices = 24;             // exponential in depth
+  float maxDistance = 150.0f;  // lights and clusters stop here
+  // a pixel never loops over more lights than this, extras are dropped
+  int maxPerCluster = 64;
+  int maxLights = 1024;  // uploaded per frame, fixed once constructed
+};
+
+// The froxel grid: the view frustum cut into tiles on screen and slices in
+// depth, with the lights touching each cluster. A cluster's box in view
+// space is separable (x bounds per column, y per row, depth per slice), so
+// Assign bins the lights into slices first, then per slice and row tests a
+// light's sphere against 4 columns at once with SSE2 or NEON. Elsewhere
+// the columns are a loop. Slices run in parallel on the job system, each
+// writing only its own clusters. No GL (it lives in cluster_grid.cpp), so
+// it can be benchmarked headless.
+class ClusterGrid {
+ public:
+  explicit ClusterGrid(const ClusterSettings& settings = ClusterSettings());
+
+  ClusterSettings settings;
+
+  // view-space spheres (center, radius); the cluster bounds are rebuilt
+  // when the projection or the grid changed
+  void Assign(const glm::vec4* spheres, int count, float fovY, float aspect,
+              float nearPlane, float farPlane, JobSystem* jobs);
+
+  // per cluster (x fastest, then y, then slice): first index, count
+  const std::vector<uint32_t>& Cells() const { return cells; }
+  // light indices, the clusters' lists one after another
+  const std::vector<uint16_t>& Indices() const { return indices; }
+
+  int ClusterCount() const { return tilesX * tilesY * slices; }
+  glm::ivec3 Dimensions() const { return glm::ivec3(tilesX, tilesY, slices); }
+  // slice = floor(log(depth) * scale + bias)
+  glm::vec2 DepthToSlice() const { return glm::vec2(depthScale, depthBias); }
+  int MaxInCluster() const { return maxInCluster; }
+  int Dropped() const { return dropped; }  // over maxPerCluster
+  double AssignMs() const { return assignMs; }
+  static const char* SimdName();
+
+ private:
+  void Fit(float fovY, float aspect, float nearPlane, float farPlane);
+  void AssignSlice(int slice, const glm::vec4* spheres);
+
+  int tilesX = 0, tilesY = 0, slices = 0, maxPerCluster = 0;
+  int paddedX = 0;  // tilesX rounded up to the SIMD width
+  float fitFovY = 0.0f, fitAspect = 0.0f, fitNear = 0.0f, fitFar = 0.0f;
+  float depthScale = 0.0f, depthBias = 0.0f;
+
+  // view-space bounds: depth per slice, x per slice and column (padded
+  // columns can't be touched), y per slice and row
+  std::vector<float> sliceNear, sliceFar;
+  std::vector<float> columnMin, columnMax;
+  std::vector<float> rowMin, rowMax;
+
+  std::vector<std::vector<int>> sliceLights;
+  std::vector<uint16_t> slots;  // maxPerCluster per cluster
+  std::vector<int> counts;
+  std::vector<int> sliceDropped;
+  std::vector<uint32_t> cells;
+  std::vector<uint16_t> indices;
+  int maxInCluster = 0;
+  int dropped = 0;
+  double assignMs = 0.0;
+};
+
+// Clustered forward lighting for the local lights. Update flickers and packs
+// `lights`, bins them on the CPU through a ClusterGrid and uploads the
+// result to three texture buffers, which Bind hands to the lit shaders:
+// clusterLights (2 texels a light: world position and radius, color times
+// intensity), clusterCells and clusterIndices. A fragment finds its cluster
+// from gl_FragCoord and its view depth and loops over just those lights,
+// so its cost follows the lights near it, not how many there are.
+class ClusteredLights {
+ public:
+  explicit ClusteredLights(const ClusterSettings& settings = ClusterSettings(),
+                           JobSystem* jobs = nullptr);
+  ~ClusteredLights();
+  ClusteredLights(const ClusteredLights&) = delete;
+  ClusteredLights& operator=(const ClusteredLights&) = delete;
+
+  std::vector<PointLight> lights;
+
+  void Update(const glm::mat4& view, float fovY, float aspect,
+              float nearPlane, float farPlane, float time);
+  // the buffers on units firstUnit .. firstUnit + 2, and the grid uniforms
+  // for a `width` x `height` target, on a shader that's in use
+  void Bind(const Shader& shader, int firstUnit, int width,
+            int height) const;
+
+  const ClusterGrid& Grid() const { return grid; }
+  int Uploaded() const { return uploaded; }  // lights within maxDistance
+
+ private:
+  ClusterGrid grid;
+  JobSystem* jobs;
+  unsigned int buffers[3] = {};   // lights, cells, indices
+  unsigned int textures[3] = {};  // GL_TEXTURE_BUFFER views of them
+  std::vector<glm::vec4> packed;  // 2 per light
+  std::vector<glm::vec4> spheres;
+  glm::mat4 view = glm::mat4(1.0f);
+  int uploaded = 0;
+};
+
+// Headless: bins `lights` random lights in front of a 1080p camera, and
+// for every cluster checks that each light whose sphere reaches a point of
+// the cluster (its tile through the projection, its slice through
+// DepthToSlice) is listed, none twice and none dropped, and that binning on
+// the job system gives the same lists. Returns how many of those failed.
+int VerifyClusterGrid(int lights, JobSystem& jobs);
+
+// Headless: `lights` random lights in front of a 1080p camera, binned over
+// and over with and without the job system. Prints the per-frame cost and
+// cluster occupancy. Returns ms per frame on the job system.
+double BenchmarkClusteredLights(int lights, JobSystem& jobs);
+
+#endif
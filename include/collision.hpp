@@ -0,0 +1,105 @@
+#ifndef COLLISION_HPP
+#define COLLISION_HPP
+
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+enum CollisionShapeType : uint8_t {
+  COLLISION_NONE = 0,  // free slot
+  COLLISION_BOX,       // oriented box, an AABB has the identity rotation
+  COLLISION_CAPSULE,
+};
+
+struct CollisionShape {
+  CollisionShapeType type = COLLISION_NONE;
+  // box: center, half extents and the local axes as columns
+  // capsule: segment a..b and radius
+  glm::vec3 a = glm::vec3(0.0f);
+  glm::vec3 b = glm::vec3(0.0f);
+  glm::mat3 rotation = glm::mat3(1.0f);
+  float radius = 0.0f;
+  glm::vec3 boundsMin = glm::vec3(0.0f);
+  glm::vec3 boundsMax = glm::vec3(0.0f);
+};
+
+struct SweepHit {
+  bool hit = false;
+  float fraction = 1.0f;  // of the motion travelled before touching
+  glm::vec3 normal = glm::vec3(0.0f, 1.0f, 0.0f);  // away from the shape
+};
+
+// Static collision geometry: a heightfield under everything plus boxes and
+// capsules for trees, props and buildings. Shapes are bucketed in a uniform
+// grid on x/z so queries only look at the cells they overlap. Queries are
+// const and don't touch shared state, so they can run on several threads.
+class CollisionWorld {
+ public:
+  explicit CollisionWorld(float cellSize = 4.0f);
+
+  // the heightfield, e.g. Terrain::HeightAt; without one there is no ground
+  std::function<float(float, float)> groundHeight;
+  float GroundHeight(float x, float z) const;
+  glm::vec3 GroundNormal(float x, float z) const;
+
+  // returned ids stay valid until removed, freed ids get reused
+  uint32_t AddBox(const glm::vec3& min, const glm::vec3& max);
+  uint32_t AddOrientedBox(const glm::vec3& center,
+                          const glm::vec3& halfExtents,
+                          const glm::mat3& rotation);
+  uint32_t AddCapsule(const glm::vec3& a, const glm::vec3& b, float radius);
+  void Remove(uint32_t id);
+
+  // ids of the shapes whose bounds overlap min..max, sorted, no duplicates
+  void Query(const glm::vec3& min, const glm::vec3& max,
+             std::vector<uint32_t>& out) const;
+  const CollisionShape& Shape(uint32_t id) const { return shapes[id]; }
+
+  // Moves a capsule (segment a..b, radius) along `motion` and returns the
+  // first contact with a shape, by conservative advancement: step by the
+  // current distance to the nearest shape, which can't overshoot. The
+  // heightfield is left to the caller, it's cheaper as a height query.
+  SweepHit SweepCapsule(const glm::vec3& a, const glm::vec3& b, float radius,
+                        const glm::vec3& motion) const;
+
+  // smallest offset that takes the capsule out of every shape it overlaps
+  glm::vec3 Depenetrate(const glm::vec3& a, const glm::vec3& b,
+                        float radius) const;
+
+  size_t ShapeCount() const { return shapes.size() - freeIds.size(); }
+  // ids go up to this, free slots are COLLISION_NONE
+  size_t SlotCount() const { return shapes.size(); }
+  // bumped by every add and remove, so copies know when they're stale
+  uint64_t Revision() const { return revision; }
+  size_t CellCount() const { return cells.size(); }
+
+ private:
+  uint32_t Insert(const CollisionShape& shape);
+  uint64_t CellKey(int x, int z) const;
+
+  float cellSize;
+  std::vector<CollisionShape> shapes;
+  std::vector<uint32_t> freeIds;
+  std::unordered_map<uint64_t, std::vector<uint32_t>> cells;
+  uint64_t revision = 0;
+};
+
+// signed distance between a capsule and a shape's surfaces (negative when
+// they overlap), `normal` points from the shape toward the capsule
+float CapsuleDistance(const CollisionShape& shape, const glm::vec3& a,
+                      const glm::vec3& b, float radius, glm::vec3& normal);
+
+// Headless: sweeps of a player sized capsule at a box face, edge and top,
+// a turned box and a trunk, where the distance to the contact and its
+// normal are known, and past a box and short of it. Returns how many came
+// out wrong.
+int VerifyCapsuleSweeps();
+
+// Headless: `trees` trunk capsules (plus a box every tenth tree) at forest
+// spacing, then `sweeps` random player sized capsule sweeps through them.
+// Returns sweeps per second on the calling thread.
+double BenchmarkCapsuleSweeps(int trees, int sweeps);
+
+#endif
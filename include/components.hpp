@@ -0,0 +1,56 @@
+#ifndef COMPONENTS_HPP
+#define COMPONENTS_HPP
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "raycast.hpp"
+
+// Components of the game's entities, see ecs.hpp. Kept small and split by
+// what reads them, so a system walks only the data it needs.
+
+struct Transform {
+  glm::vec3 position = glm::vec3(0.0f);
+  float yaw = 0.0f;  // radians around y
+};
+
+// drawn as a cube of this size, `lift` above the position
+struct Drawn {
+  glm::vec3 scale = glm::vec3(1.0f);
+  float lift = 0.0f;
+};
+
+// floats around `base` and turns slowly
+struct Bobbing {
+  glm::vec3 base;
+  float phase;
+};
+
+// a collectible, with its box in the broadphase
+struct Pickup {
+  uint32_t body;
+};
+
+// walks a path to where it last saw the player, asking for a new one a
+// few times a second
+struct Monster {
+  std::vector<glm::vec3> path;
+  size_t waypoint = 0;
+  uint32_t query = 0;
+  bool searching = false;
+  bool wantsPath = false;  // set by its think, requested on the main thread
+  float replanIn = 0.0f;
+  glm::vec3 lastSeen = glm::vec3(0.0f);
+  RayTicket sight;
+  uint32_t sightTooFar = 0;  // rays of `sight` past its range
+  bool seesPlayer = false;
+  bool seesBeam = false;
+};
+
+// one of the pack following the flow field to the player
+struct Creature {
+  glm::vec3 velocity = glm::vec3(0.0f);  // from its last think
+};
+
+#endif
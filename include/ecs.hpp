@@ -0,0 +1,280 @@
+#ifndef ECS_HPP
+#define ECS_HPP
+
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "job_system.hpp"
+
+// Handle to an entity. The generation changes every time an index is
+// reused, so a handle kept past Destroy stops matching instead of pointing
+// at whatever took its place.
+struct Entity {
+  uint32_t index = 0xffffffff;
+  uint32_t generation = 0;
+  bool operator==(const Entity& o) const {
+    return index == o.index && generation == o.generation;
+  }
+  bool operator!=(const Entity& o) const { return !(*this == o); }
+};
+
+const Entity ENTITY_NONE = Entity();
+
+// component types are numbered as they are first used, at most 64 of them
+// so read/write sets fit a mask
+typedef int ComponentType;
+const int ECS_MAX_COMPONENTS = 64;
+
+ComponentType NextComponentType();
+
+template <typename T>
+ComponentType ComponentTypeOf() {
+  static const ComponentType type = NextComponentType();
+  return type;
+}
+
+template <typename... Ts>
+uint64_t ComponentMask() {
+  return (0ull | ... | (1ull << ComponentTypeOf<Ts>()));
+}
+
+// Sparse set: `sparse` maps an entity index to its slot in the dense
+// arrays, the dense arrays hold only entities that have the component, with
+// no holes. Removing swaps the last slot in.
+class ComponentPool {
+ public:
+  virtual ~ComponentPool() = default;
+
+  bool Has(uint32_t index) const {
+    return index < sparse.size() && sparse[index] != ABSENT;
+  }
+  int Size() const { return (int)entities.size(); }
+  const Entity* Entities() const { return entities.data(); }
+  void Remove(uint32_t index);
+
+ protected:
+  static constexpr uint32_t ABSENT = 0xffffffff;
+
+  uint32_t Insert(Entity entity);
+  // moves the last element of the data into `slot` and drops the last
+  virtual void EraseSlot(uint32_t slot) = 0;
+
+  std::vector<uint32_t> sparse;  // by entity index
+  std::vector<Entity> entities;  // by slot
+};
+
+// one component type's data, contiguous and in slot order
+template <typename T>
+class ComponentStore : public ComponentPool {
+ public:
+  T& Add(Entity entity, T value) {
+    if (Has(entity.index)) {
+      T& existing = data[sparse[entity.index]];
+      existing = std::move(value);
+      return existing;
+    }
+    Insert(entity);
+    data.push_back(std::move(value));
+    return data.back();
+  }
+  T& At(uint32_t index) { return data[sparse[index]]; }
+  const T& At(uint32_t index) const { return data[sparse[index]]; }
+  T* Find(uint32_t index) { return Has(index) ? &At(index) : nullptr; }
+  T& AtSlot(int slot) { return data[slot]; }
+
+ private:
+  void EraseSlot(uint32_t slot) override {
+    if (slot + 1 != data.size()) data[slot] = std::move(data.back());
+    data.pop_back();
+  }
+
+  std::vector<T> data;
+};
+
+// Entities and their components. Everything in the game that has state
+// per thing (items, the monster and its pack, props as they come) lives
+// here instead of in one struct each.
+//
+// Each<A, B>(fn) walks the smallest of the stores involved in slot order
+// and skips entities missing one of the others, so iterating a rare
+// component costs what it has, not what the world has. Lookups, Get and
+// the iteration are safe from any number of threads as long as nobody
+// adds or removes at the same time; DestroyLater is for systems that want
+// to remove entities while others still run.
+class Registry {
+ public:
+  Entity Create();
+  // drops every component of the entity, stale handles are ignored
+  void Destroy(Entity entity);
+  // any thread, done at the next Flush
+  void DestroyLater(Entity entity);
+  void Flush();
+
+  bool Alive(Entity entity) const {
+    return entity.index < generations.size() &&
+           generations[entity.index] == entity.generation;
+  }
+  int EntityCount() const { return entityCount; }
+
+  template <typename T>
+  T& Add(Entity entity, T value = T()) {
+    return Store<T>().Add(entity, std::move(value));
+  }
+  template <typename T>
+  void Remove(Entity entity) {
+    ComponentPool* pool = Pool(ComponentTypeOf<T>());
+    if (pool && Alive(entity)) pool->Remove(entity.index);
+  }
+  template <typename T>
+  bool Has(Entity entity) const {
+    const ComponentPool* pool = Pool(ComponentTypeOf<T>());
+    return pool && Alive(entity) && pool->Has(entity.index);
+  }
+  // the entity must have it
+  template <typename T>
+  T& Get(Entity entity) {
+    return Typed<T>()->At(entity.index);
+  }
+  // null if the entity is gone or doesn't have it
+  template <typename T>
+  T* Find(Entity entity) {
+    return Has<T>(entity) ? &Get<T>(entity) : nullptr;
+  }
+
+  // creates the store on first use, main thread only
+  template <typename T>
+  ComponentStore<T>& Store() {
+    ComponentType type = ComponentTypeOf<T>();
+    if (type >= (int)pools.size()) pools.resize(type + 1);
+    if (!pools[type]) pools[type].reset(new ComponentStore<T>());
+    return *static_cast<ComponentStore<T>*>(pools[type].get());
+  }
+
+  // fn(entity, a, b, ...) for every entity with all of Ts
+  template <typename... Ts, typename Fn>
+  void Each(Fn&& fn) {
+    std::tuple<ComponentStore<Ts>*...> stores(Typed<Ts>()...);
+    if (!(std::get<ComponentStore<Ts>*>(stores) && ...)) return;
+    const ComponentPool* lead = Smallest({Typed<Ts>()...});
+    EachIn<Ts...>(stores, lead, 0, lead->Size(), fn);
+  }
+  // the same spread over the job system in runs of `grain` entities; fn
+  // must only touch the components it's handed
+  template <typename... Ts, typename Fn>
+  void ParallelEach(JobSystem* jobs, int grain, Fn&& fn) {
+    std::tuple<ComponentStore<Ts>*...> stores(Typed<Ts>()...);
+    if (!(std::get<ComponentStore<Ts>*>(stores) && ...)) return;
+    const ComponentPool* lead = Smallest({Typed<Ts>()...});
+    if (!jobs || lead->Size() <= grain) {
+      EachIn<Ts...>(stores, lead, 0, lead->Size(), fn);
+      return;
+    }
+    jobs->ParallelFor(lead->Size(), grain, [&](int begin, int end) {
+      EachIn<Ts...>(stores, lead, begin, end, fn);
+    });
+  }
+
+ private:
+  ComponentPool* Pool(ComponentType type) const {
+    return type < (int)pools.size() ? pools[type].get() : nullptr;
+  }
+  // null until something added a T; never creates, so fine off the main
+  // thread
+  template <typename T>
+  ComponentStore<T>* Typed() const {
+    return static_cast<ComponentStore<T>*>(Pool(ComponentTypeOf<T>()));
+  }
+  static const ComponentPool* Smallest(
+      std::initializer_list<const ComponentPool*> candidates) {
+    const ComponentPool* smallest = *candidates.begin();
+    for (const ComponentPool* pool : candidates) {
+      if (pool->Size() < smallest->Size()) smallest = pool;
+    }
+    return smallest;
+  }
+  template <typename... Ts, typename Fn>
+  static void EachIn(std::tuple<ComponentStore<Ts>*...>& stores,
+                     const ComponentPool* lead, int begin, int end, Fn& fn) {
+    const Entity* entities = lead->Entities();
+    for (int i = begin; i < end; i++) {
+      // the lead store is read in order, the rest through their sparse
+      uint32_t index = entities[i].index;
+      std::tuple<Ts*...> found(
+          Lookup(std::get<ComponentStore<Ts>*>(stores), lead, i, index)...);
+      if (!(std::get<Ts*>(found) && ...)) continue;
+      fn(entities[i], *std::get<Ts*>(found)...);
+    }
+  }
+  template <typename T>
+  static T* Lookup(ComponentStore<T>* store, const ComponentPool* lead,
+                   int slot, uint32_t index) {
+    return store == lead ? &store->AtSlot(slot) : store->Find(index);
+  }
+
+  // odd while the index is free, so no handle matches it
+  std::vector<uint32_t> generations;
+  std::vector<uint32_t> freeIndices;
+  int entityCount = 0;
+  std::vector<std::unique_ptr<ComponentPool>> pools;
+  std::mutex destroyMutex;
+  std::vector<Entity> toDestroy;
+};
+
+// Systems declare the components they read and write, as ComponentMask<>()
+// of them. Run goes through them in the order they were added, in waves:
+// a system joins the first wave after every earlier one it conflicts with
+// (it writes what the other touches, or reads what the other writes), and
+// the systems of a wave run side by side on the job system. A system can
+// go wide itself with ParallelEach. Pending DestroyLater calls are done
+// after the last wave.
+class SystemSchedule {
+ public:
+  void Add(const std::string& name, uint64_t reads, uint64_t writes,
+           std::function<void(Registry&)> run);
+  // jobs may be null to run everything in order on this thread
+  void Run(Registry& registry, JobSystem* jobs);
+
+  int SystemCount() const { return (int)systems.size(); }
+  int WaveCount() const { return waveCount; }
+  const std::string& Name(int system) const { return systems[system].name; }
+  int Wave(int system) const { return systems[system].wave; }
+  double SystemMs(int system) const { return systems[system].ms; }
+  double LastMs() const { return lastMs; }  // Run, wall
+
+ private:
+  struct System {
+    std::string name;
+    uint64_t reads;
+    uint64_t writes;
+    std::function<void(Registry&)> run;
+    int wave;
+    double ms;  // last run, written by its job
+  };
+
+  std::vector<System> systems;
+  int waveCount = 0;
+  double lastMs = 0.0;
+};
+
+// Headless: `entities` entities with a random mix of three components,
+// churned by destroys, removed components and reused indices, then walked
+// with Each and ParallelEach over four queries and by a schedule of three
+// systems, one destroying some of what it visits. Every live entity that
+// has the components must be visited exactly once, with its own ones, and
+// nothing else. Prints what went wrong and returns how many.
+int VerifyEcs(int entities, JobSystem& jobs);
+
+// Headless: `entities` entities with a position and velocity, a quarter
+// of them bobbing like items, moved through a per-object struct array the
+// way main.cpp used to, then with Each, ParallelEach and a schedule of
+// three systems. Prints ns per entity of each. Returns ns per entity of
+// the single threaded Each.
+double BenchmarkEcs(int entities, JobSystem& jobs);
+
+#endif
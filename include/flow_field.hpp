@@ -0,0 +1,116 @@
+#ifndef FLOW_FIELD_HPP
+#define FLOW_FIELD_HPP
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "job_system.hpp"
+#include "navmesh.hpp"
+
+struct FlowFieldSettings {
+  float cellSize = 1.0f;       // must divide the navmesh tile size
+  int size = 160;              // cells across, centered on the target
+  int maxCached = 8;           // fields kept, least recently used go first
+  int parallelWave = 256;      // cells in a wave before it's split over jobs
+  int steepCost = 3;           // cost of a cell this steep or more, 1 flat
+  float steepSlope = 30.0f;    // degrees
+};
+
+const uint32_t FLOW_UNREACHABLE = 0xffffffff;
+// directions are indices into the 8 neighbours, counter-clockwise from +x
+const uint8_t FLOW_NONE = 8;  // at the target, or no way to it
+
+// Where to walk toward one target from anywhere within `size` cells of it.
+// Fields are shared and never change once built, agents can keep one for
+// as long as they like.
+struct FlowField {
+  int targetX, targetZ;  // global cell of the target
+  int originX, originZ;  // global cell of [0, 0]
+  int size;
+  float cellSize;
+  std::vector<uint32_t> integration;  // cost to the target, 10 per cell
+  std::vector<uint8_t> directions;
+  std::vector<float> heights;  // ground of walkable cells
+
+  // unit direction on x/z to walk from `position`; zero at the target,
+  // outside the field or where there's no way to it
+  glm::vec3 Sample(const glm::vec3& position) const;
+  // ground height under `position`, or `position.y` off the walkable cells
+  float Height(const glm::vec3& position) const;
+  uint32_t Cost(const glm::vec3& position) const;
+};
+
+// Flow fields over the navmesh, for packs and ambient creatures: the cost
+// of walking is found once per target for every cell around it, then any
+// number of agents look up their direction in O(1). The navmesh is turned
+// into a grid of costs per tile (walkable where a poly covers the cell,
+// dearer on steep ground) when first needed; the integration field is a
+// Dijkstra wavefront from the target whose waves, every cell at the same
+// cost band, are split over the job system. Fields are cached by target
+// cell, so everyone chasing the player shares one and it's only rebuilt
+// when the player steps into another cell.
+class FlowFieldCache {
+ public:
+  // null jobs integrates on the calling thread only
+  FlowFieldCache(const NavMesh& navMesh, JobSystem* jobs,
+                 const FlowFieldSettings& settings = FlowFieldSettings());
+
+  const FlowFieldSettings settings;
+
+  // the field toward the cell `target` is in, built now unless cached;
+  // null when the target is off the mesh
+  std::shared_ptr<const FlowField> Get(const glm::vec3& target);
+
+  // hook to NavMesh::onTileChanged: forgets the tile's costs and every
+  // cached field that reaches into it
+  void TileChanged(ChunkCoord coord);
+
+  int CachedFields() const { return (int)fields.size(); }
+  int CacheHits() const { return cacheHits; }
+  int Built() const { return built; }
+  double BuildMs() const { return buildMs; }  // last field built
+  int Waves() const { return waves; }         // of the last field built
+
+ private:
+  struct CostTile {
+    std::vector<uint8_t> costs;  // 0 is blocked
+    std::vector<float> heights;
+  };
+  struct Entry {
+    std::shared_ptr<const FlowField> field;
+    uint64_t lastUsed;
+  };
+
+  void BuildCosts(ChunkCoord coord, CostTile& tile) const;
+  void Moves(const FlowField& field, const std::vector<uint8_t>& costs,
+             std::vector<uint8_t>& moves) const;
+  void Integrate(FlowField& field, const std::vector<uint8_t>& costs,
+                 const std::vector<uint8_t>& moves, int seed);
+  void Directions(FlowField& field, const std::vector<uint8_t>& moves);
+
+  const NavMesh& navMesh;
+  JobSystem* jobs;
+  int tileCells;
+
+  std::unordered_map<ChunkCoord, CostTile, ChunkCoordHash> costTiles;
+  std::unordered_map<uint64_t, Entry> fields;
+  uint64_t useCount = 0;
+
+  int cacheHits = 0;
+  int built = 0;
+  double buildMs = 0.0;
+  int waves = 0;
+};
+
+// Headless: builds a navmesh over a generated forest `tiles` x `tiles`
+// tiles wide, then times building a field with and without the job
+// system, and moving 1 to `maxAgents` agents along it for a number of
+// frames. Prints the field build times and the cost per agent per frame,
+// next to an HPA* search per agent for scale. Returns the nanoseconds per
+// agent per frame at maxAgents.
+double BenchmarkFlowField(int tiles, int maxAgents, JobSystem& jobs);
+
+#endif
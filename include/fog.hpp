@@ -0,0 +1,113 @@
+#ifndef FOG_HPP
+#define FOG_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "gpu_timer.hpp"
+#include "shader.hpp"
+
+struct FogSettings {
+  bool on = true;
+  glm::vec3 color = glm::vec3(0.035f, 0.04f, 0.05f);
+  float density = 0.035f;    // extinction per metre at baseHeight
+  float falloff = 0.15f;     // density halves every ln(2) / falloff metres up
+  float baseHeight = -1.0f;  // the forest floor
+};
+
+// Exponential height fog, density * exp(-falloff * (y - baseHeight)). Along
+// a ray its optical depth has a closed form, but one with an exp, a divide
+// and a special case for level rays; that's baked per frame into a small
+// lookup over (direction up or down, sqrt of distance) for the eye's
+// height, so shaders pay one texture fetch. The bake only reruns when the
+// eye moved more than 10 cm up or down or the settings changed; pass the
+// height without the view bob, or walking rebakes it every few frames.
+// Bind sets fogOn, fogLut, fogColor, fogDistance and fogParams (density,
+// falloff, base height).
+class HeightFog {
+ public:
+  explicit HeightFog(int size = 64);
+  ~HeightFog();
+  HeightFog(const HeightFog&) = delete;
+  HeightFog& operator=(const HeightFog&) = delete;
+
+  FogSettings settings;
+
+  // `distance` is the lookup's far edge, beyond it the fog stays the same
+  void Update(float eyeHeight, float distance);
+  void Bind(const Shader& shader, int unit) const;
+
+  // the fraction of what's `distance` metres away along a ray whose
+  // direction has y component `dirY` that the fog hides
+  static float Amount(const FogSettings& settings, float eyeHeight,
+                      float dirY, float distance);
+
+  int Bakes() const { return bakes; }
+  double BakeMs() const { return bakeMs; }
+
+ private:
+  unsigned int texture = 0;
+  int size;
+  std::vector<float> texels;
+  FogSettings baked;
+  float bakedHeight = 0.0f;
+  float bakedDistance = -1.0f;
+  int bakes = 0;
+  double bakeMs = 0.0;
+};
+
+struct FogVolumeSettings {
+  int width = 160;  // froxels across, reallocated when these change
+  int height = 90;
+  int slices = 64;
+  float distance = 80.0f;   // metres, slices are quadratically denser near
+  float scattering = 1.0f;  // lit fraction of the fog's extinction
+  float anisotropy = 0.3f;  // Henyey-Greenstein g, forward scattering
+};
+
+// Lit volumetric fog from the moon and the flashlight in a low resolution
+// froxel volume. Render marches it front to back one slice per draw: each
+// froxel gathers the lights (with their shadows) at its center, scatters
+// by the height fog's density there, and adds that to the slices in front
+// of it, carried in a 2D running target. The volume then holds, per slice,
+// the light scattered toward the eye up to the slice's far side, and
+// Composite adds it in front of every pixel at the pixel's depth. Columns
+// are upsampled bilaterally: neighbours whose scene depth differs from
+// the pixel's weigh less, so lit fog doesn't bleed around silhouettes.
+// Extinction stays with HeightFog, this only adds light.
+//
+// `shader` (Shader/fog_volume.fs) needs the scene's light and fog uniforms
+// set by the caller before Render, the same ones default.fs takes.
+class FogVolume {
+ public:
+  explicit FogVolume(const FogVolumeSettings& settings = FogVolumeSettings());
+  ~FogVolume();
+  FogVolume(const FogVolume&) = delete;
+  FogVolume& operator=(const FogVolume&) = delete;
+
+  FogVolumeSettings settings;
+  Shader shader;
+
+  // leaves the default framebuffer bound, callers reset their viewport
+  void Render(const glm::vec3& eye, const glm::vec3& front,
+              const glm::vec3& up, float fovY, float aspect);
+  // additively into the bound framebuffer, `width` x `height`
+  void Composite(unsigned int depthTexture, float nearPlane, float farPlane,
+                 int width, int height);
+
+  double RenderMs() const { return renderTimer.Ms(); }
+  double CompositeMs() const { return compositeTimer.Ms(); }
+
+ private:
+  void Allocate();
+
+  Shader compositeShader;
+  unsigned int FBO = 0;
+  unsigned int volume = 0;      // GL_TEXTURE_3D, rgb light, a transmittance
+  unsigned int running[2] = {};  // ping-ponged per slice
+  int width = 0, height = 0, slices = 0;  // as allocated
+  GpuTimer renderTimer;
+  GpuTimer compositeTimer;
+};
+
+#endif
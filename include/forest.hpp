@@ -0,0 +1,60 @@
+#ifndef FOREST_HPP
+#define FOREST_HPP
+
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+
+#include "job_system.hpp"
+#include "world.hpp"
+
+struct ForestSettings {
+  uint32_t seed = 1337;
+  float spacing = 4.0f;  // minimum distance between two trunks
+  glm::vec2 areaMin = glm::vec2(-100.0f);
+  glm::vec2 areaMax = glm::vec2(100.0f);
+  float groundY = 0.0f;
+  // trees sit on this when set (called from worker threads), else groundY
+  std::function<float(float, float)> groundHeight;
+
+  // density mask
+  float noiseScale = 0.012f;    // low frequency patches of dense/sparse wood
+  float minDensity = 0.15f;     // thinnest the wood gets outside clearings
+  float clearingRadius = 10.0f;  // kept free around the spawn point (origin)
+
+  float minScale = 0.8f;
+  float maxScale = 1.4f;
+};
+
+struct ForestStats {
+  int samples = 0;  // poisson points before density thinning
+  int trees = 0;
+  int tiles = 0;
+  double milliseconds = 0.0;
+};
+
+// 0..1 chance that a poisson sample at x/z becomes a tree
+float ForestDensity(const ForestSettings& settings, float x, float z);
+
+// Fills one chunk with a Poisson-disk distribution (Bridson), thinned by
+// the density mask. Samples keep half a spacing off the chunk's edges, so
+// trees in neighbouring chunks can't end up closer than the spacing however
+// and in whatever order the chunks are generated, and the rng is seeded from
+// the seed and chunk coordinate, so a chunk comes out the same every time.
+// settings.areaMin/areaMax are ignored. Trees replace the chunk's instance
+// list; call Chunk::FinalizeTrees afterwards to build the render data.
+// Returns the poisson sample count.
+int GenerateForestChunk(Chunk& chunk, float chunkSize,
+                        const ForestSettings& settings);
+
+// Every chunk overlapping the area, the same way and with the same trees as
+// GenerateForestChunk (clipped to the area), side by side on the job system.
+ForestStats GenerateForest(World& world, const ForestSettings& settings,
+                           JobSystem* jobs);
+
+// Generates a `size` x `size` metre forest on one thread and on `jobs`,
+// checks both agree and that no two trunks are closer than the spacing.
+// Returns the milliseconds on `jobs`, -1 if a check failed. Headless.
+double BenchmarkForest(float size, JobSystem& jobs);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+
+#include <glm/glm.hpp>
+
+// view frustum as six inward facing planes (xyz = normal, w = distance)
+struct Frustum {
+  glm::vec4 planes[6];
+
+  Frustum() = default;
+  explicit Frustum(const glm::mat4& viewProjection);
+
+  bool IntersectsAABB(const glm::vec3& min, const glm::vec3& max) const;
+  bool IntersectsSphere(const glm::vec3& center, float radius) const;
+};
+
+#endif
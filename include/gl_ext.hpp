@@ -0,0 +1,69 @@
+#ifndef GL_EXT_HPP
+#define GL_EXT_HPP
+
+#include <glad/glad.h>
+
+// glad is generated for plain GL 3.3, so anything newer is loaded here by hand
+// and only used when the driver actually reports support for it.
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+#ifndef GL_CLIENT_STORAGE_BIT
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#endif
+#ifndef GL_SHADER_STORAGE_BUFFER
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#endif
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+#ifndef GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#endif
+#ifndef GL_COMMAND_BARRIER_BIT
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#endif
+#ifndef GL_SHADER_STORAGE_BARRIER_BIT
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+
+typedef void(APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size,
+                                               const void* data,
+                                               GLbitfield flags);
+typedef void(APIENTRYP PFNGLDISPATCHCOMPUTEPROC)(GLuint x, GLuint y,
+                                                 GLuint z);
+typedef void(APIENTRYP PFNGLMEMORYBARRIERPROC)(GLbitfield barriers);
+typedef void(APIENTRYP PFNGLMULTIDRAWARRAYSINDIRECTPROC)(GLenum mode,
+                                                         const void* indirect,
+                                                         GLsizei drawcount,
+                                                         GLsizei stride);
+
+struct GLExtensions {
+  int major = 3;
+  int minor = 3;
+  bool bufferStorage = false;  // GL 4.4 or ARB_buffer_storage
+  bool computeCulling = false;  // GL 4.3: compute + multi draw indirect
+
+  PFNGLBUFFERSTORAGEPROC BufferStorage = nullptr;
+  PFNGLDISPATCHCOMPUTEPROC DispatchCompute = nullptr;
+  PFNGLMEMORYBARRIERPROC MemoryBarrier = nullptr;
+  PFNGLMULTIDRAWARRAYSINDIRECTPROC MultiDrawArraysIndirect = nullptr;
+};
+
+extern GLExtensions glExt;
+
+// call once after gladLoadGLLoader, with the same loader
+void LoadGLExtensions(GLADloadproc load);
+bool HasGLExtension(const char* name);
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef GPU_CULLING_HPP
+#define GPU_CULLING_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "shader.hpp"
+
+// one indirect draw: a vertex range of the shared VAO plus its local bounds
+struct CullBatch {
+  int first;
+  int count;
+  glm::vec3 boundsMin;
+  glm::vec3 boundsMax;
+};
+
+// GL 4.3 path: a compute shader culls every instance against the frustum
+// (and optionally last frame's Hi-Z), writes the survivors compacted per
+// batch and bumps the instance counts of DrawArraysIndirectCommand records,
+// which are then drawn with one glMultiDrawArraysIndirect. Nothing is read
+// back to the CPU.
+class GpuCuller {
+ public:
+  static bool Supported();
+
+  // batchOf[i] is the batch instance i belongs to
+  GpuCuller(const std::vector<CullBatch>& batches,
+            const std::vector<glm::mat4>& instances,
+            const std::vector<unsigned int>& batchOf);
+  ~GpuCuller();
+  GpuCuller(const GpuCuller&) = delete;
+  GpuCuller& operator=(const GpuCuller&) = delete;
+
+  // texture 0 disables the occlusion test
+  void SetHiZ(unsigned int texture, int width, int height, int maxLevel,
+              const glm::mat4& prevViewProjection);
+
+  void Cull(const glm::mat4& viewProjection);
+  // vao must have per-instance mat4 attributes at locations 3..6
+  void Draw(unsigned int vao);
+
+ private:
+  struct DrawCommand {
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int first;
+    unsigned int baseInstance;
+  };
+
+  Shader cullShader;
+  std::vector<DrawCommand> resetCommands;
+  unsigned int instanceCount;
+
+  unsigned int instancesIn, batchOfBuffer, batchBuffer;
+  unsigned int commandBuffer, instancesOut;
+
+  unsigned int hiZTexture = 0;
+  glm::vec2 hiZSize = glm::vec2(0.0f);
+  int hiZMaxLevel = 0;
+  glm::mat4 prevViewProjection = glm::mat4(1.0f);
+};
+
+#endif
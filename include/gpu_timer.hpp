@@ -0,0 +1,33 @@
+#ifndef GPU_TIMER_HPP
+#define GPU_TIMER_HPP
+
+// GPU time of a pass through GL_TIME_ELAPSED queries. Results are read a
+// few frames late from a small ring, never waited on: when every query is
+// still in flight the pass just isn't timed that frame. Only one timer can
+// be between Begin and End at a time (a GL rule).
+class GpuTimer {
+ public:
+  GpuTimer();
+  ~GpuTimer();
+  GpuTimer(const GpuTimer&) = delete;
+  GpuTimer& operator=(const GpuTimer&) = delete;
+
+  void Begin();
+  void End();
+
+  // the latest finished measurement
+  double Ms() const { return ms; }
+
+ private:
+  static const int QUERY_COUNT = 4;
+
+  void Poll();
+
+  unsigned int queries[QUERY_COUNT] = {};
+  bool pending[QUERY_COUNT] = {};
+  int next = 0;
+  bool running = false;
+  double ms = 0.0;
+};
+
+#endif
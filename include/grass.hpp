@@ -0,0 +1,60 @@
+#ifndef GRASS_HPP
+#define GRASS_HPP
+
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+#include "shader.hpp"
+#include "terrain.hpp"
+
+struct GrassSettings {
+  float density = 40.0f;      // blades per square meter up close
+  float drawDistance = 60.0f;  // nothing is drawn past this
+  float fadeStart = 25.0f;    // density starts thinning out here
+  float bladeHeight = 0.45f;
+  float windStrength = 0.35f;
+  glm::vec2 windDir = glm::vec2(1.0f, 0.3f);
+};
+
+// Procedural grass: nothing per blade lives in memory. The area is split
+// into square patches, each visible patch is one instanced draw and the
+// vertex shader derives a blade's position, shape and sway from
+// gl_InstanceID and the patch seed. Patches further away draw fewer
+// instances, and blades near the cutoff shrink first so nothing pops.
+class GrassField {
+ public:
+  GrassField(const glm::vec2& areaMin, const glm::vec2& areaMax, float groundY,
+             uint32_t seed, float patchSize = 16.0f);
+  ~GrassField();
+  GrassField(const GrassField&) = delete;
+  GrassField& operator=(const GrassField&) = delete;
+
+  GrassSettings settings;
+  // set view/projection/lighting on this like on the regular shader
+  Shader shader;
+  // blades stand on this when set, else on the flat groundY
+  const Terrain* terrain = nullptr;
+
+  // culls patches around the camera, `occluded` may be empty
+  void Draw(const Frustum& frustum, const glm::vec3& cameraPos, float time,
+            const std::function<bool(const glm::vec3&, const glm::vec3&)>&
+                occluded);
+
+  int PatchesDrawn() const { return patchesDrawn; }
+  int BladesDrawn() const { return bladesDrawn; }
+
+ private:
+  glm::vec2 areaMin;
+  glm::vec2 areaMax;
+  float groundY;
+  uint32_t seed;
+  float patchSize;
+  unsigned int VAO = 0;
+
+  int patchesDrawn = 0;
+  int bladesDrawn = 0;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef HIZ_HPP
+#define HIZ_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "shader.hpp"
+
+// Hierarchical-Z pyramid built from the scene depth at the end of a frame
+// and used for occlusion culling in the next one.
+//
+// Each texel stores the furthest depth of the pixels it covers. The GPU
+// culler samples the whole pyramid directly; the CPU path reads one low-res
+// level back through a small PBO ring (a couple of frames late, never
+// stalling) and tests bounds against that.
+class HiZBuffer {
+ public:
+  HiZBuffer();
+  ~HiZBuffer();
+  HiZBuffer(const HiZBuffer&) = delete;
+  HiZBuffer& operator=(const HiZBuffer&) = delete;
+
+  unsigned int texture = 0;  // R32F with mips, level 0 is half the scene size
+  int width = 0;
+  int height = 0;
+  int levels = 0;
+  glm::mat4 viewProjection = glm::mat4(1.0f);  // of the frame in texture
+
+  // depthTexture is the scene depth the frame was rendered with
+  void Build(unsigned int depthTexture, int depthWidth, int depthHeight,
+             const glm::mat4& viewProjection, const glm::vec3& cameraPos);
+
+  // CPU side test against the last read back level. Bounds that leave the
+  // captured view, cross the near plane or are too big to be worth testing
+  // count as visible. The box is grown by how far the camera moved since the
+  // capture so disocclusion from walking around can't pop objects.
+  bool IsVisible(const glm::vec3& min, const glm::vec3& max,
+                 const glm::vec3& cameraPos) const;
+  bool HasCpuDepth() const { return !cpuDepth.empty(); }
+
+  // writes a linearized view of one pyramid level into debugTexture
+  void RenderDebug(int level, float nearPlane, float farPlane);
+  unsigned int debugTexture = 0;
+  int debugWidth = 256;
+  int debugHeight = 144;
+
+ private:
+  static const int READBACK_TARGET = 128;  // read the first level this narrow
+  static const int PBO_COUNT = 3;
+
+  struct Readback {
+    unsigned int pbo = 0;
+    GLsync fence = nullptr;
+    int width = 0;
+    int height = 0;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    glm::vec3 cameraPos = glm::vec3(0.0f);
+  };
+
+  void Allocate(int width, int height);
+  void StartReadback(const glm::vec3& cameraPos);
+  void FinishReadbacks();
+
+  Shader reduceShader;
+  Shader debugShader;
+  unsigned int FBO = 0;
+  unsigned int debugFBO = 0;
+
+  Readback readbacks[PBO_COUNT];
+  int nextReadback = 0;
+  int readbackLevel = 0;
+
+  // latest completed readback
+  std::vector<float> cpuDepth;
+  int cpuWidth = 0;
+  int cpuHeight = 0;
+  glm::mat4 cpuViewProjection = glm::mat4(1.0f);
+  glm::vec3 cpuCameraPos = glm::vec3(0.0f);
+};
+
+#endif
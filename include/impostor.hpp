@@ -0,0 +1,45 @@
+#ifndef IMPOSTOR_HPP
+#define IMPOSTOR_HPP
+
+#include <glm/glm.hpp>
+
+#include "lod.hpp"
+#include "mesh.hpp"
+#include "shader.hpp"
+
+// Hemi-octahedral impostor of one mesh level. At load time the mesh is
+// rendered orthographically from frames x frames directions spread over the
+// upper hemisphere into two atlases: albedo + coverage, and object space
+// normal + depth. Instances are then drawn as one camera facing quad that
+// blends the four frames nearest to the view direction, relit with the
+// baked normals and pushed to the baked depth.
+class Impostor {
+ public:
+  // level picks the index range of `mesh` to bake, center/radius bound it
+  Impostor(GpuMesh& mesh, const LodLevel& level, const glm::vec3& center,
+           float radius, unsigned int albedoTexture, int frames = 8,
+           int frameSize = 128);
+  ~Impostor();
+  Impostor(const Impostor&) = delete;
+  Impostor& operator=(const Impostor&) = delete;
+
+  // set view/projection/lighting on this like on the regular shader
+  Shader shader;
+
+  unsigned int albedoAtlas = 0;
+  unsigned int normalDepthAtlas = 0;
+  int frames;
+  int frameSize;
+  glm::vec3 center;
+  float radius;
+
+  // instances use the InstanceData layout, same as GpuMesh
+  void Draw(unsigned int instanceBuffer, long offset, int instanceCount);
+
+ private:
+  void Bake(GpuMesh& mesh, const LodLevel& level, unsigned int albedoTexture);
+
+  unsigned int VAO = 0;
+};
+
+#endif
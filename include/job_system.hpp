@@ -0,0 +1,63 @@
+#ifndef JOB_SYSTEM_HPP
+#define JOB_SYSTEM_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// counts unfinished jobs of one batch, Wait() on it to join them
+struct JobCounter {
+  std::atomic<int> pending{0};
+  bool Done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+// Small worker pool shared by everything that wants to go wide (occlusion
+// rasterizer, world generation, ...). Two locked queues are plenty for the
+// job sizes we have: regular jobs, and background ones (chunk generation,
+// navmesh tiles, ...) that may take several frames' worth of time and that
+// workers only pick up when no regular job is waiting. A thread that waits
+// helps running the jobs of the batch it waits for instead of sleeping, so
+// waiting from inside a job can't deadlock, but never runs anyone else's:
+// a ParallelFor on the render thread costs its own work and nothing that
+// happened to be queued ahead of it.
+class JobSystem {
+ public:
+  // 0 picks hardware_concurrency - 1, leaving a core for the render thread
+  explicit JobSystem(unsigned int threadCount = 0);
+  ~JobSystem();
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  void Submit(std::function<void()> job, JobCounter* counter = nullptr);
+  void SubmitBackground(std::function<void()> job,
+                        JobCounter* counter = nullptr);
+  void Wait(JobCounter& counter);
+
+  // runs fn(begin, end) over [0, count) in chunks of `grain`, blocking
+  void ParallelFor(int count, int grain,
+                   const std::function<void(int, int)>& fn);
+
+  unsigned int ThreadCount() const { return (unsigned int)workers.size(); }
+
+ private:
+  struct Job {
+    std::function<void()> fn;
+    JobCounter* counter;
+  };
+
+  void WorkerLoop();
+  bool RunOne(JobCounter& counter);
+
+  std::vector<std::thread> workers;
+  std::deque<Job> queue;
+  std::deque<Job> background;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool quit = false;
+};
+
+#endif
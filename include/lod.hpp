@@ -0,0 +1,66 @@
+#ifndef LOD_HPP
+#define LOD_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "mesh.hpp"
+
+// one level inside a packed chain (all levels share a vertex/index buffer)
+struct LodLevel {
+  int baseVertex;
+  int firstIndex;
+  int indexCount;
+  float error;  // geometric error vs. level 0, in mesh units
+};
+
+struct LodChain {
+  std::vector<LodLevel> levels;  // finest first
+  glm::vec3 center = glm::vec3(0.0f);
+  float radius = 0.0f;
+};
+
+// Simplifies `mesh` level by level, each keeping `reduction` of the previous
+// level's triangles, and packs everything into `packed` for one GpuMesh.
+// Meant to run at bake/load time, not per frame.
+LodChain BakeLodChain(const Mesh& mesh, int levelCount, float reduction,
+                      Mesh& packed);
+
+struct LodSettings {
+  float pixelError = 1.5f;   // allowed screen space error in pixels
+  float hysteresis = 0.25f;  // coarser levels need this much extra margin
+  float fadeTime = 0.4f;     // seconds of dithered crossfade per switch
+};
+
+// per instance selection state, owned by whoever owns the instance
+struct LodState {
+  int level = -1;  // -1 until first selected, so we don't fade in from 0
+  int previous = 0;
+  float fade = 1.0f;  // 1 = no transition running
+};
+
+// Picks levels by projected error with hysteresis and appends instances to
+// per-level lists. While a switch fades, the instance goes into both the old
+// and new level's list with complementary dither masks.
+class LodSelector {
+ public:
+  LodSettings settings;
+
+  // pixels per world unit at distance 1
+  void Begin(float fovY, float screenHeight, float deltaTime);
+
+  int SelectLevel(const LodChain& chain, float distance, int current) const;
+
+  // perLevel must have one list per level of the chain. forceLevel skips
+  // the error metric, e.g. to switch to an impostor kept in an extra list
+  // past the chain's levels
+  void Submit(LodState& state, const LodChain& chain, const glm::mat4& model,
+              float distance, std::vector<std::vector<InstanceData>>& perLevel,
+              int forceLevel = -1);
+
+ private:
+  float projectionScale = 1.0f;
+  float deltaTime = 0.0f;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef MESH_HPP
+#define MESH_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// same layout as CubeVertices: position, normal, texture coord
+struct Vertex {
+  glm::vec3 position;
+  glm::vec3 normal;
+  glm::vec2 texCoord;
+};
+
+// per instance data streamed next to the mesh (attribute 3..6 and 7)
+// params.x is the LOD crossfade, 0 = opaque (see default.fs)
+struct InstanceData {
+  glm::mat4 model;
+  glm::vec4 params;
+};
+
+struct Mesh {
+  std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;
+  glm::vec3 boundsMin = glm::vec3(0.0f);
+  glm::vec3 boundsMax = glm::vec3(0.0f);
+
+  void ComputeBounds();
+  int TriangleCount() const { return (int)indices.size() / 3; }
+};
+
+// procedural tree: a tapered trunk under a few stacked cones
+Mesh BuildTreeMesh(int segments = 16);
+
+// GPU copy of one or more meshes sharing a VAO, drawn instanced with
+// InstanceData coming from whatever buffer is bound in SetInstanceBuffer
+class GpuMesh {
+ public:
+  explicit GpuMesh(const Mesh& mesh);
+  ~GpuMesh();
+  GpuMesh(const GpuMesh&) = delete;
+  GpuMesh& operator=(const GpuMesh&) = delete;
+
+  unsigned int VAO, VBO, EBO;
+  int indexCount;
+
+  // point the instance attributes at `offset` inside `buffer`
+  void SetInstanceBuffer(unsigned int buffer, long offset);
+  void DrawInstanced(int firstIndex, int indexCount, int baseVertex,
+                     int instanceCount);
+};
+
+#endif
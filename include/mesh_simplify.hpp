@@ -0,0 +1,17 @@
+#ifndef MESH_SIMPLIFY_HPP
+#define MESH_SIMPLIFY_HPP
+
+#include "mesh.hpp"
+
+// Quadric error metric edge collapse (Garland & Heckbert). Vertices are
+// welded by position for the topology, corners keep their own normal and
+// texture coord so flat shading and uv seams survive. Open borders get
+// extra constraint planes so silhouettes don't shrink.
+//
+// Returns a mesh with at most targetTriangles triangles (fewer collapses if
+// the only ones left would flip a face). `error` receives the largest
+// distance an introduced surface moved, in the mesh's own units.
+Mesh SimplifyMesh(const Mesh& mesh, int targetTriangles,
+                  float* error = nullptr);
+
+#endif
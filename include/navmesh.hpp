@@ -0,0 +1,192 @@
+#ifndef NAVMESH_HPP
+#define NAVMESH_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <glm/glm.hpp>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "collision.hpp"
+#include "job_system.hpp"
+#include "world.hpp"
+
+struct NavMeshSettings {
+  float tileSize = 64.0f;    // same as the world chunks
+  float cellSize = 0.25f;    // voxel size on x/z
+  float cellHeight = 0.1f;   // voxel size on y
+  float agentHeight = 2.0f;  // clearance a monster needs
+  float agentRadius = 0.5f;  // walls and trunks are kept this far away
+  float agentClimb = 0.4f;   // ledges it steps up or down
+  float maxSlope = 45.0f;    // degrees
+  int minRegionArea = 64;    // cells, smaller islands are dropped
+  float maxEdgeError = 1.3f;  // cells a simplified wall may stray
+};
+
+const int NAV_MAX_POLY_VERTS = 6;
+const uint16_t NAV_NO_NEIGHBOR = 0xffff;
+// an edge on the tile border, the low bits are the side (0 -x, 1 +z, 2 +x,
+// 3 -z) to look for the neighbour tile on
+const uint16_t NAV_EXTERNAL = 0x8000;
+
+// convex polygon, counter-clockwise seen from above; plain data so tiles go
+// to disk as is
+struct NavPoly {
+  uint16_t verts[NAV_MAX_POLY_VERTS];
+  // per edge (verts[i] to verts[i + 1]): poly index in the same tile,
+  // NAV_EXTERNAL | side or NAV_NO_NEIGHBOR for a wall
+  uint16_t neighbors[NAV_MAX_POLY_VERTS];
+  uint8_t vertCount;
+  uint8_t padding[3];
+};
+
+// a tile border edge leading into a poly of the neighbour tile, over the
+// part [tmin, tmax] of the edge
+struct NavLink {
+  uint16_t poly;
+  uint8_t edge;
+  uint8_t side;
+  uint16_t target;  // poly in the tile on `side`
+  float tmin;
+  float tmax;
+};
+
+struct NavTile {
+  ChunkCoord coord;
+  std::vector<glm::vec3> vertices;
+  std::vector<NavPoly> polys;
+  // links grouped by poly: poly p owns links[linkStart[p]..linkStart[p+1])
+  std::vector<NavLink> links;
+  std::vector<uint32_t> linkStart;
+
+  glm::vec3 PolyCenter(int poly) const;
+};
+
+// a poly somewhere in the mesh
+struct NavPolyRef {
+  ChunkCoord tile;
+  int poly;
+};
+
+// What a tile is built from, copied on the main thread so the build doesn't
+// race with the collision world changing.
+struct NavTileInput {
+  ChunkCoord coord;
+  glm::vec2 origin;  // min x/z corner of the tile
+  std::vector<CollisionShape> shapes;
+  std::function<float(float, float)> groundHeight;
+};
+
+// The Recast pipeline for one tile: voxelize the collision geometry into
+// span columns, keep the spans an agent can stand on, link neighbours it can
+// step between, erode them by the agent radius, split what's left into
+// monotone regions, trace and simplify the region outlines and triangulate
+// them into convex polygons. Runs on any thread.
+void BuildNavTile(const NavMeshSettings& settings, const NavTileInput& input,
+                  NavTile& tile);
+
+// Navigation mesh for monsters, tiled like the world. Tiles are requested as
+// chunks stream in (or as geometry under them changes), built on the job
+// system and linked to their neighbours on the main thread. Built tiles are
+// cached on disk keyed by a hash of the settings and the input, so a tile
+// only gets rebuilt when what's under it changed.
+class NavMesh {
+ public:
+  // an empty cacheDir turns the disk cache off
+  NavMesh(const NavMeshSettings& settings, JobSystem& jobs,
+          const std::string& cacheDir);
+  ~NavMesh();  // waits for builds still running
+  NavMesh(const NavMesh&) = delete;
+  NavMesh& operator=(const NavMesh&) = delete;
+
+  const NavMeshSettings settings;
+  // shapes are read from here when a tile's build starts
+  const CollisionWorld* collision = nullptr;
+  int maxInFlight = 4;  // tiles building at once
+
+  // queues a (re)build, e.g. when its chunk loaded
+  void RequestTile(ChunkCoord coord);
+  // rebuilds the built tiles whose input overlaps min..max
+  void Invalidate(const glm::vec3& min, const glm::vec3& max);
+  void RemoveTile(ChunkCoord coord);
+
+  // takes in finished tiles and starts queued builds; main thread
+  void Update();
+
+  // called after a tile was added, rebuilt or removed, once it's linked
+  std::function<void(ChunkCoord)> onTileChanged;
+
+  const NavTile* GetTile(ChunkCoord coord) const;
+  ChunkCoord TileAt(float x, float z) const;
+  // the poly under the position (the one closest in height if they're
+  // stacked), else the one with the nearest center within maxDistance
+  bool FindPoly(const glm::vec3& position, NavPolyRef& ref,
+                float maxDistance = 4.0f) const;
+  const std::unordered_map<ChunkCoord, std::unique_ptr<NavTile>,
+                           ChunkCoordHash>&
+  Tiles() const {
+    return tiles;
+  }
+
+  int TileCount() const { return (int)tiles.size(); }
+  int PolyCount() const { return polyCount; }
+  int Building() const { return (int)inFlight.size(); }
+  int Queued() const { return (int)queue.size(); }
+  int CacheHits() const { return cacheHits; }
+  int Built() const { return built; }
+  double BuildMs() const { return buildMs.load(); }  // last tile built
+
+ private:
+  struct Result {
+    std::unique_ptr<NavTile> tile;
+    uint32_t generation;
+    bool fromCache;
+  };
+
+  void Start(ChunkCoord coord);
+  void Link(NavTile& tile);
+  std::string CachePath(ChunkCoord coord) const;
+  bool ReadCache(const std::string& path, uint64_t hash, NavTile& tile) const;
+  void WriteCache(const std::string& path, uint64_t hash,
+                  const NavTile& tile) const;
+
+  JobSystem& jobs;
+  std::string cacheDir;
+
+  std::unordered_map<ChunkCoord, std::unique_ptr<NavTile>, ChunkCoordHash>
+      tiles;
+  std::deque<ChunkCoord> queue;
+  std::unordered_set<ChunkCoord, ChunkCoordHash> queued;
+  std::unordered_set<ChunkCoord, ChunkCoordHash> inFlight;
+  // bumped when a build starts and on removal, so builds that finish after
+  // their tile changed again are thrown away
+  std::unordered_map<ChunkCoord, uint32_t, ChunkCoordHash> generation;
+
+  std::mutex doneMutex;
+  std::deque<Result> done;
+  JobCounter counter;
+
+  int polyCount = 0;
+  int cacheHits = 0;
+  int built = 0;
+  std::atomic<double> buildMs{0.0};
+};
+
+// Headless: builds a tile of the benchmark forest with a disk cache, then
+// again in a new NavMesh from a collision world with the same shapes added
+// in another order, which has to load it from the cache, and once more with
+// a tree moved, which has to rebuild it. Returns how many of the three went
+// wrong.
+int VerifyNavCache(JobSystem& jobs);
+
+// For headless benchmarks: rolling ground over [0, size] on x/z with trunks
+// at forest density and a scatter of long rocks, the same every time.
+void MakeBenchmarkForest(float size, CollisionWorld& world);
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef OCCLUSION_RASTER_HPP
+#define OCCLUSION_RASTER_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+
+class JobSystem;
+
+// CPU depth rasterizer for occlusion culling, in the spirit of Intel's
+// Masked Occlusion Culling but without the coverage masks: simplified
+// occluders (walls, terrain, big trunks) are rasterized into a small float
+// depth buffer and object bounds are tested against it. Nothing here needs
+// a GPU, so it works the same on every driver and one frame earlier than
+// the Hi-Z readback.
+//
+// The inner loops come in AVX2, SSE2 and scalar flavours picked at runtime,
+// and NEON on arm64.
+// Rasterization is split into screen bins that run in parallel on the job
+// system; bins never share pixels so no locking is needed.
+class OcclusionRasterizer {
+ public:
+  static const int WIDTH = 320;
+  static const int HEIGHT = 192;
+  static const int TILE_W = 32;  // granularity of the max depth used to
+  static const int TILE_H = 8;   // early out in IsVisible
+  static const int BIN_W = 64;   // one job per bin
+  static const int BIN_H = 48;
+
+  explicit OcclusionRasterizer(JobSystem* jobs = nullptr);
+
+  // clears the buffer and drops the occluders of the previous frame
+  void Begin(const glm::mat4& viewProjection);
+
+  // indexed triangle list, counter clockwise front faces unless twoSided
+  void AddOccluder(const glm::vec3* positions, const unsigned int* indices,
+                   int triangleCount, const glm::mat4& model,
+                   bool twoSided = false);
+  void AddOccluderBox(const glm::vec3& min, const glm::vec3& max);
+
+  void Rasterize();
+
+  // false only when every pixel the box covers has a nearer occluder
+  bool IsVisible(const glm::vec3& min, const glm::vec3& max) const;
+
+  const float* Depth() const { return depth.data(); }
+  int TriangleCount() const { return (int)triangles.size(); }
+  static const char* SimdName();
+
+  struct Triangle {
+    float a[3], b[3], c[3];  // edge functions a*x + b*y + c >= 0 inside
+    float zA, zB, zC;        // depth plane over the screen
+    float zBias;             // moves depth to the far corner of a pixel
+    float zMax;
+    int minX, minY, maxX, maxY;  // pixel bounds, inclusive
+  };
+  const std::vector<Triangle>& Triangles() const { return triangles; }
+
+ private:
+  void SetupTriangle(const glm::vec4& v0, const glm::vec4& v1,
+                     const glm::vec4& v2, bool twoSided);
+  void RasterizeBin(int bin);
+
+  JobSystem* jobs;
+  glm::mat4 viewProjection;
+  std::vector<Triangle> triangles;
+  std::vector<float> depth;    // WIDTH * HEIGHT, 1 is the far plane
+  std::vector<float> tileMax;  // furthest depth per tile
+};
+
+// Rasterizes `triangles` random screen space triangles one at a time with
+// every kernel this CPU runs and with a plain double precision reference,
+// then asks the test kernels about random rects of the result. Returns how
+// many pixels and tests disagree; pixels within a thousandth of a pixel of
+// an edge are left out, rounding decides those. Headless.
+int VerifyOcclusionKernels(int triangles);
+
+// Rasterizes a wall, a floor and a side wall through a perspective camera,
+// the last two crossing the near plane, and asks IsVisible about boxes with
+// a known answer: behind the wall, peeking past its edge, in front of it,
+// under the floor and behind the side wall. Returns how many answers were
+// wrong. Headless.
+int VerifyOcclusionQueries(JobSystem* jobs);
+
+// Prints each kernel's rate on one thread and returns triangles per second
+// through Begin / AddOccluder / Rasterize on `jobs`, averaged over
+// `frames` frames of `triangles` random triangles. Headless.
+double BenchmarkOcclusionRaster(int triangles, int frames, JobSystem* jobs);
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef PATHFINDER_HPP
+#define PATHFINDER_HPP
+
+#include <cstdint>
+#include <deque>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "job_system.hpp"
+#include "navmesh.hpp"
+
+enum PathStatus {
+  PATH_PENDING = 0,
+  PATH_FOUND,
+  PATH_NOT_FOUND,  // off the mesh, or no way between the two
+};
+
+// Hierarchical pathfinding (HPA*) over a NavMesh. Every tile is a cluster;
+// where two tiles link, each run of linked edges along the border becomes
+// an entrance (split every maxEntranceWidth) with a node on both sides.
+// Nodes of the same tile are joined by their walking distance through the
+// tile's polys, so a search crosses the world on the small abstract graph
+// and only walks polys inside the tiles the route goes through. The route
+// is then string pulled into straight waypoints.
+//
+// Changed tiles only redo their own borders and the distances inside them
+// and their neighbours. Both that and the queued searches run a step at a
+// time within a per-frame budget, a step being one border, one node's
+// distances through a tile, one abstract node, one tile's worth of
+// refinement or the final string pull.
+class HierarchicalPathfinder {
+ public:
+  explicit HierarchicalPathfinder(const NavMesh& navMesh);
+
+  float maxEntranceWidth = 16.0f;
+
+  // hook to NavMesh::onTileChanged: drops the tile's entrances right away
+  // (they point into polys that are gone), new ones are made in Update
+  void TileChanged(ChunkCoord coord);
+
+  // queues a search; the handle stays valid until Release
+  uint32_t Request(const glm::vec3& start, const glm::vec3& goal);
+  void Release(uint32_t handle);
+  PathStatus Status(uint32_t handle) const;
+  // waypoints from start to goal, once found
+  const std::vector<glm::vec3>& Path(uint32_t handle) const;
+
+  // updates the graph for changed tiles, then runs queued searches, while
+  // the next step is expected to fit in budgetUs microseconds (the first
+  // always runs); searches wait until the graph is whole again
+  void Update(double budgetUs);
+
+  // the whole search at once, with the graph as it is
+  PathStatus FindPath(const glm::vec3& start, const glm::vec3& goal,
+                      std::vector<glm::vec3>& path);
+
+  int NodeCount() const { return (int)(nodes.size() - freeNodes.size()); }
+  int EdgeCount() const { return edgeCount; }
+  int Pending() const { return (int)pending.size(); }
+  int DirtyTiles() const { return (int)dirty.size(); }
+  double LastUpdateUs() const { return lastUpdateUs; }
+  double WorstStepUs() const { return worstStepUs; }
+
+ private:
+  struct Edge {
+    uint32_t to;
+    float cost;
+    bool inter;  // crosses to the next tile
+  };
+  struct Node {
+    ChunkCoord tile;
+    int poly;
+    glm::vec3 position;  // middle of the entrance
+    std::vector<Edge> edges;
+    bool alive = false;
+  };
+
+  enum QueryStage {
+    QUERY_LOCATE = 0,
+    QUERY_LINK_START,
+    QUERY_LINK_GOAL,
+    QUERY_ABSTRACT,
+    QUERY_REFINE,
+    QUERY_PULL,
+    QUERY_DONE,
+  };
+  struct Query {
+    bool used = false;
+    PathStatus status = PATH_PENDING;
+    QueryStage stage = QUERY_LOCATE;
+    uint64_t version = 0;  // of the graph the search started on
+    glm::vec3 start, goal;
+    NavPolyRef startRef, goalRef;
+    // the start and goal are temporary nodes, linked to their tile's nodes
+    std::vector<std::pair<uint32_t, float>> startEdges;
+    std::unordered_map<uint32_t, float> goalEdges;
+    // abstract A*
+    std::vector<std::pair<float, uint32_t>> open;  // heap on f
+    std::unordered_map<uint32_t, float> cost;
+    std::unordered_map<uint32_t, uint32_t> parent;
+    // refinement
+    std::vector<uint32_t> route;  // START, nodes..., GOAL
+    size_t hop = 0;
+    std::vector<NavPolyRef> corridor;
+    std::vector<glm::vec3> path;
+  };
+
+  // one step of rebuilding the tile at the front of `dirty`; false once
+  // it's done
+  bool RebuildStep();
+  void ClearBorder(ChunkCoord owner, int side);
+  void RebuildBorder(ChunkCoord owner, int side);
+  bool RebuildIntraEdges(ChunkCoord coord, size_t index);
+  void FreeNode(uint32_t id);
+  uint32_t NewNode(ChunkCoord tile, int poly, const glm::vec3& position);
+  const std::vector<glm::vec3>& Centers(ChunkCoord coord);
+
+  void Reset(Query& query);
+  // one unit of work; false once the query is finished
+  bool Step(Query& query);
+  bool Locate(Query& query);
+  bool Link(Query& query);
+  bool Expand(Query& query);
+  bool Refine(Query& query);
+  void StringPull(Query& query);
+
+  const NavMesh& navMesh;
+
+  std::vector<Node> nodes;
+  std::vector<uint32_t> freeNodes;
+  std::unordered_map<ChunkCoord, std::vector<uint32_t>, ChunkCoordHash>
+      tileNodes;
+  // entrance nodes per border, keyed by the tile on its -x / -z side and
+  // the side (1 or 2) it's on from there
+  std::unordered_map<uint64_t, std::vector<uint32_t>> borderNodes;
+  int edgeCount = 0;
+  uint64_t version = 0;
+  // poly centers per tile, made when first needed
+  std::unordered_map<ChunkCoord, std::vector<glm::vec3>, ChunkCoordHash>
+      polyCenters;
+
+  std::deque<ChunkCoord> dirty;
+  std::unordered_set<ChunkCoord, ChunkCoordHash> dirtySet;
+  // where the front tile's rebuild is: its four borders, then the inside
+  // distances of it and its neighbours, a node at a time
+  int rebuildStage = 0;
+  size_t rebuildNode = 0;
+  std::vector<float> distance;
+
+  std::vector<Query> queries;
+  std::vector<uint32_t> freeQueries;
+  std::deque<uint32_t> pending;
+  double lastUpdateUs = 0.0;
+  double worstStepUs = 0.0;
+  // the longest recent step of each kind, graph work then the query
+  // stages; a step starts only if twice that still fits the budget
+  double stepUs[QUERY_DONE + 1] = {};
+};
+
+// Headless: generates a forest `tiles` x `tiles` navmesh tiles wide, builds
+// the mesh on the job system and the abstract graph, then runs `queries`
+// random cross-map searches with HPA* and with plain A* over the polys.
+// Then builds the graph again and runs the searches time sliced, with a few
+// tiles changing on the way. Prints queries per second and the average and
+// worst search time of both, and the longest time-sliced frame and step.
+// Returns HPA* queries per second, 0 if a frame went over its budget.
+double BenchmarkPathfinding(int tiles, int queries, JobSystem& jobs);
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef RAYCAST_HPP
+#define RAYCAST_HPP
+
+#include <cstdint>
+#include <functional>
+#include <glm/glm.hpp>
+#include <mutex>
+#include <vector>
+
+#include "collision.hpp"
+#include "job_system.hpp"
+
+struct Ray {
+  glm::vec3 origin;
+  glm::vec3 direction;  // unit length
+  float maxDistance;
+};
+
+const uint32_t RAY_MISS = 0xffffffff;
+const uint32_t RAY_GROUND = 0xfffffffe;
+
+struct RayHit {
+  float distance;  // maxDistance on a miss
+  uint32_t shape;  // collision shape id, RAY_MISS or RAY_GROUND
+};
+
+enum RayQueryType {
+  RAY_ANY_HIT = 0,  // stops at the first thing in the way: line of sight
+  RAY_CLOSEST_HIT,
+};
+
+// rays traced together; lines of sight from one eye share most of the tree
+const int RAY_PACKET = 8;
+
+// Bounding volume hierarchy over a copy of the collision shapes, built with
+// binned SAH. Rays go down it a packet at a time: each node's box is tested
+// against all the packet's rays at once, 4 lanes per SSE2 or NEON op (two
+// per packet), and the packet only descends where some ray still hits.
+// Shapes in the leaves are tested exactly, per ray. Elsewhere the lanes are
+// a loop.
+// The heightfield isn't in the tree; rays march it in groundStep steps
+// after the shapes. Tracing is const and can run on any number of threads.
+class RayBvh {
+ public:
+  void Build(const CollisionWorld& world);
+  // shapes[i] has the collision id ids[i]
+  void Build(std::vector<CollisionShape> shapes, std::vector<uint32_t> ids,
+             std::function<float(float, float)> groundHeight);
+
+  // rays in packets of RAY_PACKET, in order; hits[i] answers rays[i]
+  void Trace(const Ray* rays, RayHit* hits, int count,
+             RayQueryType type) const;
+  // the same one ray at a time without SIMD, to compare against
+  void TraceSingle(const Ray* rays, RayHit* hits, int count,
+                   RayQueryType type) const;
+
+  float groundStep = 2.0f;  // metres between height samples, 0 for none
+
+  int NodeCount() const { return (int)nodes.size(); }
+  int ShapeCount() const { return (int)shapes.size(); }
+  double BuildMs() const { return buildMs; }
+  static const char* SimdName();
+
+  struct Packet;
+
+ private:
+  // children of an inner node are at index + 1 and `offset`; a leaf's
+  // shapes are shapes[offset .. offset + count)
+  struct Node {
+    glm::vec3 min;
+    uint32_t offset;
+    glm::vec3 max;
+    uint16_t count;  // 0 for inner nodes
+    uint16_t axis;   // of the split, to visit the near child first
+  };
+  uint32_t BuildNode(std::vector<uint32_t>& order, uint32_t begin,
+                     uint32_t end, const std::vector<glm::vec3>& centers);
+  void TracePacket(Packet& packet, RayHit* hits, RayQueryType type) const;
+  void TraceGround(const Ray& ray, RayHit& hit) const;
+
+  std::vector<Node> nodes;
+  std::vector<CollisionShape> shapes;  // in leaf order
+  std::vector<uint32_t> ids;           // collision ids of `shapes`
+  std::function<float(float, float)> groundHeight;
+  double buildMs = 0.0;
+};
+
+// where a batch of submitted rays will find its hits
+struct RayTicket {
+  uint64_t tick = 0;
+  uint32_t first = 0;
+  uint32_t count = 0;
+};
+
+// Ray queries for AI, answered a tick later. Anyone (AI jobs included)
+// submits batches during the tick; Dispatch hands them to the job system
+// to trace while the frame renders, and Collect at the start of the next
+// tick waits for them and makes the hits readable. When the collision world
+// changed, a spare tree is built in a background job nobody waits on; rays
+// keep using the current one until the spare is done and takes its place.
+// Until the first tree is in, submitted rays get no results.
+class RaycastQueue {
+ public:
+  explicit RaycastQueue(JobSystem& jobs);
+  ~RaycastQueue();  // waits for the rays and the build in flight
+  RaycastQueue(const RaycastQueue&) = delete;
+  RaycastQueue& operator=(const RaycastQueue&) = delete;
+
+  const CollisionWorld* collision = nullptr;
+  float groundStep = 2.0f;
+
+  // any thread; the ticket is good for the tick after the next Dispatch
+  RayTicket Submit(const Ray* rays, int count, RayQueryType type);
+  // main thread, start of the tick
+  void Collect();
+  // main thread, once this tick's rays are in
+  void Dispatch();
+
+  // hits of a collected ticket, null if they aren't in yet or are gone
+  const RayHit* Results(const RayTicket& ticket) const;
+
+  int RaysLastTick() const { return (int)readyHits.size(); }
+  double TraceMs() const { return traceMs; }  // of the last batch, wall
+  const RayBvh& Bvh() const { return bvh; }
+  bool HasTree() const { return hasTree; }
+
+ private:
+  struct Batch {
+    uint32_t first;
+    uint32_t count;
+    RayQueryType type;
+  };
+
+  JobSystem& jobs;
+  RayBvh bvh;            // traced against
+  RayBvh spare;          // built in the background, swapped in when done
+  bool hasTree = false;  // bvh was built at least once
+  bool building = false;
+  uint64_t builtRevision = ~0ull;  // of the world the last build copied
+
+  std::mutex submitMutex;
+  uint64_t tick = 1;  // of the rays being submitted
+  std::vector<Ray> submitted;
+  std::vector<Batch> submittedBatches;
+
+  // being traced
+  uint64_t tracingTick = 0;
+  std::vector<Ray> tracing;
+  std::vector<Batch> tracingBatches;
+  std::vector<RayHit> tracingHits;
+  JobCounter counter;
+  // copied from the world on the main thread, built from in the build job
+  std::vector<CollisionShape> buildShapes;
+  std::vector<uint32_t> buildIds;
+  std::function<float(float, float)> buildGround;
+  JobCounter buildCounter;
+  double tracedMs = 0.0;  // written by the job
+  double traceMs = 0.0;
+
+  uint64_t readyTick = 0;
+  std::vector<RayHit> readyHits;
+};
+
+// Headless: a generated forest `size` metres across, then `rays` lines of
+// sight in packets from eyes to points around them, traced one at a time,
+// in packets on one thread, through the queue on the job system, and in
+// packets with the heightfield. Prints rays per second of each. Returns
+// rays per second through the queue.
+double BenchmarkRaycasts(float size, int rays, JobSystem& jobs);
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef RENDER_TARGET_HPP
+#define RENDER_TARGET_HPP
+
+// Offscreen color + depth target the scene is drawn into, so later passes
+// (Hi-Z, post effects) can sample its depth. Blitted to the window at the end.
+class RenderTarget {
+ public:
+  RenderTarget(int width, int height);
+  ~RenderTarget();
+  RenderTarget(const RenderTarget&) = delete;
+  RenderTarget& operator=(const RenderTarget&) = delete;
+
+  unsigned int FBO;
+  unsigned int colorTexture;
+  unsigned int depthTexture;
+  int width;
+  int height;
+
+  // reallocates the attachments only when the size actually changed
+  void Resize(int width, int height);
+  void Bind();
+  void BlitToScreen();
+
+ private:
+  void Allocate();
+};
+
+// draws one triangle covering the viewport, the vertex shader builds the
+// positions from gl_VertexID (see Shader/fullscreen.vs)
+void DrawFullscreenTriangle();
+
+#endif
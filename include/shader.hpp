@@ -12,6 +12,8 @@ public:
 
     // Constructor
     Shader(const char* vertexPath, const char* fragmentPath);
+    // Compute shader program (needs a GL 4.3 context)
+    explicit Shader(const char* computePath);
 
     // Activate the shader
     void use();
@@ -23,6 +25,10 @@ public:
     void setMat4(const std::string& name, const glm::mat4& mat) const;
 
 private:
+    // Pastes in the file named by each #include "name" line, looked up
+    // next to the stage at path; one level deep, see Shader/lighting.glsl
+    static std::string expandIncludes(const std::string& code,
+        const std::string& path);
     // Utility function for checking shader compilation/linking errors
     void checkCompileErrors(unsigned int shader, const std::string& type);
 };
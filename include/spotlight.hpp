@@ -0,0 +1,118 @@
+#ifndef SPOTLIGHT_HPP
+#define SPOTLIGHT_HPP
+
+#include <functional>
+#include <glm/glm.hpp>
+
+#include "camera.hpp"
+#include "frustum.hpp"
+#include "shader.hpp"
+
+// The player's flashlight: a cone with a soft edge between the inner and
+// outer angle, inverse square falloff that reaches zero at `range`, and a
+// cookie texture projected along the cone for the rings and smudges of a
+// cheap reflector.
+struct SpotLight {
+  bool on = true;
+  glm::vec3 position = glm::vec3(0.0f);
+  glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f);
+  glm::vec3 color = glm::vec3(1.0f, 0.93f, 0.8f);
+  float intensity = 20.0f;
+  float innerAngle = 12.0f;  // half angles, degrees
+  float outerAngle = 24.0f;
+  float range = 40.0f;
+  // where the hand holds it, in camera space (right, up, forward)
+  glm::vec3 offset = glm::vec3(0.3f, -0.25f, 0.2f);
+
+  // held in the hand, pointing where the camera looks; the hand steadies it
+  // against the head bob
+  void Follow(const Camera& camera);
+  // of the cone itself, to project the cookie
+  glm::mat4 ViewProjection() const;
+};
+
+// R8 cookie of `size` texels: a hot center, a darker band and a faint
+// outer ring, with a little noise so the beam doesn't look printed
+unsigned int CreateFlashlightCookie(int size);
+
+struct SpotShadowSettings {
+  int size = 1024;  // of both layers, fixed once constructed
+  // degrees the cached layer reaches past the cone, so looking around a
+  // little doesn't redraw it
+  float margin = 12.0f;
+  // metres the light can walk before the cached layer is redrawn; the layer
+  // is drawn from far enough behind the light that its cone still holds the
+  // beam from anywhere that close
+  float moveTolerance = 0.25f;
+  float nearPlane = 0.05f;
+};
+
+// Shadow map of the flashlight in two layers of one depth array. Layer 0
+// holds the static casters (trees) and is only redrawn when the light moves
+// or turns past the margin, or a static caster inside it changes; layer 1
+// holds what moves (items, the monster and its pack) and is redrawn every
+// frame it has anything in it. Receivers take the nearer of the two, so
+// standing still with the light up costs the few moving casters in the
+// cone, however big the forest is.
+//
+// Casters are drawn by the callbacks, with the depth shader bound and the
+// light's view-projection set; they cull against the frustum they're given,
+// `min`/`max` being the world box around it to walk the chunk grid with,
+// and return how many they drew. Shaders with `instancedMatrix` at
+// location 3 like Shader/default.vs fit the depth shader as they are.
+class SpotShadow {
+ public:
+  explicit SpotShadow(
+      const SpotShadowSettings& settings = SpotShadowSettings());
+  ~SpotShadow();
+  SpotShadow(const SpotShadow&) = delete;
+  SpotShadow& operator=(const SpotShadow&) = delete;
+
+  SpotShadowSettings settings;
+  std::function<int(const Frustum&, const glm::vec3&, const glm::vec3&)>
+      drawStatic;
+  std::function<int(const Frustum&, const glm::vec3&, const glm::vec3&)>
+      drawDynamic;
+
+  // redraws what the light needs this frame; leaves the default
+  // framebuffer bound, callers rebind their target and viewport
+  void Update(const SpotLight& light);
+  // a static caster in the box was added, removed or moved
+  void Invalidate(const glm::vec3& min, const glm::vec3& max);
+
+  // binds the map to `unit` and sets spotShadow, spotShadowMatrix and
+  // spotShadowDynamic on a shader that's in use
+  void Bind(const Shader& shader, int unit) const;
+
+  unsigned int texture = 0;  // GL_TEXTURE_2D_ARRAY, depth compare on
+  const glm::mat4& ViewProjection() const { return viewProjection; }
+  int StaticRedraws() const { return staticRedraws; }
+  int StaticCasters() const { return staticCasters; }
+  int DynamicCasters() const { return dynamicCasters; }
+  bool RedrewStatic() const { return redrewStatic; }  // last Update
+
+ private:
+  void DrawLayer(int layer,
+                 const std::function<int(const Frustum&, const glm::vec3&,
+                                         const glm::vec3&)>& draw,
+                 int& casters);
+
+  Shader depthShader;
+  unsigned int FBO = 0;
+  bool dirty = true;
+  glm::vec3 cachedPosition = glm::vec3(0.0f);  // of the light, not the eye
+  glm::vec3 cachedDirection = glm::vec3(0.0f, 0.0f, -1.0f);
+  float cachedHalfAngle = 0.0f;  // degrees the layers cover
+  float cachedRange = 0.0f;
+  glm::mat4 viewProjection = glm::mat4(1.0f);
+  Frustum frustum;
+  glm::vec3 boxMin = glm::vec3(0.0f), boxMax = glm::vec3(0.0f);
+  bool dynamicInLayer = false;  // layer 1 needs a clear before reuse
+
+  int staticRedraws = 0;
+  int staticCasters = 0;
+  int dynamicCasters = 0;
+  bool redrewStatic = false;
+};
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef STREAM_BUFFER_HPP
+#define STREAM_BUFFER_HPP
+
+#include <glad/glad.h>
+
+// Ring of per-frame regions inside a single GL buffer for data that changes
+// every frame (culled instance lists, particles, debug lines).
+//
+// Each frame writes into its own region and EndFrame() drops a fence behind
+// it, so a region is only reused once the GPU has finished reading it. With
+// buffer storage the whole ring stays persistently mapped, otherwise every
+// allocation maps its range unsynchronized + invalidated, which also avoids
+// the implicit sync of glBufferData/glBufferSubData.
+//
+// A frame that asks for more than a region holds gets nullptr / -1 for what
+// didn't fit, and EndFrame then regrows the ring to that frame's demand, so
+// an undersized ring drops draws for a frame rather than for good.
+class StreamBuffer {
+ public:
+  StreamBuffer(GLenum target, GLsizeiptr regionSize, int regionCount = 3);
+  ~StreamBuffer();
+  StreamBuffer(const StreamBuffer&) = delete;
+  StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+  unsigned int ID;
+  GLenum target;
+  bool persistent;  // true when mapped once via glBufferStorage
+
+  // Reserve `size` bytes in this frame's region. Returns the write pointer
+  // (nullptr when the region is full) and the buffer offset to draw from.
+  // Without persistent mapping only one allocation may be open at a time,
+  // so call Commit() before the next Allocate() or any draw.
+  void* Allocate(GLsizeiptr size, GLintptr& offset, GLsizeiptr alignment = 16);
+  void Commit();
+
+  // copy + commit in one go, returns the offset or -1 if it did not fit
+  GLintptr Upload(const void* data, GLsizeiptr size, GLsizeiptr alignment = 16);
+
+  // fence the current region and move on to the next one, growing the ring
+  // if this frame ran out of room
+  void EndFrame();
+
+  GLsizeiptr RegionSize() const { return regionSize; }
+  GLsizeiptr BytesThisFrame() const { return used; }
+  GLsizeiptr BytesLastFrame() const { return lastFrameBytes; }
+  int FailedLastFrame() const { return failedLastFrame; }  // allocations
+  int Grows() const { return grows; }
+
+ private:
+  static const int MAX_REGIONS = 4;
+
+  void Create();
+  void Destroy();
+  void WaitForRegion(int region);
+
+  GLsizeiptr regionSize;
+  int regionCount;
+  int region = 0;
+  GLsizeiptr used = 0;  // bytes handed out in the current region
+  GLsizeiptr lastFrameBytes = 0;
+  GLsizeiptr demand = 0;  // bytes asked for this frame, fitting or not
+  int failed = 0;
+  int failedLastFrame = 0;
+  int grows = 0;
+  bool regionReady = false;  // fence of the current region already waited on
+  bool mapped = false;       // an unsynchronized mapping is open
+  unsigned char* persistentPtr = nullptr;
+  GLsync fences[MAX_REGIONS] = {};
+};
+
+// Push `totalBytes` through a fresh ring in `chunkSize` pieces and return the
+// upload rate in MB/s, including the final glFinish
+double BenchmarkStreamUpload(GLsizeiptr totalBytes, GLsizeiptr chunkSize);
+
+#endif
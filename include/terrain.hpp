@@ -0,0 +1,106 @@
+#ifndef TERRAIN_HPP
+#define TERRAIN_HPP
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <utility>
+#include <vector>
+
+#include "frustum.hpp"
+#include "job_system.hpp"
+#include "shader.hpp"
+#include "stream_buffer.hpp"
+
+struct TerrainSettings {
+  float size = 4096.0f;  // square, centered on the origin
+  int resolution = 2048;  // height samples per side
+  float amplitude = 28.0f;
+  float frequency = 1.0f / 320.0f;
+  uint32_t seed = 4242;
+  // the spawn area stays flat at plazaHeight out to plazaExtent (in x and
+  // z), then blends into the hills over plazaBlend
+  float plazaHeight = 0.0f;
+  float plazaExtent = 100.0f;
+  float plazaBlend = 60.0f;
+};
+
+// Heightmap terrain drawn with CDLOD: one N x N grid mesh reused for every
+// node, displaced in Shader/terrain.vs from the height texture. A quadtree
+// over the map (with min/max heights per node) picks nodes so that each
+// level covers a ring twice as far out as the one before, and vertices morph
+// into the next level's grid over the outer part of their ring so there are
+// no seams or pops. The triangle count depends on the LOD distance, not on
+// the terrain size.
+class Terrain {
+ public:
+  Terrain(const TerrainSettings& settings, JobSystem* jobs);
+  ~Terrain();
+  Terrain(const Terrain&) = delete;
+  Terrain& operator=(const Terrain&) = delete;
+
+  // bilinear between samples, exactly what the vertex shader does
+  float HeightAt(float x, float z) const;
+  glm::vec3 NormalAt(float x, float z) const;
+  // conservative height range over a rectangle, from the min/max tree
+  void HeightRange(const glm::vec2& min, const glm::vec2& max, float& low,
+                   float& high) const;
+  // occluders for the CPU rasterizer: a box per finest node within `reach`
+  // of the eye, topped at the node's lowest sample so it's under the
+  // surface everywhere
+  void OccluderBoxes(const glm::vec3& eye, float reach,
+                     std::vector<std::pair<glm::vec3, glm::vec3>>& boxes) const;
+
+  // binds the height map and its placement for any shader that samples it
+  // through TerrainHeight() (terrain.vs, grass.vs)
+  void BindHeightMap(const Shader& shader, int unit) const;
+
+  // lighting/camera uniforms are the caller's, like the other passes
+  void Draw(const Frustum& frustum, const glm::vec3& cameraPos,
+            const Shader& shader);
+
+  // radius of the finest ring; below ~1.7 leaf diagonals a ring can end
+  // before the next level has stopped morphing and cracks open
+  float lodDistance = 96.0f;
+  int NodesDrawn() const { return nodesDrawn; }
+  int TrianglesDrawn() const { return trianglesDrawn; }
+
+ private:
+  static const int GRID = 32;        // cells per node side
+  static const int LEAF_SIZE = 32;   // meters covered by a finest node
+
+  struct Node {
+    glm::vec2 origin;
+    float size;
+    float level;
+  };
+
+  void Generate(JobSystem* jobs);
+  void BuildMinMax();
+  void NodeBounds(int level, int x, int z, glm::vec3& min,
+                  glm::vec3& max) const;
+  void Select(int level, int x, int z, const Frustum& frustum,
+              const glm::vec3& cameraPos);
+
+  TerrainSettings settings;
+  glm::vec2 origin;  // min corner
+  float spacing;     // meters between samples
+  int levelCount;
+  std::vector<float> heights;
+  // per level, min/max height of each node
+  std::vector<std::vector<glm::vec2>> minMax;
+
+  unsigned int heightTexture = 0;
+  unsigned int VAO = 0, VBO = 0, EBO = 0;
+  int fullIndexCount = 0;
+  int halfIndexCount = 0;
+  StreamBuffer* nodeStream = nullptr;
+
+  // full nodes use the whole grid, nodes covering a child's quarter of a
+  // parent are drawn at the parent's density with every other vertex
+  std::vector<Node> fullNodes;
+  std::vector<Node> halfNodes;
+  int nodesDrawn = 0;
+  int trianglesDrawn = 0;
+};
+
+#endif
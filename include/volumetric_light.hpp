@@ -0,0 +1,75 @@
+#ifndef VOLUMETRIC_LIGHT_HPP
+#define VOLUMETRIC_LIGHT_HPP
+
+#include <glm/glm.hpp>
+
+#include "gpu_timer.hpp"
+#include "shader.hpp"
+
+struct VolumetricSettings {
+  int divisor = 2;  // 2 marches at half resolution, 4 at quarter
+  int steps = 24;   // per ray
+  float distance = 80.0f;   // metres marched at most
+  float scattering = 1.0f;  // lit fraction of the fog's extinction
+  float anisotropy = 0.3f;  // Henyey-Greenstein g, forward scattering
+  float history = 0.9f;     // weight of last frame's result where it fits
+};
+
+// Lit fog from the moon and the flashlight, raymarched at a fraction of the
+// screen's resolution. Each low resolution pixel marches from the eye to
+// the scene behind it in `steps` steps, starting at a blue noise offset
+// that shifts every frame, so few steps band into noise instead of
+// stripes. The noise is then averaged away over time: the result is
+// reprojected into last frame's view, and where the history saw the same
+// depth it's blended in, clamped to the colors around the pixel so moving
+// shadows don't leave trails. Composite brings it back to full resolution,
+// weighting the 4 nearest low resolution pixels by how close their depth
+// is to the pixel's. Like FogVolume this only adds light, extinction
+// stays with HeightFog.
+//
+// `shader` (Shader/volumetric_march.fs) needs the scene's light and fog
+// uniforms set by the caller before Render, the same ones default.fs takes.
+class VolumetricLight {
+ public:
+  explicit VolumetricLight(
+      const VolumetricSettings& settings = VolumetricSettings());
+  ~VolumetricLight();
+  VolumetricLight(const VolumetricLight&) = delete;
+  VolumetricLight& operator=(const VolumetricLight&) = delete;
+
+  VolumetricSettings settings;
+  Shader shader;
+
+  // marches and resolves for a `width` x `height` scene depth; leaves the
+  // default framebuffer bound, callers reset their viewport
+  void Render(unsigned int depthTexture, int width, int height,
+              const glm::mat4& view, const glm::mat4& projection,
+              float nearPlane, float farPlane);
+  // additively into the bound framebuffer
+  void Composite(unsigned int depthTexture, int width, int height);
+
+  int Width() const { return width; }  // of the marched target
+  int Height() const { return height; }
+  double MarchMs() const { return marchTimer.Ms(); }  // with the resolve
+  double CompositeMs() const { return compositeTimer.Ms(); }
+
+ private:
+  void Allocate(int w, int h);
+
+  Shader temporalShader;
+  Shader upsampleShader;
+  unsigned int FBO = 0;
+  unsigned int blueNoise = 0;
+  unsigned int marched = 0;       // rgb light, a view depth
+  unsigned int history[2] = {};  // resolved, ping-ponged per frame
+  int width = 0, height = 0;
+  int current = 0;  // history written this frame
+  bool historyValid = false;
+  unsigned int frame = 0;
+  glm::mat4 previousViewProjection = glm::mat4(1.0f);
+  float nearPlane = 0.1f, farPlane = 100.0f;
+  GpuTimer marchTimer;
+  GpuTimer compositeTimer;
+};
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef VOXEL_HPP
+#define VOXEL_HPP
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "frustum.hpp"
+#include "job_system.hpp"
+#include "shader.hpp"
+
+typedef uint16_t BlockId;  // 0 is air
+const int VOXEL_CHUNK = 32;
+
+// 32^3 blocks stored as indices into a per-chunk palette, packed at the
+// fewest bits (0, 1, 2, 4, 8 or 16) that address the palette. A chunk of one
+// block type costs no index memory at all.
+class VoxelChunk {
+ public:
+  VoxelChunk();
+
+  BlockId Get(int x, int y, int z) const;
+  void Set(int x, int y, int z, BlockId block);
+  bool IsEmpty() const { return palette.size() == 1 && palette[0] == 0; }
+  size_t MemoryBytes() const;
+
+ private:
+  static int Index(int x, int y, int z) {
+    return (y * VOXEL_CHUNK + z) * VOXEL_CHUNK + x;
+  }
+  void Repack(int newBits);
+
+  std::vector<BlockId> palette;
+  std::vector<uint64_t> bits;
+  int bitsPerIndex = 0;
+};
+
+// 4 bytes: x, y, z (0..32) 6 bits each, face 3 bits, block 11 bits.
+// Shader/voxel.vs unpacks it.
+struct VoxelVertex {
+  uint32_t packed;
+};
+
+struct VoxelMeshData {
+  std::vector<VoxelVertex> vertices;
+  std::vector<unsigned int> indices;
+};
+
+// Greedy mesher: per axis and slice, builds a mask of the visible faces
+// (solid next to air) and merges equal neighbours into maximal rectangles.
+// neighbors are -x, +x, -y, +y, -z, +z and may be null (treated as air).
+// Each chunk emits only faces of its own blocks, so borders aren't doubled.
+void GreedyMesh(const VoxelChunk& chunk, const VoxelChunk* const neighbors[6],
+                VoxelMeshData& out);
+
+// Meshes `chunks` seeded chunks of rolling ground, caves and loose blocks,
+// some with neighbours, and checks the quads cover exactly the faces a
+// naive one-quad-per-face mesh has, once each, with the same block and
+// wound to face out. Returns how many unit faces differ, plus one if the
+// greedy mesh didn't come out with fewer quads. Headless.
+int VerifyGreedyMesh(int chunks);
+
+// Sparse set of voxel chunks in block coordinates. A block (x, y, z) is a
+// blockSize cube centered on (x, y, z) * blockSize, which lines it up with
+// the instanced cubes in main.cpp.
+class VoxelWorld {
+ public:
+  explicit VoxelWorld(float blockSize);
+  ~VoxelWorld();
+  VoxelWorld(const VoxelWorld&) = delete;
+  VoxelWorld& operator=(const VoxelWorld&) = delete;
+
+  BlockId Get(int x, int y, int z) const;
+  // marks the chunk, and neighbours the block touches, for remeshing
+  void Set(int x, int y, int z, BlockId block);
+  void FillBox(const glm::ivec3& min, const glm::ivec3& max, BlockId block);
+
+  // meshes every dirty chunk on the job system, uploads on this thread
+  int Remesh(JobSystem* jobs);
+
+  // shader is Shader/voxel.vs, uniforms other than "origin" are the caller's
+  void Draw(const Frustum& frustum, const Shader& shader);
+
+  int ChunkCount() const { return (int)chunks.size(); }
+  int QuadCount() const { return quadCount; }
+  size_t VoxelBytes() const;
+  int ChunksDrawn() const { return chunksDrawn; }
+
+ private:
+  struct Coord {
+    int x, y, z;
+    bool operator==(const Coord& o) const {
+      return x == o.x && y == o.y && z == o.z;
+    }
+  };
+  struct CoordHash {
+    size_t operator()(const Coord& c) const {
+      return ((size_t)(uint32_t)c.x * 73856093u) ^
+             ((size_t)(uint32_t)c.y * 19349663u) ^
+             ((size_t)(uint32_t)c.z * 83492791u);
+    }
+  };
+  struct Entry {
+    VoxelChunk voxels;
+    bool dirty = true;
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    int indexCount = 0;
+  };
+
+  static int FloorDiv(int a) {
+    return a >= 0 ? a / VOXEL_CHUNK : -((-a + VOXEL_CHUNK - 1) / VOXEL_CHUNK);
+  }
+  const VoxelChunk* Find(Coord c) const;
+  void MarkDirty(Coord c);
+
+  float blockSize;
+  std::unordered_map<Coord, Entry, CoordHash> chunks;
+  int quadCount = 0;
+  int chunksDrawn = 0;
+};
+
+#endif
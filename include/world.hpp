@@ -0,0 +1,66 @@
+#ifndef WORLD_HPP
+#define WORLD_HPP
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <unordered_map>
+#include <vector>
+
+#include "lod.hpp"
+
+struct ChunkCoord {
+  int x;
+  int z;
+  bool operator==(const ChunkCoord& o) const { return x == o.x && z == o.z; }
+};
+
+struct ChunkCoordHash {
+  size_t operator()(const ChunkCoord& c) const {
+    return ((uint64_t)(uint32_t)c.x << 32) ^ (uint32_t)c.z;
+  }
+};
+
+// placement of one tree, plain data so it can be written to disk as is
+struct TreeInstance {
+  glm::vec3 position;  // base of the trunk
+  float scale;
+  float yaw;  // radians
+};
+
+// a square column of the world, chunkSize wide on x/z
+struct Chunk {
+  ChunkCoord coord;
+  glm::vec3 boundsMin = glm::vec3(0.0f);
+  glm::vec3 boundsMax = glm::vec3(0.0f);
+
+  std::vector<TreeInstance> trees;
+  // derived render data, rebuilt by FinalizeTrees
+  std::vector<glm::mat4> treeMatrices;
+  std::vector<LodState> treeLod;
+
+  // builds the matrices and grows the bounds to fit the tree mesh bounds
+  void FinalizeTrees(const glm::vec3& meshMin, const glm::vec3& meshMax);
+
+  // heap memory held by the chunk, for the streaming budget
+  size_t MemoryBytes() const;
+};
+
+// The world's spatial structure: a sparse grid of chunks keyed by their
+// integer x/z coordinate. Generators and loaders write straight into it,
+// renderers and queries walk the chunks overlapping what they need.
+class World {
+ public:
+  explicit World(float chunkSize = 64.0f);
+
+  float chunkSize;
+  std::unordered_map<ChunkCoord, Chunk, ChunkCoordHash> chunks;
+
+  ChunkCoord ChunkAt(float x, float z) const;
+  glm::vec2 ChunkOrigin(ChunkCoord c) const;  // min x/z corner
+  Chunk& GetChunk(ChunkCoord c);              // creates it if missing
+  Chunk* FindChunk(ChunkCoord c);
+
+  size_t TreeCount() const;
+};
+
+#endif
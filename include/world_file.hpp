@@ -0,0 +1,131 @@
+#ifndef WORLD_FILE_HPP
+#define WORLD_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "world.hpp"
+
+// Binary world file, little endian, everything plain data:
+//
+//   WorldFileHeader
+//   chunk blobs, each starting on a 64 byte boundary
+//   WorldFileChunk directory (chunkCount entries, sorted by x then z)
+//
+// A blob starts with its WorldFileSection table followed by the section
+// arrays, each 16 byte aligned relative to the blob. Blobs may be LZ4
+// compressed as a whole; uncompressed ones are read straight out of the
+// mapping without a copy.
+const uint32_t WORLD_FILE_VERSION = 1;
+
+enum WorldSectionType : uint32_t {
+  WORLD_SECTION_TREES = 1,     // TreeInstance[]
+  WORLD_SECTION_VERTICES = 2,  // Vertex[]
+  WORLD_SECTION_INDICES = 3,   // unsigned int[]
+};
+
+enum WorldCompression : uint32_t {
+  WORLD_COMPRESSION_NONE = 0,
+  WORLD_COMPRESSION_LZ4 = 1,
+};
+
+struct WorldFileHeader {
+  char magic[4];  // "HWLD"
+  uint32_t version;
+  float chunkSize;
+  uint32_t chunkCount;
+  uint64_t directoryOffset;
+  uint64_t reserved;
+};
+
+struct WorldFileChunk {
+  int32_t x;
+  int32_t z;
+  uint64_t offset;      // of the blob, from the start of the file
+  uint64_t storedSize;  // bytes in the file
+  uint64_t rawSize;     // bytes once decompressed
+  uint32_t compression;
+  uint32_t sectionCount;
+};
+
+struct WorldFileSection {
+  uint32_t type;
+  uint32_t elementSize;  // sizeof the element when written, checked on read
+  uint64_t offset;       // from the start of the blob
+  uint64_t count;
+};
+
+// read-only view into the mapping (or a caller's scratch buffer)
+template <typename T>
+struct Span {
+  const T* data = nullptr;
+  size_t size = 0;
+
+  const T* begin() const { return data; }
+  const T* end() const { return data + size; }
+  const T& operator[](size_t i) const { return data[i]; }
+  bool empty() const { return size == 0; }
+};
+
+// Writes the trees of every chunk in `world`. Chunks whose blob doesn't
+// shrink stay uncompressed even with `compress` set. The file is written
+// next to `path` and renamed over it, so a reader mapping the old one keeps
+// working.
+bool WriteWorldFile(const std::string& path, const World& world,
+                    bool compress);
+
+// Maps a world file and hands out spans into it. Const methods are safe to
+// call from several threads at once.
+class WorldFileReader {
+ public:
+  WorldFileReader() = default;
+  ~WorldFileReader();
+  WorldFileReader(const WorldFileReader&) = delete;
+  WorldFileReader& operator=(const WorldFileReader&) = delete;
+
+  bool Open(const std::string& path);
+  void Close();
+  bool IsOpen() const { return mapping != nullptr; }
+
+  float ChunkSize() const { return header->chunkSize; }
+  size_t FileSize() const { return fileSize; }
+  int ChunkCount() const { return (int)header->chunkCount; }
+  const WorldFileChunk& Entry(int chunk) const { return directory[chunk]; }
+  int Find(ChunkCoord coord) const;  // -1 if the file doesn't have it
+
+  // Zero-copy when the chunk is stored raw. Compressed chunks are unpacked
+  // into `scratch` and the span points there, so keep it alive meanwhile.
+  // Empty span if the chunk has no such section or the file is damaged.
+  template <typename T>
+  Span<T> Section(int chunk, WorldSectionType type,
+                  std::vector<uint8_t>& scratch) const {
+    Span<T> span;
+    const uint8_t* bytes = FindSection(chunk, type, sizeof(T), scratch,
+                                       span.size);
+    span.data = reinterpret_cast<const T*>(bytes);
+    return span;
+  }
+
+ private:
+  const uint8_t* FindSection(int chunk, uint32_t type, size_t elementSize,
+                             std::vector<uint8_t>& scratch,
+                             size_t& count) const;
+
+  int fd = -1;
+  const uint8_t* mapping = nullptr;
+  size_t fileSize = 0;
+  const WorldFileHeader* header = nullptr;
+  const WorldFileChunk* directory = nullptr;
+};
+
+// Round trip check: reads `path` back and compares it chunk by chunk with
+// `world`. Returns how many chunks differ, -1 if the file can't be opened.
+int VerifyWorldFile(const std::string& path, const World& world);
+
+// Reads every tree section of the file and returns MB/s of section data,
+// compressed chunks include the time to unpack them
+double BenchmarkWorldFileLoad(const std::string& path);
+
+#endif
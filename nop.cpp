@@ -53,6 +53,44 @@ int main(int argc, char** argv) {
       {"src/main.cpp", "build/main.o"},
       {"src/camera.cpp", "build/camera.o"},
       {"src/shader.cpp", "build/shader.o"},
+      {"src/gl_ext.cpp", "build/gl_ext.o"},
+      {"src/frustum.cpp", "build/frustum.o"},
+      {"src/stream_buffer.cpp", "build/stream_buffer.o"},
+      {"src/gpu_culling.cpp", "build/gpu_culling.o"},
+      {"src/render_target.cpp", "build/render_target.o"},
+      {"src/hiz.cpp", "build/hiz.o"},
+      {"src/job_system.cpp", "build/job_system.o"},
+      {"src/occlusion_raster.cpp", "build/occlusion_raster.o"},
+      {"src/mesh.cpp", "build/mesh.o"},
+      {"src/mesh_simplify.cpp", "build/mesh_simplify.o"},
+      {"src/lod.cpp", "build/lod.o"},
+      {"src/world.cpp", "build/world.o"},
+      {"src/forest.cpp", "build/forest.o"},
+      {"src/impostor.cpp", "build/impostor.o"},
+      {"src/grass.cpp", "build/grass.o"},
+      {"src/chunk_streamer.cpp", "build/chunk_streamer.o"},
+      {"src/block_compress.cpp", "build/block_compress.o"},
+      {"src/world_file.cpp", "build/world_file.o"},
+      {"src/voxel.cpp", "build/voxel.o"},
+      {"src/voxel_mesh.cpp", "build/voxel_mesh.o"},
+      {"src/terrain.cpp", "build/terrain.o"},
+      {"src/collision.cpp", "build/collision.o"},
+      {"src/character_controller.cpp", "build/character_controller.o"},
+      {"src/broadphase.cpp", "build/broadphase.o"},
+      {"src/navmesh.cpp", "build/navmesh.o"},
+      {"src/navmesh_build.cpp", "build/navmesh_build.o"},
+      {"src/pathfinder.cpp", "build/pathfinder.o"},
+      {"src/flow_field.cpp", "build/flow_field.o"},
+      {"src/raycast.cpp", "build/raycast.o"},
+      {"src/ai_scheduler.cpp", "build/ai_scheduler.o"},
+      {"src/ecs.cpp", "build/ecs.o"},
+      {"src/spotlight.cpp", "build/spotlight.o"},
+      {"src/gpu_timer.cpp", "build/gpu_timer.o"},
+      {"src/cascaded_shadow.cpp", "build/cascaded_shadow.o"},
+      {"src/clustered_lights.cpp", "build/clustered_lights.o"},
+      {"src/cluster_grid.cpp", "build/cluster_grid.o"},
+      {"src/fog.cpp", "build/fog.o"},
+      {"src/volumetric_light.cpp", "build/volumetric_light.o"},
       {"src/stb_image.cpp", "build/stb_image.o"}};
 
   std::string all_objs = "build/glad.o ";
@@ -67,9 +105,29 @@ int main(int argc, char** argv) {
   // Linking (Always run this or check if any .o is newer than the binary)
   run_cmd(cxx + " " + all_objs + "-o build/game " + lib);
 
+  // Headless checks and benchmarks: their own main linked against the
+  // objects above that don't touch GL, so no window or GL libraries
+  if (needs_rebuild("src/bench.cpp", "build/bench.o")) {
+    run_cmd(cxx + " " + flags + " -c src/bench.cpp -o build/bench.o " + inc);
+  }
+  std::vector<std::string> bench_objs = {
+      "build/bench.o", "build/job_system.o", "build/occlusion_raster.o",
+      "build/world.o", "build/forest.o", "build/block_compress.o",
+      "build/world_file.o", "build/chunk_streamer.o", "build/collision.o",
+      "build/character_controller.o",
+      "build/broadphase.o", "build/navmesh.o", "build/navmesh_build.o",
+      "build/pathfinder.o", "build/flow_field.o", "build/raycast.o",
+      "build/voxel_mesh.o", "build/cluster_grid.o", "build/ecs.o"};
+  std::string bench_link = cxx;
+  for (const auto& obj : bench_objs) bench_link += " " + obj;
+  run_cmd(bench_link + " -o build/bench");
+
   if (argc > 1 && std::string(argv[1]) == "run") {
     run_cmd("./build/game");
   }
+  if (argc > 1 && std::string(argv[1]) == "bench") {
+    run_cmd("./build/bench");
+  }
 
   return 0;
 }
@@ -0,0 +1,162 @@
+#include "ai_scheduler.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+const int CYCLE = AI_LOD_INTERVAL[AI_LOD_COUNT - 1];
+
+double MillisecondsSince(std::chrono::high_resolution_clock::time_point t) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::high_resolution_clock::now() - t)
+      .count();
+}
+
+}  // namespace
+
+AiScheduler::AiScheduler(JobSystem* jobs, const AiSettings& settings)
+    : settings(settings), jobs(jobs) {}
+
+uint32_t AiScheduler::Add(
+    std::function<glm::vec3()> position,
+    std::function<void(const AiSnapshot&, const glm::vec3&, float)> think,
+    float relevance) {
+  uint32_t id;
+  if (!freeIds.empty()) {
+    id = freeIds.back();
+    freeIds.pop_back();
+  } else {
+    id = (uint32_t)agents.size();
+    agents.emplace_back();
+  }
+  Agent& agent = agents[id];
+  agent.alive = true;
+  agent.position = std::move(position);
+  agent.think = std::move(think);
+  agent.relevance = std::max(relevance, 0.01f);
+  agent.lastTick = time;
+  // thinks every frame until the first Update knows better
+  Place(agent, AI_LOD_FULL);
+  agentCount++;
+  return id;
+}
+
+void AiScheduler::Remove(uint32_t id) {
+  if (id >= agents.size() || !agents[id].alive) return;
+  Unplace(agents[id]);
+  agents[id] = Agent();
+  freeIds.push_back(id);
+  agentCount--;
+}
+
+float AiScheduler::PeakMs() const {
+  return *std::max_element(history, history + HISTORY);
+}
+
+AiLod AiScheduler::PickLod(const Agent& agent, const glm::vec3& position,
+                           const AiSnapshot& snapshot) const {
+  float distance = glm::length(position - snapshot.playerPosition);
+  glm::vec3 toAgent = position - snapshot.cameraPosition;
+  if (glm::dot(toAgent, snapshot.cameraFront) < 0.0f) {
+    distance *= settings.offscreenScale;
+  }
+  distance /= agent.relevance;
+  // stay put until the distance is well past the line either way
+  const float lines[AI_LOD_COUNT - 1] = {
+      settings.fullDistance, settings.nearDistance, settings.midDistance};
+  int lod = (int)agent.lod;
+  while (lod > 0 &&
+         distance < lines[lod - 1] * (1.0f - settings.hysteresis)) {
+    lod--;
+  }
+  while (lod < AI_LOD_COUNT - 1 &&
+         distance > lines[lod] * (1.0f + settings.hysteresis)) {
+    lod++;
+  }
+  return (AiLod)lod;
+}
+
+void AiScheduler::Place(Agent& agent, AiLod lod) {
+  // the phase whose frames are least busy over the whole cycle
+  int interval = AI_LOD_INTERVAL[lod];
+  int best = 0, bestLoad = 0;
+  for (int phase = 0; phase < interval; phase++) {
+    int load = 0;
+    for (int slot = phase; slot < CYCLE; slot += interval) {
+      load = std::max(load, slotLoad[slot]);
+    }
+    if (phase == 0 || load < bestLoad) {
+      best = phase;
+      bestLoad = load;
+    }
+  }
+  agent.lod = lod;
+  agent.phase = best;
+  for (int slot = best; slot < CYCLE; slot += interval) slotLoad[slot]++;
+}
+
+void AiScheduler::Unplace(const Agent& agent) {
+  int interval = AI_LOD_INTERVAL[agent.lod];
+  for (int slot = agent.phase; slot < CYCLE; slot += interval) {
+    slotLoad[slot]--;
+  }
+}
+
+void AiScheduler::Update(AiSnapshot& snapshot, float deltaTime) {
+  auto start = std::chrono::high_resolution_clock::now();
+  frame++;
+  time += deltaTime;
+  snapshot.frame = frame;
+  snapshot.time = time;
+  snapshot.agentPositions.resize(agents.size());
+  for (size_t id = 0; id < agents.size(); id++) {
+    if (agents[id].alive) snapshot.agentPositions[id] = agents[id].position();
+  }
+
+  due.clear();
+  std::fill(lodCounts, lodCounts + AI_LOD_COUNT, 0);
+  int slot = (int)(frame % CYCLE);
+  for (size_t id = 0; id < agents.size(); id++) {
+    Agent& agent = agents[id];
+    if (!agent.alive) continue;
+    AiLod lod = PickLod(agent, snapshot.agentPositions[id], snapshot);
+    if (lod != agent.lod) {
+      Unplace(agent);
+      Place(agent, lod);
+    }
+    lodCounts[agent.lod]++;
+    if (slot % AI_LOD_INTERVAL[agent.lod] == agent.phase) {
+      due.push_back((uint32_t)id);
+    }
+  }
+
+  auto thinkRange = [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      Agent& agent = agents[due[i]];
+      auto t = std::chrono::high_resolution_clock::now();
+      agent.think(snapshot, snapshot.agentPositions[due[i]],
+                  time - agent.lastTick);
+      agent.ms = MillisecondsSince(t);
+    }
+  };
+  int count = (int)due.size();
+  if (jobs && count > 1) {
+    // a few chunks per thread so a slow agent doesn't hold up the rest
+    int chunks = (int)jobs->ThreadCount() * 4 + 1;
+    jobs->ParallelFor(count, std::max(1, (count + chunks - 1) / chunks),
+                      thinkRange);
+  } else {
+    thinkRange(0, count);
+  }
+  thinkMs = 0.0;
+  for (uint32_t id : due) {
+    agents[id].lastTick = time;
+    thinkMs += agents[id].ms;
+  }
+
+  ticksLastFrame = count;
+  wallMs = MillisecondsSince(start);
+  history[historyAt] = (float)wallMs;
+  historyAt = (historyAt + 1) % HISTORY;
+}
@@ -0,0 +1,228 @@
+// Headless checks and benchmarks. Nothing here opens a window or needs a GL
+// context, so it runs on a build machine: `./nop bench` builds and runs all
+// of them, `build/bench occlusion ...` only the named ones. The exit code is
+// the number of checks that failed.
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "broadphase.hpp"
+#include "character_controller.hpp"
+#include "chunk_streamer.hpp"
+#include "clustered_lights.hpp"
+#include "collision.hpp"
+#include "ecs.hpp"
+#include "flow_field.hpp"
+#include "forest.hpp"
+#include "job_system.hpp"
+#include "navmesh.hpp"
+#include "occlusion_raster.hpp"
+#include "pathfinder.hpp"
+#include "raycast.hpp"
+#include "voxel.hpp"
+#include "world_file.hpp"
+
+namespace {
+
+struct Bench {
+  const char* name;
+  bool (*run)(JobSystem& jobs);  // false when a check failed
+};
+
+bool Occlusion(JobSystem& jobs) {
+  int differ = VerifyOcclusionKernels(4000);
+  int wrong = VerifyOcclusionQueries(&jobs);
+  BenchmarkOcclusionRaster(4000, 100, &jobs);
+  return differ == 0 && wrong == 0;
+}
+
+// 2 km a side, 4 km^2
+bool Forest(JobSystem& jobs) { return BenchmarkForest(2000.0f, jobs) >= 0.0; }
+
+// Writes a 1 km^2 forest raw and compressed, reads both back, loads one
+// through the streamer and damages it on purpose. The file's forest has
+// another seed than the streamer's, so trees that match came from the file.
+bool WorldFileRoundTrip(JobSystem& jobs) {
+  std::string path =
+      (std::filesystem::temp_directory_path() / "bench_world.bin").string();
+  ForestSettings forest;
+  forest.seed = 35;
+  forest.areaMin = glm::vec2(-512.0f);
+  forest.areaMax = glm::vec2(512.0f);
+  World world(64.0f);
+  GenerateForest(world, forest, &jobs);
+
+  bool ok = true;
+  for (bool compress : {false, true}) {
+    if (!WriteWorldFile(path, world, compress)) return false;
+    int differ = VerifyWorldFile(path, world);
+    double rate = BenchmarkWorldFileLoad(path);
+    std::cout << "World file " << (compress ? "lz4" : "raw") << ": "
+              << world.chunks.size() << " chunks, "
+              << std::filesystem::file_size(path) / 1024 << " KB, " << differ
+              << " differ, load " << rate << " MB/s" << std::endl;
+    ok &= differ == 0;
+  }
+
+  // streamed back in around the origin, not generated
+  WorldFileReader reader;
+  if (!reader.Open(path)) return false;
+  World streamed(64.0f);
+  int loaded = 0, differ = 0;
+  {
+    ChunkStreamer streamer(streamed, jobs, ForestSettings(), glm::vec3(-1.0f),
+                           glm::vec3(1.0f));
+    streamer.settings.loadRadius = 400.0f;
+    streamer.settings.memoryBudget = 1u << 30;
+    streamer.UseWorldFile(&reader);
+    auto start = std::chrono::steady_clock::now();
+    do {
+      streamer.Update(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    } while ((streamer.Loading() > 0 || streamer.Queued() > 0) &&
+             std::chrono::steady_clock::now() - start <
+                 std::chrono::seconds(30));
+  }
+  for (const auto& entry : streamed.chunks) {
+    const Chunk* original = world.FindChunk(entry.first);
+    if (!original) continue;
+    loaded++;
+    const std::vector<TreeInstance>& a = original->trees;
+    const std::vector<TreeInstance>& b = entry.second.trees;
+    if (a.size() != b.size() ||
+        (!a.empty() &&
+         std::memcmp(a.data(), b.data(), a.size() * sizeof(TreeInstance)))) {
+      differ++;
+    }
+  }
+  std::cout << "  streamed from the file: " << loaded << " chunks, " << differ
+            << " differ" << std::endl;
+  ok &= loaded > 0 && differ == 0;
+
+  // a damaged blob and a damaged header must both be caught
+  size_t blob = reader.Entry(reader.ChunkCount() / 2).offset +
+                reader.Entry(reader.ChunkCount() / 2).storedSize / 2;
+  reader.Close();
+  auto damage = [&](size_t at) {
+    std::FILE* file = std::fopen(path.c_str(), "r+b");
+    if (!file) return;
+    std::fseek(file, (long)at, SEEK_SET);
+    int byte = std::fgetc(file);
+    std::fseek(file, (long)at, SEEK_SET);
+    std::fputc(byte ^ 0x5a, file);
+    std::fclose(file);
+  };
+  damage(blob);
+  int damagedBlob = VerifyWorldFile(path, world);
+  damage(0);
+  int damagedHeader = VerifyWorldFile(path, world);
+  std::cout << "  damaged blob: " << damagedBlob
+            << " differ, damaged header: "
+            << (damagedHeader < 0 ? "rejected" : "accepted") << std::endl;
+  ok &= damagedBlob > 0 && damagedHeader < 0;
+  std::filesystem::remove(path);
+  return ok;
+}
+
+bool Sweeps(JobSystem&) {
+  int wrong = VerifyCapsuleSweeps() + VerifyCharacterSlides();
+  double rate = BenchmarkCapsuleSweeps(100000, 1000000);
+  std::cout << "  " << rate / 1e6 << " M sweeps/s on one thread" << std::endl;
+  return wrong == 0 && rate > 0.0;
+}
+
+// both kinds against brute force, then at 10k and 100k bodies, on one
+// thread and on the jobs
+bool BroadphaseBench(JobSystem& jobs) {
+  int differ =
+      VerifyBroadphase(10000, nullptr) + VerifyBroadphase(10000, &jobs);
+  for (BroadphaseType type : {BROADPHASE_SWEEP_AND_PRUNE,
+                              BROADPHASE_SPATIAL_HASH}) {
+    for (int bodies : {10000, 100000}) {
+      BenchmarkBroadphase(type, bodies, 30, nullptr);
+      BenchmarkBroadphase(type, bodies, 30, &jobs);
+    }
+  }
+  return differ == 0;
+}
+
+// a navmesh tile has to come back from the disk cache whatever order its
+// shapes got their collision ids in
+bool NavCache(JobSystem& jobs) { return VerifyNavCache(jobs) == 0; }
+
+// 6 x 6 navmesh tiles of forest, HPA* against plain A*
+bool Paths(JobSystem& jobs) { return BenchmarkPathfinding(6, 300, jobs) > 0.0; }
+
+// one field over 3 x 3 tiles, up to 10k agents walking it
+bool Flow(JobSystem& jobs) { return BenchmarkFlowField(3, 10000, jobs) > 0.0; }
+
+// lines of sight through a 500 m forest, the tree built in the background
+bool Raycasts(JobSystem& jobs) {
+  return BenchmarkRaycasts(500.0f, 100000, jobs) > 0.0;
+}
+
+// greedy quads against one quad per visible face
+bool Voxel(JobSystem&) { return VerifyGreedyMesh(64) == 0; }
+
+// every light in every cluster it reaches, then the binning cost
+bool Clusters(JobSystem& jobs) {
+  return VerifyClusterGrid(256, jobs) == 0 &&
+         BenchmarkClusteredLights(256, jobs) > 0.0;
+}
+
+// every entity with the components visited once, then the iteration cost
+bool Ecs(JobSystem& jobs) {
+  return VerifyEcs(20000, jobs) == 0 && BenchmarkEcs(100000, jobs) > 0.0;
+}
+
+const Bench BENCHES[] = {
+    {"occlusion", Occlusion},
+    {"forest", Forest},
+    {"worldfile", WorldFileRoundTrip},
+    {"sweeps", Sweeps},
+    {"broadphase", BroadphaseBench},
+    {"navcache", NavCache},
+    {"paths", Paths},
+    {"flow", Flow},
+    {"raycasts", Raycasts},
+    {"voxel", Voxel},
+    {"clusters", Clusters},
+    {"ecs", Ecs},
+};
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    bool known = false;
+    for (const Bench& bench : BENCHES) {
+      known |= std::strcmp(argv[i], bench.name) == 0;
+    }
+    if (!known) {
+      std::cout << "unknown bench " << argv[i] << ", there are:";
+      for (const Bench& bench : BENCHES) std::cout << " " << bench.name;
+      std::cout << std::endl;
+      return 1;
+    }
+  }
+
+  JobSystem jobs;
+  int failed = 0;
+  for (const Bench& bench : BENCHES) {
+    bool wanted = argc < 2;
+    for (int i = 1; i < argc; i++) {
+      wanted |= std::strcmp(argv[i], bench.name) == 0;
+    }
+    if (!wanted) continue;
+    std::cout << "== " << bench.name << std::endl;
+    if (!bench.run(jobs)) {
+      std::cout << "FAILED: " << bench.name << std::endl;
+      failed++;
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,117 @@
+#include "block_compress.hpp"
+
+#include <cstring>
+
+namespace {
+
+const int MIN_MATCH = 4;
+const size_t LAST_LITERALS = 5;  // the block must end in this many literals
+const size_t MF_LIMIT = 12;      // no match may start closer to the end
+const int HASH_BITS = 12;
+const size_t MAX_OFFSET = 65535;
+
+uint32_t Read32(const uint8_t* p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+uint32_t HashOf(uint32_t v) { return (v * 2654435761U) >> (32 - HASH_BITS); }
+
+void WriteLength(std::vector<uint8_t>& out, size_t length) {
+  while (length >= 255) {
+    out.push_back(255);
+    length -= 255;
+  }
+  out.push_back((uint8_t)length);
+}
+
+void EmitSequence(std::vector<uint8_t>& out, const uint8_t* literals,
+                  size_t literalCount, size_t offset, size_t matchLength) {
+  size_t matchCode = matchLength ? matchLength - MIN_MATCH : 0;
+  uint8_t token = (uint8_t)((literalCount < 15 ? literalCount : 15) << 4);
+  token |= (uint8_t)(matchCode < 15 ? matchCode : 15);
+  out.push_back(token);
+  if (literalCount >= 15) WriteLength(out, literalCount - 15);
+  out.insert(out.end(), literals, literals + literalCount);
+  if (matchLength == 0) return;  // last sequence has no match
+  out.push_back((uint8_t)(offset & 0xff));
+  out.push_back((uint8_t)(offset >> 8));
+  if (matchCode >= 15) WriteLength(out, matchCode - 15);
+}
+
+}  // namespace
+
+std::vector<uint8_t> CompressLZ4(const uint8_t* src, size_t size) {
+  std::vector<uint8_t> out;
+  out.reserve(size + size / 255 + 16);
+
+  size_t anchor = 0;
+  if (size > MF_LIMIT) {
+    std::vector<uint32_t> table(1 << HASH_BITS, 0xffffffffU);
+    size_t limit = size - MF_LIMIT;
+    size_t ip = 0;
+    while (ip < limit) {
+      uint32_t sequence = Read32(src + ip);
+      uint32_t h = HashOf(sequence);
+      uint32_t ref = table[h];
+      table[h] = (uint32_t)ip;
+      if (ref == 0xffffffffU || ip - ref > MAX_OFFSET ||
+          Read32(src + ref) != sequence) {
+        ip++;
+        continue;
+      }
+
+      size_t length = MIN_MATCH;
+      size_t matchEnd = size - LAST_LITERALS;
+      while (ip + length < matchEnd && src[ref + length] == src[ip + length]) {
+        length++;
+      }
+      EmitSequence(out, src + anchor, ip - anchor, ip - ref, length);
+      ip += length;
+      anchor = ip;
+    }
+  }
+  EmitSequence(out, src + anchor, size - anchor, 0, 0);
+  return out;
+}
+
+bool DecompressLZ4(const uint8_t* src, size_t srcSize, uint8_t* dst,
+                   size_t dstSize) {
+  const uint8_t* ip = src;
+  const uint8_t* end = src + srcSize;
+  size_t op = 0;
+
+  auto readLength = [&](size_t& length) {
+    uint8_t b;
+    do {
+      if (ip >= end) return false;
+      b = *ip++;
+      length += b;
+    } while (b == 255);
+    return true;
+  };
+
+  while (ip < end) {
+    uint8_t token = *ip++;
+    size_t literals = token >> 4;
+    if (literals == 15 && !readLength(literals)) return false;
+    if ((size_t)(end - ip) < literals || dstSize - op < literals) return false;
+    std::memcpy(dst + op, ip, literals);
+    ip += literals;
+    op += literals;
+    if (ip == end) break;  // last sequence
+
+    if (end - ip < 2) return false;
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > op) return false;
+    size_t length = token & 15;
+    if (length == 15 && !readLength(length)) return false;
+    length += MIN_MATCH;
+    if (dstSize - op < length) return false;
+    // byte by byte, matches may overlap their own output
+    for (size_t i = 0; i < length; i++, op++) dst[op] = dst[op - offset];
+  }
+  return op == dstSize;
+}
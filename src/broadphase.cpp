@@ -0,0 +1,378 @@
+#include "broadphase.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+#include <random>
+
+namespace {
+
+uint64_t CellKey(int x, int z) {
+  return ((uint64_t)(uint32_t)x << 32) | (uint32_t)z;
+}
+
+uint32_t Slot(uint64_t cell, int bits) {
+  return (uint32_t)((cell * 0x9e3779b97f4a7c15ULL) >> (64 - bits));
+}
+
+// job sized ranges, a few per thread so uneven ones even out
+int Grain(int count, JobSystem* jobs) {
+  int threads = jobs ? (int)jobs->ThreadCount() + 1 : 1;
+  return std::max(256, (count + threads * 4 - 1) / (threads * 4));
+}
+
+}  // namespace
+
+Broadphase::Broadphase(BroadphaseType type, float cellSize)
+    : type(type), cellSize(cellSize) {}
+
+uint32_t Broadphase::Add(const glm::vec3& min, const glm::vec3& max) {
+  uint32_t id;
+  if (!freeIds.empty()) {
+    id = freeIds.back();
+    freeIds.pop_back();
+  } else {
+    id = (uint32_t)alive.size();
+    minX.push_back(0.0f);
+    minY.push_back(0.0f);
+    minZ.push_back(0.0f);
+    maxX.push_back(0.0f);
+    maxY.push_back(0.0f);
+    maxZ.push_back(0.0f);
+    alive.push_back(0);
+  }
+  alive[id] = 1;
+  Move(id, min, max);
+  orderDirty = true;
+  return id;
+}
+
+void Broadphase::Move(uint32_t id, const glm::vec3& min,
+                      const glm::vec3& max) {
+  minX[id] = min.x;
+  minY[id] = min.y;
+  minZ[id] = min.z;
+  maxX[id] = max.x;
+  maxY[id] = max.y;
+  maxZ[id] = max.z;
+}
+
+void Broadphase::Remove(uint32_t id) {
+  if (id >= alive.size() || !alive[id]) return;
+  alive[id] = 0;
+  freeIds.push_back(id);
+  orderDirty = true;
+}
+
+void Broadphase::FindPairs(JobSystem* jobs) {
+  auto start = std::chrono::high_resolution_clock::now();
+
+  previous.swap(pairs);
+  pairs.clear();
+  if (type == BROADPHASE_SPATIAL_HASH) {
+    SpatialHash(jobs);
+  } else {
+    SweepAndPrune(jobs);
+  }
+  size_t total = 0;
+  for (const auto& list : partial) total += list.size();
+  pairs.reserve(total);
+  for (const auto& list : partial) {
+    pairs.insert(pairs.end(), list.begin(), list.end());
+  }
+  // sorted, so the result doesn't depend on how the jobs split the work and
+  // the events are two set differences
+  std::sort(pairs.begin(), pairs.end());
+
+  began.clear();
+  ended.clear();
+  std::set_difference(pairs.begin(), pairs.end(), previous.begin(),
+                      previous.end(), std::back_inserter(began));
+  std::set_difference(previous.begin(), previous.end(), pairs.begin(),
+                      pairs.end(), std::back_inserter(ended));
+
+  lastMs = std::chrono::duration<double, std::milli>(
+               std::chrono::high_resolution_clock::now() - start)
+               .count();
+}
+
+void Broadphase::SweepAndPrune(JobSystem* jobs) {
+  if (orderDirty) {
+    order.clear();
+    for (uint32_t id = 0; id < alive.size(); id++) {
+      if (alive[id]) order.push_back(id);
+    }
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+      return minX[a] < minX[b];
+    });
+    orderDirty = false;
+  } else {
+    // bodies only moved a little since last frame, so the old order is
+    // almost sorted and an insertion sort is close to linear
+    for (size_t i = 1; i < order.size(); i++) {
+      uint32_t id = order[i];
+      float key = minX[id];
+      size_t j = i;
+      while (j > 0 && minX[order[j - 1]] > key) {
+        order[j] = order[j - 1];
+        j--;
+      }
+      order[j] = id;
+    }
+  }
+
+  int count = (int)order.size();
+  sortedMinX.resize(count);
+  sortedMaxX.resize(count);
+  sortedMinY.resize(count);
+  sortedMaxY.resize(count);
+  sortedMinZ.resize(count);
+  sortedMaxZ.resize(count);
+  for (int i = 0; i < count; i++) {
+    uint32_t id = order[i];
+    sortedMinX[i] = minX[id];
+    sortedMaxX[i] = maxX[id];
+    sortedMinY[i] = minY[id];
+    sortedMaxY[i] = maxY[id];
+    sortedMinZ[i] = minZ[id];
+    sortedMaxZ[i] = maxZ[id];
+  }
+
+  int grain = Grain(count, jobs);
+  partial.resize(std::max(1, (count + grain - 1) / grain));
+  for (auto& list : partial) list.clear();
+
+  auto sweep = [&](int begin, int end) {
+    std::vector<BroadphasePair>& out = partial[begin / grain];
+    std::vector<uint8_t> hits;
+    for (int i = begin; i < end; i++) {
+      // candidates: everything starting before this box ends on x
+      float reach = sortedMaxX[i];
+      int last = i + 1;
+      while (last < count && sortedMinX[last] <= reach) last++;
+      int candidates = last - i - 1;
+      if (candidates == 0) continue;
+
+      // branch free y/z test over the contiguous run, then compact
+      hits.resize(candidates);
+      float y0 = sortedMinY[i], y1 = sortedMaxY[i];
+      float z0 = sortedMinZ[i], z1 = sortedMaxZ[i];
+      const float* minYs = &sortedMinY[i + 1];
+      const float* maxYs = &sortedMaxY[i + 1];
+      const float* minZs = &sortedMinZ[i + 1];
+      const float* maxZs = &sortedMaxZ[i + 1];
+      for (int j = 0; j < candidates; j++) {
+        hits[j] = (uint8_t)((minYs[j] <= y1) & (maxYs[j] >= y0) &
+                            (minZs[j] <= z1) & (maxZs[j] >= z0));
+      }
+      uint32_t a = order[i];
+      for (int j = 0; j < candidates; j++) {
+        if (!hits[j]) continue;
+        uint32_t b = order[i + 1 + j];
+        out.push_back({std::min(a, b), std::max(a, b)});
+      }
+    }
+  };
+  if (jobs) {
+    jobs->ParallelFor(count, grain, sweep);
+  } else {
+    sweep(0, count);
+  }
+}
+
+void Broadphase::SpatialHash(JobSystem* jobs) {
+  entries.clear();
+  for (uint32_t id = 0; id < alive.size(); id++) {
+    if (!alive[id]) continue;
+    int x0 = (int)std::floor(minX[id] / cellSize);
+    int z0 = (int)std::floor(minZ[id] / cellSize);
+    int x1 = (int)std::floor(maxX[id] / cellSize);
+    int z1 = (int)std::floor(maxZ[id] / cellSize);
+    for (int z = z0; z <= z1; z++) {
+      for (int x = x0; x <= x1; x++) entries.push_back({CellKey(x, z), id});
+    }
+  }
+
+  // counting sort into a table about twice the entry count, every slot's
+  // entries end up next to each other
+  int bits = 6;
+  while ((size_t)1 << bits < entries.size() * 2) bits++;
+  int slots = 1 << bits;
+  slotStart.assign(slots + 1, 0);
+  for (const CellEntry& entry : entries) {
+    slotStart[Slot(entry.cell, bits) + 1]++;
+  }
+  for (int i = 0; i < slots; i++) slotStart[i + 1] += slotStart[i];
+  bucketed.resize(entries.size());
+  {
+    std::vector<uint32_t> cursor(slotStart.begin(), slotStart.end() - 1);
+    for (const CellEntry& entry : entries) {
+      bucketed[cursor[Slot(entry.cell, bits)]++] = entry;
+    }
+  }
+
+  int grain = Grain(slots, jobs);
+  partial.resize((slots + grain - 1) / grain);
+  for (auto& list : partial) list.clear();
+
+  auto test = [&](int begin, int end) {
+    std::vector<BroadphasePair>& out = partial[begin / grain];
+    for (int slot = begin; slot < end; slot++) {
+      uint32_t first = slotStart[slot];
+      uint32_t last = slotStart[slot + 1];
+      for (uint32_t i = first; i < last; i++) {
+        const CellEntry& p = bucketed[i];
+        for (uint32_t j = i + 1; j < last; j++) {
+          const CellEntry& q = bucketed[j];
+          // different cells can share a slot
+          if (p.cell != q.cell) continue;
+          uint32_t a = p.id, b = q.id;
+          if (minX[a] > maxX[b] || minX[b] > maxX[a] || minY[a] > maxY[b] ||
+              minY[b] > maxY[a] || minZ[a] > maxZ[b] || minZ[b] > maxZ[a]) {
+            continue;
+          }
+          // only the cell with the overlap's min corner reports the pair
+          int ox = (int)std::floor(std::max(minX[a], minX[b]) / cellSize);
+          int oz = (int)std::floor(std::max(minZ[a], minZ[b]) / cellSize);
+          if (CellKey(ox, oz) != p.cell) continue;
+          out.push_back({std::min(a, b), std::max(a, b)});
+        }
+      }
+    }
+  };
+  if (jobs) {
+    jobs->ParallelFor(slots, grain, test);
+  } else {
+    test(0, slots);
+  }
+}
+
+int VerifyBroadphase(int bodies, JobSystem* jobs) {
+  std::mt19937 rng(39);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  // mixed sizes, some long and thin, a few big enough to span many cells
+  float extent = std::sqrt((float)bodies) * 3.0f;
+  std::vector<glm::vec3> mins(bodies), maxs(bodies);
+  auto place = [&](int i) {
+    glm::vec3 size(0.2f + 1.8f * unit(rng), 0.2f + 1.8f * unit(rng),
+                   0.2f + 1.8f * unit(rng));
+    if (unit(rng) < 0.1f) size.x *= 5.0f;
+    if (unit(rng) < 0.01f) size *= 4.0f;
+    mins[i] = glm::vec3(unit(rng) * extent, unit(rng) * 3.0f,
+                        unit(rng) * extent);
+    // now and then exactly against the one before, which counts as touching
+    if (i % 20 == 1) mins[i] = glm::vec3(maxs[i - 1].x, mins[i - 1].y,
+                                         mins[i - 1].z);
+    maxs[i] = mins[i] + size;
+  };
+  Broadphase sweep(BROADPHASE_SWEEP_AND_PRUNE, 2.0f);
+  Broadphase hash(BROADPHASE_SPATIAL_HASH, 2.0f);
+  std::vector<uint32_t> ids(bodies);
+  for (int i = 0; i < bodies; i++) {
+    place(i);
+    ids[i] = sweep.Add(mins[i], maxs[i]);
+    hash.Add(mins[i], maxs[i]);
+  }
+
+  std::vector<BroadphasePair> expected;
+  int differ = 0;
+  // the first frame sorts from scratch, the second moves a tenth of the
+  // bodies and removes and re-adds a few, so freed ids come back
+  for (int frame = 0; frame < 2; frame++) {
+    if (frame == 1) {
+      for (int i = 0; i < bodies; i += 10) {
+        place(i);
+        sweep.Move(ids[i], mins[i], maxs[i]);
+        hash.Move(ids[i], mins[i], maxs[i]);
+      }
+      for (int i = 5; i < bodies; i += 50) {
+        sweep.Remove(ids[i]);
+        hash.Remove(ids[i]);
+        place(i);
+        ids[i] = sweep.Add(mins[i], maxs[i]);
+        hash.Add(mins[i], maxs[i]);
+      }
+    }
+    sweep.FindPairs(jobs);
+    hash.FindPairs(jobs);
+
+    // every pair of boxes, touching counts
+    expected.clear();
+    for (int i = 0; i < bodies; i++) {
+      for (int j = i + 1; j < bodies; j++) {
+        if (mins[i].x > maxs[j].x || mins[j].x > maxs[i].x ||
+            mins[i].y > maxs[j].y || mins[j].y > maxs[i].y ||
+            mins[i].z > maxs[j].z || mins[j].z > maxs[i].z) {
+          continue;
+        }
+        expected.push_back({std::min(ids[i], ids[j]),
+                            std::max(ids[i], ids[j])});
+      }
+    }
+    std::sort(expected.begin(), expected.end());
+    for (const Broadphase* found : {&sweep, &hash}) {
+      std::vector<BroadphasePair> difference;
+      std::set_symmetric_difference(expected.begin(), expected.end(),
+                                    found->Pairs().begin(),
+                                    found->Pairs().end(),
+                                    std::back_inserter(difference));
+      differ += (int)difference.size();
+    }
+  }
+  std::cout << "Broadphase" << (jobs ? " (jobs)" : "") << ": " << bodies
+            << " bodies, " << expected.size() << " pairs by brute force, "
+            << differ << " differ in sweep and prune or the hash"
+            << std::endl;
+  return differ;
+}
+
+double BenchmarkBroadphase(BroadphaseType type, int bodies, int frames,
+                           JobSystem* jobs) {
+  Broadphase broadphase(type, 2.0f);
+  std::mt19937 rng(99);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+  // about one body per 9 m^2, so each one has a handful of neighbours
+  float extent = std::sqrt((float)bodies) * 3.0f;
+  std::vector<glm::vec3> positions(bodies);
+  std::vector<glm::vec3> velocities(bodies);
+  std::vector<uint32_t> ids(bodies);
+  glm::vec3 half(0.5f);
+  for (int i = 0; i < bodies; i++) {
+    positions[i] = glm::vec3(unit(rng) * extent, unit(rng) * 2.0f,
+                             unit(rng) * extent);
+    float angle = unit(rng) * 6.2831853f;
+    velocities[i] =
+        glm::vec3(std::cos(angle), 0.0f, std::sin(angle)) * (2.0f * unit(rng));
+    ids[i] = broadphase.Add(positions[i] - half, positions[i] + half);
+  }
+  broadphase.FindPairs(jobs);  // initial sort
+
+  const float dt = 1.0f / 60.0f;
+  size_t pairCount = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int frame = 0; frame < frames; frame++) {
+    for (int i = 0; i < bodies; i++) {
+      glm::vec3& p = positions[i];
+      glm::vec3& v = velocities[i];
+      p += v * dt;
+      // bounce off the edges of the area
+      if (p.x < 0.0f || p.x > extent) v.x = -v.x;
+      if (p.z < 0.0f || p.z > extent) v.z = -v.z;
+      broadphase.Move(ids[i], p - half, p + half);
+    }
+    broadphase.FindPairs(jobs);
+    pairCount += broadphase.Pairs().size();
+  }
+  double ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::high_resolution_clock::now() - start)
+                  .count();
+  std::cout << "Broadphase "
+            << (type == BROADPHASE_SPATIAL_HASH ? "hash" : "sweep and prune")
+            << (jobs ? " (jobs)" : "") << ": " << bodies << " bodies, "
+            << pairCount / std::max(frames, 1) << " pairs, "
+            << ms / std::max(frames, 1) << " ms/frame" << std::endl;
+  return ms / std::max(frames, 1);
+}
@@ -0,0 +1,174 @@
+#include "cascaded_shadow.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <string>
+
+CascadedShadowMap::CascadedShadowMap(const CascadeSettings& settings)
+    : settings(settings),
+      depthShader("Shader/shadow_depth.vs", "Shader/shadow_depth.fs") {
+  // all layers up front, so changing the cascade count is free
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, settings.size,
+               settings.size, CSM_MAX_CASCADES, 0, GL_DEPTH_COMPONENT,
+               GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE,
+                  GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  glGenFramebuffers(1, &FBO);
+  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0,
+                            0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "ERROR::FRAMEBUFFER:: cascaded shadow map is not complete"
+              << std::endl;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+CascadedShadowMap::~CascadedShadowMap() {
+  glDeleteFramebuffers(1, &FBO);
+  glDeleteTextures(1, &texture);
+  glDeleteProgram(depthShader.ID);
+}
+
+void CascadedShadowMap::Update(const glm::vec3& lightDir,
+                               const glm::vec3& cameraPos,
+                               const glm::vec3& cameraFront,
+                               const glm::vec3& cameraUp, float fovY,
+                               float aspect, float nearPlane,
+                               float farPlane) {
+  frame++;
+  int count = glm::clamp(settings.cascades, 1, CSM_MAX_CASCADES);
+  if (count != cascadeCount) {
+    // different splits, nothing drawn so far fits them
+    for (Cascade& cascade : cascades) cascade.drawn = false;
+    cascadeCount = count;
+  }
+  glm::vec3 light = glm::normalize(lightDir);
+  glm::vec3 lightUp = std::abs(light.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f)
+                                                : glm::vec3(0.0f, 1.0f, 0.0f);
+  glm::vec3 right = glm::normalize(glm::cross(cameraFront, cameraUp));
+  glm::vec3 up = glm::cross(right, cameraFront);
+  float tanY = std::tan(fovY * 0.5f);
+  float tanX = tanY * aspect;
+  float farthest = std::min(farPlane, settings.maxDistance);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+  glViewport(0, 0, settings.size, settings.size);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  glEnable(GL_DEPTH_TEST);
+  glDepthMask(GL_TRUE);
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(2.0f, 4.0f);
+  depthShader.use();
+  depthShader.setMat4("model", glm::mat4(1.0f));
+
+  float splitNear = nearPlane;
+  for (int c = 0; c < cascadeCount; c++) {
+    Cascade& cascade = cascades[c];
+    // practical split scheme: log and uniform blended by lambda
+    float t = (c + 1) / (float)cascadeCount;
+    float logSplit = nearPlane * std::pow(farthest / nearPlane, t);
+    float evenSplit = nearPlane + (farthest - nearPlane) * t;
+    float splitFar = glm::mix(evenSplit, logSplit, settings.lambda);
+    float sliceNear = splitNear;
+    splitNear = splitFar;
+    cascade.splitFar = splitFar;
+
+    int interval = std::max(1, settings.interval[c]);
+    cascade.redrawn = false;
+    if (cascade.drawn && (frame + c) % interval != 0) continue;
+
+    // bounding sphere of the slice, its radius rounded so it holds still
+    glm::vec3 corners[8];
+    glm::vec3 center(0.0f);
+    for (int i = 0; i < 8; i++) {
+      float d = i < 4 ? sliceNear : splitFar;
+      float sx = (i & 1) ? 1.0f : -1.0f;
+      float sy = (i & 2) ? 1.0f : -1.0f;
+      corners[i] = cameraPos + cameraFront * d + right * (sx * tanX * d) +
+                   up * (sy * tanY * d);
+      center += corners[i] * 0.125f;
+    }
+    float radius = 0.0f;
+    for (const glm::vec3& corner : corners) {
+      radius = std::max(radius, glm::length(corner - center));
+    }
+    radius = std::ceil(radius * 4.0f) / 4.0f;
+
+    float depth = 2.0f * radius + settings.casterReach;
+    glm::mat4 view =
+        glm::lookAt(center - light * (radius + settings.casterReach), center,
+                    lightUp);
+    glm::mat4 projection =
+        glm::ortho(-radius, radius, -radius, radius, 0.0f, depth);
+    // move by less than a texel so the world origin lands on a texel:
+    // everything static then maps to the same texels frame to frame
+    glm::vec4 origin = projection * view * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    float half = settings.size * 0.5f;
+    glm::vec2 texels(origin.x * half, origin.y * half);
+    glm::vec2 snap = (glm::vec2(std::round(texels.x), std::round(texels.y)) -
+                      texels) /
+                     half;
+    projection[3][0] += snap.x;
+    projection[3][1] += snap.y;
+    cascade.viewProjection = projection * view;
+    cascade.texelSize = 2.0f * radius / settings.size;
+
+    // world box around the cascade's volume for the caster search
+    glm::mat4 inverse = glm::inverse(cascade.viewProjection);
+    glm::vec3 boxMin(1e30f), boxMax(-1e30f);
+    for (int i = 0; i < 8; i++) {
+      glm::vec4 p = inverse * glm::vec4((i & 1) ? 1.0f : -1.0f,
+                                        (i & 2) ? 1.0f : -1.0f,
+                                        (i & 4) ? 1.0f : -1.0f, 1.0f);
+      glm::vec3 world = glm::vec3(p) / p.w;
+      boxMin = glm::min(boxMin, world);
+      boxMax = glm::max(boxMax, world);
+    }
+
+    timers[c].Begin();
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0,
+                              c);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    depthShader.setMat4("lightViewProjection", cascade.viewProjection);
+    cascade.casters =
+        drawCasters ? drawCasters(c, Frustum(cascade.viewProjection), boxMin,
+                                  boxMax)
+                    : 0;
+    timers[c].End();
+    cascade.drawn = true;
+    cascade.redrawn = true;
+  }
+
+  glDisable(GL_POLYGON_OFFSET_FILL);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void CascadedShadowMap::Bind(const Shader& shader, int unit) const {
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  glActiveTexture(GL_TEXTURE0);
+  shader.setInt("moonShadow", unit);
+  // a cascade that was never drawn has nothing to say yet
+  int drawn = 0;
+  while (drawn < cascadeCount && cascades[drawn].drawn) drawn++;
+  shader.setInt("moonCascades", drawn);
+  for (int c = 0; c < drawn; c++) {
+    std::string index = "[" + std::to_string(c) + "]";
+    shader.setMat4("moonShadowMatrix" + index, cascades[c].viewProjection);
+    shader.setFloat("moonTexelSize" + index, cascades[c].texelSize);
+  }
+}
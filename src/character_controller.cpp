@@ -0,0 +1,211 @@
+#include "character_controller.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+glm::vec3 CharacterController::Bottom(const glm::vec3& feet) const {
+  return feet + glm::vec3(0.0f, radius, 0.0f);
+}
+
+glm::vec3 CharacterController::Top(const glm::vec3& feet) const {
+  return feet + glm::vec3(0.0f, std::max(height - radius, radius), 0.0f);
+}
+
+glm::vec3 CharacterController::Sweep(const CollisionWorld& world,
+                                     const glm::vec3& feet,
+                                     const glm::vec3& motion,
+                                     SweepHit& hit) const {
+  hit = world.SweepCapsule(Bottom(feet), Top(feet), radius, motion);
+  if (!hit.hit) return feet + motion;
+  float length = glm::length(motion);
+  if (length < 1e-6f) return feet;
+  // stop a skin short so the next sweep doesn't start touching
+  float travel = std::max(hit.fraction * length - skin, 0.0f);
+  hit.fraction = travel / length;
+  return feet + motion * hit.fraction;
+}
+
+glm::vec3 CharacterController::Slide(const CollisionWorld& world,
+                                     glm::vec3 feet, glm::vec3 motion,
+                                     glm::vec3* velocity) const {
+  for (int i = 0; i < 4; i++) {
+    if (glm::dot(motion, motion) < 1e-10f) break;
+    SweepHit hit;
+    feet = Sweep(world, feet, motion, hit);
+    if (!hit.hit) break;
+
+    // walls are treated as vertical, climbing is the step's job
+    glm::vec3 normal(hit.normal.x, 0.0f, hit.normal.z);
+    if (glm::dot(normal, normal) < 1e-8f) break;
+    normal = glm::normalize(normal);
+    motion *= 1.0f - hit.fraction;
+    float into = glm::dot(motion, normal);
+    if (into < 0.0f) motion -= normal * into;
+    if (velocity) {
+      into = glm::dot(*velocity, normal);
+      if (into < 0.0f) *velocity -= normal * into;
+    }
+  }
+  return feet;
+}
+
+void CharacterController::Move(const CollisionWorld& world,
+                               glm::vec3& velocity, float deltaTime) {
+  float minUp = std::cos(glm::radians(maxSlope));
+  bool wasGrounded = grounded;
+  grounded = false;
+
+  // streamed in trees (or standing up) can leave the capsule inside a shape
+  position += world.Depenetrate(Bottom(position), Top(position), radius);
+
+  glm::vec3 motion = velocity * deltaTime;
+  glm::vec3 flat(motion.x, 0.0f, motion.z);
+
+  // steep ground ahead only lets the part along its contour through
+  if (glm::dot(flat, flat) > 0.0f) {
+    glm::vec3 target = position + flat;
+    glm::vec3 normal = world.GroundNormal(target.x, target.z);
+    float rise = world.GroundHeight(target.x, target.z) - position.y;
+    glm::vec3 uphill(-normal.x, 0.0f, -normal.z);
+    if (rise > 0.0f && normal.y < minUp && glm::dot(uphill, uphill) > 0.0f) {
+      uphill = glm::normalize(uphill);
+      float into = glm::dot(flat, uphill);
+      if (into > 0.0f) flat -= uphill * into;
+      into = glm::dot(velocity, uphill);
+      if (into > 0.0f) velocity -= uphill * into;
+    }
+  }
+
+  if (glm::dot(flat, flat) > 0.0f) {
+    glm::vec3 plainVelocity = velocity;
+    glm::vec3 plain = Slide(world, position, flat, &plainVelocity);
+    glm::vec3 chosen = plain;
+    glm::vec3 chosenVelocity = plainVelocity;
+
+    // blocked: try the same move lifted by a step, then set it back down
+    glm::vec3 direction = glm::normalize(flat);
+    float wanted = glm::length(flat);
+    float progress = glm::dot(plain - position, direction);
+    if (wasGrounded && stepHeight > 0.0f && progress < wanted - 1e-4f) {
+      SweepHit up;
+      glm::vec3 raised =
+          Sweep(world, position, glm::vec3(0.0f, stepHeight, 0.0f), up);
+      glm::vec3 stepVelocity = velocity;
+      glm::vec3 moved = Slide(world, raised, flat, &stepVelocity);
+      SweepHit down;
+      glm::vec3 lowered = Sweep(
+          world, moved, glm::vec3(0.0f, position.y - raised.y, 0.0f), down);
+      bool walkable = !down.hit || down.normal.y >= minUp;
+      if (!walkable) {
+        // the rim may just rest on an edge, what counts is the surface
+        // under the middle of the capsule: a thin probe straight down, far
+        // enough to reach a slope under the rounded bottom
+        glm::vec3 probe = lowered + glm::vec3(0.0f, stepHeight, 0.0f);
+        SweepHit under = world.SweepCapsule(
+            probe, probe, 0.01f,
+            glm::vec3(0.0f, -stepHeight - radius - skin, 0.0f));
+        walkable = !under.hit || under.normal.y >= minUp;
+      }
+      if (walkable &&
+          glm::dot(lowered - position, direction) > progress + 1e-3f) {
+        chosen = lowered;
+        chosenVelocity = stepVelocity;
+        if (down.hit) {
+          grounded = true;
+          groundNormal = down.normal;
+        }
+      }
+    }
+    position = chosen;
+    velocity.x = chosenVelocity.x;
+    velocity.z = chosenVelocity.z;
+  }
+
+  // falling, jumping, landing on boxes and bumping heads
+  if (motion.y != 0.0f) {
+    SweepHit hit;
+    position = Sweep(world, position, glm::vec3(0.0f, motion.y, 0.0f), hit);
+    if (hit.hit) {
+      if (motion.y < 0.0f && hit.normal.y >= minUp) {
+        grounded = true;
+        groundNormal = hit.normal;
+      }
+      float into = glm::dot(velocity, hit.normal);
+      if (into < 0.0f) velocity -= hit.normal * into;
+    }
+  }
+
+  // stay on the ground walking down slopes and off small ledges
+  bool snap = wasGrounded && velocity.y <= 0.0f;
+  if (!grounded && snap) {
+    SweepHit hit;
+    glm::vec3 snapped =
+        Sweep(world, position, glm::vec3(0.0f, -stepHeight, 0.0f), hit);
+    if (hit.hit && hit.normal.y >= minUp) {
+      position = snapped;
+      grounded = true;
+      groundNormal = hit.normal;
+    }
+  }
+
+  // the heightfield
+  float ground = world.GroundHeight(position.x, position.z);
+  if (position.y < ground ||
+      (!grounded && snap && position.y <= ground + stepHeight)) {
+    position.y = ground;
+    glm::vec3 normal = world.GroundNormal(position.x, position.z);
+    float into = glm::dot(velocity, normal);
+    if (normal.y >= minUp) {
+      grounded = true;
+      groundNormal = normal;
+      velocity.y = std::max(velocity.y, 0.0f);
+    } else if (into < 0.0f) {
+      // too steep to stand on: keep only the part along the slope, gravity
+      // then slides the capsule down
+      grounded = false;
+      velocity -= normal * into;
+    }
+  }
+}
+
+int VerifyCharacterSlides() {
+  // a wall whose near face is at x = 2, no ground, so nothing but the wall
+  // takes motion away
+  CollisionWorld world;
+  world.AddBox(glm::vec3(2.0f, 0.0f, -10.0f), glm::vec3(3.0f, 3.0f, 10.0f));
+  struct Case {
+    const char* what;
+    glm::vec3 velocity;
+    glm::vec3 position, left;  // expected, and the velocity left over
+  };
+  CharacterController probe;
+  float stop = 2.0f - probe.radius - probe.skin;
+  const Case cases[] = {
+      {"into the wall", glm::vec3(4.0f, 0.0f, 0.0f),
+       glm::vec3(stop, 0.0f, 0.0f), glm::vec3(0.0f)},
+      {"sliding along the wall", glm::vec3(4.0f, 0.0f, 3.0f),
+       glm::vec3(stop, 0.0f, 3.0f), glm::vec3(0.0f, 0.0f, 3.0f)},
+      {"away from the wall", glm::vec3(-4.0f, 0.0f, 3.0f),
+       glm::vec3(-4.0f, 0.0f, 3.0f), glm::vec3(-4.0f, 0.0f, 3.0f)},
+  };
+  int wrong = 0;
+  for (const Case& c : cases) {
+    CharacterController controller;
+    glm::vec3 velocity = c.velocity;
+    controller.Move(world, velocity, 1.0f);
+    // the contact itself is only good to a few millimetres
+    if (glm::length(controller.position - c.position) <= 0.01f &&
+        glm::length(velocity - c.left) <= 1e-3f) {
+      continue;
+    }
+    std::cout << "  wrong: " << c.what << ", ended at "
+              << controller.position.x << " " << controller.position.y << " "
+              << controller.position.z << " moving " << velocity.x << " "
+              << velocity.y << " " << velocity.z << std::endl;
+    wrong++;
+  }
+  std::cout << "Character slides: " << sizeof(cases) / sizeof(cases[0])
+            << " moves at a wall, " << wrong << " wrong" << std::endl;
+  return wrong;
+}
@@ -0,0 +1,155 @@
+#include "chunk_streamer.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+ChunkStreamer::ChunkStreamer(World& world, JobSystem& jobs,
+                             const ForestSettings& forest,
+                             const glm::vec3& meshMin, const glm::vec3& meshMax)
+    : world(world),
+      jobs(jobs),
+      forest(forest),
+      meshMin(meshMin),
+      meshMax(meshMax) {}
+
+ChunkStreamer::~ChunkStreamer() { jobs.Wait(counter); }
+
+void ChunkStreamer::Update(const glm::vec3& cameraPos,
+                           const glm::vec3& cameraFront) {
+  frame++;
+  Integrate();
+
+  // everything inside the load radius is wanted, nearest and in view first
+  float size = world.chunkSize;
+  float radius = settings.loadRadius;
+  ChunkCoord lo = world.ChunkAt(cameraPos.x - radius, cameraPos.z - radius);
+  ChunkCoord hi = world.ChunkAt(cameraPos.x + radius, cameraPos.z + radius);
+  glm::vec2 front(cameraFront.x, cameraFront.z);
+  if (glm::length(front) > 0.0f) front = glm::normalize(front);
+
+  std::vector<std::pair<float, ChunkCoord>> wanted;
+  for (int z = lo.z; z <= hi.z; z++) {
+    for (int x = lo.x; x <= hi.x; x++) {
+      ChunkCoord coord = {x, z};
+      glm::vec2 center = world.ChunkOrigin(coord) + glm::vec2(size * 0.5f);
+      glm::vec2 toChunk = center - glm::vec2(cameraPos.x, cameraPos.z);
+      float distance = glm::length(toChunk);
+      if (distance > radius) continue;
+
+      if (world.FindChunk(coord)) {
+        lastWanted[coord] = frame;
+        continue;
+      }
+      if (inFlight.count(coord)) continue;
+
+      // chunks behind count up to twice as far, the one we stand in is 0
+      float facing =
+          distance > size ? glm::dot(toChunk / distance, front) : 1.0f;
+      wanted.push_back({distance * (1.5f - 0.5f * facing), coord});
+    }
+  }
+  queued = (int)wanted.size();
+
+  int slots = settings.maxInFlight - (int)inFlight.size();
+  if (slots > 0 && !wanted.empty()) {
+    size_t count = std::min(wanted.size(), (size_t)slots);
+    std::partial_sort(wanted.begin(), wanted.begin() + count, wanted.end(),
+                      [](const std::pair<float, ChunkCoord>& a,
+                         const std::pair<float, ChunkCoord>& b) {
+                        return a.first < b.first;
+                      });
+    for (size_t i = 0; i < count; i++) Load(wanted[i].second);
+  }
+
+  if (memoryBytes > settings.memoryBudget) Evict();
+}
+
+void ChunkStreamer::Load(ChunkCoord coord) {
+  inFlight.insert(coord);
+  jobs.SubmitBackground(
+      [this, coord] {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        World staging(world.chunkSize);
+        int stored = worldFile ? worldFile->Find(coord) : -1;
+        if (stored >= 0) {
+          std::vector<uint8_t> scratch;
+          Span<TreeInstance> trees = worldFile->Section<TreeInstance>(
+              stored, WORLD_SECTION_TREES, scratch);
+          staging.GetChunk(coord).trees.assign(trees.begin(), trees.end());
+        } else {
+          // on its own from the seed, so it doesn't matter what's loaded
+          GenerateForestChunk(staging.GetChunk(coord), world.chunkSize,
+                              forest);
+        }
+
+        auto chunk = std::unique_ptr<Chunk>(
+            new Chunk(std::move(staging.GetChunk(coord))));
+        chunk->FinalizeTrees(meshMin, meshMax);
+
+        generateMs = std::chrono::duration<double, std::milli>(
+                         std::chrono::high_resolution_clock::now() - start)
+                         .count();
+        std::lock_guard<std::mutex> lock(doneMutex);
+        done.push_back(std::move(chunk));
+      },
+      &counter);
+}
+
+void ChunkStreamer::Integrate() {
+  auto start = std::chrono::high_resolution_clock::now();
+  uploadedLastFrame = 0;
+  while (true) {
+    // always take at least one, so a tiny budget still makes progress
+    if (uploadedLastFrame > 0) {
+      double elapsed = std::chrono::duration<double, std::milli>(
+                           std::chrono::high_resolution_clock::now() - start)
+                           .count();
+      if (elapsed >= settings.uploadBudgetMs) break;
+    }
+
+    std::unique_ptr<Chunk> chunk;
+    {
+      std::lock_guard<std::mutex> lock(doneMutex);
+      if (done.empty()) break;
+      chunk = std::move(done.front());
+      done.pop_front();
+    }
+
+    ChunkCoord coord = chunk->coord;
+    inFlight.erase(coord);
+    memoryBytes += chunk->MemoryBytes();
+    Chunk& resident = world.chunks[coord] = std::move(*chunk);
+    if (onLoaded) onLoaded(resident);
+    lastWanted[coord] = frame;
+    uploadedLastFrame++;
+  }
+}
+
+void ChunkStreamer::Evict() {
+  // oldest first, but never what is still wanted this frame
+  std::vector<std::pair<uint64_t, ChunkCoord>> order;
+  order.reserve(world.chunks.size());
+  for (const auto& entry : world.chunks) {
+    uint64_t stamp = lastWanted[entry.first];
+    if (stamp < frame) order.push_back({stamp, entry.first});
+  }
+  std::sort(order.begin(), order.end(),
+            [](const std::pair<uint64_t, ChunkCoord>& a,
+               const std::pair<uint64_t, ChunkCoord>& b) {
+              return a.first < b.first;
+            });
+
+  for (const auto& entry : order) {
+    if (memoryBytes <= settings.memoryBudget) break;
+    auto it = world.chunks.find(entry.second);
+    memoryBytes -= std::min(memoryBytes, it->second.MemoryBytes());
+    if (onEvicted) onEvicted(it->second);
+    world.chunks.erase(it);
+    lastWanted.erase(entry.second);
+    evicted++;
+  }
+}
@@ -0,0 +1,344 @@
+#include "clustered_lights.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <random>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define CLUSTER_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define CLUSTER_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+double MillisecondsSince(std::chrono::high_resolution_clock::time_point t) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::high_resolution_clock::now() - t)
+      .count();
+}
+
+// bit i set where a circle at `x` with squared reach `reach` touches
+// [min[i], max[i]], for 4 columns
+#ifdef CLUSTER_X86
+int TouchColumns(const float* min, const float* max, float x, float reach) {
+  const __m128 center = _mm_set1_ps(x);
+  __m128 d = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(min), center),
+                        _mm_sub_ps(center, _mm_loadu_ps(max)));
+  d = _mm_max_ps(d, _mm_setzero_ps());
+  return _mm_movemask_ps(_mm_cmple_ps(_mm_mul_ps(d, d), _mm_set1_ps(reach)));
+}
+#elif defined(CLUSTER_NEON)
+int TouchColumns(const float* min, const float* max, float x, float reach) {
+  static const uint32_t bits[4] = {1, 2, 4, 8};
+  const float32x4_t center = vdupq_n_f32(x);
+  float32x4_t d = vmaxq_f32(vsubq_f32(vld1q_f32(min), center),
+                            vsubq_f32(center, vld1q_f32(max)));
+  d = vmaxq_f32(d, vdupq_n_f32(0.0f));
+  uint32x4_t touch = vcleq_f32(vmulq_f32(d, d), vdupq_n_f32(reach));
+  return (int)vaddvq_u32(vandq_u32(touch, vld1q_u32(bits)));
+}
+#else
+int TouchColumns(const float* min, const float* max, float x, float reach) {
+  int mask = 0;
+  for (int i = 0; i < 4; i++) {
+    float d = std::max(0.0f, std::max(min[i] - x, x - max[i]));
+    if (d * d <= reach) mask |= 1 << i;
+  }
+  return mask;
+}
+#endif
+
+// lanterns and fires on the ground of a forest `depth` deep and wide, in
+// view space of a camera at head height looking level into it
+std::vector<glm::vec4> ForestLights(int count, float depth) {
+  std::mt19937 rng(48);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::vector<glm::vec4> spheres(count);
+  for (glm::vec4& s : spheres) {
+    s = glm::vec4((unit(rng) - 0.5f) * depth, -1.7f + 3.0f * unit(rng),
+                  -unit(rng) * depth, 4.0f + 8.0f * unit(rng));
+  }
+  return spheres;
+}
+
+}  // namespace
+
+ClusterGrid::ClusterGrid(const ClusterSettings& settings)
+    : settings(settings) {}
+
+const char* ClusterGrid::SimdName() {
+#ifdef CLUSTER_X86
+  return "SSE2";
+#elif defined(CLUSTER_NEON)
+  return "NEON";
+#else
+  return "scalar";
+#endif
+}
+
+void ClusterGrid::Fit(float fovY, float aspect, float nearPlane,
+                      float farPlane) {
+  tilesX = std::max(1, settings.tilesX);
+  tilesY = std::max(1, settings.tilesY);
+  slices = std::max(1, settings.slices);
+  maxPerCluster = std::max(1, settings.maxPerCluster);
+  paddedX = (tilesX + 3) & ~3;
+  fitFovY = fovY;
+  fitAspect = aspect;
+  fitNear = nearPlane;
+  fitFar = farPlane;
+
+  float range = std::log(farPlane / nearPlane);
+  depthScale = slices / range;
+  depthBias = -slices * std::log(nearPlane) / range;
+
+  float tanY = std::tan(fovY * 0.5f);
+  float tanX = tanY * aspect;
+  sliceNear.resize(slices);
+  sliceFar.resize(slices);
+  columnMin.assign((size_t)slices * paddedX, 1e30f);
+  columnMax.assign((size_t)slices * paddedX, -1e30f);
+  rowMin.resize((size_t)slices * tilesY);
+  rowMax.resize((size_t)slices * tilesY);
+  for (int k = 0; k < slices; k++) {
+    float dn = nearPlane * std::pow(farPlane / nearPlane, k / (float)slices);
+    float df =
+        nearPlane * std::pow(farPlane / nearPlane, (k + 1) / (float)slices);
+    sliceNear[k] = dn;
+    sliceFar[k] = df;
+    // a tile's edge is a plane through the eye, so its extent at a depth
+    // grows linearly: the bounds over the slice are at dn or df
+    for (int x = 0; x < tilesX; x++) {
+      float x0 = (-1.0f + 2.0f * x / tilesX) * tanX;
+      float x1 = (-1.0f + 2.0f * (x + 1) / tilesX) * tanX;
+      columnMin[k * paddedX + x] = std::min(x0 * dn, x0 * df);
+      columnMax[k * paddedX + x] = std::max(x1 * dn, x1 * df);
+    }
+    for (int y = 0; y < tilesY; y++) {
+      float y0 = (-1.0f + 2.0f * y / tilesY) * tanY;
+      float y1 = (-1.0f + 2.0f * (y + 1) / tilesY) * tanY;
+      rowMin[k * tilesY + y] = std::min(y0 * dn, y0 * df);
+      rowMax[k * tilesY + y] = std::max(y1 * dn, y1 * df);
+    }
+  }
+
+  sliceLights.assign(slices, std::vector<int>());
+  sliceDropped.assign(slices, 0);
+  slots.resize((size_t)ClusterCount() * maxPerCluster);
+  counts.assign(ClusterCount(), 0);
+  cells.assign((size_t)ClusterCount() * 2, 0);
+}
+
+void ClusterGrid::Assign(const glm::vec4* spheres, int count, float fovY,
+                         float aspect, float nearPlane, float farPlane,
+                         JobSystem* jobs) {
+  auto start = std::chrono::high_resolution_clock::now();
+  farPlane = std::max(farPlane, nearPlane * 1.01f);
+  if (fovY != fitFovY || aspect != fitAspect || nearPlane != fitNear ||
+      farPlane != fitFar || settings.tilesX != tilesX ||
+      settings.tilesY != tilesY || settings.slices != slices ||
+      settings.maxPerCluster != maxPerCluster) {
+    Fit(fovY, aspect, nearPlane, farPlane);
+  }
+
+  // which slices each light's depth range reaches
+  for (std::vector<int>& list : sliceLights) list.clear();
+  for (int i = 0; i < count; i++) {
+    float depth = -spheres[i].z;
+    float radius = spheres[i].w;
+    if (depth + radius < nearPlane || depth - radius > farPlane) continue;
+    float from = std::max(depth - radius, nearPlane);
+    float to = std::min(depth + radius, farPlane);
+    int k0 = (int)std::floor(std::log(from) * depthScale + depthBias);
+    int k1 = (int)std::floor(std::log(to) * depthScale + depthBias);
+    k0 = glm::clamp(k0, 0, slices - 1);
+    k1 = glm::clamp(k1, 0, slices - 1);
+    for (int k = k0; k <= k1; k++) sliceLights[k].push_back(i);
+  }
+
+  if (jobs) {
+    jobs->ParallelFor(slices, 1, [&](int begin, int end) {
+      for (int k = begin; k < end; k++) AssignSlice(k, spheres);
+    });
+  } else {
+    for (int k = 0; k < slices; k++) AssignSlice(k, spheres);
+  }
+
+  // the slots packed into one list
+  indices.clear();
+  maxInCluster = 0;
+  dropped = 0;
+  for (int k = 0; k < slices; k++) dropped += sliceDropped[k];
+  for (int c = 0; c < ClusterCount(); c++) {
+    int n = std::min(counts[c], maxPerCluster);
+    cells[2 * c] = (uint32_t)indices.size();
+    cells[2 * c + 1] = (uint32_t)n;
+    const uint16_t* first = slots.data() + (size_t)c * maxPerCluster;
+    indices.insert(indices.end(), first, first + n);
+    maxInCluster = std::max(maxInCluster, n);
+  }
+  assignMs = MillisecondsSince(start);
+}
+
+void ClusterGrid::AssignSlice(int slice, const glm::vec4* spheres) {
+  int base = slice * tilesY * tilesX;
+  std::fill(counts.begin() + base, counts.begin() + base + tilesY * tilesX,
+            0);
+  sliceDropped[slice] = 0;
+  const float* minX = columnMin.data() + (size_t)slice * paddedX;
+  const float* maxX = columnMax.data() + (size_t)slice * paddedX;
+  for (int i : sliceLights[slice]) {
+    const glm::vec4& s = spheres[i];
+    float depth = -s.z;
+    float dz = std::max(0.0f, std::max(sliceNear[slice] - depth,
+                                       depth - sliceFar[slice]));
+    float reach = s.w * s.w - dz * dz;
+    if (reach < 0.0f) continue;
+    for (int y = 0; y < tilesY; y++) {
+      float dy = std::max(0.0f, std::max(rowMin[slice * tilesY + y] - s.y,
+                                         s.y - rowMax[slice * tilesY + y]));
+      float rowReach = reach - dy * dy;
+      if (rowReach < 0.0f) continue;
+      for (int x = 0; x < paddedX; x += 4) {
+        int mask = TouchColumns(minX + x, maxX + x, s.x, rowReach);
+        while (mask) {
+          int lane = 0;
+          while (!(mask & (1 << lane))) lane++;
+          mask &= ~(1 << lane);
+          int cluster = base + y * tilesX + x + lane;
+          int& n = counts[cluster];
+          if (n < maxPerCluster) {
+            slots[(size_t)cluster * maxPerCluster + n] = (uint16_t)i;
+            n++;
+          } else {
+            sliceDropped[slice]++;
+          }
+        }
+      }
+    }
+  }
+}
+
+int VerifyClusterGrid(int lights, JobSystem& jobs) {
+  const float fovY = glm::radians(60.0f), aspect = 16.0f / 9.0f;
+  const float nearPlane = 0.1f, farPlane = 150.0f;
+  std::vector<glm::vec4> spheres = ForestLights(lights, farPlane);
+  ClusterGrid serial, grid;
+  serial.Assign(spheres.data(), lights, fovY, aspect, nearPlane, farPlane,
+                nullptr);
+  grid.Assign(spheres.data(), lights, fovY, aspect, nearPlane, farPlane,
+              &jobs);
+  int wrong = 0;
+  if (serial.Cells() != grid.Cells() || serial.Indices() != grid.Indices()) {
+    std::cout << "  wrong: the job system binned differently" << std::endl;
+    wrong++;
+  }
+
+  // the froxels as a fragment finds them: its tile from the projection,
+  // its slice from DepthToSlice
+  glm::mat4 projection = glm::perspective(fovY, aspect, nearPlane, farPlane);
+  glm::ivec3 dims = grid.Dimensions();
+  glm::vec2 toSlice = grid.DepthToSlice();
+  const int steps = 4;  // points per edge, less one
+  int missing = 0, repeated = 0;
+  for (int k = 0; k < dims.z; k++) {
+    float dn = std::exp((k - toSlice.y) / toSlice.x);
+    float df = std::exp((k + 1 - toSlice.y) / toSlice.x);
+    for (int y = 0; y < dims.y; y++) {
+      for (int x = 0; x < dims.x; x++) {
+        int cluster = (k * dims.y + y) * dims.x + x;
+        const uint32_t* cell = grid.Cells().data() + 2 * cluster;
+        const uint16_t* list = grid.Indices().data() + cell[0];
+        std::vector<int> listed(list, list + cell[1]);
+        std::sort(listed.begin(), listed.end());
+        if (std::adjacent_find(listed.begin(), listed.end()) !=
+            listed.end()) {
+          repeated++;
+        }
+        // any point of the froxel inside a sphere means that light reaches
+        // pixels of this cluster
+        auto touches = [&](const glm::vec4& s) {
+          for (int a = 0; a <= steps; a++) {
+            float depth = dn + (df - dn) * a / steps;
+            for (int b = 0; b <= steps; b++) {
+              float ndcY = -1.0f + 2.0f * (y + b / (float)steps) / dims.y;
+              for (int c = 0; c <= steps; c++) {
+                float ndcX = -1.0f + 2.0f * (x + c / (float)steps) / dims.x;
+                glm::vec3 p(ndcX * depth / projection[0][0],
+                            ndcY * depth / projection[1][1], -depth);
+                if (glm::length(p - glm::vec3(s)) <= s.w) return true;
+              }
+            }
+          }
+          return false;
+        };
+        for (int i = 0; i < lights; i++) {
+          const glm::vec4& s = spheres[i];
+          if (-s.z + s.w < dn || -s.z - s.w > df) continue;
+          if (std::binary_search(listed.begin(), listed.end(), i) ||
+              !touches(s)) {
+            continue;
+          }
+          if (missing < 5) {
+            std::cout << "  wrong: light " << i << " reaches cluster (" << x
+                      << ", " << y << ", " << k << ") but isn't in it"
+                      << std::endl;
+          }
+          missing++;
+        }
+      }
+    }
+  }
+  wrong += missing + repeated;
+  if (grid.Dropped() > 0) {
+    std::cout << "  wrong: " << grid.Dropped() << " dropped" << std::endl;
+    wrong++;
+  }
+  std::cout << "Cluster grid: " << lights << " lights, "
+            << grid.ClusterCount() << " clusters, " << grid.Indices().size()
+            << " references, " << missing << " missing, " << repeated
+            << " clusters with a light twice, " << grid.Dropped()
+            << " dropped" << std::endl;
+  return wrong;
+}
+
+double BenchmarkClusteredLights(int lights, JobSystem& jobs) {
+  const float fovY = glm::radians(60.0f), aspect = 16.0f / 9.0f;
+  const float nearPlane = 0.1f, farPlane = 150.0f;
+  std::vector<glm::vec4> spheres = ForestLights(lights, farPlane);
+
+  ClusterGrid grid;
+  const int frames = 200;
+  grid.Assign(spheres.data(), lights, fovY, aspect, nearPlane, farPlane,
+              nullptr);  // fits the grid
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int f = 0; f < frames; f++) {
+    grid.Assign(spheres.data(), lights, fovY, aspect, nearPlane, farPlane,
+                nullptr);
+  }
+  double serialMs = MillisecondsSince(start) / frames;
+  start = std::chrono::high_resolution_clock::now();
+  for (int f = 0; f < frames; f++) {
+    grid.Assign(spheres.data(), lights, fovY, aspect, nearPlane, farPlane,
+                &jobs);
+  }
+  double jobsMs = MillisecondsSince(start) / frames;
+
+  int used = 0;
+  for (int c = 0; c < grid.ClusterCount(); c++) {
+    if (grid.Cells()[2 * c + 1] > 0) used++;
+  }
+  std::cout << "Clustered lights (" << ClusterGrid::SimdName() << "): "
+            << lights << " lights, " << grid.ClusterCount() << " clusters, "
+            << used << " lit, " << grid.Indices().size() << " references, "
+            << grid.MaxInCluster() << " max, " << grid.Dropped()
+            << " dropped; " << serialMs << " ms on 1 thread, " << jobsMs
+            << " ms on " << jobs.ThreadCount() << " workers" << std::endl;
+  return jobsMs;
+}
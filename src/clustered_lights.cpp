@@ -0,0 +1,92 @@
+#include "clustered_lights.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/type_ptr.hpp>
+
+ClusteredLights::ClusteredLights(const ClusterSettings& settings,
+                                 JobSystem* jobs)
+    : grid(settings), jobs(jobs) {
+  const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R16UI};
+  glGenBuffers(3, buffers);
+  glGenTextures(3, textures);
+  for (int i = 0; i < 3; i++) {
+    glBindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+    glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+    glTexBuffer(GL_TEXTURE_BUFFER, formats[i], buffers[i]);
+  }
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+ClusteredLights::~ClusteredLights() {
+  glDeleteTextures(3, textures);
+  glDeleteBuffers(3, buffers);
+}
+
+void ClusteredLights::Update(const glm::mat4& view, float fovY, float aspect,
+                             float nearPlane, float farPlane, float time) {
+  this->view = view;
+  farPlane = std::min(farPlane, grid.settings.maxDistance);
+  packed.clear();
+  spheres.clear();
+  int limit = std::min(grid.settings.maxLights, 65535);
+  for (const PointLight& light : lights) {
+    if ((int)spheres.size() >= limit) break;
+    glm::vec3 v = glm::vec3(view * glm::vec4(light.position, 1.0f));
+    // behind the eye or past the last slice
+    if (-v.z + light.radius < nearPlane || -v.z - light.radius > farPlane) {
+      continue;
+    }
+    // two detuned waves read as fire, not as a blinking bulb
+    float wave = std::sin(time * 9.0f + light.phase) *
+                 std::sin(time * 5.3f + light.phase * 1.7f);
+    float brightness = 1.0f - light.flicker * (0.3f + 0.25f * wave);
+    packed.push_back(glm::vec4(light.position, light.radius));
+    packed.push_back(
+        glm::vec4(light.color * (light.intensity * brightness), 0.0f));
+    spheres.push_back(glm::vec4(v, light.radius));
+  }
+  uploaded = (int)spheres.size();
+  grid.Assign(spheres.data(), uploaded, fovY, aspect, nearPlane, farPlane,
+              jobs);
+
+  // orphaned every frame, a store of 0 bytes isn't allowed behind a texture
+  auto upload = [](unsigned int buffer, const void* data, size_t bytes) {
+    static const uint32_t zeros[4] = {};
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    if (bytes == 0) {
+      glBufferData(GL_TEXTURE_BUFFER, sizeof(zeros), zeros, GL_STREAM_DRAW);
+    } else {
+      glBufferData(GL_TEXTURE_BUFFER, bytes, data, GL_STREAM_DRAW);
+    }
+  };
+  upload(buffers[0], packed.data(), packed.size() * sizeof(glm::vec4));
+  upload(buffers[1], grid.Cells().data(),
+         grid.Cells().size() * sizeof(uint32_t));
+  upload(buffers[2], grid.Indices().data(),
+         grid.Indices().size() * sizeof(uint16_t));
+  glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void ClusteredLights::Bind(const Shader& shader, int firstUnit, int width,
+                           int height) const {
+  const char* names[3] = {"clusterLights", "clusterCells", "clusterIndices"};
+  for (int i = 0; i < 3; i++) {
+    glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+    glBindTexture(GL_TEXTURE_BUFFER, textures[i]);
+    shader.setInt(names[i], firstUnit + i);
+  }
+  glActiveTexture(GL_TEXTURE0);
+  shader.setBool("clusterOn", uploaded > 0);
+  glm::ivec3 dims = grid.Dimensions();
+  glUniform3i(glGetUniformLocation(shader.ID, "clusterDims"), dims.x, dims.y,
+              dims.z);
+  glm::vec2 depth = grid.DepthToSlice();
+  glUniform2f(glGetUniformLocation(shader.ID, "clusterDepth"), depth.x,
+              depth.y);
+  glUniform2f(glGetUniformLocation(shader.ID, "clusterScreen"), (float)width,
+              (float)height);
+  shader.setMat4("clusterView", view);
+}
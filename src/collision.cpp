@@ -0,0 +1,464 @@
+#include "collision.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+namespace {
+
+// shapes closer than this count as touching
+const float CONTACT = 0.005f;
+// conservative advancement steps before a grazing sweep gives up
+const int MAX_ADVANCE = 24;
+
+void ClosestSegmentSegment(const glm::vec3& p1, const glm::vec3& q1,
+                           const glm::vec3& p2, const glm::vec3& q2,
+                           glm::vec3& c1, glm::vec3& c2) {
+  glm::vec3 d1 = q1 - p1;
+  glm::vec3 d2 = q2 - p2;
+  glm::vec3 r = p1 - p2;
+  float a = glm::dot(d1, d1);
+  float e = glm::dot(d2, d2);
+  float f = glm::dot(d2, r);
+  float s = 0.0f;
+  float t = 0.0f;
+  if (a <= 1e-12f && e <= 1e-12f) {
+    c1 = p1;
+    c2 = p2;
+    return;
+  }
+  if (a <= 1e-12f) {
+    t = glm::clamp(f / e, 0.0f, 1.0f);
+  } else {
+    float c = glm::dot(d1, r);
+    if (e <= 1e-12f) {
+      s = glm::clamp(-c / a, 0.0f, 1.0f);
+    } else {
+      float b = glm::dot(d1, d2);
+      float denom = a * e - b * b;
+      // parallel segments: any s works, take the start
+      s = denom > 1e-12f ? glm::clamp((b * f - c * e) / denom, 0.0f, 1.0f)
+                         : 0.0f;
+      t = (b * s + f) / e;
+      if (t < 0.0f) {
+        t = 0.0f;
+        s = glm::clamp(-c / a, 0.0f, 1.0f);
+      } else if (t > 1.0f) {
+        t = 1.0f;
+        s = glm::clamp((b - c) / a, 0.0f, 1.0f);
+      }
+    }
+  }
+  c1 = p1 + d1 * s;
+  c2 = p2 + d2 * t;
+}
+
+float BoxDistanceSq(const glm::vec3& p, const glm::vec3& extents) {
+  glm::vec3 d = glm::max(glm::abs(p) - extents, glm::vec3(0.0f));
+  return glm::dot(d, d);
+}
+
+}  // namespace
+
+float CapsuleDistance(const CollisionShape& shape, const glm::vec3& a,
+                      const glm::vec3& b, float radius, glm::vec3& normal) {
+  if (shape.type == COLLISION_CAPSULE) {
+    glm::vec3 onCapsule, onShape;
+    ClosestSegmentSegment(a, b, shape.a, shape.b, onCapsule, onShape);
+    glm::vec3 d = onCapsule - onShape;
+    float length = glm::length(d);
+    normal = length > 1e-6f ? d / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    return length - radius - shape.radius;
+  }
+
+  // box: work in its frame, center a, half extents b
+  glm::mat3 toLocal = glm::transpose(shape.rotation);
+  glm::vec3 la = toLocal * (a - shape.a);
+  glm::vec3 lb = toLocal * (b - shape.a);
+  const glm::vec3& extents = shape.b;
+
+  // distance to a convex shape is convex along the segment, so a golden
+  // section search finds the closest point
+  float lo = 0.0f;
+  float hi = 1.0f;
+  const float ratio = 0.618034f;
+  float t1 = hi - ratio * (hi - lo);
+  float t2 = lo + ratio * (hi - lo);
+  float f1 = BoxDistanceSq(la + (lb - la) * t1, extents);
+  float f2 = BoxDistanceSq(la + (lb - la) * t2, extents);
+  for (int i = 0; i < 20; i++) {
+    if (f1 < f2) {
+      hi = t2;
+      t2 = t1;
+      f2 = f1;
+      t1 = hi - ratio * (hi - lo);
+      f1 = BoxDistanceSq(la + (lb - la) * t1, extents);
+    } else {
+      lo = t1;
+      t1 = t2;
+      f1 = f2;
+      t2 = lo + ratio * (hi - lo);
+      f2 = BoxDistanceSq(la + (lb - la) * t2, extents);
+    }
+  }
+  // the ends aren't probed by the search
+  float t = 0.5f * (lo + hi);
+  float best = BoxDistanceSq(la + (lb - la) * t, extents);
+  if (BoxDistanceSq(la, extents) < best) {
+    t = 0.0f;
+    best = BoxDistanceSq(la, extents);
+  }
+  if (BoxDistanceSq(lb, extents) < best) t = 1.0f;
+
+  glm::vec3 p = la + (lb - la) * t;
+  glm::vec3 d = p - glm::clamp(p, -extents, extents);
+  float length = glm::length(d);
+  if (length > 1e-6f) {
+    normal = shape.rotation * (d / length);
+    return length - radius;
+  }
+
+  // the segment is inside, push out through the nearest face
+  glm::vec3 depth = extents - glm::abs(p);
+  int axis = depth.x < depth.y ? (depth.x < depth.z ? 0 : 2)
+                               : (depth.y < depth.z ? 1 : 2);
+  glm::vec3 local(0.0f);
+  local[axis] = p[axis] < 0.0f ? -1.0f : 1.0f;
+  normal = shape.rotation * local;
+  return -depth[axis] - radius;
+}
+
+CollisionWorld::CollisionWorld(float cellSize) : cellSize(cellSize) {}
+
+float CollisionWorld::GroundHeight(float x, float z) const {
+  return groundHeight ? groundHeight(x, z) : -1e30f;
+}
+
+glm::vec3 CollisionWorld::GroundNormal(float x, float z) const {
+  if (!groundHeight) return glm::vec3(0.0f, 1.0f, 0.0f);
+  const float step = 0.5f;
+  float dx = groundHeight(x + step, z) - groundHeight(x - step, z);
+  float dz = groundHeight(x, z + step) - groundHeight(x, z - step);
+  return glm::normalize(glm::vec3(-dx, 2.0f * step, -dz));
+}
+
+uint64_t CollisionWorld::CellKey(int x, int z) const {
+  return ((uint64_t)(uint32_t)x << 32) | (uint32_t)z;
+}
+
+uint32_t CollisionWorld::AddBox(const glm::vec3& min, const glm::vec3& max) {
+  return AddOrientedBox((min + max) * 0.5f, (max - min) * 0.5f,
+                        glm::mat3(1.0f));
+}
+
+uint32_t CollisionWorld::AddOrientedBox(const glm::vec3& center,
+                                        const glm::vec3& halfExtents,
+                                        const glm::mat3& rotation) {
+  CollisionShape shape;
+  shape.type = COLLISION_BOX;
+  shape.a = center;
+  shape.b = halfExtents;
+  shape.rotation = rotation;
+  // world extent of the box along each axis
+  glm::vec3 reach(0.0f);
+  for (int i = 0; i < 3; i++) {
+    reach += glm::abs(rotation[i]) * halfExtents[i];
+  }
+  shape.boundsMin = center - reach;
+  shape.boundsMax = center + reach;
+  return Insert(shape);
+}
+
+uint32_t CollisionWorld::AddCapsule(const glm::vec3& a, const glm::vec3& b,
+                                    float radius) {
+  CollisionShape shape;
+  shape.type = COLLISION_CAPSULE;
+  shape.a = a;
+  shape.b = b;
+  shape.radius = radius;
+  shape.boundsMin = glm::min(a, b) - glm::vec3(radius);
+  shape.boundsMax = glm::max(a, b) + glm::vec3(radius);
+  return Insert(shape);
+}
+
+uint32_t CollisionWorld::Insert(const CollisionShape& shape) {
+  revision++;
+  uint32_t id;
+  if (!freeIds.empty()) {
+    id = freeIds.back();
+    freeIds.pop_back();
+    shapes[id] = shape;
+  } else {
+    id = (uint32_t)shapes.size();
+    shapes.push_back(shape);
+  }
+
+  int x0 = (int)std::floor(shape.boundsMin.x / cellSize);
+  int z0 = (int)std::floor(shape.boundsMin.z / cellSize);
+  int x1 = (int)std::floor(shape.boundsMax.x / cellSize);
+  int z1 = (int)std::floor(shape.boundsMax.z / cellSize);
+  for (int z = z0; z <= z1; z++) {
+    for (int x = x0; x <= x1; x++) cells[CellKey(x, z)].push_back(id);
+  }
+  return id;
+}
+
+void CollisionWorld::Remove(uint32_t id) {
+  if (id >= shapes.size() || shapes[id].type == COLLISION_NONE) return;
+  const CollisionShape& shape = shapes[id];
+  int x0 = (int)std::floor(shape.boundsMin.x / cellSize);
+  int z0 = (int)std::floor(shape.boundsMin.z / cellSize);
+  int x1 = (int)std::floor(shape.boundsMax.x / cellSize);
+  int z1 = (int)std::floor(shape.boundsMax.z / cellSize);
+  for (int z = z0; z <= z1; z++) {
+    for (int x = x0; x <= x1; x++) {
+      auto it = cells.find(CellKey(x, z));
+      if (it == cells.end()) continue;
+      std::vector<uint32_t>& ids = it->second;
+      ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+      if (ids.empty()) cells.erase(it);
+    }
+  }
+  shapes[id].type = COLLISION_NONE;
+  freeIds.push_back(id);
+  revision++;
+}
+
+void CollisionWorld::Query(const glm::vec3& min, const glm::vec3& max,
+                           std::vector<uint32_t>& out) const {
+  out.clear();
+  int x0 = (int)std::floor(min.x / cellSize);
+  int z0 = (int)std::floor(min.z / cellSize);
+  int x1 = (int)std::floor(max.x / cellSize);
+  int z1 = (int)std::floor(max.z / cellSize);
+  for (int z = z0; z <= z1; z++) {
+    for (int x = x0; x <= x1; x++) {
+      auto it = cells.find(CellKey(x, z));
+      if (it == cells.end()) continue;
+      for (uint32_t id : it->second) {
+        const CollisionShape& shape = shapes[id];
+        if (shape.boundsMax.x < min.x || shape.boundsMin.x > max.x ||
+            shape.boundsMax.y < min.y || shape.boundsMin.y > max.y ||
+            shape.boundsMax.z < min.z || shape.boundsMin.z > max.z) {
+          continue;
+        }
+        out.push_back(id);
+      }
+    }
+  }
+  // shapes spanning several cells were found once per cell
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+SweepHit CollisionWorld::SweepCapsule(const glm::vec3& a, const glm::vec3& b,
+                                      float radius,
+                                      const glm::vec3& motion) const {
+  SweepHit result;
+  glm::vec3 lo = glm::min(a, b) - glm::vec3(radius + CONTACT);
+  glm::vec3 hi = glm::max(a, b) + glm::vec3(radius + CONTACT);
+  thread_local std::vector<uint32_t> candidates;
+  Query(glm::min(lo, lo + motion), glm::max(hi, hi + motion), candidates);
+  if (candidates.empty()) return result;
+
+  float length = glm::length(motion);
+  float t = 0.0f;
+  glm::vec3 normal(0.0f, 1.0f, 0.0f);
+  for (int step = 0; step < MAX_ADVANCE; step++) {
+    glm::vec3 offset = motion * t;
+    float nearest = 1e30f;
+    for (uint32_t id : candidates) {
+      glm::vec3 n;
+      float d = CapsuleDistance(shapes[id], a + offset, b + offset, radius, n);
+      if (d < nearest) {
+        nearest = d;
+        normal = n;
+      }
+    }
+    if (nearest <= CONTACT) {
+      result.hit = true;
+      result.fraction = t;
+      result.normal = normal;
+      return result;
+    }
+    if (length < 1e-6f) return result;
+    // nothing can close the gap faster than the capsule moves, stop a
+    // little inside the contact distance so the next step registers it
+    t += (nearest - CONTACT * 0.5f) / length;
+    if (t >= 1.0f) return result;
+  }
+
+  // grazing along a surface: call it a contact where we got to
+  result.hit = true;
+  result.fraction = t;
+  result.normal = normal;
+  return result;
+}
+
+glm::vec3 CollisionWorld::Depenetrate(const glm::vec3& a, const glm::vec3& b,
+                                      float radius) const {
+  glm::vec3 offset(0.0f);
+  std::vector<uint32_t> candidates;
+  // overlaps can push into each other, a few rounds settle it
+  for (int round = 0; round < 4; round++) {
+    glm::vec3 pa = a + offset;
+    glm::vec3 pb = b + offset;
+    Query(glm::min(pa, pb) - glm::vec3(radius),
+          glm::max(pa, pb) + glm::vec3(radius), candidates);
+    bool moved = false;
+    for (uint32_t id : candidates) {
+      glm::vec3 normal;
+      float d = CapsuleDistance(shapes[id], pa, pb, radius, normal);
+      if (d >= 0.0f) continue;
+      offset += normal * (CONTACT - d);
+      pa = a + offset;
+      pb = b + offset;
+      moved = true;
+    }
+    if (!moved) break;
+  }
+  return offset;
+}
+
+int VerifyCapsuleSweeps() {
+  // one shape per case, the player's capsule (0.3 m radius, feet at y = 0)
+  // moving at it
+  const float r = 0.3f;
+  const float diagonal = 0.70710678f;
+  struct Case {
+    const char* what;
+    CollisionShape shape;
+    glm::vec3 feet, motion;
+    bool hit;
+    float travel;  // metres to the contact
+    glm::vec3 normal;
+  };
+  auto box = [](const glm::vec3& min, const glm::vec3& max) {
+    CollisionShape shape;
+    shape.type = COLLISION_BOX;
+    shape.a = (min + max) * 0.5f;
+    shape.b = (max - min) * 0.5f;
+    return shape;
+  };
+  // 2 m ahead of the capsule along +x
+  CollisionShape wall = box(glm::vec3(2.0f, 0.0f, -1.0f),
+                            glm::vec3(3.0f, 2.0f, 1.0f));
+  CollisionShape trunk;
+  trunk.type = COLLISION_CAPSULE;
+  trunk.a = glm::vec3(3.0f, 0.0f, 0.0f);
+  trunk.b = glm::vec3(3.0f, 3.0f, 0.0f);
+  trunk.radius = 0.5f;
+  // turned 45 degrees, its -z face looks at (-1, 0, -1)
+  CollisionShape turned = box(glm::vec3(2.5f, 0.0f, -0.5f),
+                              glm::vec3(3.5f, 2.0f, 0.5f));
+  turned.rotation = glm::mat3(glm::vec3(diagonal, 0.0f, -diagonal),
+                              glm::vec3(0.0f, 1.0f, 0.0f),
+                              glm::vec3(diagonal, 0.0f, diagonal));
+  glm::vec3 face(-diagonal, 0.0f, -diagonal);
+  // the edge is 0.2 m to the side, so the contact is 0.2236 m short of it
+  float edge = std::sqrt(r * r - 0.2f * 0.2f);
+  // the trunk is 0.4 m to the side, centres touch 0.8 m apart
+  float side = std::sqrt(0.8f * 0.8f - 0.4f * 0.4f);
+  const glm::vec3 ahead(5.0f, 0.0f, 0.0f);
+  const Case cases[] = {
+      {"box face", wall, glm::vec3(0.0f), ahead, true, 2.0f - r,
+       glm::vec3(-1.0f, 0.0f, 0.0f)},
+      {"landing on a box",
+       box(glm::vec3(-1.0f, 0.0f, -1.0f), glm::vec3(1.0f, 2.0f, 1.0f)),
+       glm::vec3(0.0f, 3.0f, 0.0f), glm::vec3(0.0f, -5.0f, 0.0f), true, 1.0f,
+       glm::vec3(0.0f, 1.0f, 0.0f)},
+      {"box edge", wall, glm::vec3(0.0f, 0.0f, 1.2f), ahead, true,
+       2.0f - edge, glm::vec3(-edge, 0.0f, 0.2f) / r},
+      {"turned box face", turned, glm::vec3(3.0f, 0.0f, 0.0f) + face * 3.0f,
+       -face * 5.0f, true, 3.0f - 0.5f - r, face},
+      {"trunk", trunk, glm::vec3(0.0f, 0.0f, 0.4f), ahead, true, 3.0f - side,
+       glm::vec3(-side, 0.0f, 0.4f) / 0.8f},
+      {"passing the box", wall, glm::vec3(0.0f, 0.0f, 1.4f), ahead, false,
+       0.0f, glm::vec3(0.0f)},
+      {"stopping short", wall, glm::vec3(0.0f), glm::vec3(1.6f, 0.0f, 0.0f),
+       false, 0.0f, glm::vec3(0.0f)},
+  };
+
+  int wrong = 0;
+  for (const Case& c : cases) {
+    CollisionWorld world;
+    if (c.shape.type == COLLISION_CAPSULE) {
+      world.AddCapsule(c.shape.a, c.shape.b, c.shape.radius);
+    } else {
+      world.AddOrientedBox(c.shape.a, c.shape.b, c.shape.rotation);
+    }
+    SweepHit hit = world.SweepCapsule(c.feet + glm::vec3(0.0f, r, 0.0f),
+                                      c.feet + glm::vec3(0.0f, 1.5f, 0.0f),
+                                      r, c.motion);
+    float travel = hit.fraction * glm::length(c.motion);
+    bool right = hit.hit == c.hit;
+    // contact is anywhere within CONTACT of the surface
+    if (right && c.hit) {
+      right = std::fabs(travel - c.travel) <= 2.0f * CONTACT &&
+              glm::dot(hit.normal, c.normal) >= 0.999f;
+    }
+    if (right && !c.hit) right = hit.fraction == 1.0f;
+    if (right) continue;
+    std::cout << "  wrong: " << c.what << ", " << (hit.hit ? "hit" : "miss")
+              << " after " << travel << " m, normal " << hit.normal.x << " "
+              << hit.normal.y << " " << hit.normal.z << std::endl;
+    wrong++;
+  }
+  std::cout << "Capsule sweeps: " << sizeof(cases) / sizeof(cases[0])
+            << " known contacts, " << wrong << " wrong" << std::endl;
+  return wrong;
+}
+
+double BenchmarkCapsuleSweeps(int trees, int sweeps) {
+  CollisionWorld world;
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+  // trunks on a jittered 4 m grid like the forest, a boulder every tenth
+  int side = std::max(1, (int)std::ceil(std::sqrt((float)trees)));
+  float spacing = 4.0f;
+  float extent = side * spacing;
+  for (int i = 0; i < trees; i++) {
+    glm::vec3 base((i % side + 0.25f + 0.5f * unit(rng)) * spacing, 0.0f,
+                   (i / side + 0.25f + 0.5f * unit(rng)) * spacing);
+    float scale = 0.8f + 0.6f * unit(rng);
+    world.AddCapsule(base, base + glm::vec3(0.0f, 2.0f * scale, 0.0f),
+                     0.25f * scale);
+    if (i % 10 == 0) {
+      float yaw = unit(rng) * 6.2831853f;
+      glm::mat3 rotation(glm::vec3(std::cos(yaw), 0.0f, -std::sin(yaw)),
+                         glm::vec3(0.0f, 1.0f, 0.0f),
+                         glm::vec3(std::sin(yaw), 0.0f, std::cos(yaw)));
+      world.AddOrientedBox(base + glm::vec3(1.5f, 0.4f, 0.0f),
+                           glm::vec3(0.6f, 0.4f, 0.5f), rotation);
+    }
+  }
+
+  // player sized capsules, up to a second of sprinting per sweep
+  std::vector<glm::vec3> starts(sweeps);
+  std::vector<glm::vec3> motions(sweeps);
+  for (int i = 0; i < sweeps; i++) {
+    starts[i] = glm::vec3(unit(rng) * extent, 0.05f, unit(rng) * extent);
+    float angle = unit(rng) * 6.2831853f;
+    motions[i] = glm::vec3(std::cos(angle), 0.0f, std::sin(angle)) *
+                 (0.05f + 5.0f * unit(rng));
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  int hits = 0;
+  for (int i = 0; i < sweeps; i++) {
+    glm::vec3 feet = starts[i];
+    SweepHit hit = world.SweepCapsule(feet + glm::vec3(0.0f, 0.3f, 0.0f),
+                                      feet + glm::vec3(0.0f, 1.5f, 0.0f),
+                                      0.3f, motions[i]);
+    if (hit.hit) hits++;
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::high_resolution_clock::now() - start)
+                       .count();
+  std::cout << "Capsule sweeps: " << world.ShapeCount() << " shapes, "
+            << sweeps << " sweeps, " << hits << " hits" << std::endl;
+  return seconds > 0.0 ? sweeps / seconds : 0.0;
+}
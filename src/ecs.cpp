@@ -0,0 +1,428 @@
+#include "ecs.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+#include <glm/glm.hpp>
+
+namespace {
+
+double MillisecondsSince(std::chrono::high_resolution_clock::time_point t) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::high_resolution_clock::now() - t)
+      .count();
+}
+
+}  // namespace
+
+ComponentType NextComponentType() {
+  static std::atomic<int> next{0};
+  int type = next++;
+  if (type >= ECS_MAX_COMPONENTS) {
+    std::cout << "ERROR::ECS::TOO_MANY_COMPONENT_TYPES" << std::endl;
+  }
+  return type;
+}
+
+uint32_t ComponentPool::Insert(Entity entity) {
+  if (entity.index >= sparse.size()) sparse.resize(entity.index + 1, ABSENT);
+  uint32_t slot = (uint32_t)entities.size();
+  sparse[entity.index] = slot;
+  entities.push_back(entity);
+  return slot;
+}
+
+void ComponentPool::Remove(uint32_t index) {
+  if (!Has(index)) return;
+  uint32_t slot = sparse[index];
+  Entity last = entities.back();
+  entities[slot] = last;
+  sparse[last.index] = slot;
+  entities.pop_back();
+  sparse[index] = ABSENT;
+  EraseSlot(slot);
+}
+
+Entity Registry::Create() {
+  Entity entity;
+  if (!freeIndices.empty()) {
+    entity.index = freeIndices.back();
+    freeIndices.pop_back();
+    entity.generation = ++generations[entity.index];
+  } else {
+    entity.index = (uint32_t)generations.size();
+    generations.push_back(0);
+  }
+  entityCount++;
+  return entity;
+}
+
+void Registry::Destroy(Entity entity) {
+  if (!Alive(entity)) return;
+  for (std::unique_ptr<ComponentPool>& pool : pools) {
+    if (pool) pool->Remove(entity.index);
+  }
+  generations[entity.index]++;
+  freeIndices.push_back(entity.index);
+  entityCount--;
+}
+
+void Registry::DestroyLater(Entity entity) {
+  std::lock_guard<std::mutex> lock(destroyMutex);
+  toDestroy.push_back(entity);
+}
+
+void Registry::Flush() {
+  // Destroy skips handles that are already gone, so doubles are fine
+  for (const Entity& entity : toDestroy) Destroy(entity);
+  toDestroy.clear();
+}
+
+void SystemSchedule::Add(const std::string& name, uint64_t reads,
+                         uint64_t writes,
+                         std::function<void(Registry&)> run) {
+  int wave = 0;
+  for (const System& other : systems) {
+    bool conflict = (writes & (other.reads | other.writes)) ||
+                    (reads & other.writes);
+    if (conflict) wave = std::max(wave, other.wave + 1);
+  }
+  systems.push_back({name, reads, writes, std::move(run), wave, 0.0});
+  waveCount = std::max(waveCount, wave + 1);
+}
+
+void SystemSchedule::Run(Registry& registry, JobSystem* jobs) {
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int wave = 0; wave < waveCount; wave++) {
+    JobCounter counter;
+    System* mine = nullptr;  // the first of the wave runs here
+    for (System& system : systems) {
+      if (system.wave != wave) continue;
+      auto run = [&registry, &system]() {
+        auto t = std::chrono::high_resolution_clock::now();
+        system.run(registry);
+        system.ms = MillisecondsSince(t);
+      };
+      if (!mine || !jobs) {
+        if (!mine) {
+          mine = &system;
+        } else {
+          run();
+        }
+        continue;
+      }
+      jobs->Submit(run, &counter);
+    }
+    if (mine) {
+      auto t = std::chrono::high_resolution_clock::now();
+      mine->run(registry);
+      mine->ms = MillisecondsSince(t);
+    }
+    if (jobs) jobs->Wait(counter);
+  }
+  registry.Flush();
+  lastMs = MillisecondsSince(start);
+}
+
+namespace {
+
+struct BenchPosition {
+  glm::vec3 value;
+};
+struct BenchVelocity {
+  glm::vec3 value;
+};
+struct BenchBob {
+  float baseY;
+  float phase;
+};
+struct BenchSpin {
+  float yaw;
+};
+
+// components of the iteration check: each knows its entity, and its bit
+struct CheckA {
+  static const uint8_t bit = 1;
+  uint32_t owner;
+};
+struct CheckB {
+  static const uint8_t bit = 2;
+  uint32_t owner;
+};
+struct CheckC {
+  static const uint8_t bit = 4;
+  uint32_t owner;
+};
+
+// what an item looked like in main.cpp, plus the matrix it used to carry
+struct BenchObject {
+  glm::vec3 position;
+  glm::vec3 velocity;
+  float baseY;
+  float phase;
+  float yaw;
+  bool bobs;
+  uint32_t body;
+  glm::mat4 model;
+};
+
+// Each or ParallelEach over Ts, counting visits per entity index; returns
+// the visits that were handed a dead entity or another entity's components
+template <typename... Ts>
+int CountVisits(Registry& registry, JobSystem* jobs,
+                std::vector<std::atomic<int>>& visits) {
+  for (std::atomic<int>& v : visits) v = 0;
+  std::atomic<int> bad{0};
+  auto visit = [&](Entity entity, Ts&... components) {
+    visits[entity.index]++;
+    bool own = ((components.owner == entity.index) && ...);
+    if (!own || !registry.Alive(entity)) bad++;
+  };
+  if (jobs) {
+    registry.ParallelEach<Ts...>(jobs, 64, visit);
+  } else {
+    registry.Each<Ts...>(visit);
+  }
+  return bad;
+}
+
+}  // namespace
+
+int VerifyEcs(int entities, JobSystem& jobs) {
+  std::mt19937 rng(45);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  Registry registry;
+  // what each index should have, kept next to the registry
+  std::vector<Entity> handles;
+  std::vector<uint8_t> has;
+  auto give = [&](Entity entity, uint8_t bits) {
+    if (entity.index >= handles.size()) {
+      handles.resize(entity.index + 1, ENTITY_NONE);
+      has.resize(entity.index + 1, 0);
+    }
+    handles[entity.index] = entity;
+    if (bits & CheckA::bit) registry.Add<CheckA>(entity, {entity.index});
+    if (bits & CheckB::bit) registry.Add<CheckB>(entity, {entity.index});
+    if (bits & CheckC::bit) registry.Add<CheckC>(entity, {entity.index});
+    has[entity.index] |= bits;
+  };
+  auto randomBits = [&]() {
+    return (uint8_t)((unit(rng) < 0.7f ? CheckA::bit : 0) |
+                     (unit(rng) < 0.5f ? CheckB::bit : 0) |
+                     (unit(rng) < 0.3f ? CheckC::bit : 0));
+  };
+  for (int i = 0; i < entities; i++) give(registry.Create(), randomBits());
+  // churn: destroyed entities, dropped components, reused indices
+  for (size_t i = 0; i < handles.size(); i++) {
+    float roll = unit(rng);
+    if (roll < 0.2f) {
+      registry.Destroy(handles[i]);
+      handles[i] = ENTITY_NONE;
+      has[i] = 0;
+    } else if (roll < 0.3f) {
+      registry.Remove<CheckB>(handles[i]);
+      has[i] &= ~CheckB::bit;
+    }
+  }
+  for (int i = 0; i < entities / 10; i++) {
+    give(registry.Create(), randomBits());
+  }
+
+  std::vector<std::atomic<int>> visits(handles.size());
+  int wrong = 0;
+  auto compare = [&](const char* what, uint8_t need, int bad) {
+    int off = bad;
+    for (size_t i = 0; i < handles.size(); i++) {
+      bool match = handles[i] != ENTITY_NONE && (has[i] & need) == need;
+      if (visits[i] != (match ? 1 : 0)) off++;
+    }
+    if (off) {
+      std::cout << "  wrong: " << what << ", " << off << " entities"
+                << std::endl;
+    }
+    wrong += off;
+  };
+  for (JobSystem* on : {(JobSystem*)nullptr, &jobs}) {
+    const char* how = on ? "ParallelEach" : "Each";
+    compare((std::string(how) + "<A>").c_str(), CheckA::bit,
+            CountVisits<CheckA>(registry, on, visits));
+    compare((std::string(how) + "<A, B>").c_str(),
+            CheckA::bit | CheckB::bit,
+            CountVisits<CheckA, CheckB>(registry, on, visits));
+    compare((std::string(how) + "<C, B>").c_str(),
+            CheckB::bit | CheckC::bit,
+            CountVisits<CheckC, CheckB>(registry, on, visits));
+    compare((std::string(how) + "<A, B, C>").c_str(),
+            CheckA::bit | CheckB::bit | CheckC::bit,
+            CountVisits<CheckA, CheckB, CheckC>(registry, on, visits));
+  }
+
+  // a schedule whose systems each count their own visits, the last one
+  // destroying some of what it visits for Run to flush
+  std::vector<std::atomic<int>> byA(handles.size()), byAB(handles.size()),
+      byC(handles.size());
+  std::atomic<int> bad{0};
+  SystemSchedule schedule;
+  schedule.Add("a", 0, ComponentMask<CheckA>(), [&](Registry& r) {
+    r.ParallelEach<CheckA>(&jobs, 64, [&](Entity entity, CheckA& a) {
+      byA[entity.index]++;
+      if (a.owner != entity.index) bad++;
+    });
+  });
+  schedule.Add("ab", ComponentMask<CheckB>(), ComponentMask<CheckA>(),
+               [&](Registry& r) {
+                 r.Each<CheckA, CheckB>(
+                     [&](Entity entity, CheckA& a, CheckB& b) {
+                       byAB[entity.index]++;
+                       if (a.owner != entity.index ||
+                           b.owner != entity.index) {
+                         bad++;
+                       }
+                     });
+               });
+  schedule.Add("c", 0, ComponentMask<CheckC>(), [&](Registry& r) {
+    r.ParallelEach<CheckC>(&jobs, 64, [&](Entity entity, CheckC& c) {
+      byC[entity.index]++;
+      if (c.owner != entity.index) bad++;
+      if (entity.index % 7 == 0) r.DestroyLater(entity);
+    });
+  });
+  schedule.Run(registry, &jobs);
+  visits.swap(byA);
+  compare("system a", CheckA::bit, bad.exchange(0));
+  visits.swap(byAB);
+  compare("system ab", CheckA::bit | CheckB::bit, 0);
+  visits.swap(byC);
+  compare("system c", CheckC::bit, 0);
+  int survivors = 0;
+  for (size_t i = 0; i < handles.size(); i++) {
+    if (handles[i] == ENTITY_NONE) continue;
+    bool destroyed = (has[i] & CheckC::bit) && i % 7 == 0;
+    if (registry.Alive(handles[i]) == destroyed) wrong++;
+    if (!destroyed) survivors++;
+  }
+  if (registry.EntityCount() != survivors) wrong++;
+
+  std::cout << "ECS check: " << registry.EntityCount() << " of "
+            << handles.size() << " entities left, 8 queries and "
+            << schedule.SystemCount() << " systems in "
+            << schedule.WaveCount() << " waves, " << wrong << " wrong"
+            << std::endl;
+  return wrong;
+}
+
+double BenchmarkEcs(int entities, JobSystem& jobs) {
+  std::mt19937 rng(45);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  const float dt = 1.0f / 60.0f;
+  const int frames = 100;
+
+  Registry registry;
+  std::vector<BenchObject> objects(entities);
+  for (int i = 0; i < entities; i++) {
+    glm::vec3 position(unit(rng) * 500.0f, 0.0f, unit(rng) * 500.0f);
+    glm::vec3 velocity(unit(rng), 0.0f, unit(rng));
+    bool bobs = i % 4 == 0;
+    objects[i] = {position, velocity, 0.0f, (float)i, 0.0f,
+                  bobs, (uint32_t)i, glm::mat4(1.0f)};
+    Entity entity = registry.Create();
+    registry.Add<BenchPosition>(entity, {position});
+    registry.Add<BenchVelocity>(entity, {velocity});
+    registry.Add<BenchSpin>(entity, {0.0f});
+    if (bobs) registry.Add<BenchBob>(entity, {0.0f, (float)i});
+  }
+  // churn a few so the slots aren't in creation order any more
+  std::vector<Entity> spare;
+  for (int i = 0; i < entities / 10; i++) {
+    Entity entity = registry.Create();
+    registry.Add<BenchPosition>(entity, {glm::vec3(0.0f)});
+    spare.push_back(entity);
+  }
+  for (size_t i = 0; i < spare.size(); i += 2) registry.Destroy(spare[i]);
+
+  auto perEntity = [&](std::chrono::high_resolution_clock::time_point t) {
+    return MillisecondsSince(t) * 1.0e6 / ((double)frames * entities);
+  };
+  float time = 0.0f;
+  auto move = [dt](Entity, BenchPosition& p, const BenchVelocity& v) {
+    p.value += v.value * dt;
+  };
+  auto bob = [&time](Entity, BenchPosition& p, const BenchBob& b) {
+    p.value.y = b.baseY + 0.15f * std::sin(time * 2.0f + b.phase);
+  };
+  auto spin = [&time](Entity, BenchSpin& s) { s.yaw = time * 1.5f; };
+
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int frame = 0; frame < frames; frame++) {
+    time += dt;
+    for (BenchObject& object : objects) {
+      object.position += object.velocity * dt;
+      if (object.bobs) {
+        object.position.y =
+            object.baseY + 0.15f * std::sin(time * 2.0f + object.phase);
+      }
+      object.yaw = time * 1.5f;
+    }
+  }
+  double structNs = perEntity(start);
+
+  start = std::chrono::high_resolution_clock::now();
+  for (int frame = 0; frame < frames; frame++) {
+    time += dt;
+    registry.Each<BenchPosition, BenchVelocity>(move);
+    registry.Each<BenchPosition, BenchBob>(bob);
+    registry.Each<BenchSpin>(spin);
+  }
+  double eachNs = perEntity(start);
+
+  int grain = std::max(1024, entities / ((int)jobs.ThreadCount() * 4 + 4));
+  start = std::chrono::high_resolution_clock::now();
+  for (int frame = 0; frame < frames; frame++) {
+    time += dt;
+    registry.ParallelEach<BenchPosition, BenchVelocity>(&jobs, grain, move);
+    registry.ParallelEach<BenchPosition, BenchBob>(&jobs, grain, bob);
+    registry.ParallelEach<BenchSpin>(&jobs, grain, spin);
+  }
+  double parallelNs = perEntity(start);
+
+  // move and bob both write positions so they take turns, spin doesn't
+  // care and runs next to move
+  SystemSchedule schedule;
+  schedule.Add("move", ComponentMask<BenchVelocity>(),
+               ComponentMask<BenchPosition>(), [&](Registry& r) {
+                 r.ParallelEach<BenchPosition, BenchVelocity>(&jobs, grain,
+                                                              move);
+               });
+  schedule.Add("spin", 0, ComponentMask<BenchSpin>(), [&](Registry& r) {
+    r.ParallelEach<BenchSpin>(&jobs, grain, spin);
+  });
+  schedule.Add("bob", ComponentMask<BenchBob>(),
+               ComponentMask<BenchPosition>(), [&](Registry& r) {
+                 r.ParallelEach<BenchPosition, BenchBob>(&jobs, grain, bob);
+               });
+  start = std::chrono::high_resolution_clock::now();
+  for (int frame = 0; frame < frames; frame++) {
+    time += dt;
+    schedule.Run(registry, &jobs);
+  }
+  double scheduleNs = perEntity(start);
+
+  // keep the results alive
+  float sum = 0.0f;
+  for (const BenchObject& object : objects) sum += object.position.x;
+  registry.Each<BenchPosition>(
+      [&sum](Entity, const BenchPosition& p) { sum += p.value.x; });
+
+  std::cout << "ECS " << entities << " entities, " << frames
+            << " frames, ns per entity per frame (" << sum << "):\n"
+            << "  struct array " << structNs << "\n"
+            << "  each         " << eachNs << "\n"
+            << "  parallel     " << parallelNs << " on "
+            << jobs.ThreadCount() + 1 << " threads\n"
+            << "  schedule     " << scheduleNs << " in "
+            << schedule.WaveCount() << " waves" << std::endl;
+  return eachNs;
+}
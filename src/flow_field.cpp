@@ -0,0 +1,506 @@
+#include "flow_field.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include "pathfinder.hpp"
+
+namespace {
+
+// neighbour offsets by direction, the odd ones diagonal
+const int DIR_X[8] = {1, 1, 0, -1, -1, -1, 0, 1};
+const int DIR_Z[8] = {0, 1, 1, 1, 0, -1, -1, -1};
+const uint32_t STRAIGHT = 10;
+const uint32_t DIAGONAL = 14;
+
+int FloorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+
+uint64_t CellKey(int x, int z) {
+  return ((uint64_t)(uint32_t)x << 32) | (uint32_t)z;
+}
+
+double MillisecondsSince(std::chrono::high_resolution_clock::time_point t) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::high_resolution_clock::now() - t)
+      .count();
+}
+
+}  // namespace
+
+glm::vec3 FlowField::Sample(const glm::vec3& position) const {
+  static const float D = 0.70710678f;
+  static const glm::vec3 UNIT[9] = {
+      {1.0f, 0.0f, 0.0f}, {D, 0.0f, D},   {0.0f, 0.0f, 1.0f},
+      {-D, 0.0f, D},      {-1.0f, 0.0f, 0.0f}, {-D, 0.0f, -D},
+      {0.0f, 0.0f, -1.0f}, {D, 0.0f, -D},  {0.0f, 0.0f, 0.0f}};
+  int x = (int)std::floor(position.x / cellSize) - originX;
+  int z = (int)std::floor(position.z / cellSize) - originZ;
+  if (x < 0 || z < 0 || x >= size || z >= size) return UNIT[FLOW_NONE];
+  return UNIT[directions[z * size + x]];
+}
+
+float FlowField::Height(const glm::vec3& position) const {
+  int x = (int)std::floor(position.x / cellSize) - originX;
+  int z = (int)std::floor(position.z / cellSize) - originZ;
+  if (x < 0 || z < 0 || x >= size || z >= size) return position.y;
+  int i = z * size + x;
+  return integration[i] != FLOW_UNREACHABLE ? heights[i] : position.y;
+}
+
+uint32_t FlowField::Cost(const glm::vec3& position) const {
+  int x = (int)std::floor(position.x / cellSize) - originX;
+  int z = (int)std::floor(position.z / cellSize) - originZ;
+  if (x < 0 || z < 0 || x >= size || z >= size) return FLOW_UNREACHABLE;
+  return integration[z * size + x];
+}
+
+FlowFieldCache::FlowFieldCache(const NavMesh& navMesh, JobSystem* jobs,
+                               const FlowFieldSettings& settings)
+    : settings(settings),
+      navMesh(navMesh),
+      jobs(jobs),
+      tileCells(std::max(
+          1, (int)std::lround(navMesh.settings.tileSize / settings.cellSize))) {
+}
+
+void FlowFieldCache::TileChanged(ChunkCoord coord) {
+  costTiles.erase(coord);
+  int minX = coord.x * tileCells, minZ = coord.z * tileCells;
+  for (auto it = fields.begin(); it != fields.end();) {
+    const FlowField& field = *it->second.field;
+    bool overlaps = field.originX < minX + tileCells &&
+                    field.originX + field.size > minX &&
+                    field.originZ < minZ + tileCells &&
+                    field.originZ + field.size > minZ;
+    it = overlaps ? fields.erase(it) : std::next(it);
+  }
+}
+
+void FlowFieldCache::BuildCosts(ChunkCoord coord, CostTile& out) const {
+  out.costs.assign(tileCells * tileCells, 0);
+  out.heights.assign(tileCells * tileCells, 0.0f);
+  const NavTile* tile = navMesh.GetTile(coord);
+  if (!tile) return;
+  float cell = settings.cellSize;
+  float originX = coord.x * tileCells * cell;
+  float originZ = coord.z * tileCells * cell;
+  float steep = std::cos(glm::radians(settings.steepSlope));
+  uint8_t steepCost = (uint8_t)glm::clamp(settings.steepCost, 1, 255);
+  for (const NavPoly& poly : tile->polys) {
+    glm::vec3 min(1e30f), max(-1e30f);
+    for (int i = 0; i < poly.vertCount; i++) {
+      min = glm::min(min, tile->vertices[poly.verts[i]]);
+      max = glm::max(max, tile->vertices[poly.verts[i]]);
+    }
+    int x0 = std::max(0, (int)std::floor((min.x - originX) / cell));
+    int z0 = std::max(0, (int)std::floor((min.z - originZ) / cell));
+    int x1 = std::min(tileCells - 1, (int)std::floor((max.x - originX) / cell));
+    int z1 = std::min(tileCells - 1, (int)std::floor((max.z - originZ) / cell));
+    for (int z = z0; z <= z1; z++) {
+      for (int x = x0; x <= x1; x++) {
+        float px = originX + (x + 0.5f) * cell;
+        float pz = originZ + (z + 0.5f) * cell;
+        // the fan triangle the cell center is in gives height and slope
+        const glm::vec3& a = tile->vertices[poly.verts[0]];
+        for (int i = 1; i + 1 < poly.vertCount; i++) {
+          const glm::vec3& b = tile->vertices[poly.verts[i]];
+          const glm::vec3& c = tile->vertices[poly.verts[i + 1]];
+          float det = (b.x - a.x) * (c.z - a.z) - (c.x - a.x) * (b.z - a.z);
+          if (std::fabs(det) < 1e-8f) continue;
+          float u = ((px - a.x) * (c.z - a.z) - (c.x - a.x) * (pz - a.z)) /
+                    det;
+          float v = ((b.x - a.x) * (pz - a.z) - (px - a.x) * (b.z - a.z)) /
+                    det;
+          if (u < 0.0f || v < 0.0f || u + v > 1.0f) continue;
+          float height = a.y + u * (b.y - a.y) + v * (c.y - a.y);
+          int index = z * tileCells + x;
+          // one layer: where polys stack, the ground below wins
+          if (out.costs[index] && out.heights[index] <= height) break;
+          glm::vec3 normal = glm::normalize(glm::cross(c - a, b - a));
+          out.costs[index] = std::fabs(normal.y) < steep ? steepCost : 1;
+          out.heights[index] = height;
+          break;
+        }
+      }
+    }
+  }
+}
+
+std::shared_ptr<const FlowField> FlowFieldCache::Get(
+    const glm::vec3& target) {
+  int targetX = (int)std::floor(target.x / settings.cellSize);
+  int targetZ = (int)std::floor(target.z / settings.cellSize);
+  uint64_t key = CellKey(targetX, targetZ);
+  auto cached = fields.find(key);
+  if (cached != fields.end()) {
+    cached->second.lastUsed = ++useCount;
+    cacheHits++;
+    return cached->second.field;
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  auto field = std::make_shared<FlowField>();
+  int size = settings.size;
+  field->targetX = targetX;
+  field->targetZ = targetZ;
+  field->originX = targetX - size / 2;
+  field->originZ = targetZ - size / 2;
+  field->size = size;
+  field->cellSize = settings.cellSize;
+  field->heights.assign(size * size, 0.0f);
+  std::vector<uint8_t> costs(size * size, 0);
+
+  // cost tiles under the field, the missing ones built side by side
+  int tileX0 = FloorDiv(field->originX, tileCells);
+  int tileZ0 = FloorDiv(field->originZ, tileCells);
+  int tileX1 = FloorDiv(field->originX + size - 1, tileCells);
+  int tileZ1 = FloorDiv(field->originZ + size - 1, tileCells);
+  std::vector<std::pair<ChunkCoord, CostTile*>> missing;
+  for (int tz = tileZ0; tz <= tileZ1; tz++) {
+    for (int tx = tileX0; tx <= tileX1; tx++) {
+      ChunkCoord coord{tx, tz};
+      if (!navMesh.GetTile(coord) || costTiles.count(coord)) continue;
+      missing.push_back({coord, &costTiles[coord]});
+    }
+  }
+  auto buildCosts = [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      BuildCosts(missing[i].first, *missing[i].second);
+    }
+  };
+  if (jobs) {
+    jobs->ParallelFor((int)missing.size(), 1, buildCosts);
+  } else {
+    buildCosts(0, (int)missing.size());
+  }
+  for (int tz = tileZ0; tz <= tileZ1; tz++) {
+    for (int tx = tileX0; tx <= tileX1; tx++) {
+      auto it = costTiles.find({tx, tz});
+      if (it == costTiles.end()) continue;
+      const CostTile& tile = it->second;
+      // the part of the tile inside the field, row by row
+      int x0 = std::max(tx * tileCells, field->originX);
+      int x1 = std::min((tx + 1) * tileCells, field->originX + size);
+      int z0 = std::max(tz * tileCells, field->originZ);
+      int z1 = std::min((tz + 1) * tileCells, field->originZ + size);
+      for (int z = z0; z < z1; z++) {
+        int from = (z - tz * tileCells) * tileCells + x0 - tx * tileCells;
+        int to = (z - field->originZ) * size + x0 - field->originX;
+        std::copy(tile.costs.begin() + from,
+                  tile.costs.begin() + from + (x1 - x0), costs.begin() + to);
+        std::copy(tile.heights.begin() + from,
+                  tile.heights.begin() + from + (x1 - x0),
+                  field->heights.begin() + to);
+      }
+    }
+  }
+
+  // the target may stand where the agent radius erodes the mesh away, e.g.
+  // against a trunk, so start from the nearest walkable cell near it
+  int seed = -1;
+  int bestDistance = 0;
+  for (int dz = -3; dz <= 3; dz++) {
+    for (int dx = -3; dx <= 3; dx++) {
+      int x = size / 2 + dx, z = size / 2 + dz;
+      int distance = dx * dx + dz * dz;
+      if (!costs[z * size + x] || (seed >= 0 && distance >= bestDistance)) {
+        continue;
+      }
+      seed = z * size + x;
+      bestDistance = distance;
+    }
+  }
+  if (seed < 0) return nullptr;
+
+  std::vector<uint8_t> moves;
+  Moves(*field, costs, moves);
+  Integrate(*field, costs, moves, seed);
+  Directions(*field, moves);
+  buildMs = MillisecondsSince(start);
+  built++;
+
+  if ((int)fields.size() >= std::max(settings.maxCached, 1)) {
+    auto oldest = fields.begin();
+    for (auto it = fields.begin(); it != fields.end(); ++it) {
+      if (it->second.lastUsed < oldest->second.lastUsed) oldest = it;
+    }
+    fields.erase(oldest);
+  }
+  fields[key] = {field, ++useCount};
+  return field;
+}
+
+// Which of its neighbours an agent can step to from each cell, a bit per
+// direction: walkable, not up or down more than the navmesh allows and,
+// going diagonally, not across the corner of a blocked cell.
+void FlowFieldCache::Moves(const FlowField& field,
+                           const std::vector<uint8_t>& costs,
+                           std::vector<uint8_t>& moves) const {
+  int size = field.size;
+  const NavMeshSettings& nav = navMesh.settings;
+  float maxRise = settings.cellSize * 1.4142136f *
+                      std::tan(glm::radians(nav.maxSlope)) +
+                  nav.agentClimb;
+  moves.assign(size * size, 0);
+  auto rows = [&](int begin, int end) {
+    for (int z = begin; z < end; z++) {
+      for (int x = 0; x < size; x++) {
+        int cell = z * size + x;
+        if (!costs[cell]) continue;
+        float height = field.heights[cell];
+        uint8_t mask = 0;
+        for (int dir = 0; dir < 8; dir += 2) {
+          int nx = x + DIR_X[dir], nz = z + DIR_Z[dir];
+          if (nx < 0 || nz < 0 || nx >= size || nz >= size) continue;
+          int next = nz * size + nx;
+          if (costs[next] &&
+              std::fabs(field.heights[next] - height) <= maxRise) {
+            mask |= 1 << dir;
+          }
+        }
+        for (int dir = 1; dir < 8; dir += 2) {
+          // both straight moves around the corner must be open
+          int around = (1 << (dir - 1)) | (1 << ((dir + 1) & 7));
+          if ((mask & around) != around) continue;
+          int next = (z + DIR_Z[dir]) * size + x + DIR_X[dir];
+          if (costs[next] &&
+              std::fabs(field.heights[next] - height) <= maxRise) {
+            mask |= 1 << dir;
+          }
+        }
+        moves[cell] = mask;
+      }
+    }
+  };
+  if (jobs) {
+    jobs->ParallelFor(size, 16, rows);
+  } else {
+    rows(0, size);
+  }
+}
+
+// Dijkstra with buckets one straight step wide (Dial's algorithm). No step
+// costs less than a bucket, so nothing in a bucket can lower anything else
+// in it: every cell in the current bucket is final and the whole bucket is
+// one wave that can be relaxed in parallel. Cells lowered by several
+// threads at once may be queued twice; the settled flags skip most copies.
+void FlowFieldCache::Integrate(FlowField& field,
+                               const std::vector<uint8_t>& costs,
+                               const std::vector<uint8_t>& moves, int seed) {
+  int size = field.size;
+  int count = size * size;
+  uint32_t maxCost = 1;
+  for (uint8_t cost : costs) maxCost = std::max(maxCost, (uint32_t)cost);
+  int ring = (int)(DIAGONAL * maxCost / STRAIGHT) + 2;
+
+  std::unique_ptr<std::atomic<uint32_t>[]> distance(
+      new std::atomic<uint32_t>[count]);
+  std::unique_ptr<std::atomic<uint8_t>[]> settled(
+      new std::atomic<uint8_t>[count]);
+  for (int i = 0; i < count; i++) {
+    distance[i].store(FLOW_UNREACHABLE, std::memory_order_relaxed);
+    settled[i].store(0, std::memory_order_relaxed);
+  }
+
+  int chunks = jobs ? (int)jobs->ThreadCount() + 1 : 1;
+  std::vector<std::vector<int>> buckets(ring);
+  // per chunk, the cells it queued into each bucket
+  std::vector<std::vector<std::vector<int>>> queued(
+      chunks, std::vector<std::vector<int>>(ring));
+  distance[seed].store(0, std::memory_order_relaxed);
+  buckets[0].push_back(seed);
+  size_t waiting = 1;
+
+  auto relax = [&](const std::vector<int>& wave, int begin, int end,
+                   std::vector<std::vector<int>>& out) {
+    for (int w = begin; w < end; w++) {
+      int cell = wave[w];
+      // a copy on another thread may relax it too, which is harmless
+      if (settled[cell].load(std::memory_order_relaxed)) continue;
+      settled[cell].store(1, std::memory_order_relaxed);
+      uint32_t d = distance[cell].load(std::memory_order_relaxed);
+      for (int dir = 0; dir < 8; dir++) {
+        if (!(moves[cell] & (1 << dir))) continue;
+        int next = cell + DIR_Z[dir] * size + DIR_X[dir];
+        if (settled[next].load(std::memory_order_relaxed)) continue;
+        uint32_t nd = d + ((dir & 1) ? DIAGONAL : STRAIGHT) * costs[next];
+        uint32_t current = distance[next].load(std::memory_order_relaxed);
+        while (nd < current) {
+          if (distance[next].compare_exchange_weak(
+                  current, nd, std::memory_order_relaxed)) {
+            out[(nd / STRAIGHT) % ring].push_back(next);
+            break;
+          }
+        }
+      }
+    }
+  };
+
+  waves = 0;
+  for (uint32_t band = 0; waiting > 0; band++) {
+    std::vector<int> wave;
+    wave.swap(buckets[band % ring]);
+    if (wave.empty()) continue;
+    waiting -= wave.size();
+    waves++;
+    int length = (int)wave.size();
+    if (!jobs || length < settings.parallelWave) {
+      relax(wave, 0, length, queued[0]);
+    } else {
+      int grain = (length + chunks - 1) / chunks;
+      jobs->ParallelFor(length, grain, [&](int begin, int end) {
+        relax(wave, begin, end, queued[begin / grain]);
+      });
+    }
+    for (auto& chunk : queued) {
+      for (int b = 0; b < ring; b++) {
+        buckets[b].insert(buckets[b].end(), chunk[b].begin(), chunk[b].end());
+        waiting += chunk[b].size();
+        chunk[b].clear();
+      }
+    }
+  }
+
+  field.integration.resize(count);
+  for (int i = 0; i < count; i++) {
+    field.integration[i] = distance[i].load(std::memory_order_relaxed);
+  }
+}
+
+void FlowFieldCache::Directions(FlowField& field,
+                                const std::vector<uint8_t>& moves) {
+  int size = field.size;
+  field.directions.assign(size * size, FLOW_NONE);
+  auto rows = [&](int begin, int end) {
+    for (int z = begin; z < end; z++) {
+      for (int x = 0; x < size; x++) {
+        int cell = z * size + x;
+        uint32_t best = field.integration[cell];
+        if (best == FLOW_UNREACHABLE) continue;
+        for (int dir = 0; dir < 8; dir++) {
+          if (!(moves[cell] & (1 << dir))) continue;
+          uint32_t d = field.integration[cell + DIR_Z[dir] * size + DIR_X[dir]];
+          if (d < best) {
+            best = d;
+            field.directions[cell] = (uint8_t)dir;
+          }
+        }
+      }
+    }
+  };
+  if (jobs) {
+    jobs->ParallelFor(size, 16, rows);
+  } else {
+    rows(0, size);
+  }
+}
+
+double BenchmarkFlowField(int tiles, int maxAgents, JobSystem& jobs) {
+  NavMeshSettings navSettings;
+  CollisionWorld world;
+  float extent = tiles * navSettings.tileSize;
+  MakeBenchmarkForest(extent, world);
+  NavMesh mesh(navSettings, jobs, "");
+  mesh.collision = &world;
+  mesh.maxInFlight = (int)jobs.ThreadCount() + 1;
+  HierarchicalPathfinder pathfinder(mesh);
+  mesh.onTileChanged = [&](ChunkCoord coord) {
+    pathfinder.TileChanged(coord);
+  };
+  for (int z = 0; z < tiles; z++) {
+    for (int x = 0; x < tiles; x++) mesh.RequestTile({x, z});
+  }
+  while (mesh.Queued() || mesh.Building()) {
+    mesh.Update();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  pathfinder.Update(1.0e12);
+
+  // one field over the whole forest, toward a spot on the mesh in the middle
+  FlowFieldSettings settings;
+  settings.size = (int)(extent / settings.cellSize);
+  NavPolyRef ref;
+  glm::vec3 middle(extent * 0.5f, 0.0f, extent * 0.5f);
+  middle.y = world.GroundHeight(middle.x, middle.z);
+  if (!mesh.FindPoly(middle, ref, extent)) return 0.0;
+  glm::vec3 target = mesh.GetTile(ref.tile)->PolyCenter(ref.poly);
+
+  // first build pays for the cost tiles too, then fresh targets nearby
+  const int runs = 8;
+  double costsMs = 0.0, fieldMs[2] = {0.0, 0.0};
+  int waves = 0;
+  for (int wide = 0; wide < 2; wide++) {
+    FlowFieldCache cache(mesh, wide ? &jobs : nullptr, settings);
+    auto start = std::chrono::high_resolution_clock::now();
+    if (!cache.Get(target)) return 0.0;
+    if (wide) costsMs = MillisecondsSince(start);
+    waves = cache.Waves();
+    for (int i = 1; i <= runs; i++) {
+      glm::vec3 moved = target + glm::vec3((float)(i % 3) - 1.0f, 0.0f,
+                                           (float)(i / 3) - 1.0f) *
+                                     settings.cellSize;
+      start = std::chrono::high_resolution_clock::now();
+      cache.Get(moved);
+      fieldMs[wide] += MillisecondsSince(start);
+    }
+    fieldMs[wide] /= runs;
+  }
+
+  FlowFieldCache cache(mesh, &jobs, settings);
+  std::shared_ptr<const FlowField> field = cache.Get(target);
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  auto randomPosition = [&]() {
+    for (;;) {
+      glm::vec3 p(unit(rng) * extent, 0.0f, unit(rng) * extent);
+      if (field->Cost(p) == FLOW_UNREACHABLE) continue;
+      p.y = field->Height(p);
+      return p;
+    }
+  };
+
+  // agents walk for a number of frames, asking the cache for the field
+  // every frame like the game does
+  const int frames = 60;
+  const float step = 4.0f / 60.0f;
+  double nsPerAgent = 0.0;
+  std::cout << "Flow field: " << settings.size << "x" << settings.size
+            << " cells, " << waves << " waves, cost tiles " << costsMs
+            << " ms, field " << fieldMs[0] << " ms on 1 thread, "
+            << fieldMs[1] << " ms on " << jobs.ThreadCount() + 1
+            << std::endl;
+  for (int agents = 1; agents <= std::max(maxAgents, 1); agents *= 10) {
+    std::vector<glm::vec3> positions(agents);
+    for (glm::vec3& p : positions) p = randomPosition();
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+      std::shared_ptr<const FlowField> current = cache.Get(target);
+      for (glm::vec3& p : positions) {
+        p += current->Sample(p) * step;
+        p.y = current->Height(p);
+      }
+    }
+    nsPerAgent =
+        MillisecondsSince(start) * 1.0e6 / ((double)frames * agents);
+    std::cout << "  " << agents << " agents: " << nsPerAgent
+              << " ns per agent per frame" << std::endl;
+    if (agents >= maxAgents) break;
+  }
+
+  // what each of them would pay for its own path instead
+  const int searches = 50;
+  std::vector<glm::vec3> path;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < searches; i++) {
+    pathfinder.FindPath(randomPosition(), target, path);
+  }
+  std::cout << "  HPA* per agent: "
+            << MillisecondsSince(start) * 1000.0 / searches << " us"
+            << std::endl;
+  return nsPerAgent;
+}
@@ -0,0 +1,211 @@
+#include "fog.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <glm/gtc/type_ptr.hpp>
+#include <iostream>
+
+#include "render_target.hpp"
+
+HeightFog::HeightFog(int size) : size(size), texels((size_t)size * size) {
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R16F, size, size, 0, GL_RED, GL_FLOAT,
+               nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+HeightFog::~HeightFog() { glDeleteTextures(1, &texture); }
+
+float HeightFog::Amount(const FogSettings& settings, float eyeHeight,
+                        float dirY, float distance) {
+  float atEye = settings.density *
+                std::exp(-settings.falloff * (eyeHeight - settings.baseHeight));
+  // the density falls off along the ray as exp(-x * t) for t in [0, 1]
+  float x = settings.falloff * dirY * distance;
+  float shape = std::abs(x) < 1e-4f ? 1.0f - 0.5f * x
+                                     : (1.0f - std::exp(-x)) / x;
+  return 1.0f - std::exp(-atEye * distance * shape);
+}
+
+void HeightFog::Update(float eyeHeight, float distance) {
+  // at the default falloff 10 cm changes the density at the eye by 1.5%,
+  // well under what the 8 bit colour it ends up in can show
+  bool same = settings.density == baked.density &&
+              settings.falloff == baked.falloff &&
+              settings.baseHeight == baked.baseHeight &&
+              distance == bakedDistance &&
+              std::abs(eyeHeight - bakedHeight) < 0.1f;
+  if (same) return;
+  auto start = std::chrono::high_resolution_clock::now();
+  baked = settings;
+  bakedHeight = eyeHeight;
+  bakedDistance = distance;
+
+  // across: direction y from -1 to 1, up: sqrt of the distance, so the
+  // first metres, where the fog changes fastest, get the most texels
+  for (int j = 0; j < size; j++) {
+    float v = j / (float)(size - 1);
+    for (int i = 0; i < size; i++) {
+      float dirY = i / (float)(size - 1) * 2.0f - 1.0f;
+      texels[(size_t)j * size + i] =
+          Amount(settings, eyeHeight, dirY, v * v * distance);
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RED, GL_FLOAT,
+                  texels.data());
+  glBindTexture(GL_TEXTURE_2D, 0);
+  bakes++;
+  bakeMs = std::chrono::duration<double, std::milli>(
+               std::chrono::high_resolution_clock::now() - start)
+               .count();
+}
+
+void HeightFog::Bind(const Shader& shader, int unit) const {
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glActiveTexture(GL_TEXTURE0);
+  shader.setInt("fogLut", unit);
+  shader.setBool("fogOn", settings.on);
+  glUniform3fv(glGetUniformLocation(shader.ID, "fogColor"), 1,
+               glm::value_ptr(settings.color));
+  shader.setFloat("fogDistance", bakedDistance);
+  glUniform3f(glGetUniformLocation(shader.ID, "fogParams"), settings.density,
+              settings.falloff, settings.baseHeight);
+}
+
+FogVolume::FogVolume(const FogVolumeSettings& settings)
+    : settings(settings),
+      shader("Shader/fullscreen.vs", "Shader/fog_volume.fs"),
+      compositeShader("Shader/fullscreen.vs", "Shader/fog_composite.fs") {
+  glGenFramebuffers(1, &FBO);
+  glGenTextures(1, &volume);
+  glGenTextures(2, running);
+  Allocate();
+}
+
+FogVolume::~FogVolume() {
+  glDeleteFramebuffers(1, &FBO);
+  glDeleteTextures(1, &volume);
+  glDeleteTextures(2, running);
+  glDeleteProgram(shader.ID);
+  glDeleteProgram(compositeShader.ID);
+}
+
+void FogVolume::Allocate() {
+  width = std::max(1, settings.width);
+  height = std::max(1, settings.height);
+  slices = std::max(1, settings.slices);
+
+  glBindTexture(GL_TEXTURE_3D, volume);
+  glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, width, height, slices, 0,
+               GL_RGBA, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_3D, 0);
+  for (unsigned int target : running) {
+    glBindTexture(GL_TEXTURE_2D, target);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA,
+                 GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, volume, 0,
+                            0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                         running[0], 0);
+  const GLenum targets[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, targets);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "ERROR::FRAMEBUFFER:: fog volume is not complete"
+              << std::endl;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void FogVolume::Render(const glm::vec3& eye, const glm::vec3& front,
+                       const glm::vec3& up, float fovY, float aspect) {
+  if (settings.width != width || settings.height != height ||
+      settings.slices != slices) {
+    Allocate();
+  }
+  renderTimer.Begin();
+  glm::vec3 right = glm::normalize(glm::cross(front, up));
+  glm::mat3 basis(right, glm::cross(right, front), -front);
+  float tanY = std::tan(fovY * 0.5f);
+
+  shader.use();
+  shader.setInt("fogRunning", 11);
+  shader.setInt("fogSlices", slices);
+  shader.setFloat("fogVolumeDistance", settings.distance);
+  shader.setFloat("fogScattering", settings.scattering);
+  shader.setFloat("fogAnisotropy", settings.anisotropy);
+  glUniform3fv(glGetUniformLocation(shader.ID, "fogEye"), 1,
+               glm::value_ptr(eye));
+  glUniformMatrix3fv(glGetUniformLocation(shader.ID, "fogBasis"), 1,
+                     GL_FALSE, glm::value_ptr(basis));
+  glUniform2f(glGetUniformLocation(shader.ID, "fogTan"), tanY * aspect, tanY);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+  glViewport(0, 0, width, height);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_BLEND);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  // nothing in front of the first slice: no light, all transmitted
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                         running[1], 0);
+  const float clear[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+  glClearBufferfv(GL_COLOR, 1, clear);
+  glActiveTexture(GL_TEXTURE11);
+  for (int k = 0; k < slices; k++) {
+    // read what the slices in front left, write this one's sum over it
+    glBindTexture(GL_TEXTURE_2D, running[(k + 1) & 1]);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, volume,
+                              0, k);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+                           GL_TEXTURE_2D, running[k & 1], 0);
+    shader.setInt("fogSlice", k);
+    DrawFullscreenTriangle();
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glActiveTexture(GL_TEXTURE0);
+  glEnable(GL_DEPTH_TEST);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  renderTimer.End();
+}
+
+void FogVolume::Composite(unsigned int depthTexture, float nearPlane,
+                          float farPlane, int width, int height) {
+  compositeTimer.Begin();
+  glViewport(0, 0, width, height);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE);
+  compositeShader.use();
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, depthTexture);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_3D, volume);
+  compositeShader.setInt("sceneDepth", 0);
+  compositeShader.setInt("fogVolume", 1);
+  glUniform2f(glGetUniformLocation(compositeShader.ID, "fogPlanes"),
+              nearPlane, farPlane);
+  compositeShader.setFloat("fogVolumeDistance", settings.distance);
+  DrawFullscreenTriangle();
+  glBindTexture(GL_TEXTURE_3D, 0);
+  glActiveTexture(GL_TEXTURE0);
+  glDisable(GL_BLEND);
+  glEnable(GL_DEPTH_TEST);
+  compositeTimer.End();
+}
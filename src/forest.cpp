@@ -0,0 +1,297 @@
+#include "forest.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace {
+
+uint32_t Hash(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+uint32_t Hash(uint32_t seed, int x, int z) {
+  return Hash(seed ^ Hash((uint32_t)x * 0x9e3779b9U ^ Hash((uint32_t)z)));
+}
+
+float Unit(uint32_t h) { return (h >> 8) * (1.0f / 16777216.0f); }
+
+// small xorshift, one per tile
+struct Rng {
+  uint32_t state;
+  explicit Rng(uint32_t seed) : state(seed ? seed : 0x6d2b79f5U) {}
+  float Next() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return Unit(state);
+  }
+};
+
+float ValueNoise(uint32_t seed, float x, float z) {
+  int ix = (int)std::floor(x);
+  int iz = (int)std::floor(z);
+  float fx = x - ix;
+  float fz = z - iz;
+  fx = fx * fx * (3.0f - 2.0f * fx);
+  fz = fz * fz * (3.0f - 2.0f * fz);
+  float a = Unit(Hash(seed, ix, iz));
+  float b = Unit(Hash(seed, ix + 1, iz));
+  float c = Unit(Hash(seed, ix, iz + 1));
+  float d = Unit(Hash(seed, ix + 1, iz + 1));
+  return (a + (b - a) * fx) + ((c + (d - c) * fx) - (a + (b - a) * fx)) * fz;
+}
+
+float Smoothstep(float edge0, float edge1, float x) {
+  float t = std::min(std::max((x - edge0) / (edge1 - edge0), 0.0f), 1.0f);
+  return t * t * (3.0f - 2.0f * t);
+}
+
+const float EMPTY = std::numeric_limits<float>::infinity();
+
+// background grid over all tiles, at most one sample per cell
+struct SampleGrid {
+  glm::vec2 origin;
+  float cellSize;
+  int width, height;
+  int reach;  // cells to search around a candidate
+  std::vector<glm::vec2> cells;
+
+  glm::vec2& At(int x, int z) { return cells[(size_t)z * width + x]; }
+
+  bool Fits(const glm::vec2& p, float minDist2) {
+    int cx = (int)((p.x - origin.x) / cellSize);
+    int cz = (int)((p.y - origin.y) / cellSize);
+    int x0 = std::max(cx - reach, 0), x1 = std::min(cx + reach, width - 1);
+    int z0 = std::max(cz - reach, 0), z1 = std::min(cz + reach, height - 1);
+    for (int z = z0; z <= z1; z++) {
+      for (int x = x0; x <= x1; x++) {
+        const glm::vec2& q = At(x, z);
+        if (q.x == EMPTY) continue;
+        glm::vec2 d = q - p;
+        if (d.x * d.x + d.y * d.y < minDist2) return false;
+      }
+    }
+    return true;
+  }
+
+  void Insert(const glm::vec2& p) {
+    int cx = std::min((int)((p.x - origin.x) / cellSize), width - 1);
+    int cz = std::min((int)((p.y - origin.y) / cellSize), height - 1);
+    At(cx, cz) = p;
+  }
+};
+
+const int ATTEMPTS = 30;  // bridson's k
+const int SEEDS = 8;      // random starts per tile, so gaps get filled
+
+}  // namespace
+
+float ForestDensity(const ForestSettings& settings, float x, float z) {
+  float s = settings.noiseScale;
+  float n = ValueNoise(settings.seed, x * s, z * s) * 0.65f +
+            ValueNoise(settings.seed + 1, x * s * 3.1f, z * s * 3.1f) * 0.35f;
+  float density = settings.minDensity +
+                  (1.0f - settings.minDensity) * Smoothstep(0.3f, 0.65f, n);
+  float fromSpawn = std::sqrt(x * x + z * z);
+  density *= Smoothstep(settings.clearingRadius,
+                        settings.clearingRadius + 8.0f, fromSpawn);
+  return density;
+}
+
+namespace {
+
+// Bridson inside [boxMin, boxMax) of one chunk, samples never leave the box
+int GenerateTile(Chunk& chunk, float chunkSize, const ForestSettings& settings,
+                 const glm::vec2& boxMin, const glm::vec2& boxMax) {
+  chunk.trees.clear();
+  if (boxMin.x >= boxMax.x || boxMin.y >= boxMax.y) return 0;
+
+  // cells must tile the chunk exactly and stay <= spacing / sqrt(2)
+  float spacing = settings.spacing;
+  int cellsPerTile = (int)std::ceil(chunkSize / (spacing / std::sqrt(2.0f)));
+  SampleGrid grid;
+  grid.origin = glm::vec2(chunk.coord.x, chunk.coord.z) * chunkSize;
+  grid.cellSize = chunkSize / cellsPerTile;
+  grid.width = cellsPerTile;
+  grid.height = cellsPerTile;
+  grid.reach = (int)std::ceil(spacing / grid.cellSize);
+  grid.cells.assign((size_t)grid.width * grid.height, glm::vec2(EMPTY));
+
+  float minDist2 = spacing * spacing;
+  Rng rng(Hash(settings.seed, chunk.coord.x, chunk.coord.z));
+  std::vector<glm::vec2> active;
+  int samples = 0;
+
+  auto accept = [&](const glm::vec2& p) {
+    grid.Insert(p);
+    active.push_back(p);
+    samples++;
+    // thinning uses its own hash so the poisson set stays the same when
+    // only the mask changes
+    uint32_t h = Hash(settings.seed ^ 0xa511e9b3U,
+                      (int)std::floor(p.x * 16.0f),
+                      (int)std::floor(p.y * 16.0f));
+    if (Unit(h) >= ForestDensity(settings, p.x, p.y)) return;
+    float scale = settings.minScale +
+                  (settings.maxScale - settings.minScale) * Unit(Hash(h));
+    float yaw = Unit(Hash(h + 1)) * 6.2831853f;
+    float ground = settings.groundHeight ? settings.groundHeight(p.x, p.y)
+                                         : settings.groundY;
+    chunk.trees.push_back({glm::vec3(p.x, ground, p.y), scale, yaw});
+  };
+  auto inside = [&](const glm::vec2& p) {
+    return p.x >= boxMin.x && p.x < boxMax.x && p.y >= boxMin.y &&
+           p.y < boxMax.y;
+  };
+
+  for (int i = 0; i < SEEDS; i++) {
+    glm::vec2 p =
+        boxMin + (boxMax - boxMin) * glm::vec2(rng.Next(), rng.Next());
+    if (grid.Fits(p, minDist2)) accept(p);
+
+    while (!active.empty()) {
+      size_t pick = (size_t)(rng.Next() * active.size());
+      pick = std::min(pick, active.size() - 1);
+      glm::vec2 from = active[pick];
+      bool found = false;
+      for (int k = 0; k < ATTEMPTS; k++) {
+        float angle = rng.Next() * 6.2831853f;
+        // uniform by area over the annulus [r, 2r]
+        float radius = spacing * std::sqrt(1.0f + 3.0f * rng.Next());
+        glm::vec2 q =
+            from + glm::vec2(std::cos(angle), std::sin(angle)) * radius;
+        if (!inside(q) || !grid.Fits(q, minDist2)) continue;
+        accept(q);
+        found = true;
+        break;
+      }
+      if (!found) {
+        active[pick] = active.back();
+        active.pop_back();
+      }
+    }
+  }
+  return samples;
+}
+
+}  // namespace
+
+int GenerateForestChunk(Chunk& chunk, float chunkSize,
+                        const ForestSettings& settings) {
+  glm::vec2 origin = glm::vec2(chunk.coord.x, chunk.coord.z) * chunkSize;
+  float inset = settings.spacing * 0.5f;
+  return GenerateTile(chunk, chunkSize, settings, origin + glm::vec2(inset),
+                      origin + glm::vec2(chunkSize - inset));
+}
+
+ForestStats GenerateForest(World& world, const ForestSettings& settings,
+                           JobSystem* jobs) {
+  auto start = std::chrono::high_resolution_clock::now();
+  ForestStats stats;
+
+  ChunkCoord lo = world.ChunkAt(settings.areaMin.x, settings.areaMin.y);
+  ChunkCoord hi = world.ChunkAt(settings.areaMax.x, settings.areaMax.y);
+  int tilesX = hi.x - lo.x + 1;
+  int tilesZ = hi.z - lo.z + 1;
+
+  // create every chunk up front, the map must not change under the workers
+  std::vector<Chunk*> tiles(tilesX * tilesZ);
+  for (int z = 0; z < tilesZ; z++) {
+    for (int x = 0; x < tilesX; x++) {
+      tiles[z * tilesX + x] = &world.GetChunk({lo.x + x, lo.z + z});
+    }
+  }
+  std::vector<int> samplesPerTile(tiles.size(), 0);
+
+  // tiles share nothing, so they all go wide at once
+  float inset = settings.spacing * 0.5f;
+  auto runTiles = [&](int begin, int end) {
+    for (int tile = begin; tile < end; tile++) {
+      Chunk& chunk = *tiles[tile];
+      glm::vec2 origin = world.ChunkOrigin(chunk.coord);
+      glm::vec2 boxMin = glm::max(origin + glm::vec2(inset), settings.areaMin);
+      glm::vec2 boxMax = glm::min(origin + glm::vec2(world.chunkSize - inset),
+                                  settings.areaMax);
+      samplesPerTile[tile] =
+          GenerateTile(chunk, world.chunkSize, settings, boxMin, boxMax);
+    }
+  };
+  if (jobs) {
+    jobs->ParallelFor((int)tiles.size(), 1, runTiles);
+  } else {
+    runTiles(0, (int)tiles.size());
+  }
+
+  for (size_t i = 0; i < tiles.size(); i++) {
+    stats.samples += samplesPerTile[i];
+    stats.trees += (int)tiles[i]->trees.size();
+  }
+  stats.tiles = (int)tiles.size();
+  stats.milliseconds = std::chrono::duration<double, std::milli>(
+                           std::chrono::high_resolution_clock::now() - start)
+                           .count();
+  return stats;
+}
+
+double BenchmarkForest(float size, JobSystem& jobs) {
+  ForestSettings settings;
+  settings.areaMin = glm::vec2(-0.5f * size);
+  settings.areaMax = glm::vec2(0.5f * size);
+
+  World single(64.0f);
+  ForestStats one = GenerateForest(single, settings, nullptr);
+  World wide(64.0f);
+  ForestStats all = GenerateForest(wide, settings, &jobs);
+
+  // the same trees either way, and never two closer than the spacing
+  int differ = 0;
+  for (const auto& entry : single.chunks) {
+    const Chunk* other = wide.FindChunk(entry.first);
+    const std::vector<TreeInstance>& trees = entry.second.trees;
+    if (!other || other->trees.size() != trees.size()) {
+      differ++;
+      continue;
+    }
+    for (size_t i = 0; i < trees.size(); i++) {
+      if (trees[i].position != other->trees[i].position) {
+        differ++;
+        break;
+      }
+    }
+  }
+  int tooClose = 0;
+  float minDist2 = settings.spacing * settings.spacing * 0.999f;
+  for (const auto& entry : wide.chunks) {
+    for (const TreeInstance& tree : entry.second.trees) {
+      for (int dz = -1; dz <= 1; dz++) {
+        for (int dx = -1; dx <= 1; dx++) {
+          const Chunk* near = wide.FindChunk(
+              {entry.first.x + dx, entry.first.z + dz});
+          if (!near) continue;
+          for (const TreeInstance& other : near->trees) {
+            if (&other == &tree) continue;
+            glm::vec3 d = other.position - tree.position;
+            if (d.x * d.x + d.z * d.z < minDist2) tooClose++;
+          }
+        }
+      }
+    }
+  }
+
+  std::cout << "Forest: " << size * size / 1e6f << " km^2, " << all.tiles
+            << " chunks, " << all.trees << " trees (" << all.samples
+            << " samples), 1 thread " << one.milliseconds << " ms, "
+            << jobs.ThreadCount() + 1 << " threads " << all.milliseconds
+            << " ms, " << differ << " chunks differ, " << tooClose
+            << " trees too close" << std::endl;
+  return differ == 0 && tooClose == 0 ? all.milliseconds : -1.0;
+}
@@ -0,0 +1,38 @@
+#include "gl_ext.hpp"
+
+#include <cstring>
+
+GLExtensions glExt;
+
+bool HasGLExtension(const char* name) {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  for (GLint i = 0; i < count; i++) {
+    const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, i);
+    if (ext && std::strcmp(ext, name) == 0) return true;
+  }
+  return false;
+}
+
+static bool AtLeast(int major, int minor) {
+  return glExt.major > major || (glExt.major == major && glExt.minor >= minor);
+}
+
+void LoadGLExtensions(GLADloadproc load) {
+  glExt.major = GLVersion.major;
+  glExt.minor = GLVersion.minor;
+
+  if (AtLeast(4, 4) || HasGLExtension("GL_ARB_buffer_storage")) {
+    glExt.BufferStorage = (PFNGLBUFFERSTORAGEPROC)load("glBufferStorage");
+  }
+  glExt.bufferStorage = glExt.BufferStorage != nullptr;
+
+  if (AtLeast(4, 3)) {
+    glExt.DispatchCompute = (PFNGLDISPATCHCOMPUTEPROC)load("glDispatchCompute");
+    glExt.MemoryBarrier = (PFNGLMEMORYBARRIERPROC)load("glMemoryBarrier");
+    glExt.MultiDrawArraysIndirect =
+        (PFNGLMULTIDRAWARRAYSINDIRECTPROC)load("glMultiDrawArraysIndirect");
+  }
+  glExt.computeCulling = glExt.DispatchCompute && glExt.MemoryBarrier &&
+                         glExt.MultiDrawArraysIndirect;
+}
@@ -0,0 +1,120 @@
+#include "gpu_culling.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "frustum.hpp"
+#include "gl_ext.hpp"
+
+bool GpuCuller::Supported() { return glExt.computeCulling; }
+
+static unsigned int CreateStorage(GLsizeiptr size, const void* data) {
+  unsigned int buffer;
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, size, data,
+               data ? GL_STATIC_DRAW : GL_DYNAMIC_COPY);
+  return buffer;
+}
+
+GpuCuller::GpuCuller(const std::vector<CullBatch>& batches,
+                     const std::vector<glm::mat4>& instances,
+                     const std::vector<unsigned int>& batchOf)
+    : cullShader("Shader/cull.cs") {
+  instanceCount = (unsigned int)instances.size();
+
+  // every batch gets an output range big enough for all of its instances
+  std::vector<unsigned int> perBatch(batches.size(), 0);
+  for (unsigned int b : batchOf) perBatch[b]++;
+
+  std::vector<glm::vec4> bounds;
+  unsigned int base = 0;
+  for (size_t i = 0; i < batches.size(); i++) {
+    DrawCommand cmd;
+    cmd.count = batches[i].count;
+    cmd.instanceCount = 0;
+    cmd.first = batches[i].first;
+    cmd.baseInstance = base;
+    resetCommands.push_back(cmd);
+    base += perBatch[i];
+
+    bounds.push_back(glm::vec4(batches[i].boundsMin, 0.0f));
+    bounds.push_back(glm::vec4(batches[i].boundsMax, 0.0f));
+  }
+
+  instancesIn = CreateStorage(instances.size() * sizeof(glm::mat4),
+                              instances.data());
+  batchOfBuffer =
+      CreateStorage(batchOf.size() * sizeof(unsigned int), batchOf.data());
+  batchBuffer = CreateStorage(bounds.size() * sizeof(glm::vec4), bounds.data());
+  commandBuffer = CreateStorage(
+      resetCommands.size() * sizeof(DrawCommand), nullptr);
+  instancesOut =
+      CreateStorage(instances.size() * sizeof(glm::mat4), nullptr);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+GpuCuller::~GpuCuller() {
+  unsigned int buffers[] = {instancesIn, batchOfBuffer, batchBuffer,
+                            commandBuffer, instancesOut};
+  glDeleteBuffers(5, buffers);
+  glDeleteProgram(cullShader.ID);
+}
+
+void GpuCuller::SetHiZ(unsigned int texture, int width, int height,
+                       int maxLevel, const glm::mat4& prevViewProj) {
+  hiZTexture = texture;
+  hiZSize = glm::vec2(width, height);
+  hiZMaxLevel = maxLevel;
+  prevViewProjection = prevViewProj;
+}
+
+void GpuCuller::Cull(const glm::mat4& viewProjection) {
+  // zero the instance counts, the rest of each command is constant
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0,
+                  resetCommands.size() * sizeof(DrawCommand),
+                  resetCommands.data());
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  cullShader.use();
+  Frustum frustum(viewProjection);
+  glUniform4fv(glGetUniformLocation(cullShader.ID, "frustumPlanes"), 6,
+               glm::value_ptr(frustum.planes[0]));
+  glUniform1ui(glGetUniformLocation(cullShader.ID, "instanceCount"),
+               instanceCount);
+
+  cullShader.setBool("useHiZ", hiZTexture != 0);
+  if (hiZTexture != 0) {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, hiZTexture);
+    cullShader.setInt("hiZ", 0);
+    glUniform2fv(glGetUniformLocation(cullShader.ID, "hiZSize"), 1,
+                 glm::value_ptr(hiZSize));
+    cullShader.setInt("hiZMaxLevel", hiZMaxLevel);
+    cullShader.setMat4("prevViewProjection", prevViewProjection);
+  }
+
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, instancesIn);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, batchOfBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, batchBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, commandBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, instancesOut);
+
+  glExt.DispatchCompute((instanceCount + 63) / 64, 1, 1);
+  glExt.MemoryBarrier(GL_COMMAND_BARRIER_BIT |
+                      GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void GpuCuller::Draw(unsigned int vao) {
+  glBindVertexArray(vao);
+  glBindBuffer(GL_ARRAY_BUFFER, instancesOut);
+  for (int i = 0; i < 4; i++) {
+    glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                          (void*)(sizeof(glm::vec4) * i));
+  }
+  // baseInstance of each command offsets into instancesOut
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+  glExt.MultiDrawArraysIndirect(GL_TRIANGLES, nullptr,
+                                (GLsizei)resetCommands.size(), 0);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
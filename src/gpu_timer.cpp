@@ -0,0 +1,37 @@
+#include "gpu_timer.hpp"
+
+#include <glad/glad.h>
+
+GpuTimer::GpuTimer() { glGenQueries(QUERY_COUNT, queries); }
+
+GpuTimer::~GpuTimer() { glDeleteQueries(QUERY_COUNT, queries); }
+
+void GpuTimer::Poll() {
+  // oldest first, so `ms` ends up the newest finished one
+  for (int i = 0; i < QUERY_COUNT; i++) {
+    int q = (next + i) % QUERY_COUNT;
+    if (!pending[q]) continue;
+    GLint available = 0;
+    glGetQueryObjectiv(queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) continue;
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(queries[q], GL_QUERY_RESULT, &ns);
+    ms = ns / 1.0e6;
+    pending[q] = false;
+  }
+}
+
+void GpuTimer::Begin() {
+  Poll();
+  if (pending[next]) return;  // all in flight, skip this one
+  glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+  running = true;
+}
+
+void GpuTimer::End() {
+  if (!running) return;
+  glEndQuery(GL_TIME_ELAPSED);
+  pending[next] = true;
+  next = (next + 1) % QUERY_COUNT;
+  running = false;
+}
@@ -0,0 +1,94 @@
+#include "grass.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+GrassField::GrassField(const glm::vec2& areaMin, const glm::vec2& areaMax,
+                       float groundY, uint32_t seed, float patchSize)
+    : shader("Shader/grass.vs", "Shader/grass.fs"),
+      areaMin(areaMin),
+      areaMax(areaMax),
+      groundY(groundY),
+      seed(seed),
+      patchSize(patchSize) {
+  // core profile wants a VAO bound, the blades need no attributes
+  glGenVertexArrays(1, &VAO);
+}
+
+GrassField::~GrassField() {
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteProgram(shader.ID);
+}
+
+void GrassField::Draw(
+    const Frustum& frustum, const glm::vec3& cameraPos, float time,
+    const std::function<bool(const glm::vec3&, const glm::vec3&)>& occluded) {
+  patchesDrawn = 0;
+  bladesDrawn = 0;
+
+  float range = settings.drawDistance;
+  int x0 = (int)std::floor((std::max(cameraPos.x - range, areaMin.x) -
+                            areaMin.x) / patchSize);
+  int z0 = (int)std::floor((std::max(cameraPos.z - range, areaMin.y) -
+                            areaMin.y) / patchSize);
+  int x1 = (int)std::ceil((std::min(cameraPos.x + range, areaMax.x) -
+                           areaMin.x) / patchSize);
+  int z1 = (int)std::ceil((std::min(cameraPos.z + range, areaMax.y) -
+                           areaMin.y) / patchSize);
+  if (x0 >= x1 || z0 >= z1) return;
+
+  int maxBlades = (int)(settings.density * patchSize * patchSize);
+  glm::vec2 wind = glm::normalize(settings.windDir);
+  float fadeStart = std::min(settings.fadeStart, range);
+
+  shader.use();
+  shader.setFloat("time", time);
+  shader.setFloat("groundY", groundY);
+  shader.setBool("useTerrain", terrain != nullptr);
+  if (terrain) terrain->BindHeightMap(shader, 3);
+  shader.setFloat("patchSize", patchSize);
+  shader.setFloat("bladeHeight", settings.bladeHeight);
+  shader.setFloat("windStrength", settings.windStrength);
+  shader.setFloat("fadeStart", fadeStart);
+  shader.setFloat("fadeEnd", range);
+  shader.setInt("maxBlades", maxBlades);
+  glUniform2f(glGetUniformLocation(shader.ID, "windDir"), wind.x, wind.y);
+  glUniform2f(glGetUniformLocation(shader.ID, "areaMax"), areaMax.x,
+              areaMax.y);
+  int originLoc = glGetUniformLocation(shader.ID, "patchOrigin");
+  int seedLoc = glGetUniformLocation(shader.ID, "patchSeed");
+
+  glBindVertexArray(VAO);
+  glDisable(GL_CULL_FACE);  // blades are single sided quads
+  for (int z = z0; z < z1; z++) {
+    for (int x = x0; x < x1; x++) {
+      glm::vec2 origin = areaMin + glm::vec2(x, z) * patchSize;
+      glm::vec2 end = glm::min(origin + glm::vec2(patchSize), areaMax);
+      float low = groundY, high = groundY;
+      if (terrain) terrain->HeightRange(origin, end, low, high);
+      glm::vec3 min(origin.x, low, origin.y);
+      glm::vec3 max(end.x, high + settings.bladeHeight * 1.4f, end.y);
+
+      glm::vec3 nearest = glm::clamp(cameraPos, min, max);
+      float distance = glm::length(glm::vec2(nearest.x - cameraPos.x,
+                                             nearest.z - cameraPos.z));
+      if (distance > range) continue;
+      if (!frustum.IntersectsAABB(min, max)) continue;
+      if (occluded && occluded(min, max)) continue;
+
+      // blades are ranked by instance id, the shader fades the tail
+      float t = (distance - fadeStart) / std::max(range - fadeStart, 0.001f);
+      float keep = 1.0f - std::min(std::max(t, 0.0f), 1.0f);
+      int count = (int)std::ceil(maxBlades * keep);
+      if (count <= 0) continue;
+
+      glUniform2f(originLoc, origin.x, origin.y);
+      glUniform1ui(seedLoc, seed ^ (uint32_t)(x * 73856093) ^
+                                (uint32_t)(z * 19349663));
+      glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 7, count);
+      patchesDrawn++;
+      bladesDrawn += count;
+    }
+  }
+  glEnable(GL_CULL_FACE);
+}
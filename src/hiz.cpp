@@ -0,0 +1,250 @@
+#include "hiz.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "render_target.hpp"
+
+HiZBuffer::HiZBuffer()
+    : reduceShader("Shader/fullscreen.vs", "Shader/hiz.fs"),
+      debugShader("Shader/fullscreen.vs", "Shader/hiz_debug.fs") {
+  glGenFramebuffers(1, &FBO);
+  glGenFramebuffers(1, &debugFBO);
+  for (Readback& r : readbacks) glGenBuffers(1, &r.pbo);
+
+  glGenTextures(1, &debugTexture);
+  glBindTexture(GL_TEXTURE_2D, debugTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, debugWidth, debugHeight, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, debugFBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         debugTexture, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+HiZBuffer::~HiZBuffer() {
+  for (Readback& r : readbacks) {
+    if (r.fence) glDeleteSync(r.fence);
+    glDeleteBuffers(1, &r.pbo);
+  }
+  glDeleteFramebuffers(1, &FBO);
+  glDeleteFramebuffers(1, &debugFBO);
+  glDeleteTextures(1, &texture);
+  glDeleteTextures(1, &debugTexture);
+  glDeleteProgram(reduceShader.ID);
+  glDeleteProgram(debugShader.ID);
+}
+
+void HiZBuffer::Allocate(int w, int h) {
+  if (texture) glDeleteTextures(1, &texture);
+  width = w;
+  height = h;
+
+  levels = 1;
+  while ((w > 1 || h > 1) && levels < 16) {
+    w = std::max(1, w / 2);
+    h = std::max(1, h / 2);
+    levels++;
+  }
+
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  w = width;
+  h = height;
+  readbackLevel = levels - 1;
+  for (int level = 0; level < levels; level++) {
+    glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, w, h, 0, GL_RED, GL_FLOAT,
+                 nullptr);
+    if (w <= READBACK_TARGET && readbackLevel == levels - 1) {
+      readbackLevel = level;
+    }
+    w = std::max(1, w / 2);
+    h = std::max(1, h / 2);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  // in-flight readbacks refer to the old size
+  for (Readback& r : readbacks) {
+    if (r.fence) glDeleteSync(r.fence);
+    r.fence = nullptr;
+  }
+  cpuDepth.clear();
+}
+
+void HiZBuffer::Build(unsigned int depthTexture, int depthWidth,
+                      int depthHeight, const glm::mat4& viewProj,
+                      const glm::vec3& cameraPos) {
+  int w = std::max(1, depthWidth / 2);
+  int h = std::max(1, depthHeight / 2);
+  if (w != width || h != height || !texture) Allocate(w, h);
+  viewProjection = viewProj;
+
+  FinishReadbacks();
+
+  glDisable(GL_DEPTH_TEST);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+  reduceShader.use();
+  reduceShader.setInt("source", 0);
+  glActiveTexture(GL_TEXTURE0);
+
+  int srcWidth = depthWidth;
+  int srcHeight = depthHeight;
+  w = width;
+  h = height;
+  for (int level = 0; level < levels; level++) {
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           texture, level);
+    glViewport(0, 0, w, h);
+
+    if (level == 0) {
+      glBindTexture(GL_TEXTURE_2D, depthTexture);
+      reduceShader.setInt("sourceLevel", 0);
+    } else {
+      // only expose the level we read so it can't alias the one we write
+      glBindTexture(GL_TEXTURE_2D, texture);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+      reduceShader.setInt("sourceLevel", level - 1);
+    }
+    glUniform2i(glGetUniformLocation(reduceShader.ID, "sourceSize"), srcWidth,
+                srcHeight);
+    DrawFullscreenTriangle();
+
+    srcWidth = w;
+    srcHeight = h;
+    w = std::max(1, w / 2);
+    h = std::max(1, h / 2);
+  }
+
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  StartReadback(cameraPos);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glEnable(GL_DEPTH_TEST);
+}
+
+void HiZBuffer::StartReadback(const glm::vec3& cameraPos) {
+  Readback& r = readbacks[nextReadback];
+  if (r.fence) return;  // ring is full, skip this frame rather than stall
+  nextReadback = (nextReadback + 1) % PBO_COUNT;
+
+  r.width = std::max(1, width >> readbackLevel);
+  r.height = std::max(1, height >> readbackLevel);
+  r.viewProjection = viewProjection;
+  r.cameraPos = cameraPos;
+
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         texture, readbackLevel);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+  glBufferData(GL_PIXEL_PACK_BUFFER, r.width * r.height * sizeof(float),
+               nullptr, GL_STREAM_READ);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, r.width, r.height, GL_RED, GL_FLOAT, nullptr);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  r.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void HiZBuffer::FinishReadbacks() {
+  // oldest first so cpuDepth ends up holding the newest finished one
+  for (int i = 0; i < PBO_COUNT; i++) {
+    Readback& r = readbacks[(nextReadback + i) % PBO_COUNT];
+    if (!r.fence) continue;
+    if (glClientWaitSync(r.fence, 0, 0) == GL_TIMEOUT_EXPIRED) continue;
+    glDeleteSync(r.fence);
+    r.fence = nullptr;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+    GLsizeiptr size = r.width * r.height * sizeof(float);
+    void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size,
+                                  GL_MAP_READ_BIT);
+    if (data) {
+      cpuDepth.resize(r.width * r.height);
+      std::memcpy(cpuDepth.data(), data, size);
+      cpuWidth = r.width;
+      cpuHeight = r.height;
+      cpuViewProjection = r.viewProjection;
+      cpuCameraPos = r.cameraPos;
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  }
+}
+
+bool HiZBuffer::IsVisible(const glm::vec3& min, const glm::vec3& max,
+                          const glm::vec3& cameraPos) const {
+  if (cpuDepth.empty()) return true;
+
+  // conservative reprojection: grow the box by the camera travel
+  glm::vec3 pad(glm::length(cameraPos - cpuCameraPos));
+  glm::vec3 lo = min - pad;
+  glm::vec3 hi = max + pad;
+
+  glm::vec2 minUV(1.0f), maxUV(0.0f);
+  float nearestDepth = 1.0f;
+  for (int i = 0; i < 8; i++) {
+    glm::vec3 corner((i & 1) ? hi.x : lo.x, (i & 2) ? hi.y : lo.y,
+                     (i & 4) ? hi.z : lo.z);
+    glm::vec4 clip = cpuViewProjection * glm::vec4(corner, 1.0f);
+    if (clip.w <= 0.0f) return true;  // crosses the camera plane
+    glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    glm::vec2 uv = glm::vec2(ndc.x, ndc.y) * 0.5f + 0.5f;
+    minUV = glm::min(minUV, uv);
+    maxUV = glm::max(maxUV, uv);
+    nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+  }
+  // no depth information outside the captured view
+  if (minUV.x < 0.0f || minUV.y < 0.0f || maxUV.x > 1.0f || maxUV.y > 1.0f) {
+    return true;
+  }
+
+  // one texel of slack on each side for the rounding
+  int x0 = std::max(0, (int)(minUV.x * cpuWidth) - 1);
+  int y0 = std::max(0, (int)(minUV.y * cpuHeight) - 1);
+  int x1 = std::min(cpuWidth - 1, (int)(maxUV.x * cpuWidth) + 1);
+  int y1 = std::min(cpuHeight - 1, (int)(maxUV.y * cpuHeight) + 1);
+  if ((x1 - x0 + 1) * (y1 - y0 + 1) > 1024) return true;
+
+  for (int y = y0; y <= y1; y++) {
+    for (int x = x0; x <= x1; x++) {
+      if (nearestDepth <= cpuDepth[y * cpuWidth + x]) return true;
+    }
+  }
+  return false;
+}
+
+void HiZBuffer::RenderDebug(int level, float nearPlane, float farPlane) {
+  if (!texture) return;
+  level = std::min(std::max(level, 0), levels - 1);
+
+  glDisable(GL_DEPTH_TEST);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  glBindFramebuffer(GL_FRAMEBUFFER, debugFBO);
+  glViewport(0, 0, debugWidth, debugHeight);
+  debugShader.use();
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  debugShader.setInt("pyramid", 0);
+  debugShader.setInt("level", level);
+  debugShader.setFloat("nearPlane", nearPlane);
+  debugShader.setFloat("farPlane", farPlane);
+  DrawFullscreenTriangle();
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glEnable(GL_DEPTH_TEST);
+}
@@ -0,0 +1,171 @@
+#include "impostor.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+
+namespace {
+
+// must match Shader/impostor.vs
+glm::vec3 HemiOctDecode(glm::vec2 uv) {
+  glm::vec2 e = uv * 2.0f - 1.0f;
+  float x = (e.x - e.y) * 0.5f;
+  float z = (e.x + e.y) * 0.5f;
+  float y = 1.0f - std::abs(x) - std::abs(z);
+  return glm::normalize(glm::vec3(x, y, z));
+}
+
+void FrameBasis(const glm::vec3& d, glm::vec3& right, glm::vec3& up) {
+  right = std::abs(d.y) < 0.999f
+              ? glm::normalize(glm::cross(glm::vec3(0.0f, 1.0f, 0.0f), d))
+              : glm::vec3(1.0f, 0.0f, 0.0f);
+  up = glm::cross(d, right);
+}
+
+}  // namespace
+
+Impostor::Impostor(GpuMesh& mesh, const LodLevel& level,
+                   const glm::vec3& center, float radius,
+                   unsigned int albedoTexture, int frames, int frameSize)
+    : shader("Shader/impostor.vs", "Shader/impostor.fs"),
+      frames(frames),
+      frameSize(frameSize),
+      center(center),
+      radius(radius) {
+  Bake(mesh, level, albedoTexture);
+
+  // no vertex attributes, the quad comes from gl_VertexID
+  glGenVertexArrays(1, &VAO);
+  glBindVertexArray(VAO);
+  for (int i = 0; i < 5; i++) {
+    glEnableVertexAttribArray(3 + i);
+    glVertexAttribDivisor(3 + i, 1);
+  }
+  glBindVertexArray(0);
+}
+
+Impostor::~Impostor() {
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteTextures(1, &albedoAtlas);
+  glDeleteTextures(1, &normalDepthAtlas);
+  glDeleteProgram(shader.ID);
+}
+
+void Impostor::Bake(GpuMesh& mesh, const LodLevel& level,
+                    unsigned int albedoTexture) {
+  int size = frames * frameSize;
+  unsigned int* atlases[2] = {&albedoAtlas, &normalDepthAtlas};
+  for (unsigned int* atlas : atlases) {
+    glGenTextures(1, atlas);
+    glBindTexture(GL_TEXTURE_2D, *atlas);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+
+  unsigned int FBO, depth;
+  glGenFramebuffers(1, &FBO);
+  glGenRenderbuffers(1, &depth);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size, size);
+  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         albedoAtlas, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                         normalDepthAtlas, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                            GL_RENDERBUFFER, depth);
+  GLenum drawBuffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+  glDrawBuffers(2, drawBuffers);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "ERROR::FRAMEBUFFER:: impostor atlas is not complete"
+              << std::endl;
+  }
+
+  // empty texels stay at zero alpha, the draw shader divides by coverage
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  glEnable(GL_DEPTH_TEST);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  // one identity instance so the mesh VAO's instance attributes are sourced
+  InstanceData identity = {glm::mat4(1.0f), glm::vec4(0.0f)};
+  unsigned int instanceBuffer;
+  glGenBuffers(1, &instanceBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(identity), &identity, GL_STATIC_DRAW);
+  mesh.SetInstanceBuffer(instanceBuffer, 0);
+
+  Shader bakeShader("Shader/impostor_bake.vs", "Shader/impostor_bake.fs");
+  bakeShader.use();
+  bakeShader.setInt("ourTexture", 0);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, albedoTexture);
+
+  // depth range is the bounding sphere, 0 = nearest to the viewer
+  glm::mat4 projection =
+      glm::ortho(-radius, radius, -radius, radius, -radius, radius);
+  for (int y = 0; y < frames; y++) {
+    for (int x = 0; x < frames; x++) {
+      glm::vec3 d = HemiOctDecode(glm::vec2(x, y) / (float)(frames - 1));
+      glm::vec3 right, up;
+      FrameBasis(d, right, up);
+
+      glm::mat4 view(1.0f);
+      for (int i = 0; i < 3; i++) {
+        view[i][0] = right[i];
+        view[i][1] = up[i];
+        view[i][2] = d[i];
+      }
+      view[3][0] = -glm::dot(right, center);
+      view[3][1] = -glm::dot(up, center);
+      view[3][2] = -glm::dot(d, center);
+
+      glViewport(x * frameSize, y * frameSize, frameSize, frameSize);
+      bakeShader.setMat4("viewProjection", projection * view);
+      mesh.DrawInstanced(level.firstIndex, level.indexCount, level.baseVertex,
+                         1);
+    }
+  }
+
+  for (unsigned int* atlas : atlases) {
+    glBindTexture(GL_TEXTURE_2D, *atlas);
+    glGenerateMipmap(GL_TEXTURE_2D);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  glDeleteFramebuffers(1, &FBO);
+  glDeleteRenderbuffers(1, &depth);
+  glDeleteBuffers(1, &instanceBuffer);
+  glDeleteProgram(bakeShader.ID);
+}
+
+void Impostor::Draw(unsigned int instanceBuffer, long offset,
+                    int instanceCount) {
+  if (instanceCount <= 0) return;
+  shader.use();
+  shader.setInt("albedoAtlas", 1);
+  shader.setInt("normalDepthAtlas", 2);
+  shader.setFloat("frames", (float)frames);
+  shader.setFloat("radius", radius);
+  glUniform3fv(glGetUniformLocation(shader.ID, "center"), 1, &center[0]);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, albedoAtlas);
+  glActiveTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_2D, normalDepthAtlas);
+  glActiveTexture(GL_TEXTURE0);
+
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  for (int i = 0; i < 4; i++) {
+    glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                          (void*)(offset + sizeof(glm::vec4) * i));
+  }
+  glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                        (void*)(offset + offsetof(InstanceData, params)));
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instanceCount);
+}
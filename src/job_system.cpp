@@ -0,0 +1,106 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+
+JobSystem::JobSystem(unsigned int threadCount) {
+  if (threadCount == 0) {
+    unsigned int hw = std::thread::hardware_concurrency();
+    threadCount = hw > 1 ? hw - 1 : 1;
+  }
+  for (unsigned int i = 0; i < threadCount; i++) {
+    workers.emplace_back(&JobSystem::WorkerLoop, this);
+  }
+}
+
+JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  wake.notify_all();
+  for (std::thread& t : workers) t.join();
+}
+
+void JobSystem::Submit(std::function<void()> job, JobCounter* counter) {
+  if (counter) counter->pending.fetch_add(1, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.push_back({std::move(job), counter});
+  }
+  wake.notify_one();
+}
+
+void JobSystem::SubmitBackground(std::function<void()> job,
+                                 JobCounter* counter) {
+  if (counter) counter->pending.fetch_add(1, std::memory_order_relaxed);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    background.push_back({std::move(job), counter});
+  }
+  wake.notify_one();
+}
+
+bool JobSystem::RunOne(JobCounter& counter) {
+  Job job;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto mine = [&counter](const Job& j) { return j.counter == &counter; };
+    std::deque<Job>* from = &queue;
+    auto it = std::find_if(queue.begin(), queue.end(), mine);
+    if (it == queue.end()) {
+      from = &background;
+      it = std::find_if(background.begin(), background.end(), mine);
+      if (it == background.end()) return false;
+    }
+    job = std::move(*it);
+    from->erase(it);
+  }
+  job.fn();
+  job.counter->pending.fetch_sub(1, std::memory_order_release);
+  return true;
+}
+
+void JobSystem::WorkerLoop() {
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [this] {
+        return quit || !queue.empty() || !background.empty();
+      });
+      // quit and nothing left to do
+      if (queue.empty() && background.empty()) return;
+      std::deque<Job>& from = queue.empty() ? background : queue;
+      job = std::move(from.front());
+      from.pop_front();
+    }
+    job.fn();
+    if (job.counter) {
+      job.counter->pending.fetch_sub(1, std::memory_order_release);
+    }
+  }
+}
+
+void JobSystem::Wait(JobCounter& counter) {
+  while (!counter.Done()) {
+    if (!RunOne(counter)) std::this_thread::yield();
+  }
+}
+
+void JobSystem::ParallelFor(int count, int grain,
+                            const std::function<void(int, int)>& fn) {
+  if (count <= 0) return;
+  if (grain < 1) grain = 1;
+  if (count <= grain) {
+    fn(0, count);
+    return;
+  }
+
+  JobCounter counter;
+  for (int begin = grain; begin < count; begin += grain) {
+    int end = begin + grain < count ? begin + grain : count;
+    Submit([&fn, begin, end] { fn(begin, end); }, &counter);
+  }
+  fn(0, grain);  // first chunk on the calling thread
+  Wait(counter);
+}
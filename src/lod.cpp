@@ -0,0 +1,103 @@
+#include "lod.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "mesh_simplify.hpp"
+
+LodChain BakeLodChain(const Mesh& mesh, int levelCount, float reduction,
+                      Mesh& packed) {
+  LodChain chain;
+  packed = Mesh();
+
+  Mesh current = mesh;
+  float error = 0.0f;
+  for (int i = 0; i < levelCount; i++) {
+    if (i > 0) {
+      int target = std::max(1, (int)(current.TriangleCount() * reduction));
+      float levelError = 0.0f;
+      Mesh next = SimplifyMesh(current, target, &levelError);
+      // nothing left to take away, further levels would be duplicates
+      if (next.TriangleCount() >= current.TriangleCount()) break;
+      current = next;
+      error += levelError;
+    }
+
+    LodLevel level;
+    level.baseVertex = (int)packed.vertices.size();
+    level.firstIndex = (int)packed.indices.size();
+    level.indexCount = (int)current.indices.size();
+    level.error = error;
+    chain.levels.push_back(level);
+
+    packed.vertices.insert(packed.vertices.end(), current.vertices.begin(),
+                           current.vertices.end());
+    packed.indices.insert(packed.indices.end(), current.indices.begin(),
+                          current.indices.end());
+  }
+
+  packed.ComputeBounds();
+  chain.center = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+  chain.radius = glm::length(mesh.boundsMax - mesh.boundsMin) * 0.5f;
+  return chain;
+}
+
+void LodSelector::Begin(float fovY, float screenHeight, float dt) {
+  projectionScale = screenHeight / (2.0f * std::tan(fovY * 0.5f));
+  deltaTime = dt;
+}
+
+int LodSelector::SelectLevel(const LodChain& chain, float distance,
+                             int current) const {
+  int count = (int)chain.levels.size();
+  if (count == 0) return 0;
+  distance = std::max(distance, 0.01f);
+  auto pixels = [&](int level) {
+    return chain.levels[level].error * projectionScale / distance;
+  };
+
+  int level = std::min(std::max(current, 0), count - 1);
+  // refine right away once the current level is visibly wrong
+  while (level > 0 && pixels(level) > settings.pixelError) level--;
+  // only coarsen with some margin, so standing still at the threshold
+  // doesn't flicker between two levels
+  float coarsen = settings.pixelError * (1.0f - settings.hysteresis);
+  while (level + 1 < count && pixels(level + 1) <= coarsen) level++;
+  return level;
+}
+
+void LodSelector::Submit(LodState& state, const LodChain& chain,
+                         const glm::mat4& model, float distance,
+                         std::vector<std::vector<InstanceData>>& perLevel,
+                         int forceLevel) {
+  if (state.level < 0) {
+    state.level = forceLevel >= 0 ? forceLevel
+                                  : SelectLevel(chain, distance,
+                                                (int)chain.levels.size() - 1);
+    state.fade = 1.0f;
+  } else {
+    int level = forceLevel >= 0 ? forceLevel
+                                : SelectLevel(chain, distance, state.level);
+    if (level != state.level) {
+      state.previous = state.level;
+      state.level = level;
+      state.fade = 0.0f;
+    }
+  }
+
+  if (state.fade < 1.0f && settings.fadeTime > 0.0f) {
+    state.fade = std::min(1.0f, state.fade + deltaTime / settings.fadeTime);
+  } else {
+    state.fade = 1.0f;
+  }
+
+  if (state.fade >= 1.0f) {
+    perLevel[state.level].push_back({model, glm::vec4(0.0f)});
+    return;
+  }
+  // new level takes dither values below fade, old one the rest
+  float fade = std::max(state.fade, 0.001f);
+  perLevel[state.level].push_back({model, glm::vec4(fade, 0.0f, 0.0f, 0.0f)});
+  perLevel[state.previous].push_back(
+      {model, glm::vec4(-(1.0f - fade), 0.0f, 0.0f, 0.0f)});
+}
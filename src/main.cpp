@@ -7,15 +7,50 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
+#include <random>
 
+#include "ai_scheduler.hpp"
+#include "broadphase.hpp"
 #include "camera.hpp"
+#include "cascaded_shadow.hpp"
+#include "character_controller.hpp"
+#include "chunk_streamer.hpp"
+#include "clustered_lights.hpp"
+#include "collision.hpp"
+#include "components.hpp"
+#include "ecs.hpp"
+#include "forest.hpp"
+#include "flow_field.hpp"
+#include "fog.hpp"
+#include "frustum.hpp"
+#include "gl_ext.hpp"
+#include "gpu_culling.hpp"
+#include "grass.hpp"
+#include "hiz.hpp"
+#include "impostor.hpp"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
+#include "job_system.hpp"
+#include "lod.hpp"
+#include "mesh.hpp"
+#include "navmesh.hpp"
+#include "occlusion_raster.hpp"
+#include "pathfinder.hpp"
 #include "primitives.hpp"
+#include "raycast.hpp"
+#include "render_target.hpp"
 #include "shader.hpp"
+#include "spotlight.hpp"
+#include "stream_buffer.hpp"
+#include "terrain.hpp"
+#include "volumetric_light.hpp"
+#include "voxel.hpp"
+#include "world.hpp"
+#include "world_file.hpp"
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
@@ -33,8 +68,11 @@ float lastFrame = 0.0f;  // Time of last frame
 
 int floorsize = 100;
 float floorY = -1.0f;
+int floorTileSize = 16;  // cubes per side of a culling tile
 
 float renderDistance = 500.0f;
+bool impostors = true;
+float impostorDistance = 60.0f;  // trees further than this become quads
 
 float ambientStrength = 0.05f;
 float diffuseStrength = 0.35f;
@@ -42,14 +80,34 @@ float specularStrength = 0.25f;
 float shininess = 32.0f;
 glm::vec3 moonDir(-0.2f, -1.0f, -0.3f);
 glm::vec3 moonColor(0.6f, 0.65f, 0.8f);
+bool moonShadows = true;
+bool localLights = true;  // lanterns and campfires
+// 0 height fog only, 1 lit froxel volume, 2 finer one, 3 raymarched
+int fogQuality = 1;
 
 // toggle vars
 bool fullscreen = true;
 bool wireframe = false;
 bool freeCam = false;
+bool voxelFloor = true;  // greedy meshed voxels instead of instanced cubes
+bool gpuCulling = true;  // only used when the context is GL 4.3+
+bool occlusionCulling = true;
+int occlusionSource = 0;  // CPU path: 0 = Hi-Z readback, 1 = software raster
+bool showHiZ = false;
+int hiZDebugLevel = 0;
+
+// a square block of floor cubes that gets frustum culled as one
+struct FloorTile {
+  glm::vec3 min;
+  glm::vec3 max;
+  int first;  // index into modelMatrices
+  int count;
+};
 
 // camera
 Camera camera;
+// the player's flashlight, L switches it
+SpotLight flashlight;
 
 int main() {
   glfwInit();
@@ -79,6 +137,7 @@ int main() {
     std::cout << "Failed to initialize GLAD" << std::endl;
     return -1;
   }
+  LoadGLExtensions((GLADloadproc)glfwGetProcAddress);
 
   // imgui load
   IMGUI_CHECKVERSION();
@@ -97,13 +156,14 @@ int main() {
   // build and compile shader programs
   Shader ourShader("Shader/default.vs", "Shader/default.fs");
   Shader skyboxShader("Shader/skybox.vs", "Shader/skybox.fs");
+  Shader voxelShader("Shader/voxel.vs", "Shader/default.fs");
+  Shader terrainShader("Shader/terrain.vs", "Shader/default.fs");
 
   // regular buffers
-  unsigned int VBO, VAO, EBO, instancedVBO;
+  unsigned int VBO, VAO, EBO;
   glGenVertexArrays(1, &VAO);
   glGenBuffers(1, &VBO);
   glGenBuffers(1, &EBO);
-  glGenBuffers(1, &instancedVBO);
   glBindVertexArray(VAO);
 
   // cube geometry
@@ -125,28 +185,48 @@ int main() {
                         (void*)(6 * sizeof(float)));
   glEnableVertexAttribArray(1);
 
+  // floor matrices are stored tile by tile so a visible tile is one memcpy
   std::vector<glm::mat4> modelMatrices;
-  for (int x = -floorsize; x < floorsize; x++) {
-    for (int z = -floorsize; z < floorsize; z++) {
-      glm::mat4 model = glm::mat4(1.0f);
-      float xPos = (float)x * cubeScale;
-      float zPos = (float)z * cubeScale;
-      model = glm::translate(model,
-                             glm::vec3(xPos, floorY, zPos));  // floor is at -1
-      model = glm::scale(model, glm::vec3(cubeScale));
-      modelMatrices.push_back(model);
+  std::vector<FloorTile> floorTiles;
+  for (int tx = -floorsize; tx < floorsize; tx += floorTileSize) {
+    for (int tz = -floorsize; tz < floorsize; tz += floorTileSize) {
+      FloorTile tile;
+      tile.first = (int)modelMatrices.size();
+      int xEnd = std::min(tx + floorTileSize, floorsize);
+      int zEnd = std::min(tz + floorTileSize, floorsize);
+      for (int x = tx; x < xEnd; x++) {
+        for (int z = tz; z < zEnd; z++) {
+          glm::mat4 model = glm::mat4(1.0f);
+          float xPos = (float)x * cubeScale;
+          float zPos = (float)z * cubeScale;
+          model = glm::translate(
+              model, glm::vec3(xPos, floorY, zPos));  // floor is at -1
+          model = glm::scale(model, glm::vec3(cubeScale));
+          modelMatrices.push_back(model);
+        }
+      }
+      tile.count = (int)modelMatrices.size() - tile.first;
+      float half = 0.5f * cubeScale;
+      tile.min = glm::vec3(tx * cubeScale - half, floorY - half,
+                           tz * cubeScale - half);
+      tile.max = glm::vec3((xEnd - 1) * cubeScale + half, floorY + half,
+                           (zEnd - 1) * cubeScale + half);
+      floorTiles.push_back(tile);
     }
   }
 
-  glBindBuffer(GL_ARRAY_BUFFER, instancedVBO);
-  glBufferData(GL_ARRAY_BUFFER, modelMatrices.size() * sizeof(glm::mat4),
-               &modelMatrices[0], GL_STATIC_DRAW);
+  // visible instances are streamed every frame, one region per frame in
+  // flight sized for the worst case of every tile being visible plus the
+  // cubes of the items and creatures drawn after them
+  const int dynamicCubes = 256;
+  StreamBuffer* instanceStream = new StreamBuffer(
+      GL_ARRAY_BUFFER,
+      (modelMatrices.size() + dynamicCubes) * sizeof(glm::mat4));
 
   // Mat4 takes up 4 attribute slots (e.g., locations 3, 4, 5, and 6)
+  // the pointers themselves are set per frame once the offset is known
   for (int i = 0; i < 4; i++) {
     glEnableVertexAttribArray(3 + i);
-    glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
-                          (void*)(sizeof(glm::vec4) * i));
 
     // Tell OpenGL this is per-instance data, not per-vertex
     glVertexAttribDivisor(3 + i, 1);
@@ -154,6 +234,202 @@ int main() {
 
   glBindVertexArray(0);
 
+  // GPU driven path, everything stays on the GPU from culling to drawing
+  GpuCuller* gpuCuller = nullptr;
+  if (GpuCuller::Supported()) {
+    std::vector<CullBatch> batches = {
+        {0, 36, glm::vec3(-0.5f), glm::vec3(0.5f)}};  // unit cube
+    std::vector<unsigned int> batchOf(modelMatrices.size(), 0);
+    gpuCuller = new GpuCuller(batches, modelMatrices, batchOf);
+  }
+
+  // offscreen scene target and the depth pyramid built from it
+  RenderTarget* sceneTarget = new RenderTarget(mode->width, mode->height);
+  HiZBuffer* hiZ = new HiZBuffer();
+  std::vector<int> visibleTiles;
+  // the flashlight's cookie and its shadow map, casters are hooked up once
+  // the trees and items exist
+  unsigned int flashlightCookie = CreateFlashlightCookie(128);
+  SpotShadow* flashlightShadow = new SpotShadow();
+  // the moon's cascades, same casters as the flashlight's
+  CascadedShadowMap* moonShadow = new CascadedShadowMap();
+
+  // worker threads and the CPU occlusion rasterizer running on them
+  JobSystem* jobs = new JobSystem();
+  OcclusionRasterizer* softOcclusion = new OcclusionRasterizer(jobs);
+  // lanterns and campfires, binned into froxels on the workers
+  ClusteredLights* clusteredLights =
+      new ClusteredLights(ClusterSettings(), jobs);
+  // height fog everywhere, lit volumetric fog near the eye on top
+  HeightFog* heightFog = new HeightFog();
+  FogVolume* fogVolume = new FogVolume();
+  VolumetricLight* volumetricLight = new VolumetricLight();
+
+  // simplified occluders for the software rasterizer: the slab under the
+  // floor tops (hides anything below ground), the terrain nodes near the
+  // eye and the trees near it, the last two gathered per frame
+  std::vector<std::pair<glm::vec3, glm::vec3>> occluderBoxes;
+  {
+    float half = 0.5f * cubeScale;
+    occluderBoxes.push_back(
+        {glm::vec3(-floorsize * cubeScale - half, floorY - half,
+                   -floorsize * cubeScale - half),
+         glm::vec3((floorsize - 1) * cubeScale + half, floorY,
+                   (floorsize - 1) * cubeScale + half)});
+  }
+
+  // hills around the cube floor, flat a hair under the floor tops so the
+  // two don't z-fight
+  TerrainSettings terrainSettings;
+  terrainSettings.plazaHeight = floorY + 0.5f * cubeScale - 0.05f;
+  terrainSettings.plazaExtent = floorsize * cubeScale;
+  Terrain* terrain = new Terrain(terrainSettings, jobs);
+  const float terrainOccluderReach = 128.0f;
+  std::vector<std::pair<glm::vec3, glm::vec3>> terrainOccluders;
+
+  // unbounded forest, chunks stream in and out around the camera
+  World* world = new World(64.0f);
+  ForestSettings forest;
+  forest.groundY = floorY + 0.5f * cubeScale;
+  forest.groundHeight = [terrain](float x, float z) {
+    return terrain->HeightAt(x, z);
+  };
+
+  Mesh treePacked;
+  LodChain treeLod = BakeLodChain(BuildTreeMesh(), 4, 0.5f, treePacked);
+  GpuMesh* treeMesh = new GpuMesh(treePacked);
+  ChunkStreamer* streamer = new ChunkStreamer(
+      *world, *jobs, forest, treePacked.boundsMin, treePacked.boundsMax);
+
+  // what the player walks on and into: terrain, the floor slab and a
+  // capsule per trunk of every resident chunk
+  CollisionWorld* collision = new CollisionWorld();
+  collision->groundHeight = forest.groundHeight;
+  {
+    float half = 0.5f * cubeScale;
+    collision->AddBox(glm::vec3(-floorsize * cubeScale - half, floorY - half,
+                                -floorsize * cubeScale - half),
+                      glm::vec3((floorsize - 1) * cubeScale + half,
+                                floorY + half,
+                                (floorsize - 1) * cubeScale + half));
+  }
+  // where monsters can walk, a tile per chunk built from the same shapes
+  NavMesh* navMesh = new NavMesh(NavMeshSettings(), *jobs, "navcache");
+  navMesh->collision = collision;
+  std::unordered_map<ChunkCoord, std::vector<uint32_t>, ChunkCoordHash>
+      chunkShapes;
+  // a few lanterns per chunk and now and then a campfire, placed from the
+  // chunk's coordinate so they come back where they were
+  std::unordered_map<ChunkCoord, std::vector<PointLight>, ChunkCoordHash>
+      chunkLights;
+  streamer->onLoaded = [&](const Chunk& chunk) {
+    std::mt19937 rng((uint32_t)ChunkCoordHash()(chunk.coord) * 2654435761u);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    glm::vec2 origin = world->ChunkOrigin(chunk.coord);
+    std::vector<PointLight>& lights = chunkLights[chunk.coord];
+    int lanterns = 2 + (int)(unit(rng) * 3.0f);
+    bool campfire = unit(rng) < 0.35f;
+    for (int i = 0; i < lanterns + (campfire ? 1 : 0); i++) {
+      PointLight light;
+      float x = origin.x + unit(rng) * world->chunkSize;
+      float z = origin.y + unit(rng) * world->chunkSize;
+      light.phase = unit(rng) * 6.2831853f;
+      if (i < lanterns) {
+        light.position = glm::vec3(x, forest.groundHeight(x, z) + 1.4f, z);
+        light.color = glm::vec3(1.0f, 0.72f, 0.38f);
+        light.intensity = 6.0f;
+        light.radius = 10.0f;
+        light.flicker = 0.15f;
+      } else {
+        light.position = glm::vec3(x, forest.groundHeight(x, z) + 0.4f, z);
+        light.color = glm::vec3(1.0f, 0.45f, 0.15f);
+        light.intensity = 16.0f;
+        light.radius = 16.0f;
+        light.flicker = 1.0f;
+      }
+      lights.push_back(light);
+    }
+
+    flashlightShadow->Invalidate(chunk.boundsMin, chunk.boundsMax);
+    std::vector<uint32_t>& ids = chunkShapes[chunk.coord];
+    for (const TreeInstance& tree : chunk.trees) {
+      // the trunk of BuildTreeMesh: 2 units tall, 0.25 radius at the base
+      ids.push_back(collision->AddCapsule(
+          tree.position,
+          tree.position + glm::vec3(0.0f, 2.0f * tree.scale, 0.0f),
+          0.25f * tree.scale));
+      // trunks near the edge also change the tiles next door
+      const CollisionShape& trunk = collision->Shape(ids.back());
+      navMesh->Invalidate(trunk.boundsMin, trunk.boundsMax);
+    }
+    navMesh->RequestTile(chunk.coord);
+  };
+  streamer->onEvicted = [&](const Chunk& chunk) {
+    flashlightShadow->Invalidate(chunk.boundsMin, chunk.boundsMax);
+    navMesh->RemoveTile(chunk.coord);
+    chunkLights.erase(chunk.coord);
+    auto it = chunkShapes.find(chunk.coord);
+    if (it == chunkShapes.end()) return;
+    for (uint32_t id : it->second) collision->Remove(id);
+    chunkShapes.erase(it);
+  };
+  // routes across tiles for the monster, kept up to date as tiles change
+  HierarchicalPathfinder* pathfinder = new HierarchicalPathfinder(*navMesh);
+  // lines of sight for the monster, traced in the background a tick late
+  RaycastQueue* rays = new RaycastQueue(*jobs);
+  rays->collision = collision;
+  // and one field toward the player shared by the whole pack
+  FlowFieldCache* flowFields = new FlowFieldCache(*navMesh, jobs);
+  navMesh->onTileChanged = [&](ChunkCoord coord) {
+    pathfinder->TileChanged(coord);
+    flowFields->TileChanged(coord);
+  };
+  // monster and creatures think at rates by distance, on the job system
+  AiScheduler* ai = new AiScheduler(jobs);
+  CharacterController player;
+  player.position =
+      camera.cameraPos -
+      glm::vec3(0.0f, camera.cameraHeight - 0.5f * cubeScale, 0.0f);
+  double sweepRate = 0.0;
+
+  // a saved world takes precedence over generating, chunk by chunk
+  const char* worldPath = "world.bin";
+  WorldFileReader* worldFile = new WorldFileReader();
+  if (worldFile->Open(worldPath)) {
+    if (worldFile->ChunkSize() == world->chunkSize) {
+      streamer->UseWorldFile(worldFile);
+      std::cout << "World file: " << worldFile->ChunkCount() << " chunks"
+                << std::endl;
+    } else {
+      std::cout << "World file has a different chunk size, ignoring it"
+                << std::endl;
+      worldFile->Close();
+    }
+  }
+  bool compressWorld = true;
+  int worldRoundTrip = -2;  // -2 = not checked yet
+  double worldLoadRate = 0.0;
+
+  // visible trees are streamed per LOD level like the floor instances
+  StreamBuffer* treeStream = new StreamBuffer(GL_ARRAY_BUFFER, 4 << 20);
+  // the shadow passes' casters get their own ring, so a frame where every
+  // cascade redraws doesn't take room from the scene's lists
+  StreamBuffer* shadowStream = new StreamBuffer(GL_ARRAY_BUFFER, 4 << 20);
+  // one list per mesh level plus the impostor list at the end
+  LodSelector lodSelector;
+  int impostorLevel = (int)treeLod.levels.size();
+  std::vector<std::vector<InstanceData>> treeLists(impostorLevel + 1);
+  std::vector<GLintptr> treeOffsets(impostorLevel + 1);
+
+  // the same floor as voxels, a block per cube
+  VoxelWorld* voxels = new VoxelWorld(cubeScale);
+  {
+    int floorLayer = (int)std::round(floorY / cubeScale);
+    voxels->FillBox(glm::ivec3(-floorsize, floorLayer, -floorsize),
+                    glm::ivec3(floorsize - 1, floorLayer, floorsize - 1), 1);
+    voxels->Remesh(jobs);
+  }
+
   // skybox
   unsigned int skyboxVAO, skyboxVBO;
   glGenVertexArrays(1, &skyboxVAO);
@@ -197,6 +473,317 @@ int main() {
   }
   stbi_image_free(data);
 
+  // baked from the finest level once the texture exists
+  Impostor* treeImpostor = new Impostor(
+      *treeMesh, treeLod.levels[0], treeLod.center, treeLod.radius, texture);
+
+  // grass everywhere around the camera, generated in the vertex shader
+  GrassField* grass = new GrassField(glm::vec2(-1.0e5f), glm::vec2(1.0e5f),
+                                     forest.groundY, 7331);
+  grass->terrain = terrain;
+
+  // items, the monster and its pack are entities; their per-frame work is
+  // a schedule of systems that runs side by side where it can
+  Registry* ecs = new Registry();
+  SystemSchedule* systems = new SystemSchedule();
+
+  // collectibles scattered around the spawn, they bob and spin so they go
+  // through the broadphase every frame like anything else that moves
+  Broadphase* broadphase = new Broadphase();
+  std::vector<Entity> entityOfBody;  // broadphase id -> item
+  const float pickupRadius = 1.2f;
+  const int itemCount = 48;
+  for (int i = 0; i < itemCount; i++) {
+    // golden angle spiral between 15 and 80 m out
+    float angle = i * 2.3999632f;
+    float radius = 15.0f + 65.0f * std::sqrt((i + 0.5f) / itemCount);
+    float x = std::cos(angle) * radius;
+    float z = std::sin(angle) * radius;
+    glm::vec3 base(x, terrain->HeightAt(x, z) + 0.6f, z);
+    uint32_t body = broadphase->Add(base - glm::vec3(pickupRadius),
+                                    base + glm::vec3(pickupRadius));
+    Entity item = ecs->Create();
+    ecs->Add<Transform>(item, {base, angle});
+    ecs->Add<Bobbing>(item, {base, angle});
+    ecs->Add<Pickup>(item, {body});
+    ecs->Add<Drawn>(item, {glm::vec3(0.3f), 0.0f});
+    if (entityOfBody.size() <= body) entityOfBody.resize(body + 1);
+    entityOfBody[body] = item;
+  }
+  uint32_t playerBody = broadphase->Add(player.position, player.position);
+  int itemsCollected = 0;
+  std::vector<glm::mat4> itemMatrices;
+
+  Entity monsterEntity = ecs->Create();
+  glm::vec3 monsterStart(60.0f, terrain->HeightAt(60.0f, 60.0f), 60.0f);
+  ecs->Add<Transform>(monsterEntity, {monsterStart, 0.0f});
+  ecs->Add<Drawn>(monsterEntity, {glm::vec3(0.8f, 2.0f, 0.8f), 1.0f});
+  ecs->Add<Monster>(monsterEntity).lastSeen = player.position;
+  const float monsterSpeed = 3.5f;
+  const float sightRange = 60.0f;
+  double raycastRate = 0.0;
+  float pathBudgetUs = 300.0f;
+  double pathRate = 0.0;
+  // a pack of small creatures following the flow field to the player
+  std::vector<Entity> pack;
+  for (int i = 0; i < 12; i++) {
+    float angle = i * 0.5236f;
+    float x = -50.0f + 6.0f * std::cos(angle);
+    float z = 40.0f + 6.0f * std::sin(angle);
+    Entity creature = ecs->Create();
+    ecs->Add<Transform>(creature,
+                        {glm::vec3(x, terrain->HeightAt(x, z), z), 0.0f});
+    ecs->Add<Drawn>(creature, {glm::vec3(0.5f, 0.6f, 0.5f), 0.3f});
+    ecs->Add<Creature>(creature);
+    pack.push_back(creature);
+  }
+  const float packSpeed = 4.5f;
+
+  // the monster's think picks where to look and when to replan; what it saw
+  // and the path come back on the main thread
+  ai->Add([&]() { return ecs->Get<Transform>(monsterEntity).position; },
+          [&](const AiSnapshot& snapshot, const glm::vec3& position,
+              float dt) {
+            Monster& monster = ecs->Get<Monster>(monsterEntity);
+            const int sightRays = 3, beamRays = 8;
+            glm::vec3 eye = position + glm::vec3(0.0f, 1.8f, 0.0f);
+            // feet to eye, then points along the view where the flashlight
+            // beam lands
+            glm::vec3 feet = snapshot.playerPosition + glm::vec3(0.0f, 0.2f,
+                                                                0.0f);
+            Ray sight[sightRays + beamRays];
+            monster.sightTooFar = 0;
+            for (int i = 0; i < sightRays + beamRays; i++) {
+              glm::vec3 target =
+                  i < sightRays
+                      ? glm::mix(feet, snapshot.cameraPosition, i * 0.5f)
+                      : snapshot.cameraPosition +
+                            snapshot.cameraFront *
+                                (3.0f + 2.5f * (i - sightRays));
+              glm::vec3 to = target - eye;
+              float distance = glm::length(to);
+              if (distance > sightRange || distance < 1e-3f) {
+                monster.sightTooFar |= 1u << i;
+                distance = 0.0f;
+                to = glm::vec3(0.0f, -1.0f, 0.0f);
+              }
+              sight[i] = {eye, distance > 0.0f ? to / distance : to,
+                          distance};
+            }
+            monster.sight =
+                snapshot.rays->Submit(sight, sightRays + beamRays,
+                                      RAY_ANY_HIT);
+            monster.replanIn -= dt;
+            if (monster.replanIn <= 0.0f) {
+              monster.wantsPath = true;
+              monster.replanIn = 0.4f;
+            }
+          },
+          3.0f);
+  // creatures steer down the field and away from whoever is too close
+  for (Entity entity : pack) {
+    ai->Add([&, entity]() { return ecs->Get<Transform>(entity).position; },
+            [&, entity](const AiSnapshot& snapshot,
+                        const glm::vec3& position, float) {
+              Creature& creature = ecs->Get<Creature>(entity);
+              const FlowField* field = snapshot.playerField.get();
+              if (!field ||
+                  glm::length(snapshot.playerPosition - position) < 2.0f) {
+                creature.velocity = glm::vec3(0.0f);
+                return;
+              }
+              glm::vec3 steer = field->Sample(position);
+              for (const glm::vec3& other : snapshot.agentPositions) {
+                glm::vec3 away = position - other;
+                away.y = 0.0f;
+                float distance = glm::length(away);
+                if (distance > 1e-4f && distance < 1.2f) {
+                  steer += away * ((1.2f - distance) / distance);
+                }
+              }
+              float length = glm::length(steer);
+              creature.velocity =
+                  length > 1e-4f ? steer * (packSpeed / std::max(length, 1.0f))
+                                 : glm::vec3(0.0f);
+            });
+  }
+
+  // items bob and spin, then everything with a box in the broadphase moves
+  // it while the cubes to draw are gathered
+  float gameTime = 0.0f;
+  systems->Add("bob", ComponentMask<Bobbing>(), ComponentMask<Transform>(),
+               [&](Registry& registry) {
+                 registry.ParallelEach<Transform, Bobbing>(
+                     jobs, 1024,
+                     [&](Entity, Transform& transform, const Bobbing& bob) {
+                       float wave = std::sin(gameTime * 2.0f + bob.phase);
+                       transform.position =
+                           bob.base + glm::vec3(0.0f, 0.15f * wave, 0.0f);
+                       transform.yaw = gameTime * 1.5f + bob.phase;
+                     });
+               });
+  systems->Add("pickup bounds", ComponentMask<Transform, Pickup>(), 0,
+               [&](Registry& registry) {
+                 registry.Each<Transform, Pickup>(
+                     [&](Entity, const Transform& transform,
+                         const Pickup& pickup) {
+                       glm::vec3 half(pickupRadius);
+                       broadphase->Move(pickup.body, transform.position - half,
+                                        transform.position + half);
+                     });
+               });
+  systems->Add("draw list", ComponentMask<Transform, Drawn>(), 0,
+               [&](Registry& registry) {
+                 itemMatrices.clear();
+                 registry.Each<Transform, Drawn>(
+                     [&](Entity, const Transform& transform,
+                         const Drawn& drawn) {
+                       glm::mat4 model = glm::translate(
+                           glm::mat4(1.0f),
+                           transform.position +
+                               glm::vec3(0.0f, drawn.lift, 0.0f));
+                       model = glm::rotate(model, transform.yaw,
+                                           glm::vec3(0.0f, 1.0f, 0.0f));
+                       itemMatrices.push_back(glm::scale(model, drawn.scale));
+                     });
+               });
+  double ecsNsPerEntity = 0.0;
+  double clusterMs = 0.0;
+
+  // flashlight shadow casters: trees a step below full detail in the cached
+  // layer, the cubes of items, the monster and its pack in the moving one
+  std::vector<InstanceData> shadowTrees;
+  std::vector<glm::mat4> shadowCubes;
+  flashlightShadow->drawStatic = [&](const Frustum& light,
+                                     const glm::vec3& min,
+                                     const glm::vec3& max) {
+    shadowTrees.clear();
+    ChunkCoord from = world->ChunkAt(min.x, min.z);
+    ChunkCoord to = world->ChunkAt(max.x, max.z);
+    for (int cz = from.z; cz <= to.z; cz++) {
+      for (int cx = from.x; cx <= to.x; cx++) {
+        const Chunk* chunk = world->FindChunk({cx, cz});
+        if (!chunk ||
+            !light.IntersectsAABB(chunk->boundsMin, chunk->boundsMax)) {
+          continue;
+        }
+        for (size_t i = 0; i < chunk->trees.size(); i++) {
+          const TreeInstance& tree = chunk->trees[i];
+          glm::vec3 center = tree.position + treeLod.center * tree.scale;
+          if (!light.IntersectsSphere(center, treeLod.radius * tree.scale)) {
+            continue;
+          }
+          shadowTrees.push_back({chunk->treeMatrices[i], glm::vec4(0.0f)});
+        }
+      }
+    }
+    if (shadowTrees.empty()) return 0;
+    GLintptr offset = shadowStream->Upload(
+        shadowTrees.data(), shadowTrees.size() * sizeof(InstanceData));
+    if (offset < 0) return 0;
+    const LodLevel& level = treeLod.levels[std::min(1, impostorLevel - 1)];
+    treeMesh->SetInstanceBuffer(shadowStream->ID, (long)offset);
+    treeMesh->DrawInstanced(level.firstIndex, level.indexCount,
+                            level.baseVertex, (int)shadowTrees.size());
+    return (int)shadowTrees.size();
+  };
+  flashlightShadow->drawDynamic = [&](const Frustum& light, const glm::vec3&,
+                                      const glm::vec3&) {
+    shadowCubes.clear();
+    for (const glm::mat4& cube : itemMatrices) {
+      // half the diagonal of the scaled unit cube bounds it
+      float scale = std::max(glm::length(glm::vec3(cube[0])),
+                             std::max(glm::length(glm::vec3(cube[1])),
+                                      glm::length(glm::vec3(cube[2]))));
+      if (light.IntersectsSphere(glm::vec3(cube[3]), 0.87f * scale)) {
+        shadowCubes.push_back(cube);
+      }
+    }
+    if (shadowCubes.empty()) return 0;
+    GLintptr offset = shadowStream->Upload(
+        shadowCubes.data(), shadowCubes.size() * sizeof(glm::mat4));
+    if (offset < 0) return 0;
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, shadowStream->ID);
+    for (int i = 0; i < 4; i++) {
+      glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                            (void*)(offset + sizeof(glm::vec4) * i));
+    }
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 36, (int)shadowCubes.size());
+    return (int)shadowCubes.size();
+  };
+  // moon casters: the chunks under the cascade's box, coarser trees in the
+  // far cascades, and the small cubes only where they'd cover a texel
+  moonShadow->drawCasters = [&](int cascade, const Frustum& light,
+                                const glm::vec3& min, const glm::vec3& max) {
+    shadowTrees.clear();
+    ChunkCoord from = world->ChunkAt(min.x, min.z);
+    ChunkCoord to = world->ChunkAt(max.x, max.z);
+    for (int cz = from.z; cz <= to.z; cz++) {
+      for (int cx = from.x; cx <= to.x; cx++) {
+        const Chunk* chunk = world->FindChunk({cx, cz});
+        if (!chunk ||
+            !light.IntersectsAABB(chunk->boundsMin, chunk->boundsMax)) {
+          continue;
+        }
+        for (size_t i = 0; i < chunk->trees.size(); i++) {
+          const TreeInstance& tree = chunk->trees[i];
+          glm::vec3 center = tree.position + treeLod.center * tree.scale;
+          if (!light.IntersectsSphere(center, treeLod.radius * tree.scale)) {
+            continue;
+          }
+          shadowTrees.push_back({chunk->treeMatrices[i], glm::vec4(0.0f)});
+        }
+      }
+    }
+    int casters = 0;
+    if (!shadowTrees.empty()) {
+      GLintptr offset = shadowStream->Upload(
+          shadowTrees.data(), shadowTrees.size() * sizeof(InstanceData));
+      if (offset >= 0) {
+        int lod = std::min(std::max(1, cascade), impostorLevel - 1);
+        const LodLevel& level = treeLod.levels[lod];
+        treeMesh->SetInstanceBuffer(shadowStream->ID, (long)offset);
+        treeMesh->DrawInstanced(level.firstIndex, level.indexCount,
+                                level.baseVertex, (int)shadowTrees.size());
+        casters += (int)shadowTrees.size();
+      }
+    }
+    if (cascade >= 2) return casters;
+    shadowCubes.clear();
+    for (const glm::mat4& cube : itemMatrices) {
+      float scale = std::max(glm::length(glm::vec3(cube[0])),
+                             std::max(glm::length(glm::vec3(cube[1])),
+                                      glm::length(glm::vec3(cube[2]))));
+      if (light.IntersectsSphere(glm::vec3(cube[3]), 0.87f * scale)) {
+        shadowCubes.push_back(cube);
+      }
+    }
+    if (shadowCubes.empty()) return casters;
+    GLintptr offset = shadowStream->Upload(
+        shadowCubes.data(), shadowCubes.size() * sizeof(glm::mat4));
+    if (offset < 0) return casters;
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, shadowStream->ID);
+    for (int i = 0; i < 4; i++) {
+      glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                            (void*)(offset + sizeof(glm::vec4) * i));
+    }
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 36, (int)shadowCubes.size());
+    return casters + (int)shadowCubes.size();
+  };
+  double flowNsPerAgent = 0.0;
+  double broadphaseMs[2][2][2] = {};  // [type][100k][jobs]
+
+  // perf stats
+  int visibleInstances = 0;
+  int testedTiles = 0;
+  int occludedTiles = 0;
+  float streamRate = 0.0f;  // smoothed MB/s through instanceStream
+  int streamFailures = 0;   // of all three rings, last frame
+  int visibleTrees = 0;
+  double benchmarkRate = 0.0;
+
   // render loop
   while (!glfwWindowShouldClose(window)) {
     // calculate delta time
@@ -220,57 +807,460 @@ int main() {
     ImGui::Begin("Settings");
     ImGui::Checkbox("Free Cam", &freeCam);
     ImGui::Checkbox("Wireframe", &wireframe);
+    ImGui::Checkbox("Voxel Floor", &voxelFloor);
+    if (gpuCuller) ImGui::Checkbox("GPU Culling", &gpuCulling);
     ImGui::PushItemWidth(50);
     ImGui::SliderFloat("Render Distance", &renderDistance, 5.0f, 1000.0f);
+    ImGui::SliderFloat("LOD Error (px)", &lodSelector.settings.pixelError,
+                       0.25f, 8.0f);
+    ImGui::SliderFloat("LOD Fade (s)", &lodSelector.settings.fadeTime, 0.0f,
+                       1.0f);
+    ImGui::Checkbox("Impostors", &impostors);
+    ImGui::SliderFloat("Impostor Distance", &impostorDistance, 10.0f, 500.0f);
+    ImGui::SliderFloat("Terrain LOD", &terrain->lodDistance, 80.0f, 400.0f);
+    int broadphaseType = broadphase->type;
+    if (ImGui::Combo("Broadphase", &broadphaseType,
+                     "Sweep and prune\0Spatial hash\0")) {
+      broadphase->type = (BroadphaseType)broadphaseType;
+    }
+    ImGui::SliderFloat("Grass Distance", &grass->settings.drawDistance, 5.0f,
+                       200.0f);
+    ImGui::SliderFloat("Grass Density", &grass->settings.density, 0.0f,
+                       120.0f);
+    ImGui::SliderFloat("Load Radius", &streamer->settings.loadRadius, 64.0f,
+                       1000.0f);
+    int memoryBudgetMB = (int)(streamer->settings.memoryBudget >> 20);
+    if (ImGui::SliderInt("Chunk Memory (MB)", &memoryBudgetMB, 1, 256)) {
+      streamer->settings.memoryBudget = (size_t)memoryBudgetMB << 20;
+    }
     ImGui::PopItemWidth();
     ImGui::End();
 
+    ImGui::Begin("Performance");
+    ImGui::Text("GL %d.%d", glExt.major, glExt.minor);
+    if (voxelFloor) {
+      ImGui::Text("Voxel floor: %d quads, %d/%d chunks drawn, %.0f KB",
+                  voxels->QuadCount(), voxels->ChunksDrawn(),
+                  voxels->ChunkCount(), voxels->VoxelBytes() / 1024.0);
+    } else if (gpuCuller && gpuCulling) {
+      ImGui::Text("Floor instances: GPU culled / %d",
+                  (int)modelMatrices.size());
+    } else {
+      ImGui::Text("Floor instances: %d / %d", visibleInstances,
+                  (int)modelMatrices.size());
+    }
+    ImGui::Text("Terrain: %d nodes, %d triangles", terrain->NodesDrawn(),
+                terrain->TrianglesDrawn());
+    ImGui::Text("Trees: %d / %d", visibleTrees, (int)world->TreeCount());
+    for (int i = 0; i < impostorLevel; i++) {
+      if (i > 0) ImGui::SameLine();
+      ImGui::Text("L%d: %d", i, (int)treeLists[i].size());
+    }
+    ImGui::SameLine();
+    ImGui::Text("Impostor: %d", (int)treeLists[impostorLevel].size());
+    ImGui::Text("Grass: %d blades in %d patches", grass->BladesDrawn(),
+                grass->PatchesDrawn());
+    ImGui::Text("Collision: %d shapes in %d cells%s",
+                (int)collision->ShapeCount(), (int)collision->CellCount(),
+                player.grounded ? ", grounded" : "");
+    ImGui::Text("Navmesh: %d tiles, %d polys, %d building, %d queued",
+                navMesh->TileCount(), navMesh->PolyCount(),
+                navMesh->Building(), navMesh->Queued());
+    ImGui::Text("Navmesh tiles: %d built (%.1f ms last), %d from cache",
+                navMesh->Built(), navMesh->BuildMs(), navMesh->CacheHits());
+    ImGui::Text("Pathfinding: %d nodes, %d edges, %d pending, %d dirty",
+                pathfinder->NodeCount(), pathfinder->EdgeCount(),
+                pathfinder->Pending(), pathfinder->DirtyTiles());
+    ImGui::Text("Pathfinding: %.0f us last frame, %.0f us worst step",
+                pathfinder->LastUpdateUs(), pathfinder->WorstStepUs());
+    ImGui::SliderFloat("Path Budget (us)", &pathBudgetUs, 50.0f, 2000.0f);
+    if (ImGui::Button("Benchmark pathfinding")) {
+      pathRate = BenchmarkPathfinding(6, 300, *jobs);
+    }
+    if (pathRate > 0.0) {
+      ImGui::SameLine();
+      ImGui::Text("%.0f queries/s", pathRate);
+    }
+    const Monster& seen = ecs->Get<Monster>(monsterEntity);
+    ImGui::Text("Monster: %s the player, %s the beam (%d rays, %.2f ms %s)",
+                seen.seesPlayer ? "sees" : "can't see",
+                seen.seesBeam ? "sees" : "can't see", rays->RaysLastTick(),
+                rays->TraceMs(), RayBvh::SimdName());
+    if (ImGui::Button("Benchmark raycasts")) {
+      raycastRate = BenchmarkRaycasts(512.0f, 1000000, *jobs);
+    }
+    if (raycastRate > 0.0) {
+      ImGui::SameLine();
+      ImGui::Text("%.2f M rays/s", raycastRate / 1.0e6);
+    }
+    ImGui::Text("Flow fields: %d cached, %d built (%.2f ms, %d waves), %d hits",
+                flowFields->CachedFields(), flowFields->Built(),
+                flowFields->BuildMs(), flowFields->Waves(),
+                flowFields->CacheHits());
+    ImGui::Text("AI: %d agents, %d ticks, LOD %d/%d/%d/%d",
+                ai->AgentCount(), ai->TicksLastFrame(),
+                ai->AgentsAt(AI_LOD_FULL), ai->AgentsAt(AI_LOD_NEAR),
+                ai->AgentsAt(AI_LOD_MID), ai->AgentsAt(AI_LOD_FAR));
+    ImGui::Text("AI time: %.3f ms (%.3f ms thinking), %.3f ms peak",
+                ai->WallMs(), ai->ThinkMs(), ai->PeakMs());
+    ImGui::PlotLines("AI ms", ai->History(), AiScheduler::HISTORY,
+                     ai->HistoryOffset(), nullptr, 0.0f, FLT_MAX,
+                     ImVec2(0.0f, 40.0f));
+    if (ImGui::Button("Benchmark flow fields")) {
+      flowNsPerAgent = BenchmarkFlowField(3, 10000, *jobs);
+    }
+    if (flowNsPerAgent > 0.0) {
+      ImGui::SameLine();
+      ImGui::Text("%.1f ns per agent at 10k", flowNsPerAgent);
+    }
+    if (ImGui::Button("Benchmark sweeps")) {
+      sweepRate = BenchmarkCapsuleSweeps(100000, 1000000);
+    }
+    if (sweepRate > 0.0) {
+      ImGui::SameLine();
+      ImGui::Text("%.2f M capsule sweeps/s", sweepRate / 1.0e6);
+    }
+    ImGui::Text("Broadphase: %d bodies, %d pairs, %.3f ms",
+                broadphase->BodyCount(), (int)broadphase->Pairs().size(),
+                broadphase->LastMs());
+    ImGui::Text("Items: %d / %d collected", itemsCollected, itemCount);
+    ImGui::Text("Flashlight shadow: %d trees %s (%d redraws), %d moving",
+                flashlightShadow->StaticCasters(),
+                flashlightShadow->RedrewStatic() ? "redrawn" : "cached",
+                flashlightShadow->StaticRedraws(),
+                flashlightShadow->DynamicCasters());
+    for (int c = 0; moonShadows && c < moonShadow->CascadeCount(); c++) {
+      ImGui::Text("Moon cascade %d: to %.0f m, %d casters, %.3f ms GPU, "
+                  "every %d (%s)",
+                  c, moonShadow->SplitFar(c), moonShadow->Casters(c),
+                  moonShadow->GpuMs(c),
+                  std::max(1, moonShadow->settings.interval[c]),
+                  moonShadow->Redrawn(c) ? "redrawn" : "cached");
+    }
+    {
+      const ClusterGrid& grid = clusteredLights->Grid();
+      ImGui::Text("Local lights: %d of %d in view, %d in a cluster at most, "
+                  "%d dropped, %.3f ms (%s)",
+                  clusteredLights->Uploaded(),
+                  (int)clusteredLights->lights.size(), grid.MaxInCluster(),
+                  grid.Dropped(), grid.AssignMs(), ClusterGrid::SimdName());
+    }
+    ImGui::Text("Fog: lookup baked %d times (%.3f ms)", heightFog->Bakes(),
+                heightFog->BakeMs());
+    if (fogQuality == 3 && heightFog->settings.on) {
+      ImGui::Text("Volumetric %dx%d: %.3f ms GPU march, %.3f ms composite",
+                  volumetricLight->Width(), volumetricLight->Height(),
+                  volumetricLight->MarchMs(), volumetricLight->CompositeMs());
+    } else if (fogQuality > 0 && heightFog->settings.on) {
+      ImGui::Text("Fog volume %dx%dx%d: %.3f ms GPU scatter, %.3f ms "
+                  "composite",
+                  fogVolume->settings.width, fogVolume->settings.height,
+                  fogVolume->settings.slices, fogVolume->RenderMs(),
+                  fogVolume->CompositeMs());
+    }
+    if (ImGui::Button("Benchmark clusters")) {
+      clusterMs = BenchmarkClusteredLights(512, *jobs);
+    }
+    if (clusterMs > 0.0) {
+      ImGui::SameLine();
+      ImGui::Text("%.3f ms for 512 lights", clusterMs);
+    }
+    ImGui::Text("ECS: %d entities, %d systems in %d waves, %.3f ms",
+                ecs->EntityCount(), systems->SystemCount(),
+                systems->WaveCount(), systems->LastMs());
+    if (ImGui::Button("Benchmark ECS")) {
+      ecsNsPerEntity = BenchmarkEcs(50000, *jobs);
+    }
+    if (ecsNsPerEntity > 0.0) {
+      ImGui::SameLine();
+      ImGui::Text("%.1f ns per entity", ecsNsPerEntity);
+    }
+    if (ImGui::Button("Benchmark broadphase")) {
+      for (int type = 0; type < 2; type++) {
+        for (int large = 0; large < 2; large++) {
+          for (int wide = 0; wide < 2; wide++) {
+            broadphaseMs[type][large][wide] =
+                BenchmarkBroadphase((BroadphaseType)type,
+                                    large ? 100000 : 10000, 30,
+                                    wide ? jobs : nullptr);
+          }
+        }
+      }
+    }
+    if (broadphaseMs[0][0][0] > 0.0) {
+      const char* names[2] = {"SAP", "Hash"};
+      for (int type = 0; type < 2; type++) {
+        ImGui::Text("%s ms/frame: 10k %.2f / %.2f MT, 100k %.2f / %.2f MT",
+                    names[type], broadphaseMs[type][0][0],
+                    broadphaseMs[type][0][1], broadphaseMs[type][1][0],
+                    broadphaseMs[type][1][1]);
+      }
+    }
+    ImGui::Text("Chunks: %d resident, %d loading, %d queued",
+                streamer->Resident(), streamer->Loading(), streamer->Queued());
+    ImGui::Text("Chunk memory: %.1f MB, %d evicted, %.2f ms per chunk",
+                streamer->MemoryBytes() / (1024.0 * 1024.0),
+                streamer->Evicted(), streamer->GenerateMs());
+    if (ImGui::Button("Save world")) {
+      // written to a new file, a mapping of the old one stays valid
+      if (WriteWorldFile(worldPath, *world, compressWorld)) {
+        worldRoundTrip = VerifyWorldFile(worldPath, *world);
+      }
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("LZ4", &compressWorld);
+    ImGui::SameLine();
+    if (ImGui::Button("Benchmark load")) {
+      worldLoadRate = BenchmarkWorldFileLoad(worldPath);
+    }
+    if (worldRoundTrip != -2) {
+      ImGui::Text("Round trip: %s", worldRoundTrip == 0   ? "ok"
+                                    : worldRoundTrip < 0 ? "unreadable"
+                                                         : "mismatch");
+    }
+    if (worldLoadRate > 0.0) {
+      ImGui::SameLine();
+      ImGui::Text("Load: %.0f MB/s", worldLoadRate);
+    }
+    ImGui::Text("Instance stream: %.1f MB/s (%s)", streamRate,
+                instanceStream->persistent ? "persistent" : "unsynchronized");
+    ImGui::Text("Streams: %d uploads didn't fit last frame, regrown %d times",
+                streamFailures,
+                instanceStream->Grows() + treeStream->Grows() +
+                    shadowStream->Grows());
+    if (ImGui::Button("Benchmark upload")) {
+      benchmarkRate = BenchmarkStreamUpload(256 << 20, 1 << 20);
+    }
+    if (benchmarkRate > 0.0) {
+      ImGui::SameLine();
+      ImGui::Text("%.0f MB/s", benchmarkRate);
+    }
+    ImGui::End();
+
+    ImGui::Begin("Occlusion");
+    ImGui::Checkbox("Occlusion Culling", &occlusionCulling);
+    if (gpuCuller && gpuCulling) {
+      ImGui::Text("Tested on the GPU against the full pyramid");
+    } else {
+      ImGui::RadioButton("Hi-Z readback", &occlusionSource, 0);
+      ImGui::SameLine();
+      ImGui::RadioButton("Software raster", &occlusionSource, 1);
+      ImGui::Text("Tiles: %d tested, %d occluded", testedTiles, occludedTiles);
+      if (occlusionSource == 0) {
+        ImGui::Text("CPU depth: %s", hiZ->HasCpuDepth() ? "ready" : "waiting");
+      } else {
+        ImGui::Text("Raster: %s, %d occluder triangles, %u threads",
+                    OcclusionRasterizer::SimdName(),
+                    softOcclusion->TriangleCount(), jobs->ThreadCount() + 1);
+      }
+    }
+    ImGui::Checkbox("Show Hi-Z", &showHiZ);
+    if (showHiZ) {
+      ImGui::SliderInt("Level", &hiZDebugLevel, 0,
+                       std::max(0, hiZ->levels - 1));
+      ImGui::Image((ImTextureID)hiZ->debugTexture,
+                   ImVec2((float)hiZ->debugWidth, (float)hiZ->debugHeight),
+                   ImVec2(0, 1), ImVec2(1, 0));
+    }
+    ImGui::End();
+
     ImGui::Begin("Environment");
     ImGui::SliderFloat("Ambient", &ambientStrength, 0.01f, 10.0f);
     ImGui::SliderFloat("Diffuse", &diffuseStrength, 0.01f, 10.0f);
     ImGui::SliderFloat("Specular", &specularStrength, 0.01f, 10.0f);
     ImGui::SliderFloat("Shininess", &shininess, 1.0f, 100.0f);
+    ImGui::SliderFloat("Wind", &grass->settings.windStrength, 0.0f, 2.0f);
+    ImGui::Checkbox("Flashlight (L)", &flashlight.on);
+    ImGui::SliderFloat("Flashlight Intensity", &flashlight.intensity, 0.0f,
+                       100.0f);
+    ImGui::SliderFloat("Flashlight Cone", &flashlight.outerAngle, 5.0f,
+                       60.0f);
+    flashlight.innerAngle = std::min(flashlight.innerAngle,
+                                     flashlight.outerAngle);
+    ImGui::SliderFloat("Flashlight Hotspot", &flashlight.innerAngle, 1.0f,
+                       flashlight.outerAngle);
+    ImGui::SliderFloat("Flashlight Range", &flashlight.range, 5.0f, 100.0f);
+    ImGui::Checkbox("Moon Shadows", &moonShadows);
+    ImGui::Checkbox("Local Lights", &localLights);
+    ImGui::Checkbox("Fog", &heightFog->settings.on);
+    ImGui::ColorEdit3("Fog Color", &heightFog->settings.color.x);
+    ImGui::SliderFloat("Fog Density", &heightFog->settings.density, 0.0f,
+                       0.2f);
+    ImGui::SliderFloat("Fog Falloff", &heightFog->settings.falloff, 0.01f,
+                       1.0f);
+    ImGui::Combo("Fog Quality", &fogQuality,
+                 "Height fog\0Volumetric\0Volumetric high\0Raymarched\0");
+    if (ImGui::SliderFloat("Fog Scattering", &fogVolume->settings.scattering,
+                           0.0f, 4.0f)) {
+      volumetricLight->settings.scattering = fogVolume->settings.scattering;
+    }
+    if (fogQuality == 3) {
+      int scale = volumetricLight->settings.divisor == 4 ? 1 : 0;
+      if (ImGui::Combo("Volumetric Resolution", &scale, "Half\0Quarter\0")) {
+        volumetricLight->settings.divisor = scale == 1 ? 4 : 2;
+      }
+      ImGui::SliderInt("Volumetric Steps", &volumetricLight->settings.steps, 4,
+                       64);
+      ImGui::SliderFloat("Volumetric History",
+                         &volumetricLight->settings.history, 0.0f, 0.98f);
+    }
+    ImGui::SliderInt("Moon Cascades", &moonShadow->settings.cascades, 1,
+                     CSM_MAX_CASCADES);
+    ImGui::SliderFloat("Moon Shadow Distance",
+                       &moonShadow->settings.maxDistance, 20.0f, 500.0f);
     ImGui::End();
 
     // render
 
     // OPEN_GL
+    // scene goes into an offscreen target so its depth can feed the Hi-Z
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    sceneTarget->Resize(width, height);
+    sceneTarget->Bind();
+
     glClearColor(0.02f, 0.02f, 0.03f, 1.0f);
     glEnable(GL_DEPTH_TEST);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // Bind Texture
-    glBindTexture(GL_TEXTURE_2D, texture);
-
     // Matrices
     // global space
     glm::mat4 model = glm::mat4(1.0f);
 
-    // apply gravity & floor collision (unless freeCam is on)
+    // apply gravity & move the player capsule (unless freeCam is on), the
+    // eye sits cameraHeight above the floor cube centers like before
+    float eyeHeight = camera.cameraHeight - 0.5f * cubeScale;
     if (!freeCam) {
       if (!camera.isGrounded) {
         camera.velocity.y += camera.GRAVITY * deltaTime;
       }
 
-      camera.cameraPos += camera.velocity * deltaTime;
-      float floorLevel = floorY + camera.cameraHeight;
+      player.height = eyeHeight + 0.1f;  // follows crouching
+      player.Move(*collision, camera.velocity, deltaTime);
+      camera.isGrounded = player.grounded;
+      camera.cameraPos = player.position + glm::vec3(0.0f, eyeHeight, 0.0f);
+    } else {
+      player.position = camera.cameraPos - glm::vec3(0.0f, eyeHeight, 0.0f);
+    }
+
+    streamer->Update(camera.cameraPos, camera.cameraFront);
+    navMesh->Update();
+    pathfinder->Update(pathBudgetUs);
+
+    // what the monster saw last tick: its first rays go to the player, the
+    // rest to where the flashlight beam lands. A monster thinking every few
+    // frames has nothing to collect in between and keeps what it had.
+    const int sightRays = 3, beamRays = 8;
+    Monster& monster = ecs->Get<Monster>(monsterEntity);
+    glm::vec3& monsterPosition = ecs->Get<Transform>(monsterEntity).position;
+    rays->Collect();
+    if (const RayHit* hits = rays->Results(monster.sight)) {
+      monster.seesPlayer = false;
+      monster.seesBeam = false;
+      for (int i = 0; i < sightRays + beamRays; i++) {
+        if (hits[i].shape != RAY_MISS || (monster.sightTooFar >> i & 1)) {
+          continue;
+        }
+        if (i < sightRays) {
+          monster.seesPlayer = true;
+        } else {
+          monster.seesBeam = true;
+        }
+      }
+      if (monster.seesPlayer) monster.lastSeen = player.position;
+    }
+
+    // the field is cached per player cell, so this only builds one when
+    // the player steps into a new cell
+    std::shared_ptr<const FlowField> packField =
+        flowFields->Get(player.position);
+    AiSnapshot aiSnapshot;
+    aiSnapshot.playerPosition = player.position;
+    aiSnapshot.cameraPosition = camera.cameraPos;
+    aiSnapshot.cameraFront = camera.cameraFront;
+    aiSnapshot.navMesh = navMesh;
+    aiSnapshot.playerField = packField;
+    aiSnapshot.rays = rays;
+    ai->Update(aiSnapshot, deltaTime);
+
+    if (monster.searching) {
+      PathStatus status = pathfinder->Status(monster.query);
+      if (status != PATH_PENDING) {
+        if (status == PATH_FOUND) {
+          monster.path = pathfinder->Path(monster.query);
+          monster.waypoint = 1;
+        }
+        pathfinder->Release(monster.query);
+        monster.searching = false;
+      }
+    } else if (monster.wantsPath) {
+      monster.query = pathfinder->Request(monsterPosition, monster.lastSeen);
+      monster.searching = true;
+      monster.wantsPath = false;
+    }
+    // creatures keep the velocity of their last think between ticks, but
+    // never walk off the field
+    if (packField) {
+      ecs->Each<Transform, Creature>(
+          [&](Entity, Transform& transform, const Creature& creature) {
+            glm::vec3 next =
+                transform.position + creature.velocity * deltaTime;
+            if (packField->Cost(next) == FLOW_UNREACHABLE) return;
+            transform.position = next;
+            transform.position.y = packField->Height(next);
+          });
+    }
 
-      if (camera.cameraPos.y <= floorLevel) {
-        camera.cameraPos.y = floorLevel;  // Snap to floor
-        camera.velocity.y = 0.0f;         // Stop falling
-        camera.isGrounded = true;
+    // keeps walking the old path while the new one is searched for, and
+    // stops once it's within reach
+    float monsterStep = monsterSpeed * deltaTime;
+    while (monsterStep > 0.0f && monster.waypoint < monster.path.size() &&
+           glm::length(player.position - monsterPosition) > 1.5f) {
+      glm::vec3 to = monster.path[monster.waypoint] - monsterPosition;
+      float length = glm::length(to);
+      if (length <= monsterStep) {
+        monsterPosition = monster.path[monster.waypoint++];
+        monsterStep -= length;
       } else {
-        camera.isGrounded = false;
+        monsterPosition += to * (monsterStep / length);
+        monsterStep = 0.0f;
       }
     }
+    // this tick's rays trace while the frame renders
+    rays->Dispatch();
+
+    // the broadphase pairs items with the player and the exact pickup
+    // radius is the narrowphase
+    gameTime = currentFrame;
+    systems->Run(*ecs, jobs);
+    broadphase->Move(
+        playerBody,
+        player.position - glm::vec3(player.radius, 0.0f, player.radius),
+        player.position +
+            glm::vec3(player.radius, player.height, player.radius));
+    broadphase->FindPairs(jobs);
+    for (const BroadphasePair& pair : broadphase->Pairs()) {
+      if (pair.a != playerBody && pair.b != playerBody) continue;
+      uint32_t other = pair.a == playerBody ? pair.b : pair.a;
+      if (other >= entityOfBody.size()) continue;
+      Entity item = entityOfBody[other];
+      if (!ecs->Alive(item)) continue;
+      glm::vec3 center = (broadphase->BodyMin(other) +
+                          broadphase->BodyMax(other)) * 0.5f;
+      // distance from the item to the player's capsule axis
+      glm::vec3 axis = player.position;
+      axis.y = glm::clamp(center.y, player.position.y + player.radius,
+                          player.position.y + player.height - player.radius);
+      if (glm::length(center - axis) > pickupRadius + player.radius) continue;
+      broadphase->Remove(other);
+      ecs->Destroy(item);
+      itemsCollected++;
+    }
 
     // view matrix
     glm::mat4 view = camera.GetViewMatrix();
 
     // projection matrix
-    int width, height;
-    glfwGetFramebufferSize(window, &width, &height);
-
     // Ensure we don't divide by zero if window is minimized
     float aspect = (height > 0) ? (float)width / (float)height : 1.0f;
 
@@ -278,35 +1268,264 @@ int main() {
     glm::mat4 projection =
         glm::perspective(glm::radians(60.0f), aspect, 0.1f, renderDistance);
 
+    // cull the floor: compute shader on GL 4.3+, tiles on the CPU otherwise
+    bool useGpuCulling = gpuCuller && gpuCulling && !voxelFloor;
+    GLintptr instanceOffset = 0;
+    visibleInstances = 0;
+    Frustum frustum(projection * view);
+    bool useSoftOcclusion =
+        !useGpuCulling && occlusionCulling && occlusionSource == 1;
+    if (useSoftOcclusion) {
+      softOcclusion->Begin(projection * view);
+      for (const auto& box : occluderBoxes) {
+        softOcclusion->AddOccluderBox(box.first, box.second);
+      }
+      // the ground of the hills around, which hides what's behind a ridge
+      terrainOccluders.clear();
+      terrain->OccluderBoxes(camera.cameraPos, terrainOccluderReach,
+                             terrainOccluders);
+      for (const auto& box : terrainOccluders) {
+        softOcclusion->AddOccluderBox(box.first, box.second);
+      }
+      // the solid core of nearby trees: trunk plus a box inside the lowest
+      // cone, small enough to stay inside it at any yaw
+      const float occluderReach = 40.0f;
+      for (auto& entry : world->chunks) {
+        const Chunk& chunk = entry.second;
+        glm::vec3 nearest =
+            glm::clamp(camera.cameraPos, chunk.boundsMin, chunk.boundsMax);
+        if (glm::length(nearest - camera.cameraPos) > occluderReach) continue;
+        for (const TreeInstance& tree : chunk.trees) {
+          if (glm::length(tree.position - camera.cameraPos) > occluderReach) {
+            continue;
+          }
+          glm::vec3 p = tree.position;
+          float s = tree.scale;
+          softOcclusion->AddOccluderBox(p + glm::vec3(-0.17f, 0.0f, -0.17f) * s,
+                                        p + glm::vec3(0.17f, 1.6f, 0.17f) * s);
+          softOcclusion->AddOccluderBox(p + glm::vec3(-0.55f, 1.6f, -0.55f) * s,
+                                        p + glm::vec3(0.55f, 2.8f, 0.55f) * s);
+        }
+      }
+      softOcclusion->Rasterize();
+    }
+    auto occluded = [&](const glm::vec3& min, const glm::vec3& max) {
+      if (!occlusionCulling) return false;
+      return useSoftOcclusion ? !softOcclusion->IsVisible(min, max)
+                              : !hiZ->IsVisible(min, max, camera.cameraPos);
+    };
+
+    if (voxelFloor) {
+      // a few quads per chunk, frustum culled per chunk when drawn
+      voxels->Remesh(jobs);
+    } else if (useGpuCulling) {
+      gpuCuller->SetHiZ(occlusionCulling ? hiZ->texture : 0, hiZ->width,
+                        hiZ->height, hiZ->levels - 1, hiZ->viewProjection);
+      gpuCuller->Cull(projection * view);
+    } else {
+      // cull floor tiles and stream the visible instances
+      visibleTiles.clear();
+      testedTiles = 0;
+      occludedTiles = 0;
+      for (int i = 0; i < (int)floorTiles.size(); i++) {
+        const FloorTile& tile = floorTiles[i];
+        if (!frustum.IntersectsAABB(tile.min, tile.max)) continue;
+        if (occlusionCulling) {
+          testedTiles++;
+          if (occluded(tile.min, tile.max)) {
+            occludedTiles++;
+            continue;
+          }
+        }
+        visibleTiles.push_back(i);
+        visibleInstances += tile.count;
+      }
+
+      glm::mat4* instances = (glm::mat4*)instanceStream->Allocate(
+          visibleInstances * sizeof(glm::mat4), instanceOffset);
+      if (instances) {
+        for (int i : visibleTiles) {
+          const FloorTile& tile = floorTiles[i];
+          std::copy(modelMatrices.begin() + tile.first,
+                    modelMatrices.begin() + tile.first + tile.count,
+                    instances);
+          instances += tile.count;
+        }
+        instanceStream->Commit();
+      } else {
+        visibleInstances = 0;
+      }
+    }
+
+    // trees: cull whole chunks, then pick a LOD per tree
+    lodSelector.Begin(glm::radians(60.0f), (float)height, deltaTime);
+    for (auto& list : treeLists) list.clear();
+    for (auto& entry : world->chunks) {
+      Chunk& chunk = entry.second;
+      if (!frustum.IntersectsAABB(chunk.boundsMin, chunk.boundsMax)) continue;
+      if (occluded(chunk.boundsMin, chunk.boundsMax)) continue;
+      for (size_t i = 0; i < chunk.trees.size(); i++) {
+        const TreeInstance& tree = chunk.trees[i];
+        glm::vec3 center = tree.position + treeLod.center * tree.scale;
+        if (!frustum.IntersectsSphere(center, treeLod.radius * tree.scale)) {
+          continue;
+        }
+        // error is in mesh units, so measure distance in them too
+        float distance = glm::length(center - camera.cameraPos);
+        LodState& state = chunk.treeLod[i];
+        // a little hysteresis so trees at the threshold don't flip
+        float threshold = state.level == impostorLevel ? impostorDistance * 0.9f
+                                                       : impostorDistance;
+        int force = impostors && distance > threshold ? impostorLevel : -1;
+        lodSelector.Submit(state, treeLod, chunk.treeMatrices[i],
+                           distance / tree.scale, treeLists, force);
+      }
+    }
+    visibleTrees = 0;
+    for (size_t i = 0; i < treeLists.size(); i++) {
+      treeOffsets[i] = treeStream->Upload(
+          treeLists[i].data(), treeLists[i].size() * sizeof(InstanceData));
+      if (treeOffsets[i] >= 0) visibleTrees += (int)treeLists[i].size();
+    }
+
+    // the flashlight's shadow map, then back to the scene target
+    flashlight.Follow(camera);
+    flashlightShadow->Update(flashlight);
+    if (moonShadows) {
+      moonShadow->Update(moonDir, camera.cameraPos, camera.cameraFront,
+                         camera.cameraUp, glm::radians(60.0f), aspect, 0.1f,
+                         renderDistance);
+    }
+    // the local lights into froxels for this view
+    clusteredLights->lights.clear();
+    if (localLights) {
+      for (auto& entry : chunkLights) {
+        clusteredLights->lights.insert(clusteredLights->lights.end(),
+                                       entry.second.begin(),
+                                       entry.second.end());
+      }
+    }
+    clusteredLights->Update(view, glm::radians(60.0f), aspect, 0.1f,
+                            renderDistance, gameTime);
+    heightFog->Update(camera.cameraPos.y, renderDistance);
+    sceneTarget->Bind();
+    glm::mat4 flashlightCookieMatrix = flashlight.ViewProjection();
+
+    // Bind Texture
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
     ourShader.use();
 
-    // phong lighting
+    // phong lighting, shared by every lit shader
     glm::vec3 moonDirNorm = glm::normalize(moonDir);
-    glUniform3fv(glGetUniformLocation(ourShader.ID, "viewPos"), 1,
-                 glm::value_ptr(camera.cameraPos));
-    glUniform3fv(glGetUniformLocation(ourShader.ID, "lightDir"), 1,
-                 glm::value_ptr(moonDirNorm));
-    glUniform3fv(glGetUniformLocation(ourShader.ID, "lightColor"), 1,
-                 glm::value_ptr(moonColor));
-    glUniform1f(glGetUniformLocation(ourShader.ID, "ambientStrength"),
-                ambientStrength);
-    glUniform1f(glGetUniformLocation(ourShader.ID, "diffuseStrength"),
-                diffuseStrength);
-    glUniform1f(glGetUniformLocation(ourShader.ID, "specularStrength"),
-                specularStrength);
-    glUniform1f(glGetUniformLocation(ourShader.ID, "shininess"), shininess);
+    auto setSceneUniforms = [&](const Shader& shader) {
+      glUniform3fv(glGetUniformLocation(shader.ID, "viewPos"), 1,
+                   glm::value_ptr(camera.cameraPos));
+      glUniform3fv(glGetUniformLocation(shader.ID, "lightDir"), 1,
+                   glm::value_ptr(moonDirNorm));
+      glUniform3fv(glGetUniformLocation(shader.ID, "lightColor"), 1,
+                   glm::value_ptr(moonColor));
+      glUniform1f(glGetUniformLocation(shader.ID, "ambientStrength"),
+                  ambientStrength);
+      glUniform1f(glGetUniformLocation(shader.ID, "diffuseStrength"),
+                  diffuseStrength);
+      glUniform1f(glGetUniformLocation(shader.ID, "specularStrength"),
+                  specularStrength);
+      glUniform1f(glGetUniformLocation(shader.ID, "shininess"), shininess);
+
+      // the flashlight: cookie on unit 5, shadow map on unit 4
+      shader.setBool("spotOn", flashlight.on);
+      glUniform3fv(glGetUniformLocation(shader.ID, "spotPos"), 1,
+                   glm::value_ptr(flashlight.position));
+      glUniform3fv(glGetUniformLocation(shader.ID, "spotDir"), 1,
+                   glm::value_ptr(flashlight.direction));
+      glm::vec3 spotColor = flashlight.color * flashlight.intensity;
+      glUniform3fv(glGetUniformLocation(shader.ID, "spotColor"), 1,
+                   glm::value_ptr(spotColor));
+      glUniform2f(glGetUniformLocation(shader.ID, "spotCone"),
+                  std::cos(glm::radians(flashlight.innerAngle)),
+                  std::cos(glm::radians(flashlight.outerAngle)));
+      shader.setFloat("spotRange", flashlight.range);
+      shader.setMat4("spotCookieMatrix", flashlightCookieMatrix);
+      glActiveTexture(GL_TEXTURE5);
+      glBindTexture(GL_TEXTURE_2D, flashlightCookie);
+      glActiveTexture(GL_TEXTURE0);
+      shader.setInt("spotCookie", 5);
+      flashlightShadow->Bind(shader, 4);
+      // the moon's cascades on unit 6
+      shader.setBool("moonShadowOn", moonShadows);
+      moonShadow->Bind(shader, 6);
+      // local lights' texture buffers on units 7 to 9
+      clusteredLights->Bind(shader, 7, width, height);
+      // the fog's lookup on unit 10
+      heightFog->Bind(shader, 10);
+
+      int viewLoc = glGetUniformLocation(shader.ID, "view");
+      glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+      int projectionLoc = glGetUniformLocation(shader.ID, "projection");
+      glUniformMatrix4fv(projectionLoc, 1, GL_FALSE,
+                         glm::value_ptr(projection));
+    };
+    setSceneUniforms(ourShader);
 
     int modelLoc = glGetUniformLocation(ourShader.ID, "model");
     glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    int viewLoc = glGetUniformLocation(ourShader.ID, "view");
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    int projectionLoc = glGetUniformLocation(ourShader.ID, "projection");
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
     // render container
     glPolygonMode(GL_FRONT_AND_BACK, wireframe ? GL_LINE : GL_FILL);
-    glBindVertexArray(VAO);
-    glDrawArraysInstanced(GL_TRIANGLES, 0, 36, modelMatrices.size());
+    if (voxelFloor) {
+      voxelShader.use();
+      setSceneUniforms(voxelShader);
+      voxels->Draw(frustum, voxelShader);
+      ourShader.use();
+    } else if (useGpuCulling) {
+      gpuCuller->Draw(VAO);
+    } else {
+      glBindVertexArray(VAO);
+      glBindBuffer(GL_ARRAY_BUFFER, instanceStream->ID);
+      for (int i = 0; i < 4; i++) {
+        glVertexAttribPointer(
+            3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+            (void*)(instanceOffset + sizeof(glm::vec4) * i));
+      }
+      glDrawArraysInstanced(GL_TRIANGLES, 0, 36, visibleInstances);
+    }
+
+    GLintptr itemOffset = instanceStream->Upload(
+        itemMatrices.data(), itemMatrices.size() * sizeof(glm::mat4));
+    if (itemOffset >= 0) {
+      glBindVertexArray(VAO);
+      glBindBuffer(GL_ARRAY_BUFFER, instanceStream->ID);
+      for (int i = 0; i < 4; i++) {
+        glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                              (void*)(itemOffset + sizeof(glm::vec4) * i));
+      }
+      glDrawArraysInstanced(GL_TRIANGLES, 0, 36, (int)itemMatrices.size());
+    }
+
+    terrainShader.use();
+    setSceneUniforms(terrainShader);
+    terrainShader.setFloat("uvScale", 1.0f / cubeScale);
+    terrain->Draw(frustum, camera.cameraPos, terrainShader);
+    ourShader.use();
+    for (int i = 0; i < impostorLevel; i++) {
+      if (treeOffsets[i] < 0 || treeLists[i].empty()) continue;
+      const LodLevel& level = treeLod.levels[i];
+      treeMesh->SetInstanceBuffer(treeStream->ID, (long)treeOffsets[i]);
+      treeMesh->DrawInstanced(level.firstIndex, level.indexCount,
+                              level.baseVertex, (int)treeLists[i].size());
+    }
+    if (treeOffsets[impostorLevel] >= 0) {
+      treeImpostor->shader.use();
+      setSceneUniforms(treeImpostor->shader);
+      treeImpostor->Draw(treeStream->ID, (long)treeOffsets[impostorLevel],
+                         (int)treeLists[impostorLevel].size());
+    }
+
+    grass->shader.use();
+    setSceneUniforms(grass->shader);
+    grass->Draw(frustum, camera.cameraPos, currentFrame, occluded);
 
     // Skybox
     glDepthFunc(GL_LEQUAL);  // disable depth buffer (skybox is at depth 1.0)
@@ -320,15 +1539,62 @@ int main() {
     glUniformMatrix4fv(glGetUniformLocation(skyboxShader.ID, "projection"), 1,
                        GL_FALSE, glm::value_ptr(projection));
 
+    heightFog->Bind(skyboxShader, 10);
+
     glBindVertexArray(skyboxVAO);
     glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
     glDrawArrays(GL_TRIANGLES, 0, 36);
     glDepthFunc(GL_LESS);  // Reset
 
+    // lit fog in froxels, with the same lights and shadows as the scene
+    bool volumetricFog = fogQuality > 0 && heightFog->settings.on;
+    if (volumetricFog && fogQuality == 3) {
+      // or raymarched per pixel at a fraction of the resolution
+      volumetricLight->shader.use();
+      setSceneUniforms(volumetricLight->shader);
+      volumetricLight->Render(sceneTarget->depthTexture, sceneTarget->width,
+                              sceneTarget->height, view, projection, 0.1f,
+                              renderDistance);
+    } else if (volumetricFog) {
+      const int froxels[2][3] = {{96, 54, 48}, {160, 90, 64}};
+      fogVolume->settings.width = froxels[fogQuality - 1][0];
+      fogVolume->settings.height = froxels[fogQuality - 1][1];
+      fogVolume->settings.slices = froxels[fogQuality - 1][2];
+      fogVolume->shader.use();
+      setSceneUniforms(fogVolume->shader);
+      glm::vec3 eye = camera.cameraPos;
+      eye.y += camera.visualBobOffset;
+      fogVolume->Render(eye, camera.cameraFront, camera.cameraUp,
+                        glm::radians(60.0f), aspect);
+    }
+
+    // depth pyramid for next frame's occlusion culling
+    hiZ->Build(sceneTarget->depthTexture, sceneTarget->width,
+               sceneTarget->height, projection * view, camera.cameraPos);
+    if (showHiZ) hiZ->RenderDebug(hiZDebugLevel, 0.1f, renderDistance);
+    sceneTarget->BlitToScreen();
+    if (volumetricFog && fogQuality == 3) {
+      volumetricLight->Composite(sceneTarget->depthTexture, width, height);
+    } else if (volumetricFog) {
+      fogVolume->Composite(sceneTarget->depthTexture, 0.1f, renderDistance,
+                           width, height);
+    }
+
     // render imgui
     ImGui::Render();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
+    streamFailures = 0;
+    for (StreamBuffer* stream : {instanceStream, treeStream, shadowStream}) {
+      stream->EndFrame();
+      streamFailures += stream->FailedLastFrame();
+    }
+    if (deltaTime > 0.0f) {
+      float rate = instanceStream->BytesLastFrame() / (1024.0f * 1024.0f) /
+                   deltaTime;
+      streamRate = glm::mix(streamRate, rate, 0.05f);
+    }
+
     // glfw: swap buffers and poll IO events
     glfwSwapBuffers(window);
     glfwPollEvents();
@@ -338,6 +1604,38 @@ int main() {
   glDeleteVertexArrays(1, &VAO);
   glDeleteBuffers(1, &VBO);
   glDeleteBuffers(1, &EBO);
+  delete instanceStream;
+  delete treeStream;
+  delete shadowStream;
+  delete treeMesh;
+  delete treeImpostor;
+  delete grass;
+  delete broadphase;
+  delete systems;
+  delete ecs;
+  delete ai;
+  delete flowFields;
+  delete rays;
+  delete pathfinder;
+  delete navMesh;
+  delete streamer;
+  delete collision;
+  delete worldFile;
+  delete terrain;
+  delete world;
+  delete gpuCuller;
+  delete flashlightShadow;
+  delete moonShadow;
+  delete clusteredLights;
+  delete heightFog;
+  delete fogVolume;
+  delete volumetricLight;
+  glDeleteTextures(1, &flashlightCookie);
+  delete hiZ;
+  delete softOcclusion;
+  delete voxels;
+  delete jobs;
+  delete sceneTarget;
 
   // imgui: terminate
   ImGui_ImplOpenGL3_Shutdown();
@@ -378,6 +1676,15 @@ void processInput(GLFWwindow* window) {
   }
   // player/ camera controls from camera.cpp
   camera.ProcessKeyboard(window, deltaTime, freeCam);
+  static bool lWasDown = false;
+  if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS) {
+    if (!lWasDown) {
+      flashlight.on = !flashlight.on;
+    }
+    lWasDown = true;
+  } else {
+    lWasDown = false;
+  }
   static bool pWasDown = false;
 
   // toggle Wireframe mode
@@ -0,0 +1,147 @@
+#include "mesh.hpp"
+
+#include <glad/glad.h>
+
+#include <cmath>
+#include <cstddef>
+
+void Mesh::ComputeBounds() {
+  if (vertices.empty()) return;
+  boundsMin = boundsMax = vertices[0].position;
+  for (const Vertex& v : vertices) {
+    boundsMin = glm::min(boundsMin, v.position);
+    boundsMax = glm::max(boundsMax, v.position);
+  }
+}
+
+// ring of `segments` + 1 vertices (the seam is doubled for the uvs)
+static void AddRing(Mesh& mesh, int segments, float y, float radius,
+                    float slope, float v) {
+  for (int i = 0; i <= segments; i++) {
+    float u = (float)i / segments;
+    float angle = u * 2.0f * 3.14159265f;
+    float c = std::cos(angle), s = std::sin(angle);
+    Vertex vert;
+    vert.position = glm::vec3(c * radius, y, s * radius);
+    vert.normal = glm::normalize(glm::vec3(c, slope, s));
+    vert.texCoord = glm::vec2(u, v);
+    mesh.vertices.push_back(vert);
+  }
+}
+
+// connects the last two rings, counter clockwise seen from outside
+static void StitchRings(Mesh& mesh, int segments) {
+  unsigned int top = (unsigned int)mesh.vertices.size() - (segments + 1);
+  unsigned int bottom = top - (segments + 1);
+  for (int i = 0; i < segments; i++) {
+    unsigned int b0 = bottom + i, b1 = bottom + i + 1;
+    unsigned int t0 = top + i, t1 = top + i + 1;
+    mesh.indices.insert(mesh.indices.end(), {b0, t0, b1, b1, t0, t1});
+  }
+}
+
+Mesh BuildTreeMesh(int segments) {
+  Mesh mesh;
+
+  // trunk, slightly tapered
+  const int trunkRings = 4;
+  const float trunkHeight = 2.0f;
+  for (int r = 0; r <= trunkRings; r++) {
+    float t = (float)r / trunkRings;
+    AddRing(mesh, segments, t * trunkHeight, glm::mix(0.25f, 0.18f, t), 0.0f,
+            t * 2.0f);
+    if (r > 0) StitchRings(mesh, segments);
+  }
+
+  // canopy: three cones, each ring stitched to the previous one
+  const int coneRings = 6;
+  const float coneBase[3] = {1.6f, 3.0f, 4.3f};
+  const float coneHeight[3] = {2.4f, 2.2f, 2.0f};
+  const float coneRadius[3] = {1.6f, 1.25f, 0.9f};
+  for (int c = 0; c < 3; c++) {
+    float slope = coneRadius[c] / coneHeight[c];
+    unsigned int skirtStart = (unsigned int)mesh.vertices.size();
+    for (int r = 0; r <= coneRings; r++) {
+      float t = (float)r / coneRings;
+      // keep a tiny radius at the tip so the top ring still has normals
+      float radius = glm::mix(coneRadius[c], 0.02f, t);
+      AddRing(mesh, segments, coneBase[c] + t * coneHeight[c], radius, slope,
+              t);
+      if (r > 0) StitchRings(mesh, segments);
+    }
+
+    // flat underside so the cone is closed from below
+    Vertex center;
+    center.position = glm::vec3(0.0f, coneBase[c], 0.0f);
+    center.normal = glm::vec3(0.0f, -1.0f, 0.0f);
+    center.texCoord = glm::vec2(0.5f, 0.0f);
+    unsigned int centerIndex = (unsigned int)mesh.vertices.size();
+    mesh.vertices.push_back(center);
+    for (int i = 0; i < segments; i++) {
+      mesh.indices.insert(mesh.indices.end(),
+                          {centerIndex, skirtStart + i, skirtStart + i + 1});
+    }
+  }
+
+  mesh.ComputeBounds();
+  return mesh;
+}
+
+GpuMesh::GpuMesh(const Mesh& mesh) {
+  indexCount = (int)mesh.indices.size();
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &EBO);
+  glBindVertexArray(VAO);
+
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(Vertex),
+               mesh.vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(),
+               GL_STATIC_DRAW);
+
+  // same attribute locations as the cube VAO in main.cpp
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                        (void*)offsetof(Vertex, position));
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                        (void*)offsetof(Vertex, normal));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                        (void*)offsetof(Vertex, texCoord));
+  glEnableVertexAttribArray(1);
+
+  for (int i = 0; i < 5; i++) {
+    glEnableVertexAttribArray(3 + i);
+    glVertexAttribDivisor(3 + i, 1);
+  }
+  glBindVertexArray(0);
+}
+
+GpuMesh::~GpuMesh() {
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &EBO);
+}
+
+void GpuMesh::SetInstanceBuffer(unsigned int buffer, long offset) {
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  for (int i = 0; i < 4; i++) {
+    glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                          (void*)(offset + sizeof(glm::vec4) * i));
+  }
+  glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                        (void*)(offset + offsetof(InstanceData, params)));
+}
+
+void GpuMesh::DrawInstanced(int firstIndex, int count, int baseVertex,
+                            int instanceCount) {
+  if (instanceCount <= 0 || count <= 0) return;
+  glBindVertexArray(VAO);
+  glDrawElementsInstancedBaseVertex(
+      GL_TRIANGLES, count, GL_UNSIGNED_INT,
+      (void*)(firstIndex * sizeof(unsigned int)), instanceCount, baseVertex);
+}
@@ -0,0 +1,278 @@
+#include "mesh_simplify.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+// symmetric 4x4 matrix, upper triangle only
+struct Quadric {
+  double xx = 0, xy = 0, xz = 0, xw = 0;
+  double yy = 0, yz = 0, yw = 0;
+  double zz = 0, zw = 0;
+  double ww = 0;
+
+  static Quadric FromPlane(double a, double b, double c, double d,
+                           double weight) {
+    Quadric q;
+    q.xx = weight * a * a;
+    q.xy = weight * a * b;
+    q.xz = weight * a * c;
+    q.xw = weight * a * d;
+    q.yy = weight * b * b;
+    q.yz = weight * b * c;
+    q.yw = weight * b * d;
+    q.zz = weight * c * c;
+    q.zw = weight * c * d;
+    q.ww = weight * d * d;
+    return q;
+  }
+
+  Quadric& operator+=(const Quadric& o) {
+    xx += o.xx, xy += o.xy, xz += o.xz, xw += o.xw;
+    yy += o.yy, yz += o.yz, yw += o.yw;
+    zz += o.zz, zw += o.zw;
+    ww += o.ww;
+    return *this;
+  }
+
+  // sum of squared distances of p to all accumulated planes
+  double Evaluate(const glm::vec3& p) const {
+    double x = p.x, y = p.y, z = p.z;
+    double e = xx * x * x + 2 * xy * x * y + 2 * xz * x * z + 2 * xw * x +
+               yy * y * y + 2 * yz * y * z + 2 * yw * y + zz * z * z +
+               2 * zw * z + ww;
+    return e > 0.0 ? e : 0.0;
+  }
+};
+
+struct Collapse {
+  double cost;
+  unsigned int from, to;
+  unsigned int fromVersion, toVersion;
+  glm::vec3 target;
+
+  bool operator>(const Collapse& o) const { return cost > o.cost; }
+};
+
+uint64_t EdgeKey(unsigned int a, unsigned int b) {
+  if (a > b) std::swap(a, b);
+  return ((uint64_t)a << 32) | b;
+}
+
+struct PositionHash {
+  size_t operator()(const glm::vec3& p) const {
+    uint32_t bits[3];
+    std::memcpy(bits, &p, sizeof(bits));
+    return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^
+           (bits[2] * 83492791u);
+  }
+};
+
+struct PositionEqual {
+  bool operator()(const glm::vec3& a, const glm::vec3& b) const {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+  }
+};
+
+}  // namespace
+
+Mesh SimplifyMesh(const Mesh& mesh, int targetTriangles, float* error) {
+  // weld by position, triangles work on position ids from here on
+  std::unordered_map<glm::vec3, unsigned int, PositionHash, PositionEqual>
+      welded;
+  std::vector<glm::vec3> positions;
+  std::vector<unsigned int> positionOf(mesh.vertices.size());
+  for (size_t i = 0; i < mesh.vertices.size(); i++) {
+    auto it = welded.find(mesh.vertices[i].position);
+    if (it == welded.end()) {
+      it = welded.emplace(mesh.vertices[i].position, (unsigned int)positions.size())
+               .first;
+      positions.push_back(mesh.vertices[i].position);
+    }
+    positionOf[i] = it->second;
+  }
+
+  const int triCount = mesh.TriangleCount();
+  std::vector<unsigned int> tris(triCount * 3);
+  std::vector<bool> triRemoved(triCount, false);
+  std::vector<std::vector<unsigned int>> trisOf(positions.size());
+  for (int t = 0; t < triCount; t++) {
+    for (int k = 0; k < 3; k++) {
+      tris[t * 3 + k] = positionOf[mesh.indices[t * 3 + k]];
+      trisOf[tris[t * 3 + k]].push_back(t);
+    }
+  }
+
+  // face quadrics, plus a perpendicular plane along every open edge
+  std::vector<Quadric> quadrics(positions.size());
+  std::unordered_map<uint64_t, int> edgeUse;
+  for (int t = 0; t < triCount; t++) {
+    glm::vec3 p0 = positions[tris[t * 3]];
+    glm::vec3 p1 = positions[tris[t * 3 + 1]];
+    glm::vec3 p2 = positions[tris[t * 3 + 2]];
+    glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+    float len = glm::length(n);
+    if (len > 0.0f) {
+      n /= len;
+      Quadric q = Quadric::FromPlane(n.x, n.y, n.z, -glm::dot(n, p0), 1.0);
+      for (int k = 0; k < 3; k++) quadrics[tris[t * 3 + k]] += q;
+    }
+    for (int k = 0; k < 3; k++) {
+      edgeUse[EdgeKey(tris[t * 3 + k], tris[t * 3 + (k + 1) % 3])]++;
+    }
+  }
+  const double borderWeight = 10.0;
+  for (int t = 0; t < triCount; t++) {
+    glm::vec3 p0 = positions[tris[t * 3]];
+    glm::vec3 p1 = positions[tris[t * 3 + 1]];
+    glm::vec3 p2 = positions[tris[t * 3 + 2]];
+    glm::vec3 faceNormal = glm::cross(p1 - p0, p2 - p0);
+    if (glm::length(faceNormal) == 0.0f) continue;
+    for (int k = 0; k < 3; k++) {
+      unsigned int a = tris[t * 3 + k], b = tris[t * 3 + (k + 1) % 3];
+      if (edgeUse[EdgeKey(a, b)] != 1) continue;
+      glm::vec3 edge = positions[b] - positions[a];
+      glm::vec3 n = glm::cross(edge, faceNormal);
+      float len = glm::length(n);
+      if (len == 0.0f) continue;
+      n /= len;
+      Quadric q = Quadric::FromPlane(n.x, n.y, n.z,
+                                     -glm::dot(n, positions[a]), borderWeight);
+      quadrics[a] += q;
+      quadrics[b] += q;
+    }
+  }
+
+  std::vector<unsigned int> version(positions.size(), 0);
+  std::vector<bool> positionRemoved(positions.size(), false);
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>>
+      heap;
+
+  auto pushEdge = [&](unsigned int a, unsigned int b) {
+    Quadric q = quadrics[a];
+    q += quadrics[b];
+    // endpoints or midpoint, cheaper and more robust than solving for the
+    // optimum and good enough for distant LODs
+    glm::vec3 candidates[3] = {positions[a], positions[b],
+                               (positions[a] + positions[b]) * 0.5f};
+    Collapse best;
+    best.cost = std::numeric_limits<double>::max();
+    for (const glm::vec3& c : candidates) {
+      double cost = q.Evaluate(c);
+      if (cost < best.cost) {
+        best.cost = cost;
+        best.target = c;
+      }
+    }
+    best.from = a;
+    best.to = b;
+    best.fromVersion = version[a];
+    best.toVersion = version[b];
+    heap.push(best);
+  };
+
+  for (const auto& edge : edgeUse) {
+    pushEdge((unsigned int)(edge.first >> 32),
+             (unsigned int)(edge.first & 0xffffffffu));
+  }
+
+  // would moving the live triangles around v to `target` flip any of them?
+  auto flips = [&](unsigned int v, unsigned int other,
+                   const glm::vec3& target) {
+    for (unsigned int t : trisOf[v]) {
+      if (triRemoved[t]) continue;
+      const unsigned int* tri = &tris[t * 3];
+      if (tri[0] == other || tri[1] == other || tri[2] == other) continue;
+      glm::vec3 p[3], moved[3];
+      for (int k = 0; k < 3; k++) {
+        p[k] = positions[tri[k]];
+        moved[k] = tri[k] == v ? target : p[k];
+      }
+      glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+      glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+      if (glm::dot(before, before) == 0.0f) continue;  // already degenerate
+      if (glm::dot(before, after) <= 0.0f) return true;
+    }
+    return false;
+  };
+
+  int liveTris = triCount;
+  double maxCost = 0.0;
+  while (liveTris > targetTriangles && !heap.empty()) {
+    Collapse c = heap.top();
+    heap.pop();
+    if (positionRemoved[c.from] || positionRemoved[c.to]) continue;
+    if (version[c.from] != c.fromVersion || version[c.to] != c.toVersion) {
+      continue;
+    }
+    if (flips(c.from, c.to, c.target) || flips(c.to, c.from, c.target)) {
+      continue;
+    }
+
+    // fold `from` into `to`
+    for (unsigned int t : trisOf[c.from]) {
+      if (triRemoved[t]) continue;
+      unsigned int* tri = &tris[t * 3];
+      if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+        triRemoved[t] = true;
+        liveTris--;
+        continue;
+      }
+      for (int k = 0; k < 3; k++) {
+        if (tri[k] == c.from) tri[k] = c.to;
+      }
+      trisOf[c.to].push_back(t);
+    }
+    trisOf[c.from].clear();
+    positionRemoved[c.from] = true;
+    positions[c.to] = c.target;
+    quadrics[c.to] += quadrics[c.from];
+    version[c.to]++;
+    maxCost = std::max(maxCost, c.cost);
+
+    // drop dead triangles from the survivor's list and requeue its edges
+    std::vector<unsigned int>& around = trisOf[c.to];
+    std::unordered_set<unsigned int> neighbours;
+    size_t keep = 0;
+    for (unsigned int t : around) {
+      if (triRemoved[t]) continue;
+      around[keep++] = t;
+      for (int k = 0; k < 3; k++) {
+        if (tris[t * 3 + k] != c.to) neighbours.insert(tris[t * 3 + k]);
+      }
+    }
+    around.resize(keep);
+    for (unsigned int n : neighbours) pushEdge(c.to, n);
+  }
+
+  // rebuild, one output vertex per (original corner vertex, position)
+  Mesh result;
+  std::unordered_map<uint64_t, unsigned int> emitted;
+  for (int t = 0; t < triCount; t++) {
+    if (triRemoved[t]) continue;
+    for (int k = 0; k < 3; k++) {
+      unsigned int original = mesh.indices[t * 3 + k];
+      unsigned int position = tris[t * 3 + k];
+      uint64_t key = ((uint64_t)original << 32) | position;
+      auto it = emitted.find(key);
+      if (it == emitted.end()) {
+        Vertex v = mesh.vertices[original];
+        v.position = positions[position];
+        it = emitted.emplace(key, (unsigned int)result.vertices.size()).first;
+        result.vertices.push_back(v);
+      }
+      result.indices.push_back(it->second);
+    }
+  }
+  result.ComputeBounds();
+
+  if (error) *error = (float)std::sqrt(maxCost);
+  return result;
+}
@@ -0,0 +1,550 @@
+#include "navmesh.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+
+namespace {
+
+const uint32_t NAV_FILE_VERSION = 2;
+
+// one file per tile: header, vertices, polys
+struct NavTileFileHeader {
+  char magic[4];  // "HNAV"
+  uint32_t version;
+  uint64_t hash;  // of the settings and the input, see InputHash
+  int32_t x;
+  int32_t z;
+  uint32_t vertexCount;
+  uint32_t polyCount;
+};
+
+// neighbour tile offsets by side, as in NAV_EXTERNAL
+const int SIDE_X[4] = {-1, 0, 1, 0};
+const int SIDE_Z[4] = {0, 1, 0, -1};
+
+uint64_t Fnv1a(uint64_t hash, const void* data, size_t size) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+template <typename T>
+uint64_t Fnv1a(uint64_t hash, const T& value) {
+  return Fnv1a(hash, &value, sizeof(value));
+}
+
+// padding around a tile the build looks at, see BuildNavTile
+float Padding(const NavMeshSettings& settings) {
+  return (std::ceil(settings.agentRadius / settings.cellSize) + 3.0f) *
+         settings.cellSize;
+}
+
+// Everything a build depends on: the settings, the shapes and the ground on
+// a coarse grid. Field by field, struct padding isn't hashed. The shapes come
+// in collision id order, which depends on what streamed in first, so each
+// is hashed on its own and the sorted hashes go in.
+uint64_t InputHash(const NavMeshSettings& settings,
+                   const NavTileInput& input) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash = Fnv1a(hash, NAV_FILE_VERSION);
+  hash = Fnv1a(hash, settings.tileSize);
+  hash = Fnv1a(hash, settings.cellSize);
+  hash = Fnv1a(hash, settings.cellHeight);
+  hash = Fnv1a(hash, settings.agentHeight);
+  hash = Fnv1a(hash, settings.agentRadius);
+  hash = Fnv1a(hash, settings.agentClimb);
+  hash = Fnv1a(hash, settings.maxSlope);
+  hash = Fnv1a(hash, settings.minRegionArea);
+  hash = Fnv1a(hash, settings.maxEdgeError);
+  hash = Fnv1a(hash, input.coord.x);
+  hash = Fnv1a(hash, input.coord.z);
+  std::vector<uint64_t> shapes;
+  shapes.reserve(input.shapes.size());
+  for (const CollisionShape& shape : input.shapes) {
+    uint64_t one = Fnv1a(0xcbf29ce484222325ULL, shape.type);
+    one = Fnv1a(one, &shape.a[0], 3 * sizeof(float));
+    one = Fnv1a(one, &shape.b[0], 3 * sizeof(float));
+    for (int i = 0; i < 3; i++) {
+      one = Fnv1a(one, &shape.rotation[i][0], 3 * sizeof(float));
+    }
+    shapes.push_back(Fnv1a(one, shape.radius));
+  }
+  std::sort(shapes.begin(), shapes.end());
+  hash = Fnv1a(hash, shapes.size());
+  for (uint64_t one : shapes) hash = Fnv1a(hash, one);
+  if (input.groundHeight) {
+    const int samples = 32;
+    float pad = Padding(settings);
+    float step = (settings.tileSize + 2.0f * pad) / samples;
+    for (int z = 0; z <= samples; z++) {
+      for (int x = 0; x <= samples; x++) {
+        float height = input.groundHeight(input.origin.x - pad + x * step,
+                                          input.origin.y - pad + z * step);
+        hash = Fnv1a(hash, height);
+      }
+    }
+  }
+  return hash;
+}
+
+}  // namespace
+
+glm::vec3 NavTile::PolyCenter(int poly) const {
+  const NavPoly& p = polys[poly];
+  glm::vec3 sum(0.0f);
+  for (int i = 0; i < p.vertCount; i++) sum += vertices[p.verts[i]];
+  return sum / (float)p.vertCount;
+}
+
+NavMesh::NavMesh(const NavMeshSettings& settings, JobSystem& jobs,
+                 const std::string& cacheDir)
+    : settings(settings), jobs(jobs), cacheDir(cacheDir) {
+  if (!cacheDir.empty()) {
+    std::error_code error;
+    std::filesystem::create_directories(cacheDir, error);
+    if (error) {
+      std::cout << "ERROR::NAVMESH::CACHE_DIRECTORY_NOT_CREATED: " << cacheDir
+                << std::endl;
+      this->cacheDir.clear();
+    }
+  }
+}
+
+NavMesh::~NavMesh() { jobs.Wait(counter); }
+
+void NavMesh::RequestTile(ChunkCoord coord) {
+  if (queued.insert(coord).second) queue.push_back(coord);
+}
+
+void NavMesh::Invalidate(const glm::vec3& min, const glm::vec3& max) {
+  float pad = Padding(settings);
+  auto overlaps = [&](ChunkCoord coord) {
+    float x0 = coord.x * settings.tileSize - pad;
+    float z0 = coord.z * settings.tileSize - pad;
+    float x1 = (coord.x + 1) * settings.tileSize + pad;
+    float z1 = (coord.z + 1) * settings.tileSize + pad;
+    return min.x <= x1 && max.x >= x0 && min.z <= z1 && max.z >= z0;
+  };
+  for (const auto& entry : tiles) {
+    if (overlaps(entry.first)) RequestTile(entry.first);
+  }
+  for (ChunkCoord coord : inFlight) {
+    if (overlaps(coord)) RequestTile(coord);
+  }
+}
+
+void NavMesh::RemoveTile(ChunkCoord coord) {
+  generation[coord]++;  // a build still running is stale now
+  if (queued.erase(coord)) {
+    queue.erase(std::find(queue.begin(), queue.end(), coord));
+  }
+  auto it = tiles.find(coord);
+  if (it == tiles.end()) return;
+  polyCount -= (int)it->second->polys.size();
+  tiles.erase(it);
+  for (int side = 0; side < 4; side++) {
+    auto neighbor =
+        tiles.find({coord.x + SIDE_X[side], coord.z + SIDE_Z[side]});
+    if (neighbor != tiles.end()) Link(*neighbor->second);
+  }
+  if (onTileChanged) onTileChanged(coord);
+}
+
+void NavMesh::Update() {
+  std::deque<Result> finished;
+  {
+    std::lock_guard<std::mutex> lock(doneMutex);
+    finished.swap(done);
+  }
+  for (Result& result : finished) {
+    ChunkCoord coord = result.tile->coord;
+    inFlight.erase(coord);
+    if (result.generation != generation[coord]) continue;
+    if (result.fromCache) {
+      cacheHits++;
+    } else {
+      built++;
+    }
+
+    std::unique_ptr<NavTile>& slot = tiles[coord];
+    if (slot) polyCount -= (int)slot->polys.size();
+    slot = std::move(result.tile);
+    polyCount += (int)slot->polys.size();
+    Link(*slot);
+    for (int side = 0; side < 4; side++) {
+      auto neighbor =
+          tiles.find({coord.x + SIDE_X[side], coord.z + SIDE_Z[side]});
+      if (neighbor != tiles.end()) Link(*neighbor->second);
+    }
+    if (onTileChanged) onTileChanged(coord);
+  }
+
+  // a tile that's still building waits for the build to finish first, the
+  // new one starts from fresh input after that
+  std::vector<ChunkCoord> later;
+  while ((int)inFlight.size() < maxInFlight && !queue.empty()) {
+    ChunkCoord coord = queue.front();
+    queue.pop_front();
+    if (inFlight.count(coord)) {
+      later.push_back(coord);
+      continue;
+    }
+    queued.erase(coord);
+    Start(coord);
+  }
+  queue.insert(queue.end(), later.begin(), later.end());
+}
+
+void NavMesh::Start(ChunkCoord coord) {
+  uint32_t current = ++generation[coord];
+  inFlight.insert(coord);
+
+  auto input = std::make_shared<NavTileInput>();
+  input->coord = coord;
+  input->origin = glm::vec2(coord.x, coord.z) * settings.tileSize;
+  if (collision) {
+    input->groundHeight = collision->groundHeight;
+    float pad = Padding(settings);
+    glm::vec3 min(input->origin.x - pad, -1.0e9f, input->origin.y - pad);
+    glm::vec3 max(input->origin.x + settings.tileSize + pad, 1.0e9f,
+                  input->origin.y + settings.tileSize + pad);
+    std::vector<uint32_t> ids;
+    collision->Query(min, max, ids);
+    for (uint32_t id : ids) input->shapes.push_back(collision->Shape(id));
+  }
+
+  jobs.SubmitBackground(
+      [this, input, current] {
+        auto start = std::chrono::high_resolution_clock::now();
+        uint64_t hash = InputHash(settings, *input);
+        std::string path = CachePath(input->coord);
+        std::unique_ptr<NavTile> tile(new NavTile());
+        bool fromCache = !path.empty() && ReadCache(path, hash, *tile);
+        if (!fromCache) {
+          BuildNavTile(settings, *input, *tile);
+          if (!path.empty()) WriteCache(path, hash, *tile);
+          buildMs = std::chrono::duration<double, std::milli>(
+                        std::chrono::high_resolution_clock::now() - start)
+                        .count();
+        }
+        std::lock_guard<std::mutex> lock(doneMutex);
+        done.push_back({std::move(tile), current, fromCache});
+      },
+      &counter);
+}
+
+// Links every border edge of the tile to the polys across it in the
+// neighbour tiles: edges on opposite sides that overlap along the border
+// and are within a step of each other at both ends of the overlap.
+void NavMesh::Link(NavTile& tile) {
+  tile.links.clear();
+  tile.linkStart.assign(tile.polys.size() + 1, 0);
+  float climb = settings.agentClimb + 2.0f * settings.cellHeight;
+  for (size_t p = 0; p < tile.polys.size(); p++) {
+    tile.linkStart[p] = (uint32_t)tile.links.size();
+    const NavPoly& poly = tile.polys[p];
+    for (int e = 0; e < poly.vertCount; e++) {
+      uint16_t neighbor = poly.neighbors[e];
+      if (neighbor == NAV_NO_NEIGHBOR || !(neighbor & NAV_EXTERNAL)) continue;
+      int side = neighbor & 3;
+      auto other = tiles.find(
+          {tile.coord.x + SIDE_X[side], tile.coord.z + SIDE_Z[side]});
+      if (other == tiles.end()) continue;
+      const NavTile& across = *other->second;
+      uint16_t facing = NAV_EXTERNAL | ((side + 2) & 3);
+
+      // position along the border: z on the x sides, x on the z sides
+      int axis = side == 0 || side == 2 ? 2 : 0;
+      const glm::vec3& a = tile.vertices[poly.verts[e]];
+      const glm::vec3& b = tile.vertices[poly.verts[(e + 1) % poly.vertCount]];
+      float length = b[axis] - a[axis];
+      if (std::fabs(length) < 1.0e-4f) continue;
+      for (size_t q = 0; q < across.polys.size(); q++) {
+        const NavPoly& target = across.polys[q];
+        for (int f = 0; f < target.vertCount; f++) {
+          if (target.neighbors[f] != facing) continue;
+          const glm::vec3& c = across.vertices[target.verts[f]];
+          const glm::vec3& d =
+              across.vertices[target.verts[(f + 1) % target.vertCount]];
+          float lo = std::max(std::min(a[axis], b[axis]),
+                              std::min(c[axis], d[axis]));
+          float hi = std::min(std::max(a[axis], b[axis]),
+                              std::max(c[axis], d[axis]));
+          if (hi - lo < 1.0e-3f) continue;
+
+          // heights of both edges at the ends of the overlap
+          float otherLength = d[axis] - c[axis];
+          bool close = true;
+          for (float at : {lo, hi}) {
+            float y0 = a.y + (b.y - a.y) * (at - a[axis]) / length;
+            float y1 = c.y + (d.y - c.y) * (at - c[axis]) / otherLength;
+            close = close && std::fabs(y0 - y1) <= climb;
+          }
+          if (!close) continue;
+
+          float t0 = (lo - a[axis]) / length, t1 = (hi - a[axis]) / length;
+          NavLink link;
+          link.poly = (uint16_t)p;
+          link.edge = (uint8_t)e;
+          link.side = (uint8_t)side;
+          link.target = (uint16_t)q;
+          link.tmin = std::min(t0, t1);
+          link.tmax = std::max(t0, t1);
+          tile.links.push_back(link);
+        }
+      }
+    }
+  }
+  tile.linkStart[tile.polys.size()] = (uint32_t)tile.links.size();
+}
+
+const NavTile* NavMesh::GetTile(ChunkCoord coord) const {
+  auto it = tiles.find(coord);
+  return it == tiles.end() ? nullptr : it->second.get();
+}
+
+ChunkCoord NavMesh::TileAt(float x, float z) const {
+  return {(int)std::floor(x / settings.tileSize),
+          (int)std::floor(z / settings.tileSize)};
+}
+
+bool NavMesh::FindPoly(const glm::vec3& position, NavPolyRef& ref,
+                       float maxDistance) const {
+  ChunkCoord coord = TileAt(position.x, position.z);
+  const NavTile* tile = GetTile(coord);
+  if (!tile) return false;
+  int best = -1;
+  float bestScore = maxDistance;
+  bool bestInside = false;
+  for (size_t p = 0; p < tile->polys.size(); p++) {
+    const NavPoly& poly = tile->polys[p];
+    // inside when left of every edge, the polys being counter-clockwise
+    bool inside = true;
+    for (int i = 0; i < poly.vertCount && inside; i++) {
+      const glm::vec3& a = tile->vertices[poly.verts[i]];
+      const glm::vec3& b = tile->vertices[poly.verts[(i + 1) % poly.vertCount]];
+      inside = (b.z - a.z) * (position.x - a.x) -
+                   (b.x - a.x) * (position.z - a.z) >=
+               0.0f;
+    }
+    glm::vec3 center = tile->PolyCenter((int)p);
+    if (inside) {
+      float score = std::fabs(center.y - position.y);
+      if (!bestInside || score < bestScore) {
+        best = (int)p;
+        bestScore = score;
+        bestInside = true;
+      }
+    } else if (!bestInside) {
+      float score = glm::length(center - position);
+      if (score < bestScore) {
+        best = (int)p;
+        bestScore = score;
+      }
+    }
+  }
+  if (best < 0) return false;
+  ref.tile = coord;
+  ref.poly = best;
+  return true;
+}
+
+std::string NavMesh::CachePath(ChunkCoord coord) const {
+  if (cacheDir.empty()) return std::string();
+  return cacheDir + "/" + std::to_string(coord.x) + "_" +
+         std::to_string(coord.z) + ".nav";
+}
+
+bool NavMesh::ReadCache(const std::string& path, uint64_t hash,
+                        NavTile& tile) const {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return false;
+  NavTileFileHeader header;
+  if (!file.read((char*)&header, sizeof(header))) return false;
+  // an old or foreign file is rebuilt and overwritten, no need to complain
+  if (std::memcmp(header.magic, "HNAV", 4) != 0 ||
+      header.version != NAV_FILE_VERSION || header.hash != hash) {
+    return false;
+  }
+  if (header.vertexCount >= NAV_NO_NEIGHBOR ||
+      header.polyCount >= NAV_EXTERNAL) {
+    std::cout << "ERROR::NAVMESH::CACHE_DAMAGED: " << path << std::endl;
+    return false;
+  }
+  tile.coord = {header.x, header.z};
+  tile.vertices.resize(header.vertexCount);
+  tile.polys.resize(header.polyCount);
+  file.read((char*)tile.vertices.data(),
+            tile.vertices.size() * sizeof(glm::vec3));
+  file.read((char*)tile.polys.data(), tile.polys.size() * sizeof(NavPoly));
+  bool valid = (bool)file;
+  for (const NavPoly& poly : tile.polys) {
+    valid = valid && poly.vertCount >= 3 &&
+            poly.vertCount <= NAV_MAX_POLY_VERTS;
+    for (int i = 0; valid && i < poly.vertCount; i++) {
+      valid = poly.verts[i] < header.vertexCount;
+    }
+  }
+  if (!valid) {
+    std::cout << "ERROR::NAVMESH::CACHE_DAMAGED: " << path << std::endl;
+    return false;
+  }
+  tile.links.clear();
+  tile.linkStart.assign(tile.polys.size() + 1, 0);
+  return true;
+}
+
+void NavMesh::WriteCache(const std::string& path, uint64_t hash,
+                         const NavTile& tile) const {
+  // written next to it and renamed over, a crash never leaves half a file
+  std::string temp = path + ".tmp";
+  {
+    std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+    if (!file) {
+      std::cout << "ERROR::NAVMESH::CACHE_NOT_WRITTEN: " << path << std::endl;
+      return;
+    }
+    NavTileFileHeader header = {};
+    std::memcpy(header.magic, "HNAV", 4);
+    header.version = NAV_FILE_VERSION;
+    header.hash = hash;
+    header.x = tile.coord.x;
+    header.z = tile.coord.z;
+    header.vertexCount = (uint32_t)tile.vertices.size();
+    header.polyCount = (uint32_t)tile.polys.size();
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)tile.vertices.data(),
+               tile.vertices.size() * sizeof(glm::vec3));
+    file.write((const char*)tile.polys.data(),
+               tile.polys.size() * sizeof(NavPoly));
+    if (!file) {
+      std::cout << "ERROR::NAVMESH::CACHE_NOT_WRITTEN: " << path << std::endl;
+      return;
+    }
+  }
+  std::rename(temp.c_str(), path.c_str());
+}
+
+int VerifyNavCache(JobSystem& jobs) {
+  std::string dir =
+      (std::filesystem::temp_directory_path() / "bench_navcache").string();
+  std::filesystem::remove_all(dir);
+  NavMeshSettings settings;
+  CollisionWorld original;
+  MakeBenchmarkForest(2.0f * settings.tileSize, original);
+  const ChunkCoord coord = {0, 0};
+
+  // builds (or loads) the one tile against `world` with a fresh NavMesh,
+  // as a new session would
+  auto session = [&](const CollisionWorld& world, int& built, int& loaded) {
+    NavMesh nav(settings, jobs, dir);
+    nav.collision = &world;
+    nav.RequestTile(coord);
+    auto start = std::chrono::steady_clock::now();
+    while (nav.Built() + nav.CacheHits() == 0 &&
+           std::chrono::steady_clock::now() - start <
+               std::chrono::seconds(30)) {
+      nav.Update();
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    built = nav.Built();
+    loaded = nav.CacheHits();
+    const NavTile* tile = nav.GetTile(coord);
+    return tile ? (int)tile->polys.size() : -1;
+  };
+
+  // the same shapes added in another order, after a few ids were freed, so
+  // every shape has another id than before
+  std::vector<CollisionShape> shapes;
+  for (size_t id = 0; id < original.SlotCount(); id++) {
+    const CollisionShape& shape = original.Shape((uint32_t)id);
+    if (shape.type != COLLISION_NONE) shapes.push_back(shape);
+  }
+  std::mt19937 rng(40);
+  std::shuffle(shapes.begin(), shapes.end(), rng);
+  auto rebuild = [&](CollisionWorld& world) {
+    world.groundHeight = original.groundHeight;
+    std::vector<uint32_t> spare;
+    for (int i = 0; i < 7; i++) {
+      spare.push_back(world.AddBox(glm::vec3(-1000.0f - i),
+                                   glm::vec3(-999.0f - i)));
+    }
+    for (uint32_t id : spare) world.Remove(id);
+    for (const CollisionShape& shape : shapes) {
+      if (shape.type == COLLISION_CAPSULE) {
+        world.AddCapsule(shape.a, shape.b, shape.radius);
+      } else {
+        world.AddOrientedBox(shape.a, shape.b, shape.rotation);
+      }
+    }
+  };
+  CollisionWorld shuffled;
+  rebuild(shuffled);
+  // and a tree in the tile moved, which has to rebuild
+  for (CollisionShape& shape : shapes) {
+    if (shape.type != COLLISION_CAPSULE || shape.a.x < 8.0f ||
+        shape.a.x > 56.0f || shape.a.z < 8.0f || shape.a.z > 56.0f) {
+      continue;
+    }
+    shape.a.x += 3.0f;
+    shape.b.x += 3.0f;
+    break;
+  }
+  CollisionWorld moved;
+  rebuild(moved);
+
+  int built[3], loaded[3];
+  int polys = session(original, built[0], loaded[0]);
+  int shuffledPolys = session(shuffled, built[1], loaded[1]);
+  session(moved, built[2], loaded[2]);
+  std::filesystem::remove_all(dir);
+  int wrong = 0;
+  wrong += built[0] != 1 || polys <= 0;
+  wrong += loaded[1] != 1 || built[1] != 0 || shuffledPolys != polys;
+  wrong += built[2] != 1 || loaded[2] != 0;
+  std::cout << "Nav cache: " << polys << " polys, shuffled shapes "
+            << (loaded[1] ? "loaded from the cache" : "rebuilt")
+            << ", a moved tree "
+            << (built[2] ? "rebuilt" : "loaded from the cache") << ", "
+            << wrong << " wrong" << std::endl;
+  return wrong;
+}
+
+void MakeBenchmarkForest(float size, CollisionWorld& world) {
+  world.groundHeight = [](float x, float z) {
+    return 4.0f * std::sin(x * 0.013f) * std::cos(z * 0.011f) +
+           1.5f * std::sin(x * 0.041f + z * 0.037f);
+  };
+  std::mt19937 rng(41);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  int trees = (int)(size * size / 40.0f);
+  for (int i = 0; i < trees; i++) {
+    float x = unit(rng) * size, z = unit(rng) * size;
+    float y = world.GroundHeight(x, z);
+    float scale = 0.8f + 0.6f * unit(rng);
+    world.AddCapsule(glm::vec3(x, y, z),
+                     glm::vec3(x, y + 2.0f * scale, z), 0.25f * scale);
+  }
+  int rocks = (int)(size * size / 1500.0f);
+  for (int i = 0; i < rocks; i++) {
+    float x = unit(rng) * size, z = unit(rng) * size;
+    float yaw = unit(rng) * 3.14159265f;
+    glm::mat3 rotation(1.0f);
+    rotation[0] = glm::vec3(std::cos(yaw), 0.0f, -std::sin(yaw));
+    rotation[2] = glm::vec3(std::sin(yaw), 0.0f, std::cos(yaw));
+    world.AddOrientedBox(glm::vec3(x, world.GroundHeight(x, z), z),
+                         glm::vec3(4.0f + 4.0f * unit(rng), 1.5f, 0.8f),
+                         rotation);
+  }
+}
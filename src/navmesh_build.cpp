@@ -0,0 +1,909 @@
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <unordered_map>
+
+#include "navmesh.hpp"
+
+namespace {
+
+// neighbour offsets by direction: -x, +z, +x, -z
+const int DIR_X[4] = {-1, 0, 1, 0};
+const int DIR_Z[4] = {0, 1, 0, -1};
+const int NOT_CONNECTED = -1;
+const int BORDER_REGION = 0x40000000;  // flag on regions of the padding
+const int NULL_NEIGHBOR = -1;          // sweep touches several regions
+const int FLOOR_NONE = -1000000;       // below any ground, in cells
+const int CEILING_NONE = 1000000;
+
+// solid voxels of one column, lo..hi in cells
+struct SolidSpan {
+  int lo;
+  int hi;
+  bool walkable;  // the top is flat enough to stand on
+};
+
+// free space above a walkable solid span
+struct OpenSpan {
+  int floor;
+  int ceiling;
+  int con[4];  // index of the span in the neighbour column, or NOT_CONNECTED
+  int region;
+  int dist;  // to the nearest edge, 2 per step (3 diagonally)
+  bool walkable;
+};
+
+// open spans column by column, columns[c]..columns[c + 1]
+struct Field {
+  int width;  // columns on x and z, padding included
+  int border;
+  std::vector<int> first;
+  std::vector<OpenSpan> spans;
+
+  int Column(int x, int z) const { return x + z * width; }
+  int Neighbor(int x, int z, int span, int dir) const {
+    return first[Column(x + DIR_X[dir], z + DIR_Z[dir])] +
+           spans[span].con[dir];
+  }
+};
+
+// contour vertex in cells; r is the region across the edge ending here (the
+// raw point's index once simplified)
+struct ContourVertex {
+  int x, y, z;
+  int r;
+};
+
+// twice the signed area of a, b, c on x/z: positive when they turn
+// counter-clockwise seen from above
+int Area2(const ContourVertex& a, const ContourVertex& b,
+          const ContourVertex& c) {
+  return (b.z - a.z) * (c.x - a.x) - (b.x - a.x) * (c.z - a.z);
+}
+
+// vertical line at x/z against an oriented box, y range where it's inside
+bool BoxColumn(const CollisionShape& box, float x, float z, float& lo,
+               float& hi) {
+  glm::vec3 origin =
+      glm::transpose(box.rotation) * (glm::vec3(x, 0.0f, z) - box.a);
+  glm::vec3 up(box.rotation[0].y, box.rotation[1].y, box.rotation[2].y);
+  float t0 = -FLT_MAX, t1 = FLT_MAX;
+  for (int i = 0; i < 3; i++) {
+    if (std::fabs(up[i]) < 1.0e-6f) {
+      if (std::fabs(origin[i]) > box.b[i]) return false;
+      continue;
+    }
+    float a = (-box.b[i] - origin[i]) / up[i];
+    float b = (box.b[i] - origin[i]) / up[i];
+    if (a > b) std::swap(a, b);
+    t0 = std::max(t0, a);
+    t1 = std::min(t1, b);
+  }
+  if (t0 > t1) return false;
+  lo = t0;
+  hi = t1;
+  return true;
+}
+
+// Solid spans per column: everything below the ground plus the y range each
+// shape covers over the column's square. Shapes are voxelized analytically,
+// there are no triangles to rasterize.
+void Rasterize(const NavMeshSettings& settings, const NavTileInput& input,
+               int width, int border,
+               std::vector<std::vector<SolidSpan>>& columns) {
+  float cs = settings.cellSize, ch = settings.cellHeight;
+  glm::vec2 base = input.origin - glm::vec2(border * cs);
+  float cosSlope = std::cos(glm::radians(settings.maxSlope));
+  columns.assign(width * width, {});
+
+  // ground heights at the cell corners, each column is solid up to the
+  // highest of its four
+  if (input.groundHeight) {
+    int stride = width + 1;
+    std::vector<float> corners(stride * stride);
+    for (int z = 0; z <= width; z++) {
+      for (int x = 0; x <= width; x++) {
+        corners[x + z * stride] =
+            input.groundHeight(base.x + x * cs, base.y + z * cs);
+      }
+    }
+    for (int z = 0; z < width; z++) {
+      for (int x = 0; x < width; x++) {
+        float h00 = corners[x + z * stride];
+        float h10 = corners[x + 1 + z * stride];
+        float h01 = corners[x + (z + 1) * stride];
+        float h11 = corners[x + 1 + (z + 1) * stride];
+        float top = std::max(std::max(h00, h10), std::max(h01, h11));
+        float dx = (h10 + h11 - h00 - h01) / (2.0f * cs);
+        float dz = (h01 + h11 - h00 - h10) / (2.0f * cs);
+        bool walkable = 1.0f / std::sqrt(1.0f + dx * dx + dz * dz) >= cosSlope;
+        columns[x + z * width].push_back(
+            {FLOOR_NONE, (int)std::ceil(top / ch), walkable});
+      }
+    }
+  }
+
+  for (const CollisionShape& shape : input.shapes) {
+    int x0 = std::max(0, (int)std::floor((shape.boundsMin.x - base.x) / cs));
+    int z0 = std::max(0, (int)std::floor((shape.boundsMin.z - base.y) / cs));
+    int x1 = std::min(width - 1,
+                      (int)std::floor((shape.boundsMax.x - base.x) / cs));
+    int z1 = std::min(width - 1,
+                      (int)std::floor((shape.boundsMax.z - base.y) / cs));
+
+    if (shape.type == COLLISION_BOX) {
+      // the top face is the one whose axis is closest to up
+      float upness = 0.0f;
+      for (int i = 0; i < 3; i++) {
+        upness = std::max(upness, std::fabs(shape.rotation[i].y));
+      }
+      bool walkable = upness >= cosSlope;
+      for (int z = z0; z <= z1; z++) {
+        for (int x = x0; x <= x1; x++) {
+          // the column center and its corners, whatever they hit counts
+          float cx = base.x + (x + 0.5f) * cs, cz = base.y + (z + 0.5f) * cs;
+          const float offsets[5][2] = {
+              {0.0f, 0.0f}, {-0.5f, -0.5f}, {0.5f, -0.5f}, {-0.5f, 0.5f},
+              {0.5f, 0.5f}};
+          float lo = FLT_MAX, hi = -FLT_MAX;
+          for (const auto& offset : offsets) {
+            float a, b;
+            if (BoxColumn(shape, cx + offset[0] * cs, cz + offset[1] * cs, a,
+                          b)) {
+              lo = std::min(lo, a);
+              hi = std::max(hi, b);
+            }
+          }
+          if (lo > hi) continue;
+          columns[x + z * width].push_back({(int)std::floor(lo / ch),
+                                            (int)std::ceil(hi / ch),
+                                            walkable});
+        }
+      }
+    } else if (shape.type == COLLISION_CAPSULE) {
+      glm::vec2 a(shape.a.x, shape.a.z), b(shape.b.x, shape.b.z);
+      glm::vec2 ab = b - a;
+      float length2 = glm::dot(ab, ab);
+      int lo = (int)std::floor(shape.boundsMin.y / ch);
+      int hi = (int)std::ceil(shape.boundsMax.y / ch);
+      for (int z = z0; z <= z1; z++) {
+        for (int x = x0; x <= x1; x++) {
+          glm::vec2 cellMin = base + glm::vec2(x * cs, z * cs);
+          glm::vec2 center = cellMin + glm::vec2(0.5f * cs);
+          // axis point nearest the column, then the column square's point
+          // nearest to that
+          float t = length2 > 0.0f
+                        ? glm::clamp(glm::dot(center - a, ab) / length2, 0.0f,
+                                     1.0f)
+                        : 0.0f;
+          glm::vec2 axis = a + ab * t;
+          glm::vec2 nearest =
+              glm::clamp(axis, cellMin, cellMin + glm::vec2(cs));
+          if (glm::length(nearest - axis) > shape.radius) continue;
+          // rounded tops are nothing to stand on
+          columns[x + z * width].push_back({lo, hi, false});
+        }
+      }
+    }
+  }
+
+  // merge overlapping spans, the top that ends up highest decides whether
+  // the merged one is walkable (both count when they end about level)
+  for (std::vector<SolidSpan>& spans : columns) {
+    if (spans.size() < 2) continue;
+    std::sort(spans.begin(), spans.end(),
+              [](const SolidSpan& a, const SolidSpan& b) {
+                return a.lo < b.lo;
+              });
+    size_t count = 1;
+    for (size_t i = 1; i < spans.size(); i++) {
+      SolidSpan& last = spans[count - 1];
+      const SolidSpan& span = spans[i];
+      if (span.lo > last.hi) {
+        spans[count++] = span;
+        continue;
+      }
+      if (std::abs(span.hi - last.hi) <= 1) {
+        last.walkable = last.walkable || span.walkable;
+      } else if (span.hi > last.hi) {
+        last.walkable = span.walkable;
+      }
+      last.hi = std::max(last.hi, span.hi);
+    }
+    spans.resize(count);
+  }
+}
+
+// open space above every walkable top with room for the agent, linked to
+// the spans next to it that are within a step
+void BuildField(const NavMeshSettings& settings,
+                const std::vector<std::vector<SolidSpan>>& columns, int width,
+                int border, Field& field) {
+  int climb = (int)std::floor(settings.agentClimb / settings.cellHeight);
+  int height = (int)std::ceil(settings.agentHeight / settings.cellHeight);
+  field.width = width;
+  field.border = border;
+  field.first.assign(width * width + 1, 0);
+  field.spans.clear();
+  for (int c = 0; c < width * width; c++) {
+    field.first[c] = (int)field.spans.size();
+    const std::vector<SolidSpan>& spans = columns[c];
+    for (size_t i = 0; i < spans.size(); i++) {
+      if (!spans[i].walkable) continue;
+      int floor = spans[i].hi;
+      int ceiling = i + 1 < spans.size() ? spans[i + 1].lo : CEILING_NONE;
+      if (ceiling - floor < height) continue;
+      OpenSpan span;
+      span.floor = floor;
+      span.ceiling = ceiling;
+      for (int& con : span.con) con = NOT_CONNECTED;
+      span.region = 0;
+      span.dist = 0;
+      span.walkable = true;
+      field.spans.push_back(span);
+    }
+  }
+  field.first[width * width] = (int)field.spans.size();
+
+  for (int z = 0; z < width; z++) {
+    for (int x = 0; x < width; x++) {
+      int c = field.Column(x, z);
+      for (int i = field.first[c]; i < field.first[c + 1]; i++) {
+        OpenSpan& span = field.spans[i];
+        for (int dir = 0; dir < 4; dir++) {
+          int nx = x + DIR_X[dir], nz = z + DIR_Z[dir];
+          if (nx < 0 || nz < 0 || nx >= width || nz >= width) continue;
+          int n = field.Column(nx, nz);
+          for (int j = field.first[n]; j < field.first[n + 1]; j++) {
+            const OpenSpan& other = field.spans[j];
+            int gap = std::min(span.ceiling, other.ceiling) -
+                      std::max(span.floor, other.floor);
+            if (gap >= height && std::abs(other.floor - span.floor) <= climb) {
+              span.con[dir] = j - field.first[n];
+              break;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// Distance to the nearest edge with a two pass chamfer transform, then
+// everything closer than the agent radius stops being walkable. Links into
+// spans that were dropped are cut so later passes only see walkable ones.
+void Erode(const NavMeshSettings& settings, Field& field) {
+  int width = field.width;
+  std::vector<OpenSpan>& spans = field.spans;
+  for (OpenSpan& span : spans) {
+    bool inside = true;
+    for (int con : span.con) inside = inside && con != NOT_CONNECTED;
+    span.dist = inside ? 255 : 0;
+  }
+
+  for (int z = 0; z < width; z++) {
+    for (int x = 0; x < width; x++) {
+      int c = field.Column(x, z);
+      for (int i = field.first[c]; i < field.first[c + 1]; i++) {
+        OpenSpan& span = spans[i];
+        if (span.con[0] != NOT_CONNECTED) {
+          int a = field.Neighbor(x, z, i, 0);
+          span.dist = std::min(span.dist, spans[a].dist + 2);
+          if (spans[a].con[3] != NOT_CONNECTED) {
+            int d = field.Neighbor(x - 1, z, a, 3);
+            span.dist = std::min(span.dist, spans[d].dist + 3);
+          }
+        }
+        if (span.con[3] != NOT_CONNECTED) {
+          int a = field.Neighbor(x, z, i, 3);
+          span.dist = std::min(span.dist, spans[a].dist + 2);
+          if (spans[a].con[2] != NOT_CONNECTED) {
+            int d = field.Neighbor(x, z - 1, a, 2);
+            span.dist = std::min(span.dist, spans[d].dist + 3);
+          }
+        }
+      }
+    }
+  }
+  for (int z = width - 1; z >= 0; z--) {
+    for (int x = width - 1; x >= 0; x--) {
+      int c = field.Column(x, z);
+      for (int i = field.first[c]; i < field.first[c + 1]; i++) {
+        OpenSpan& span = spans[i];
+        if (span.con[2] != NOT_CONNECTED) {
+          int a = field.Neighbor(x, z, i, 2);
+          span.dist = std::min(span.dist, spans[a].dist + 2);
+          if (spans[a].con[1] != NOT_CONNECTED) {
+            int d = field.Neighbor(x + 1, z, a, 1);
+            span.dist = std::min(span.dist, spans[d].dist + 3);
+          }
+        }
+        if (span.con[1] != NOT_CONNECTED) {
+          int a = field.Neighbor(x, z, i, 1);
+          span.dist = std::min(span.dist, spans[a].dist + 2);
+          if (spans[a].con[0] != NOT_CONNECTED) {
+            int d = field.Neighbor(x, z + 1, a, 0);
+            span.dist = std::min(span.dist, spans[d].dist + 3);
+          }
+        }
+      }
+    }
+  }
+
+  int threshold =
+      2 * (int)std::ceil(settings.agentRadius / settings.cellSize);
+  for (OpenSpan& span : spans) {
+    if (span.dist < threshold) span.walkable = false;
+  }
+  for (int z = 0; z < width; z++) {
+    for (int x = 0; x < width; x++) {
+      int c = field.Column(x, z);
+      for (int i = field.first[c]; i < field.first[c + 1]; i++) {
+        OpenSpan& span = spans[i];
+        for (int dir = 0; dir < 4; dir++) {
+          if (span.con[dir] == NOT_CONNECTED) continue;
+          if (!span.walkable || !spans[field.Neighbor(x, z, i, dir)].walkable) {
+            span.con[dir] = NOT_CONNECTED;
+          }
+        }
+      }
+    }
+  }
+}
+
+// Monotone partitioning: every row is split into sweeps of connected spans,
+// and a sweep continues the region of the row before only when that region
+// connects to nothing else in this row. Regions come out without holes, so
+// each has one outline. The padding gets one region per side so the
+// outlines are cut at the tile edge.
+void BuildRegions(const NavMeshSettings& settings, Field& field) {
+  int width = field.width, border = field.border;
+  auto paint = [&](int x0, int x1, int z0, int z1, int region) {
+    for (int z = z0; z < z1; z++) {
+      for (int x = x0; x < x1; x++) {
+        int c = field.Column(x, z);
+        for (int i = field.first[c]; i < field.first[c + 1]; i++) {
+          if (field.spans[i].walkable) field.spans[i].region = region;
+        }
+      }
+    }
+  };
+  paint(0, border, 0, width, BORDER_REGION | 1);
+  paint(width - border, width, 0, width, BORDER_REGION | 2);
+  paint(0, width, 0, border, BORDER_REGION | 3);
+  paint(0, width, width - border, width, BORDER_REGION | 4);
+
+  struct Sweep {
+    int neighbor;  // region of the row before, NULL_NEIGHBOR if several
+    int links;     // spans linked to it
+    int id;
+  };
+  std::vector<Sweep> sweeps;
+  std::vector<int> linked;  // per region: spans of this row linked to it
+  int next = 1;
+  for (int z = border; z < width - border; z++) {
+    linked.assign(next + 1, 0);
+    sweeps.assign(1, {0, 0, 0});
+    for (int x = border; x < width - border; x++) {
+      int c = field.Column(x, z);
+      for (int i = field.first[c]; i < field.first[c + 1]; i++) {
+        OpenSpan& span = field.spans[i];
+        if (!span.walkable) continue;
+
+        // same sweep as the span before on this row
+        int sweep = 0;
+        if (span.con[0] != NOT_CONNECTED) {
+          int region = field.spans[field.Neighbor(x, z, i, 0)].region;
+          if (!(region & BORDER_REGION)) sweep = region;
+        }
+        if (!sweep) {
+          sweep = (int)sweeps.size();
+          sweeps.push_back({0, 0, 0});
+        }
+
+        // region of the row before
+        if (span.con[3] != NOT_CONNECTED) {
+          int region = field.spans[field.Neighbor(x, z, i, 3)].region;
+          if (region && !(region & BORDER_REGION)) {
+            Sweep& s = sweeps[sweep];
+            if (!s.neighbor || s.neighbor == region) {
+              s.neighbor = region;
+              s.links++;
+              linked[region]++;
+            } else {
+              s.neighbor = NULL_NEIGHBOR;
+            }
+          }
+        }
+        span.region = sweep;
+      }
+    }
+
+    for (size_t s = 1; s < sweeps.size(); s++) {
+      Sweep& sweep = sweeps[s];
+      if (sweep.neighbor > 0 && linked[sweep.neighbor] == sweep.links) {
+        sweep.id = sweep.neighbor;
+      } else {
+        sweep.id = next++;
+      }
+    }
+    for (int x = border; x < width - border; x++) {
+      int c = field.Column(x, z);
+      for (int i = field.first[c]; i < field.first[c + 1]; i++) {
+        OpenSpan& span = field.spans[i];
+        if (span.walkable && span.region > 0 &&
+            !(span.region & BORDER_REGION)) {
+          span.region = sweeps[span.region].id;
+        }
+      }
+    }
+  }
+
+  // Drop islands smaller than minRegionArea: regions that touch are joined
+  // with union find, and a group survives if it's big enough or reaches the
+  // tile edge (it may go on in the next tile).
+  std::vector<int> parent(next), area(next, 0);
+  std::vector<uint8_t> edge(next, 0);
+  for (int r = 0; r < next; r++) parent[r] = r;
+  auto find = [&](int r) {
+    while (parent[r] != r) r = parent[r] = parent[parent[r]];
+    return r;
+  };
+  for (int z = border; z < width - border; z++) {
+    for (int x = border; x < width - border; x++) {
+      int c = field.Column(x, z);
+      for (int i = field.first[c]; i < field.first[c + 1]; i++) {
+        const OpenSpan& span = field.spans[i];
+        if (!span.walkable || !span.region) continue;
+        area[span.region]++;
+        for (int dir = 0; dir < 4; dir++) {
+          if (span.con[dir] == NOT_CONNECTED) continue;
+          int region = field.spans[field.Neighbor(x, z, i, dir)].region;
+          if (region & BORDER_REGION) {
+            edge[span.region] = 1;
+          } else if (region && region != span.region) {
+            parent[find(region)] = find(span.region);
+          }
+        }
+      }
+    }
+  }
+  std::vector<int> groupArea(next, 0);
+  std::vector<uint8_t> groupEdge(next, 0);
+  for (int r = 1; r < next; r++) {
+    groupArea[find(r)] += area[r];
+    groupEdge[find(r)] |= edge[r];
+  }
+  for (OpenSpan& span : field.spans) {
+    if (!span.region || (span.region & BORDER_REGION)) continue;
+    int group = find(span.region);
+    if (groupArea[group] < settings.minRegionArea && !groupEdge[group]) {
+      span.region = 0;
+      span.walkable = false;
+    }
+  }
+}
+
+// highest floor around the corner of a span's edge in direction dir
+int CornerHeight(const Field& field, int x, int z, int i, int dir) {
+  const OpenSpan& span = field.spans[i];
+  int height = span.floor;
+  int turn = (dir + 1) & 3;
+  if (span.con[dir] != NOT_CONNECTED) {
+    int a = field.Neighbor(x, z, i, dir);
+    height = std::max(height, field.spans[a].floor);
+    if (field.spans[a].con[turn] != NOT_CONNECTED) {
+      int d = field.Neighbor(x + DIR_X[dir], z + DIR_Z[dir], a, turn);
+      height = std::max(height, field.spans[d].floor);
+    }
+  }
+  if (span.con[turn] != NOT_CONNECTED) {
+    int a = field.Neighbor(x, z, i, turn);
+    height = std::max(height, field.spans[a].floor);
+    if (field.spans[a].con[dir] != NOT_CONNECTED) {
+      int d = field.Neighbor(x + DIR_X[turn], z + DIR_Z[turn], a, dir);
+      height = std::max(height, field.spans[d].floor);
+    }
+  }
+  return height;
+}
+
+// follows a region's outline from span i, keeping the wall on one side:
+// along an edge turn toward it, across a link turn away
+void WalkContour(const Field& field, int x, int z, int i,
+                 std::vector<uint8_t>& flags,
+                 std::vector<ContourVertex>& points) {
+  int dir = 0;
+  while (!(flags[i] & (1 << dir))) dir++;
+  int startDir = dir, start = i;
+  for (int iteration = 0; iteration < 40000; iteration++) {
+    const OpenSpan& span = field.spans[i];
+    if (flags[i] & (1 << dir)) {
+      ContourVertex point;
+      point.x = x;
+      point.y = CornerHeight(field, x, z, i, dir);
+      point.z = z;
+      if (dir == 0) point.z++;
+      if (dir == 1) point.x++, point.z++;
+      if (dir == 2) point.x++;
+      point.r = span.con[dir] != NOT_CONNECTED
+                    ? field.spans[field.Neighbor(x, z, i, dir)].region
+                    : 0;
+      points.push_back(point);
+      flags[i] &= ~(1 << dir);
+      dir = (dir + 1) & 3;
+    } else {
+      if (span.con[dir] == NOT_CONNECTED) return;  // can't happen
+      i = field.Neighbor(x, z, i, dir);
+      x += DIR_X[dir];
+      z += DIR_Z[dir];
+      dir = (dir + 3) & 3;
+    }
+    if (i == start && dir == startDir) break;
+  }
+}
+
+// squared distance from point x/z to segment a..b on x/z
+float DistanceToSegment2(int x, int z, int ax, int az, int bx, int bz) {
+  float px = (float)(bx - ax), pz = (float)(bz - az);
+  float dx = (float)(x - ax), dz = (float)(z - az);
+  float d = px * px + pz * pz;
+  float t = d > 0.0f ? glm::clamp((px * dx + pz * dz) / d, 0.0f, 1.0f) : 0.0f;
+  dx = ax + t * px - x;
+  dz = az + t * pz - z;
+  return dx * dx + dz * dz;
+}
+
+// Keeps the vertices where the region on the other side changes, so
+// outlines shared by two regions (or cut by the tile edge) simplify the
+// same on both sides, then adds wall vertices Douglas-Peucker style until
+// no raw vertex is further than maxEdgeError from the outline.
+void SimplifyContour(const std::vector<ContourVertex>& raw, float maxError,
+                     std::vector<ContourVertex>& simplified) {
+  simplified.clear();
+  int count = (int)raw.size();
+  for (int i = 0; i < count; i++) {
+    if (raw[i].r != raw[(i + 1) % count].r) {
+      simplified.push_back({raw[i].x, raw[i].y, raw[i].z, i});
+    }
+  }
+  if (simplified.empty()) {
+    // a closed wall all round: start from the lower left and upper right
+    int lower = 0, upper = 0;
+    for (int i = 1; i < count; i++) {
+      const ContourVertex& p = raw[i];
+      if (p.x < raw[lower].x || (p.x == raw[lower].x && p.z < raw[lower].z)) {
+        lower = i;
+      }
+      if (p.x > raw[upper].x || (p.x == raw[upper].x && p.z > raw[upper].z)) {
+        upper = i;
+      }
+    }
+    simplified.push_back({raw[lower].x, raw[lower].y, raw[lower].z, lower});
+    simplified.push_back({raw[upper].x, raw[upper].y, raw[upper].z, upper});
+  }
+
+  for (size_t i = 0; i < simplified.size();) {
+    const ContourVertex& a = simplified[i];
+    const ContourVertex& b = simplified[(i + 1) % simplified.size()];
+    // walk the raw points in the same order from both sides of a shared
+    // edge so they pick the same vertices
+    int ax = a.x, az = a.z, bx = b.x, bz = b.z;
+    int step, index, end;
+    if (bx > ax || (bx == ax && bz > az)) {
+      step = 1;
+      index = (a.r + step) % count;
+      end = b.r;
+    } else {
+      step = count - 1;
+      index = (b.r + step) % count;
+      end = a.r;
+      std::swap(ax, bx);
+      std::swap(az, bz);
+    }
+    float worst = 0.0f;
+    int worstIndex = -1;
+    // only walls get detail, portals stay straight between their ends
+    if (raw[index].r == 0) {
+      while (index != end) {
+        float d = DistanceToSegment2(raw[index].x, raw[index].z, ax, az, bx,
+                                     bz);
+        if (d > worst) {
+          worst = d;
+          worstIndex = index;
+        }
+        index = (index + step) % count;
+      }
+    }
+    if (worstIndex >= 0 && worst > maxError * maxError) {
+      const ContourVertex& p = raw[worstIndex];
+      simplified.insert(simplified.begin() + i + 1,
+                        {p.x, p.y, p.z, worstIndex});
+    } else {
+      i++;
+    }
+  }
+
+  // drop vertices that landed on their successor
+  for (size_t i = 0; i < simplified.size() && simplified.size() > 1;) {
+    const ContourVertex& a = simplified[i];
+    const ContourVertex& b = simplified[(i + 1) % simplified.size()];
+    if (a.x == b.x && a.z == b.z) {
+      simplified.erase(simplified.begin() + i);
+    } else {
+      i++;
+    }
+  }
+}
+
+// inside or on the counter-clockwise triangle a, b, c
+bool InTriangle(const ContourVertex& p, const ContourVertex& a,
+                const ContourVertex& b, const ContourVertex& c) {
+  return Area2(a, b, p) >= 0 && Area2(b, c, p) >= 0 && Area2(c, a, p) >= 0;
+}
+
+bool SameSpot(const ContourVertex& a, const ContourVertex& b) {
+  return a.x == b.x && a.z == b.z;
+}
+
+// Ear clipping of a counter-clockwise outline, cutting the shortest ear
+// first to keep slivers down; triangles index into `outline`.
+void Triangulate(const std::vector<ContourVertex>& outline,
+                 std::vector<int>& triangles) {
+  std::vector<int> remaining;
+  for (int i = 0; i < (int)outline.size(); i++) remaining.push_back(i);
+  while (remaining.size() > 3) {
+    int n = (int)remaining.size();
+    int best = -1, bestLength = INT_MAX, straight = -1;
+    for (int i = 0; i < n; i++) {
+      const ContourVertex& p = outline[remaining[(i + n - 1) % n]];
+      const ContourVertex& c = outline[remaining[i]];
+      const ContourVertex& q = outline[remaining[(i + 1) % n]];
+      int area = Area2(p, c, q);
+      if (area == 0) straight = i;
+      if (area <= 0) continue;
+      bool ear = true;
+      for (int k = 0; k < n && ear; k++) {
+        const ContourVertex& v = outline[remaining[k]];
+        if (SameSpot(v, p) || SameSpot(v, c) || SameSpot(v, q)) continue;
+        ear = !InTriangle(v, p, c, q);
+      }
+      if (!ear) continue;
+      int dx = q.x - p.x, dz = q.z - p.z;
+      if (dx * dx + dz * dz < bestLength) {
+        bestLength = dx * dx + dz * dz;
+        best = i;
+      }
+    }
+    if (best < 0) {
+      // no ear: drop a straight corner if there is one, else the outline
+      // crosses itself and what's left is given up on
+      if (straight < 0) return;
+      remaining.erase(remaining.begin() + straight);
+      continue;
+    }
+    triangles.push_back(remaining[(best + n - 1) % n]);
+    triangles.push_back(remaining[best]);
+    triangles.push_back(remaining[(best + 1) % n]);
+    remaining.erase(remaining.begin() + best);
+  }
+  if (remaining.size() == 3 &&
+      Area2(outline[remaining[0]], outline[remaining[1]],
+            outline[remaining[2]]) > 0) {
+    triangles.insert(triangles.end(), remaining.begin(), remaining.end());
+  }
+}
+
+// Squared length of the edge a and b share if merging them over it gives a
+// convex polygon of at most NAV_MAX_POLY_VERTS, else -1.
+int MergeValue(const std::vector<int>& a, const std::vector<int>& b,
+               const std::vector<ContourVertex>& vertices, int& edgeA,
+               int& edgeB) {
+  int na = (int)a.size(), nb = (int)b.size();
+  if (na + nb - 2 > NAV_MAX_POLY_VERTS) return -1;
+  edgeA = edgeB = -1;
+  for (int i = 0; i < na && edgeA < 0; i++) {
+    for (int j = 0; j < nb; j++) {
+      if (a[i] == b[(j + 1) % nb] && a[(i + 1) % na] == b[j]) {
+        edgeA = i;
+        edgeB = j;
+        break;
+      }
+    }
+  }
+  if (edgeA < 0) return -1;
+  // both corners where the outlines join have to stay convex
+  if (Area2(vertices[a[(edgeA + na - 1) % na]], vertices[a[edgeA]],
+            vertices[b[(edgeB + 2) % nb]]) <= 0) {
+    return -1;
+  }
+  if (Area2(vertices[b[(edgeB + nb - 1) % nb]], vertices[b[edgeB]],
+            vertices[a[(edgeA + 2) % na]]) <= 0) {
+    return -1;
+  }
+  const ContourVertex& p = vertices[a[edgeA]];
+  const ContourVertex& q = vertices[a[(edgeA + 1) % na]];
+  return (q.x - p.x) * (q.x - p.x) + (q.z - p.z) * (q.z - p.z);
+}
+
+// triangles into convex polygons, longest shared edge first
+void MergePolys(const std::vector<ContourVertex>& vertices,
+                std::vector<std::vector<int>>& polys) {
+  while (true) {
+    int bestValue = 0, bestA = -1, bestB = -1, bestEdgeA = 0, bestEdgeB = 0;
+    for (size_t i = 0; i < polys.size(); i++) {
+      for (size_t j = i + 1; j < polys.size(); j++) {
+        int edgeA, edgeB;
+        int value = MergeValue(polys[i], polys[j], vertices, edgeA, edgeB);
+        if (value > bestValue) {
+          bestValue = value;
+          bestA = (int)i;
+          bestB = (int)j;
+          bestEdgeA = edgeA;
+          bestEdgeB = edgeB;
+        }
+      }
+    }
+    if (bestA < 0) return;
+    const std::vector<int>& a = polys[bestA];
+    const std::vector<int>& b = polys[bestB];
+    std::vector<int> merged;
+    for (size_t i = 0; i + 1 < a.size(); i++) {
+      merged.push_back(a[(bestEdgeA + 1 + i) % a.size()]);
+    }
+    for (size_t i = 0; i + 1 < b.size(); i++) {
+      merged.push_back(b[(bestEdgeB + 1 + i) % b.size()]);
+    }
+    polys[bestA] = merged;
+    polys.erase(polys.begin() + bestB);
+  }
+}
+
+}  // namespace
+
+void BuildNavTile(const NavMeshSettings& settings, const NavTileInput& input,
+                  NavTile& tile) {
+  tile.coord = input.coord;
+  tile.vertices.clear();
+  tile.polys.clear();
+  tile.links.clear();
+  tile.linkStart.assign(1, 0);
+
+  // padding wider than the erosion so the tile edge sees what's beyond it
+  float cs = settings.cellSize, ch = settings.cellHeight;
+  int tileCells = (int)std::round(settings.tileSize / cs);
+  int border = (int)std::ceil(settings.agentRadius / cs) + 3;
+  int width = tileCells + 2 * border;
+
+  std::vector<std::vector<SolidSpan>> columns;
+  Rasterize(settings, input, width, border, columns);
+  Field field;
+  BuildField(settings, columns, width, border, field);
+  columns.clear();
+  Erode(settings, field);
+  BuildRegions(settings, field);
+
+  // one outline per region; flags hold the edges still to walk per span
+  std::vector<uint8_t> flags(field.spans.size(), 0);
+  for (int z = 0; z < width; z++) {
+    for (int x = 0; x < width; x++) {
+      int c = field.Column(x, z);
+      for (int i = field.first[c]; i < field.first[c + 1]; i++) {
+        const OpenSpan& span = field.spans[i];
+        if (!span.region || (span.region & BORDER_REGION)) continue;
+        for (int dir = 0; dir < 4; dir++) {
+          bool same = span.con[dir] != NOT_CONNECTED &&
+                      field.spans[field.Neighbor(x, z, i, dir)].region ==
+                          span.region;
+          if (!same) flags[i] |= (uint8_t)(1 << dir);
+        }
+      }
+    }
+  }
+
+  // shared vertices are matched on x/z and a close height
+  std::vector<ContourVertex> vertices;
+  std::unordered_map<uint64_t, std::vector<int>> vertexLookup;
+  auto addVertex = [&](const ContourVertex& v) {
+    uint64_t key = ((uint64_t)(uint32_t)v.x << 32) | (uint32_t)v.z;
+    std::vector<int>& bucket = vertexLookup[key];
+    for (int index : bucket) {
+      if (std::abs(vertices[index].y - v.y) <= 2) return index;
+    }
+    bucket.push_back((int)vertices.size());
+    vertices.push_back({v.x, v.y, v.z, 0});
+    return (int)vertices.size() - 1;
+  };
+
+  std::vector<std::vector<int>> polys;
+  std::vector<ContourVertex> raw, outline;
+  std::vector<int> triangles;
+  for (int z = 0; z < width; z++) {
+    for (int x = 0; x < width; x++) {
+      int c = field.Column(x, z);
+      for (int i = field.first[c]; i < field.first[c + 1]; i++) {
+        if (!flags[i]) continue;
+        if (flags[i] == 0xf) {
+          flags[i] = 0;  // a lone span, nothing to outline
+          continue;
+        }
+        raw.clear();
+        WalkContour(field, x, z, i, flags, raw);
+        SimplifyContour(raw, settings.maxEdgeError, outline);
+        if (outline.size() < 3) continue;
+
+        int area = 0;
+        for (size_t k = 1; k + 1 < outline.size(); k++) {
+          area += Area2(outline[0], outline[k], outline[k + 1]);
+        }
+        if (area == 0) continue;
+        if (area < 0) std::reverse(outline.begin(), outline.end());
+
+        triangles.clear();
+        Triangulate(outline, triangles);
+        std::vector<std::vector<int>> regionPolys;
+        for (size_t t = 0; t < triangles.size(); t += 3) {
+          std::vector<int> poly;
+          for (int k = 0; k < 3; k++) {
+            poly.push_back(addVertex(outline[triangles[t + k]]));
+          }
+          // vertices merged with a neighbour's can collapse a triangle
+          if (poly[0] == poly[1] || poly[1] == poly[2] || poly[0] == poly[2]) {
+            continue;
+          }
+          regionPolys.push_back(poly);
+        }
+        MergePolys(vertices, regionPolys);
+        polys.insert(polys.end(), regionPolys.begin(), regionPolys.end());
+      }
+    }
+  }
+  if (vertices.size() >= NAV_NO_NEIGHBOR || polys.size() >= NAV_EXTERNAL) {
+    return;  // far more than any tile should need
+  }
+
+  // neighbours inside the tile share an edge the other way round
+  std::unordered_map<uint64_t, std::pair<int, int>> edges;
+  auto edgeKey = [](int a, int b) {
+    return ((uint64_t)(uint32_t)a << 32) | (uint32_t)b;
+  };
+  for (size_t p = 0; p < polys.size(); p++) {
+    for (size_t e = 0; e < polys[p].size(); e++) {
+      int a = polys[p][e], b = polys[p][(e + 1) % polys[p].size()];
+      edges[edgeKey(a, b)] = {(int)p, (int)e};
+    }
+  }
+  int low = border, high = border + tileCells;
+  tile.polys.resize(polys.size());
+  for (size_t p = 0; p < polys.size(); p++) {
+    NavPoly& poly = tile.polys[p];
+    poly = {};
+    poly.vertCount = (uint8_t)polys[p].size();
+    for (size_t e = 0; e < polys[p].size(); e++) {
+      int a = polys[p][e], b = polys[p][(e + 1) % polys[p].size()];
+      poly.verts[e] = (uint16_t)a;
+      poly.neighbors[e] = NAV_NO_NEIGHBOR;
+      auto other = edges.find(edgeKey(b, a));
+      if (other != edges.end()) {
+        poly.neighbors[e] = (uint16_t)other->second.first;
+        continue;
+      }
+      const ContourVertex& va = vertices[a];
+      const ContourVertex& vb = vertices[b];
+      if (va.x == low && vb.x == low) poly.neighbors[e] = NAV_EXTERNAL | 0;
+      if (va.z == high && vb.z == high) poly.neighbors[e] = NAV_EXTERNAL | 1;
+      if (va.x == high && vb.x == high) poly.neighbors[e] = NAV_EXTERNAL | 2;
+      if (va.z == low && vb.z == low) poly.neighbors[e] = NAV_EXTERNAL | 3;
+    }
+  }
+
+  tile.vertices.reserve(vertices.size());
+  for (const ContourVertex& v : vertices) {
+    tile.vertices.push_back(glm::vec3(input.origin.x + (v.x - border) * cs,
+                                      v.y * ch,
+                                      input.origin.y + (v.z - border) * cs));
+  }
+  tile.linkStart.assign(tile.polys.size() + 1, 0);
+}
@@ -0,0 +1,749 @@
+#include "occlusion_raster.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <iostream>
+#include <random>
+
+#include "job_system.hpp"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define OCCLUSION_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define OCCLUSION_NEON 1
+#include <arm_neon.h>
+#endif
+
+typedef OcclusionRasterizer::Triangle Triangle;
+static const int W = OcclusionRasterizer::WIDTH;
+
+// Kernels. Raster writes min(depth, triangle depth) for every pixel center
+// inside the triangle within [x0, x1) x [y0, y1); x0 is a multiple of 8 and
+// x1 never crosses a bin, so full vector loads stay inside the row. Test
+// returns true if any pixel in the rect is at least as far as zNear.
+
+static void RasterScalar(const Triangle& t, float* depth,
+                                          int x0, int y0, int x1, int y1) {
+  for (int y = y0; y < y1; y++) {
+    float py = y + 0.5f;
+    float* row = depth + y * W;
+    for (int x = x0; x < x1; x++) {
+      float px = x + 0.5f;
+      float e0 = t.a[0] * px + t.b[0] * py + t.c[0];
+      float e1 = t.a[1] * px + t.b[1] * py + t.c[1];
+      float e2 = t.a[2] * px + t.b[2] * py + t.c[2];
+      if (e0 < 0.0f || e1 < 0.0f || e2 < 0.0f) continue;
+      float z = std::min(t.zA * px + t.zB * py + t.zC + t.zBias, t.zMax);
+      row[x] = std::min(row[x], z);
+    }
+  }
+}
+
+static bool TestScalar(const float* depth, int x0, int y0, int x1, int y1,
+                       float zNear) {
+  for (int y = y0; y < y1; y++) {
+    const float* row = depth + y * W;
+    for (int x = x0; x < x1; x++) {
+      if (row[x] >= zNear) return true;
+    }
+  }
+  return false;
+}
+
+#ifdef OCCLUSION_X86
+static void RasterSSE(const Triangle& t, float* depth, int x0, int y0, int x1,
+                      int y1) {
+  const __m128 laneOffset = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  const __m128i laneIndex = _mm_setr_epi32(0, 1, 2, 3);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 a0 = _mm_set1_ps(t.a[0]);
+  const __m128 a1 = _mm_set1_ps(t.a[1]);
+  const __m128 a2 = _mm_set1_ps(t.a[2]);
+  const __m128 zA = _mm_set1_ps(t.zA);
+  const __m128 zMax = _mm_set1_ps(t.zMax);
+  const __m128i end = _mm_set1_epi32(x1);
+
+  for (int y = y0; y < y1; y++) {
+    float py = y + 0.5f;
+    __m128 r0 = _mm_set1_ps(t.b[0] * py + t.c[0]);
+    __m128 r1 = _mm_set1_ps(t.b[1] * py + t.c[1]);
+    __m128 r2 = _mm_set1_ps(t.b[2] * py + t.c[2]);
+    __m128 rz = _mm_set1_ps(t.zB * py + t.zC + t.zBias);
+    float* row = depth + y * W;
+    for (int x = x0; x < x1; x += 4) {
+      __m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneOffset);
+      __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), r0);
+      __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), r1);
+      __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), r2);
+      __m128 inside = _mm_and_ps(
+          _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)),
+          _mm_cmpge_ps(e2, zero));
+      __m128i lane = _mm_add_epi32(_mm_set1_epi32(x), laneIndex);
+      inside = _mm_and_ps(inside, _mm_castsi128_ps(_mm_cmpgt_epi32(end, lane)));
+      if (_mm_movemask_ps(inside) == 0) continue;
+
+      __m128 z = _mm_min_ps(_mm_add_ps(_mm_mul_ps(zA, px), rz), zMax);
+      __m128 d = _mm_loadu_ps(row + x);
+      __m128 nd = _mm_min_ps(d, z);
+      d = _mm_or_ps(_mm_and_ps(inside, nd), _mm_andnot_ps(inside, d));
+      _mm_storeu_ps(row + x, d);
+    }
+  }
+}
+
+static bool TestSSE(const float* depth, int x0, int y0, int x1, int y1,
+                    float zNear) {
+  const __m128i laneIndex = _mm_setr_epi32(0, 1, 2, 3);
+  const __m128i begin = _mm_set1_epi32(x0 - 1);
+  const __m128i end = _mm_set1_epi32(x1);
+  const __m128 z = _mm_set1_ps(zNear);
+  int start = x0 & ~3;
+
+  for (int y = y0; y < y1; y++) {
+    const float* row = depth + y * W;
+    for (int x = start; x < x1; x += 4) {
+      __m128i lane = _mm_add_epi32(_mm_set1_epi32(x), laneIndex);
+      __m128 inRange = _mm_castsi128_ps(_mm_and_si128(
+          _mm_cmpgt_epi32(lane, begin), _mm_cmpgt_epi32(end, lane)));
+      __m128 farther = _mm_cmpge_ps(_mm_loadu_ps(row + x), z);
+      if (_mm_movemask_ps(_mm_and_ps(farther, inRange))) return true;
+    }
+  }
+  return false;
+}
+
+__attribute__((target("avx2,fma"))) static void RasterAVX2(
+    const Triangle& t, float* depth, int x0, int y0, int x1, int y1) {
+  const __m256 laneOffset =
+      _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+  const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 a0 = _mm256_set1_ps(t.a[0]);
+  const __m256 a1 = _mm256_set1_ps(t.a[1]);
+  const __m256 a2 = _mm256_set1_ps(t.a[2]);
+  const __m256 zA = _mm256_set1_ps(t.zA);
+  const __m256 zMax = _mm256_set1_ps(t.zMax);
+  const __m256i end = _mm256_set1_epi32(x1);
+
+  for (int y = y0; y < y1; y++) {
+    float py = y + 0.5f;
+    __m256 r0 = _mm256_set1_ps(t.b[0] * py + t.c[0]);
+    __m256 r1 = _mm256_set1_ps(t.b[1] * py + t.c[1]);
+    __m256 r2 = _mm256_set1_ps(t.b[2] * py + t.c[2]);
+    __m256 rz = _mm256_set1_ps(t.zB * py + t.zC + t.zBias);
+    float* row = depth + y * W;
+    for (int x = x0; x < x1; x += 8) {
+      __m256 px = _mm256_add_ps(_mm256_set1_ps((float)x), laneOffset);
+      __m256 e0 = _mm256_fmadd_ps(a0, px, r0);
+      __m256 e1 = _mm256_fmadd_ps(a1, px, r1);
+      __m256 e2 = _mm256_fmadd_ps(a2, px, r2);
+      __m256 inside =
+          _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ),
+                                      _mm256_cmp_ps(e1, zero, _CMP_GE_OQ)),
+                        _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+      __m256i lane = _mm256_add_epi32(_mm256_set1_epi32(x), laneIndex);
+      inside = _mm256_and_ps(
+          inside, _mm256_castsi256_ps(_mm256_cmpgt_epi32(end, lane)));
+      if (_mm256_movemask_ps(inside) == 0) continue;
+
+      __m256 z = _mm256_min_ps(_mm256_fmadd_ps(zA, px, rz), zMax);
+      __m256 d = _mm256_loadu_ps(row + x);
+      _mm256_storeu_ps(row + x,
+                       _mm256_blendv_ps(d, _mm256_min_ps(d, z), inside));
+    }
+  }
+}
+
+__attribute__((target("avx2"))) static bool TestAVX2(const float* depth,
+                                                      int x0, int y0, int x1,
+                                                      int y1, float zNear) {
+  const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i begin = _mm256_set1_epi32(x0 - 1);
+  const __m256i end = _mm256_set1_epi32(x1);
+  const __m256 z = _mm256_set1_ps(zNear);
+  int start = x0 & ~7;
+
+  for (int y = y0; y < y1; y++) {
+    const float* row = depth + y * W;
+    for (int x = start; x < x1; x += 8) {
+      __m256i lane = _mm256_add_epi32(_mm256_set1_epi32(x), laneIndex);
+      __m256 inRange = _mm256_castsi256_ps(_mm256_and_si256(
+          _mm256_cmpgt_epi32(lane, begin), _mm256_cmpgt_epi32(end, lane)));
+      __m256 farther =
+          _mm256_cmp_ps(_mm256_loadu_ps(row + x), z, _CMP_GE_OQ);
+      if (_mm256_movemask_ps(_mm256_and_ps(farther, inRange))) return true;
+    }
+  }
+  return false;
+}
+#endif
+
+#ifdef OCCLUSION_NEON
+// the SSE2 kernels lane for lane; every AArch64 CPU has NEON
+static void RasterNEON(const Triangle& t, float* depth, int x0, int y0,
+                       int x1, int y1) {
+  static const float offsets[4] = {0.5f, 1.5f, 2.5f, 3.5f};
+  static const int32_t indices[4] = {0, 1, 2, 3};
+  const float32x4_t laneOffset = vld1q_f32(offsets);
+  const int32x4_t laneIndex = vld1q_s32(indices);
+  const float32x4_t zero = vdupq_n_f32(0.0f);
+  const float32x4_t a0 = vdupq_n_f32(t.a[0]);
+  const float32x4_t a1 = vdupq_n_f32(t.a[1]);
+  const float32x4_t a2 = vdupq_n_f32(t.a[2]);
+  const float32x4_t zA = vdupq_n_f32(t.zA);
+  const float32x4_t zMax = vdupq_n_f32(t.zMax);
+  const int32x4_t end = vdupq_n_s32(x1);
+
+  for (int y = y0; y < y1; y++) {
+    float py = y + 0.5f;
+    float32x4_t r0 = vdupq_n_f32(t.b[0] * py + t.c[0]);
+    float32x4_t r1 = vdupq_n_f32(t.b[1] * py + t.c[1]);
+    float32x4_t r2 = vdupq_n_f32(t.b[2] * py + t.c[2]);
+    float32x4_t rz = vdupq_n_f32(t.zB * py + t.zC + t.zBias);
+    float* row = depth + y * W;
+    for (int x = x0; x < x1; x += 4) {
+      float32x4_t px = vaddq_f32(vdupq_n_f32((float)x), laneOffset);
+      float32x4_t e0 = vaddq_f32(vmulq_f32(a0, px), r0);
+      float32x4_t e1 = vaddq_f32(vmulq_f32(a1, px), r1);
+      float32x4_t e2 = vaddq_f32(vmulq_f32(a2, px), r2);
+      uint32x4_t inside =
+          vandq_u32(vandq_u32(vcgeq_f32(e0, zero), vcgeq_f32(e1, zero)),
+                    vcgeq_f32(e2, zero));
+      int32x4_t lane = vaddq_s32(vdupq_n_s32(x), laneIndex);
+      inside = vandq_u32(inside, vcgtq_s32(end, lane));
+      if (vmaxvq_u32(inside) == 0) continue;
+
+      float32x4_t z = vminq_f32(vaddq_f32(vmulq_f32(zA, px), rz), zMax);
+      float32x4_t d = vld1q_f32(row + x);
+      vst1q_f32(row + x, vbslq_f32(inside, vminq_f32(d, z), d));
+    }
+  }
+}
+
+static bool TestNEON(const float* depth, int x0, int y0, int x1, int y1,
+                     float zNear) {
+  static const int32_t indices[4] = {0, 1, 2, 3};
+  const int32x4_t laneIndex = vld1q_s32(indices);
+  const int32x4_t begin = vdupq_n_s32(x0 - 1);
+  const int32x4_t end = vdupq_n_s32(x1);
+  const float32x4_t z = vdupq_n_f32(zNear);
+  int start = x0 & ~3;
+
+  for (int y = y0; y < y1; y++) {
+    const float* row = depth + y * W;
+    for (int x = start; x < x1; x += 4) {
+      int32x4_t lane = vaddq_s32(vdupq_n_s32(x), laneIndex);
+      uint32x4_t inRange =
+          vandq_u32(vcgtq_s32(lane, begin), vcgtq_s32(end, lane));
+      uint32x4_t farther = vcgeq_f32(vld1q_f32(row + x), z);
+      if (vmaxvq_u32(vandq_u32(farther, inRange))) return true;
+    }
+  }
+  return false;
+}
+#endif
+
+typedef void (*RasterFn)(const Triangle&, float*, int, int, int, int);
+typedef bool (*TestFn)(const float*, int, int, int, int, float);
+
+struct Kernels {
+  RasterFn raster;
+  TestFn test;
+  const char* name;
+};
+
+static Kernels PickKernels() {
+#ifdef OCCLUSION_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return {RasterAVX2, TestAVX2, "AVX2"};
+  }
+  return {RasterSSE, TestSSE, "SSE2"};
+#elif defined(OCCLUSION_NEON)
+  return {RasterNEON, TestNEON, "NEON"};
+#else
+  return {RasterScalar, TestScalar, "scalar"};
+#endif
+}
+
+static const Kernels& GetKernels() {
+  static const Kernels kernels = PickKernels();
+  return kernels;
+}
+
+// every flavour this CPU can run, for the checks and benchmarks
+static std::vector<Kernels> AllKernels() {
+  std::vector<Kernels> all = {{RasterScalar, TestScalar, "scalar"}};
+#ifdef OCCLUSION_X86
+  all.push_back({RasterSSE, TestSSE, "SSE2"});
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    all.push_back({RasterAVX2, TestAVX2, "AVX2"});
+  }
+#elif defined(OCCLUSION_NEON)
+  all.push_back({RasterNEON, TestNEON, "NEON"});
+#endif
+  return all;
+}
+
+const char* OcclusionRasterizer::SimdName() { return GetKernels().name; }
+
+OcclusionRasterizer::OcclusionRasterizer(JobSystem* jobs)
+    : jobs(jobs),
+      viewProjection(1.0f),
+      depth(WIDTH * HEIGHT, 1.0f),
+      tileMax((WIDTH / TILE_W) * (HEIGHT / TILE_H), 1.0f) {
+  static_assert(WIDTH % BIN_W == 0 && HEIGHT % BIN_H == 0,
+                "bins must tile the buffer");
+  static_assert(BIN_W % TILE_W == 0 && BIN_H % TILE_H == 0,
+                "tiles must not straddle bins");
+  static_assert(TILE_W % 8 == 0, "tiles must fit whole vectors");
+}
+
+void OcclusionRasterizer::Begin(const glm::mat4& viewProj) {
+  viewProjection = viewProj;
+  triangles.clear();
+  std::fill(depth.begin(), depth.end(), 1.0f);
+  std::fill(tileMax.begin(), tileMax.end(), 1.0f);
+}
+
+void OcclusionRasterizer::SetupTriangle(const glm::vec4& c0,
+                                        const glm::vec4& c1,
+                                        const glm::vec4& c2, bool twoSided) {
+  // clip space -> pixels (y up, like gl_FragCoord) and [0, 1] depth
+  glm::vec3 s[3];
+  const glm::vec4* clip[3] = {&c0, &c1, &c2};
+  for (int i = 0; i < 3; i++) {
+    const glm::vec4& c = *clip[i];
+    s[i] = glm::vec3((c.x / c.w * 0.5f + 0.5f) * WIDTH,
+                     (c.y / c.w * 0.5f + 0.5f) * HEIGHT,
+                     c.z / c.w * 0.5f + 0.5f);
+  }
+
+  float area = (s[1].x - s[0].x) * (s[2].y - s[0].y) -
+               (s[2].x - s[0].x) * (s[1].y - s[0].y);
+  if (area == 0.0f) return;
+  if (area < 0.0f) {
+    if (!twoSided) return;  // back face
+    std::swap(s[1], s[2]);
+    area = -area;
+  }
+
+  Triangle t;
+  float minX = std::min(s[0].x, std::min(s[1].x, s[2].x));
+  float maxX = std::max(s[0].x, std::max(s[1].x, s[2].x));
+  float minY = std::min(s[0].y, std::min(s[1].y, s[2].y));
+  float maxY = std::max(s[0].y, std::max(s[1].y, s[2].y));
+  if (maxX < 0.0f || maxY < 0.0f || minX >= WIDTH || minY >= HEIGHT) return;
+  t.minX = std::max(0, (int)std::floor(minX));
+  t.minY = std::max(0, (int)std::floor(minY));
+  t.maxX = std::min(WIDTH - 1, (int)std::ceil(maxX));
+  t.maxY = std::min(HEIGHT - 1, (int)std::ceil(maxY));
+
+  for (int i = 0; i < 3; i++) {
+    const glm::vec3& p = s[i];
+    const glm::vec3& q = s[(i + 1) % 3];
+    t.a[i] = p.y - q.y;
+    t.b[i] = q.x - p.x;
+    t.c[i] = -(t.a[i] * p.x + t.b[i] * p.y);
+  }
+
+  float dx1 = s[1].x - s[0].x, dy1 = s[1].y - s[0].y, dz1 = s[1].z - s[0].z;
+  float dx2 = s[2].x - s[0].x, dy2 = s[2].y - s[0].y, dz2 = s[2].z - s[0].z;
+  t.zA = (dz1 * dy2 - dz2 * dy1) / area;
+  t.zB = (dx1 * dz2 - dx2 * dz1) / area;
+  t.zC = s[0].z - t.zA * s[0].x - t.zB * s[0].y;
+  // an occluder must never claim to be nearer than it is anywhere in the
+  // pixel, so write the depth of the pixel's far corner
+  t.zBias = 0.5f * (std::fabs(t.zA) + std::fabs(t.zB));
+  t.zMax = std::max(s[0].z, std::max(s[1].z, s[2].z));
+
+  triangles.push_back(t);
+}
+
+void OcclusionRasterizer::AddOccluder(const glm::vec3* positions,
+                                      const unsigned int* indices,
+                                      int triangleCount,
+                                      const glm::mat4& model, bool twoSided) {
+  glm::mat4 mvp = viewProjection * model;
+  for (int i = 0; i < triangleCount; i++) {
+    glm::vec4 in[3];
+    for (int k = 0; k < 3; k++) {
+      in[k] = mvp * glm::vec4(positions[indices[i * 3 + k]], 1.0f);
+    }
+
+    // clip against the near plane (z >= -w), leaves at most a quad
+    glm::vec4 out[4];
+    int count = 0;
+    for (int k = 0; k < 3; k++) {
+      const glm::vec4& a = in[k];
+      const glm::vec4& b = in[(k + 1) % 3];
+      float da = a.z + a.w;
+      float db = b.z + b.w;
+      if (da >= 0.0f) out[count++] = a;
+      if ((da >= 0.0f) != (db >= 0.0f)) {
+        out[count++] = a + (b - a) * (da / (da - db));
+      }
+    }
+    if (count < 3) continue;
+
+    SetupTriangle(out[0], out[1], out[2], twoSided);
+    if (count == 4) SetupTriangle(out[0], out[2], out[3], twoSided);
+  }
+}
+
+void OcclusionRasterizer::AddOccluderBox(const glm::vec3& min,
+                                         const glm::vec3& max) {
+  // corner i has x from bit 0, y from bit 1, z from bit 2
+  static const unsigned int boxIndices[36] = {
+      1, 3, 7, 1, 7, 5,  // +x
+      0, 6, 2, 0, 4, 6,  // -x
+      2, 6, 7, 2, 7, 3,  // +y
+      0, 1, 5, 0, 5, 4,  // -y
+      4, 5, 7, 4, 7, 6,  // +z
+      0, 2, 3, 0, 3, 1   // -z
+  };
+  glm::vec3 corners[8];
+  for (int i = 0; i < 8; i++) {
+    corners[i] = glm::vec3((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y,
+                           (i & 4) ? max.z : min.z);
+  }
+  AddOccluder(corners, boxIndices, 12, glm::mat4(1.0f));
+}
+
+void OcclusionRasterizer::RasterizeBin(int bin) {
+  const int binsX = WIDTH / BIN_W;
+  int bx0 = (bin % binsX) * BIN_W;
+  int by0 = (bin / binsX) * BIN_H;
+  int bx1 = bx0 + BIN_W;
+  int by1 = by0 + BIN_H;
+  RasterFn raster = GetKernels().raster;
+
+  for (const Triangle& t : triangles) {
+    int x0 = std::max(t.minX, bx0);
+    int y0 = std::max(t.minY, by0);
+    int x1 = std::min(t.maxX + 1, bx1);
+    int y1 = std::min(t.maxY + 1, by1);
+    if (x0 >= x1 || y0 >= y1) continue;
+    raster(t, depth.data(), x0 & ~7, y0, x1, y1);
+  }
+
+  // refresh the furthest depth of the tiles inside this bin
+  const int tilesX = WIDTH / TILE_W;
+  for (int ty = by0 / TILE_H; ty < by1 / TILE_H; ty++) {
+    for (int tx = bx0 / TILE_W; tx < bx1 / TILE_W; tx++) {
+      float furthest = 0.0f;
+      for (int y = ty * TILE_H; y < (ty + 1) * TILE_H; y++) {
+        const float* row = depth.data() + y * WIDTH + tx * TILE_W;
+        for (int x = 0; x < TILE_W; x++) furthest = std::max(furthest, row[x]);
+      }
+      tileMax[ty * tilesX + tx] = furthest;
+    }
+  }
+}
+
+void OcclusionRasterizer::Rasterize() {
+  const int binCount = (WIDTH / BIN_W) * (HEIGHT / BIN_H);
+  if (jobs) {
+    jobs->ParallelFor(binCount, 1, [this](int begin, int end) {
+      for (int bin = begin; bin < end; bin++) RasterizeBin(bin);
+    });
+  } else {
+    for (int bin = 0; bin < binCount; bin++) RasterizeBin(bin);
+  }
+}
+
+bool OcclusionRasterizer::IsVisible(const glm::vec3& min,
+                                    const glm::vec3& max) const {
+  float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f;
+  float zNear = 1.0f;
+  for (int i = 0; i < 8; i++) {
+    glm::vec3 corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y,
+                     (i & 4) ? max.z : min.z);
+    glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+    if (clip.w <= 1e-5f) return true;  // reaches behind the camera
+    float x = (clip.x / clip.w * 0.5f + 0.5f) * WIDTH;
+    float y = (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT;
+    minX = std::min(minX, x);
+    maxX = std::max(maxX, x);
+    minY = std::min(minY, y);
+    maxY = std::max(maxY, y);
+    zNear = std::min(zNear, clip.z / clip.w * 0.5f + 0.5f);
+  }
+  if (zNear < 0.0f) return true;
+
+  int x0 = std::max(0, (int)std::floor(minX));
+  int y0 = std::max(0, (int)std::floor(minY));
+  int x1 = std::min(WIDTH, (int)std::ceil(maxX) + 1);
+  int y1 = std::min(HEIGHT, (int)std::ceil(maxY) + 1);
+  if (x0 >= x1 || y0 >= y1) return true;  // off screen, frustum's job
+
+  TestFn test = GetKernels().test;
+  const int tilesX = WIDTH / TILE_W;
+  for (int ty = y0 / TILE_H; ty <= (y1 - 1) / TILE_H; ty++) {
+    for (int tx = x0 / TILE_W; tx <= (x1 - 1) / TILE_W; tx++) {
+      // every pixel of the tile is nearer than the box, nothing to see
+      if (tileMax[ty * tilesX + tx] < zNear) continue;
+      int rx0 = std::max(x0, tx * TILE_W);
+      int ry0 = std::max(y0, ty * TILE_H);
+      int rx1 = std::min(x1, (tx + 1) * TILE_W);
+      int ry1 = std::min(y1, (ty + 1) * TILE_H);
+      if (test(depth.data(), rx0, ry0, rx1, ry1, zNear)) return true;
+    }
+  }
+  return false;
+}
+
+namespace {
+
+double MillisecondsSince(std::chrono::high_resolution_clock::time_point t) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::high_resolution_clock::now() - t)
+      .count();
+}
+
+// Triangles of up to ~40 pixels anywhere on (and a little off) the screen,
+// in clip space with w = 1 so none need near clipping. Either winding.
+void RandomTriangles(std::mt19937& rng, int count,
+                     std::vector<glm::vec3>& positions,
+                     std::vector<unsigned int>& indices) {
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  positions.clear();
+  indices.clear();
+  for (int i = 0; i < count; i++) {
+    glm::vec3 center(unit(rng) * 1.1f, unit(rng) * 1.1f,
+                     0.5f + 0.35f * unit(rng));
+    for (int k = 0; k < 3; k++) {
+      positions.push_back(center + glm::vec3(unit(rng) * 0.25f,
+                                             unit(rng) * 0.25f,
+                                             unit(rng) * 0.1f));
+      indices.push_back((unsigned int)indices.size());
+    }
+  }
+}
+
+}  // namespace
+
+int VerifyOcclusionKernels(int triangleCount) {
+  const int H = OcclusionRasterizer::HEIGHT;
+  std::vector<Kernels> kernels = AllKernels();
+  std::mt19937 rng(29);
+  std::vector<glm::vec3> positions;
+  std::vector<unsigned int> indices;
+  RandomTriangles(rng, triangleCount, positions, indices);
+
+  std::vector<std::vector<float>> buffers(kernels.size(),
+                                          std::vector<float>(W * H, 1.0f));
+  std::vector<float> scene(W * H, 1.0f);  // every triangle, for the tests
+  OcclusionRasterizer single;
+  int differ = 0, edges = 0, pixels = 0;
+  for (int i = 0; i < triangleCount; i++) {
+    single.Begin(glm::mat4(1.0f));
+    single.AddOccluder(positions.data(), indices.data() + i * 3, 1,
+                       glm::mat4(1.0f), true);
+    if (single.Triangles().empty()) continue;  // off screen
+    const Triangle& t = single.Triangles()[0];
+    int x0 = t.minX & ~7, x1 = t.maxX + 1;
+    for (size_t k = 0; k < kernels.size(); k++) {
+      kernels[k].raster(t, buffers[k].data(), x0, t.minY, x1, t.maxY + 1);
+    }
+    RasterScalar(t, scene.data(), x0, t.minY, x1, t.maxY + 1);
+
+    // the reference: straight from the vertices, in doubles
+    double sx[3], sy[3], sz[3];
+    for (int k = 0; k < 3; k++) {
+      const glm::vec3& p = positions[i * 3 + k];
+      sx[k] = (p.x * 0.5 + 0.5) * W;
+      sy[k] = (p.y * 0.5 + 0.5) * H;
+      sz[k] = p.z * 0.5 + 0.5;
+    }
+    double area = (sx[1] - sx[0]) * (sy[2] - sy[0]) -
+                  (sx[2] - sx[0]) * (sy[1] - sy[0]);
+    double sign = area < 0.0 ? -1.0 : 1.0;
+    double dzdx = ((sz[1] - sz[0]) * (sy[2] - sy[0]) -
+                   (sz[2] - sz[0]) * (sy[1] - sy[0])) / area;
+    double dzdy = ((sx[1] - sx[0]) * (sz[2] - sz[0]) -
+                   (sx[2] - sx[0]) * (sz[1] - sz[0])) / area;
+    double zMax = std::max(sz[0], std::max(sz[1], sz[2]));
+    double tolerance = 1e-5 + 1e-6 * (std::fabs(dzdx) * W +
+                                      std::fabs(dzdy) * H);
+    for (int y = t.minY; y <= t.maxY; y++) {
+      for (int x = x0; x < x1; x++) {
+        double px = x + 0.5, py = y + 0.5;
+        bool inside = true, edge = false;
+        for (int k = 0; k < 3; k++) {
+          int n = (k + 1) % 3;
+          double ex = sx[n] - sx[k], ey = sy[n] - sy[k];
+          double e = sign * (ex * (py - sy[k]) - ey * (px - sx[k]));
+          double distance = e / std::sqrt(ex * ex + ey * ey);
+          if (distance < 0.0) inside = false;
+          if (std::fabs(distance) < 1e-3) edge = true;
+        }
+        double z = 1.0;
+        if (inside) {
+          z = sz[0] + dzdx * (px - sx[0]) + dzdy * (py - sy[0]) +
+              0.5 * (std::fabs(dzdx) + std::fabs(dzdy));
+          z = std::min(std::min(z, zMax), 1.0);
+        }
+        pixels++;
+        if (edge) edges++;
+        for (size_t k = 0; k < kernels.size(); k++) {
+          float& written = buffers[k][y * W + x];
+          if (!edge && std::fabs(written - z) > tolerance) differ++;
+          written = 1.0f;
+        }
+      }
+    }
+  }
+
+  // the test kernels against a plain loop over the whole scene
+  std::uniform_int_distribution<int> px(0, W - 1), py(0, H - 1);
+  std::uniform_real_distribution<float> depth(0.3f, 1.0f);
+  int tests = 0;
+  for (int i = 0; i < 20000; i++) {
+    int x0 = px(rng), y0 = py(rng);
+    int x1 = std::min(W, x0 + 1 + px(rng) % 48);
+    int y1 = std::min(H, y0 + 1 + py(rng) % 24);
+    float zNear = depth(rng);
+    bool expected = false;
+    for (int y = y0; y < y1 && !expected; y++) {
+      for (int x = x0; x < x1; x++) {
+        if (scene[y * W + x] >= zNear) expected = true;
+      }
+    }
+    for (const Kernels& k : kernels) {
+      if (k.test(scene.data(), x0, y0, x1, y1, zNear) != expected) differ++;
+    }
+    tests++;
+  }
+
+  std::cout << "Occlusion kernels:";
+  for (const Kernels& k : kernels) std::cout << " " << k.name;
+  std::cout << " against the reference, " << triangleCount << " triangles, "
+            << pixels << " pixels (" << edges << " on edges), " << tests
+            << " tests, " << differ << " differ" << std::endl;
+  return differ;
+}
+
+int VerifyOcclusionQueries(JobSystem* jobs) {
+  // eye at the origin looking down -z, 60 degrees, like the game's camera
+  glm::mat4 viewProjection =
+      glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 500.0f) *
+      glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+                  glm::vec3(0.0f, 1.0f, 0.0f));
+  OcclusionRasterizer rasterizer(jobs);
+  rasterizer.Begin(viewProjection);
+  // a wall 10 m ahead, its right edge at x = 5
+  rasterizer.AddOccluderBox(glm::vec3(-5.0f, -4.0f, -10.5f),
+                            glm::vec3(5.0f, 4.0f, -10.0f));
+  // a floor 2 m down and a wall 3 m to the left, both reaching behind the
+  // eye, so their triangles are clipped at the near plane; the floor's
+  // diagonal is in view, so one of its triangles clips to a quad
+  rasterizer.AddOccluderBox(glm::vec3(-30.0f, -3.0f, -60.0f),
+                            glm::vec3(30.0f, -2.0f, 5.0f));
+  rasterizer.AddOccluderBox(glm::vec3(-4.0f, -10.0f, -200.0f),
+                            glm::vec3(-3.0f, 10.0f, 20.0f));
+  rasterizer.Rasterize();
+
+  struct Query {
+    const char* what;
+    glm::vec3 min, max;
+    bool visible;
+  };
+  const Query queries[] = {
+      {"behind the wall", glm::vec3(-1.0f, -1.0f, -21.0f),
+       glm::vec3(1.0f, 1.0f, -19.0f), false},
+      {"just behind the wall", glm::vec3(-4.0f, -3.0f, -11.0f),
+       glm::vec3(4.0f, 3.0f, -10.6f), false},
+      // x / z reaches 0.55 at the far side, past the edge's 0.5
+      {"peeking past the edge", glm::vec3(8.0f, -1.0f, -22.0f),
+       glm::vec3(12.0f, 1.0f, -20.0f), true},
+      {"in front of the wall", glm::vec3(-1.0f, -1.0f, -6.0f),
+       glm::vec3(1.0f, 1.0f, -5.0f), true},
+      {"through the wall", glm::vec3(-1.0f, -1.0f, -12.0f),
+       glm::vec3(1.0f, 1.0f, -8.0f), true},
+      {"reaching behind the eye", glm::vec3(-0.5f, -1.0f, -20.0f),
+       glm::vec3(0.5f, 1.0f, 1.0f), true},
+      {"beside the wall", glm::vec3(7.0f, -1.0f, -12.0f),
+       glm::vec3(9.0f, 1.0f, -10.0f), true},
+      {"under the floor", glm::vec3(20.0f, -8.0f, -31.0f),
+       glm::vec3(22.0f, -5.0f, -29.0f), false},
+      // seen through the floor's clipped quad, right of the wall
+      {"under the floor, far", glm::vec3(28.0f, -5.0f, -54.0f),
+       glm::vec3(29.5f, -4.0f, -53.0f), false},
+      {"under the floor, near", glm::vec3(8.0f, -5.0f, -12.0f),
+       glm::vec3(9.0f, -4.0f, -10.0f), false},
+      {"on the floor", glm::vec3(20.0f, -2.0f, -31.0f),
+       glm::vec3(22.0f, 0.0f, -29.0f), true},
+      {"behind the side wall", glm::vec3(-12.0f, -1.0f, -20.0f),
+       glm::vec3(-8.0f, 1.0f, -18.0f), false},
+      {"in front of the side wall", glm::vec3(-2.5f, -1.0f, -8.0f),
+       glm::vec3(-2.0f, 1.0f, -7.0f), true},
+  };
+  int wrong = 0;
+  for (const Query& query : queries) {
+    if (rasterizer.IsVisible(query.min, query.max) == query.visible) {
+      continue;
+    }
+    std::cout << "  wrong: " << query.what << " should be "
+              << (query.visible ? "visible" : "hidden") << std::endl;
+    wrong++;
+  }
+  std::cout << "Occlusion queries: " << rasterizer.TriangleCount()
+            << " triangles after clipping, "
+            << sizeof(queries) / sizeof(queries[0]) << " boxes, " << wrong
+            << " wrong" << std::endl;
+  return wrong;
+}
+
+double BenchmarkOcclusionRaster(int triangleCount, int frames,
+                                JobSystem* jobs) {
+  std::mt19937 rng(29);
+  std::vector<glm::vec3> positions;
+  std::vector<unsigned int> indices;
+  RandomTriangles(rng, triangleCount, positions, indices);
+
+  // each kernel alone, over the whole buffer
+  OcclusionRasterizer setup;
+  setup.Begin(glm::mat4(1.0f));
+  setup.AddOccluder(positions.data(), indices.data(), triangleCount,
+                    glm::mat4(1.0f), true);
+  std::vector<float> depth(W * OcclusionRasterizer::HEIGHT);
+  std::cout << "Occlusion raster: " << setup.TriangleCount()
+            << " triangles on screen";
+  for (const Kernels& k : AllKernels()) {
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int f = 0; f < frames; f++) {
+      std::fill(depth.begin(), depth.end(), 1.0f);
+      for (const Triangle& t : setup.Triangles()) {
+        k.raster(t, depth.data(), t.minX & ~7, t.minY, t.maxX + 1,
+                 t.maxY + 1);
+      }
+    }
+    double ms = MillisecondsSince(start);
+    std::cout << ", " << k.name << " "
+              << (ms > 0.0 ? setup.TriangleCount() * frames / ms / 1e3 : 0.0)
+              << " M tris/s";
+  }
+  std::cout << std::endl;
+
+  // the whole frame as the game runs it
+  OcclusionRasterizer rasterizer(jobs);
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int f = 0; f < frames; f++) {
+    rasterizer.Begin(glm::mat4(1.0f));
+    rasterizer.AddOccluder(positions.data(), indices.data(), triangleCount,
+                           glm::mat4(1.0f), true);
+    rasterizer.Rasterize();
+  }
+  double ms = MillisecondsSince(start);
+  double rate = ms > 0.0 ? triangleCount * frames / (ms / 1000.0) : 0.0;
+  std::cout << "  pipeline (" << OcclusionRasterizer::SimdName() << ") on "
+            << (jobs ? jobs->ThreadCount() + 1 : 1)
+            << " threads: " << rate / 1e6 << " M tris/s, " << ms / frames
+            << " ms per frame" << std::endl;
+  return rate;
+}
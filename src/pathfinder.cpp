@@ -0,0 +1,938 @@
+#include "pathfinder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <thread>
+#include <time.h>
+
+namespace {
+
+const uint32_t NODE_START = 0xfffffffe;
+const uint32_t NODE_GOAL = 0xffffffff;
+const float UNREACHED = std::numeric_limits<float>::max();
+
+// neighbour tile offsets by side, as in NAV_EXTERNAL
+const int SIDE_X[4] = {-1, 0, 1, 0};
+const int SIDE_Z[4] = {0, 1, 0, -1};
+
+ChunkCoord Across(ChunkCoord coord, int side) {
+  return {coord.x + SIDE_X[side], coord.z + SIDE_Z[side]};
+}
+
+uint64_t BorderKey(ChunkCoord owner, int side) {
+  return ((uint64_t)(uint32_t)owner.x << 34) |
+         ((uint64_t)(uint32_t)owner.z << 2) | (uint64_t)side;
+}
+
+double MicrosecondsSince(std::chrono::high_resolution_clock::time_point t) {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::high_resolution_clock::now() - t)
+      .count();
+}
+
+// this thread's CPU time, which leaves out the time it was switched out
+double ThreadMicroseconds() {
+  timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec * 1.0e6 + t.tv_nsec / 1.0e3;
+}
+
+bool Internal(uint16_t neighbor) {
+  return neighbor != NAV_NO_NEIGHBOR && !(neighbor & NAV_EXTERNAL);
+}
+
+void PolyCenters(const NavTile& tile, std::vector<glm::vec3>& centers) {
+  centers.resize(tile.polys.size());
+  for (size_t p = 0; p < tile.polys.size(); p++) {
+    centers[p] = tile.PolyCenter((int)p);
+  }
+}
+
+// min heap of (f, id) in a plain vector
+template <typename Id>
+void PushOpen(std::vector<std::pair<float, Id>>& open, float f, Id id) {
+  open.push_back({f, id});
+  std::push_heap(open.begin(), open.end(),
+                 std::greater<std::pair<float, Id>>());
+}
+
+template <typename Id>
+std::pair<float, Id> PopOpen(std::vector<std::pair<float, Id>>& open) {
+  std::pop_heap(open.begin(), open.end(), std::greater<std::pair<float, Id>>());
+  std::pair<float, Id> top = open.back();
+  open.pop_back();
+  return top;
+}
+
+// walking distance from one poly to every other poly of the tile, center to
+// center; UNREACHED where there's no way inside the tile
+void TileDistances(const NavTile& tile, const std::vector<glm::vec3>& centers,
+                   int from, std::vector<float>& distance) {
+  thread_local std::vector<std::pair<float, int>> open;
+  distance.assign(tile.polys.size(), UNREACHED);
+  open.clear();
+  distance[from] = 0.0f;
+  PushOpen(open, 0.0f, from);
+  while (!open.empty()) {
+    std::pair<float, int> top = PopOpen(open);
+    int p = top.second;
+    if (top.first > distance[p]) continue;
+    const NavPoly& poly = tile.polys[p];
+    for (int e = 0; e < poly.vertCount; e++) {
+      if (!Internal(poly.neighbors[e])) continue;
+      int n = poly.neighbors[e];
+      float d = distance[p] + glm::length(centers[n] - centers[p]);
+      if (d < distance[n]) {
+        distance[n] = d;
+        PushOpen(open, d, n);
+      }
+    }
+  }
+}
+
+// A* between two polys of one tile, without leaving it
+bool TilePath(const NavTile& tile, const std::vector<glm::vec3>& centers,
+              int from, int to, std::vector<int>& polys) {
+  thread_local std::vector<std::pair<float, int>> open;
+  thread_local std::vector<float> cost;
+  thread_local std::vector<int> parent;
+  polys.clear();
+  cost.assign(tile.polys.size(), UNREACHED);
+  parent.assign(tile.polys.size(), -1);
+  open.clear();
+  cost[from] = 0.0f;
+  PushOpen(open, glm::length(centers[to] - centers[from]), from);
+  while (!open.empty()) {
+    std::pair<float, int> top = PopOpen(open);
+    int p = top.second;
+    if (p == to) break;
+    if (top.first > cost[p] + glm::length(centers[to] - centers[p]) + 1e-3f) {
+      continue;  // stale entry
+    }
+    const NavPoly& poly = tile.polys[p];
+    for (int e = 0; e < poly.vertCount; e++) {
+      if (!Internal(poly.neighbors[e])) continue;
+      int n = poly.neighbors[e];
+      float c = cost[p] + glm::length(centers[n] - centers[p]);
+      if (c < cost[n]) {
+        cost[n] = c;
+        parent[n] = p;
+        PushOpen(open, c + glm::length(centers[to] - centers[n]), n);
+      }
+    }
+  }
+  if (cost[to] == UNREACHED) return false;
+  for (int p = to; p != -1; p = parent[p]) polys.push_back(p);
+  std::reverse(polys.begin(), polys.end());
+  return true;
+}
+
+// The edge between two neighbouring polys as left/right seen walking from
+// `from` into `to`. Polys are counter-clockwise, so that's the edge's start
+// and end; across tiles only the linked part of the edge counts.
+bool Portal(const NavMesh& mesh, const NavPolyRef& from, const NavPolyRef& to,
+            glm::vec3& left, glm::vec3& right) {
+  const NavTile* tile = mesh.GetTile(from.tile);
+  if (!tile) return false;
+  const NavPoly& poly = tile->polys[from.poly];
+  if (from.tile == to.tile) {
+    for (int e = 0; e < poly.vertCount; e++) {
+      if (poly.neighbors[e] != to.poly) continue;
+      left = tile->vertices[poly.verts[e]];
+      right = tile->vertices[poly.verts[(e + 1) % poly.vertCount]];
+      return true;
+    }
+    return false;
+  }
+  for (uint32_t k = tile->linkStart[from.poly];
+       k < tile->linkStart[from.poly + 1]; k++) {
+    const NavLink& link = tile->links[k];
+    if (link.target != to.poly || !(Across(from.tile, link.side) == to.tile)) {
+      continue;
+    }
+    const glm::vec3& a = tile->vertices[poly.verts[link.edge]];
+    const glm::vec3& b =
+        tile->vertices[poly.verts[(link.edge + 1) % poly.vertCount]];
+    left = a + (b - a) * link.tmin;
+    right = a + (b - a) * link.tmax;
+    return true;
+  }
+  return false;
+}
+
+// twice the signed area of a, b, c on x/z, as the navmesh uses it
+float Area2(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+  return (c.x - a.x) * (b.z - a.z) - (b.x - a.x) * (c.z - a.z);
+}
+
+bool SameSpot(const glm::vec3& a, const glm::vec3& b) {
+  glm::vec3 d = b - a;
+  return d.x * d.x + d.z * d.z < 1.0e-6f;
+}
+
+}  // namespace
+
+HierarchicalPathfinder::HierarchicalPathfinder(const NavMesh& navMesh)
+    : navMesh(navMesh) {}
+
+void HierarchicalPathfinder::TileChanged(ChunkCoord coord) {
+  for (int side = 0; side < 4; side++) {
+    if (side == 1 || side == 2) {
+      ClearBorder(coord, side);
+    } else {
+      ClearBorder(Across(coord, side), (side + 2) & 3);
+    }
+  }
+  // edges inside the five tiles may still lead to the nodes just dropped
+  for (int side = -1; side < 4; side++) {
+    auto it = tileNodes.find(side < 0 ? coord : Across(coord, side));
+    if (it == tileNodes.end()) continue;
+    for (uint32_t id : it->second) {
+      std::vector<Edge>& edges = nodes[id].edges;
+      size_t before = edges.size();
+      edges.erase(std::remove_if(edges.begin(), edges.end(),
+                                 [this](const Edge& e) {
+                                   return !nodes[e.to].alive;
+                                 }),
+                  edges.end());
+      edgeCount -= (int)(before - edges.size());
+    }
+  }
+  polyCenters.erase(coord);
+  version++;
+  // a rebuild half way may count on nodes that are gone: start it over
+  rebuildStage = 0;
+  rebuildNode = 0;
+  if (dirtySet.insert(coord).second) dirty.push_back(coord);
+}
+
+const std::vector<glm::vec3>& HierarchicalPathfinder::Centers(
+    ChunkCoord coord) {
+  auto it = polyCenters.find(coord);
+  if (it != polyCenters.end()) return it->second;
+  std::vector<glm::vec3>& list = polyCenters[coord];
+  PolyCenters(*navMesh.GetTile(coord), list);
+  return list;
+}
+
+uint32_t HierarchicalPathfinder::NewNode(ChunkCoord tile, int poly,
+                                         const glm::vec3& position) {
+  uint32_t id;
+  if (!freeNodes.empty()) {
+    id = freeNodes.back();
+    freeNodes.pop_back();
+  } else {
+    id = (uint32_t)nodes.size();
+    nodes.emplace_back();
+  }
+  Node& node = nodes[id];
+  node.tile = tile;
+  node.poly = poly;
+  node.position = position;
+  node.edges.clear();
+  node.alive = true;
+  tileNodes[tile].push_back(id);
+  return id;
+}
+
+void HierarchicalPathfinder::FreeNode(uint32_t id) {
+  Node& node = nodes[id];
+  edgeCount -= (int)node.edges.size();
+  node.edges.clear();
+  node.alive = false;
+  auto it = tileNodes.find(node.tile);
+  if (it != tileNodes.end()) {
+    std::vector<uint32_t>& list = it->second;
+    list.erase(std::find(list.begin(), list.end(), id));
+    if (list.empty()) tileNodes.erase(it);
+  }
+  freeNodes.push_back(id);
+}
+
+// The tile's four borders get new entrances, which changes the node sets of
+// the tile and its neighbours, so all five redo their inside distances.
+bool HierarchicalPathfinder::RebuildStep() {
+  ChunkCoord coord = dirty.front();
+  if (rebuildStage < 4) {
+    int side = rebuildStage++;
+    if (side == 1 || side == 2) {
+      RebuildBorder(coord, side);
+    } else {
+      RebuildBorder(Across(coord, side), (side + 2) & 3);
+    }
+    return true;
+  }
+  ChunkCoord tile =
+      rebuildStage == 4 ? coord : Across(coord, rebuildStage - 5);
+  if (RebuildIntraEdges(tile, rebuildNode)) {
+    rebuildNode++;
+    return true;
+  }
+  rebuildNode = 0;
+  if (++rebuildStage < 9) return true;
+  rebuildStage = 0;
+  dirty.pop_front();
+  dirtySet.erase(coord);
+  version++;
+  return false;
+}
+
+void HierarchicalPathfinder::ClearBorder(ChunkCoord owner, int side) {
+  auto it = borderNodes.find(BorderKey(owner, side));
+  if (it == borderNodes.end()) return;
+  for (uint32_t id : it->second) FreeNode(id);
+  borderNodes.erase(it);
+}
+
+void HierarchicalPathfinder::RebuildBorder(ChunkCoord owner, int side) {
+  ClearBorder(owner, side);
+  uint64_t key = BorderKey(owner, side);
+  ChunkCoord other = Across(owner, side);
+  const NavTile* tile = navMesh.GetTile(owner);
+  if (!tile || !navMesh.GetTile(other)) return;
+
+  // the linked parts of the border edges, ordered along the border
+  struct Piece {
+    float lo, hi;
+    glm::vec3 a, b;  // the linked part of the edge
+    const NavLink* link;
+  };
+  int axis = side == 2 ? 2 : 0;
+  std::vector<Piece> pieces;
+  for (size_t p = 0; p < tile->polys.size(); p++) {
+    const NavPoly& poly = tile->polys[p];
+    for (uint32_t k = tile->linkStart[p]; k < tile->linkStart[p + 1]; k++) {
+      const NavLink& link = tile->links[k];
+      if (link.side != side) continue;
+      const glm::vec3& a = tile->vertices[poly.verts[link.edge]];
+      const glm::vec3& b =
+          tile->vertices[poly.verts[(link.edge + 1) % poly.vertCount]];
+      Piece piece;
+      piece.a = a + (b - a) * link.tmin;
+      piece.b = a + (b - a) * link.tmax;
+      piece.lo = std::min(piece.a[axis], piece.b[axis]);
+      piece.hi = std::max(piece.a[axis], piece.b[axis]);
+      piece.link = &link;
+      pieces.push_back(piece);
+    }
+  }
+  std::sort(pieces.begin(), pieces.end(),
+            [](const Piece& x, const Piece& y) { return x.lo < y.lo; });
+
+  // touching pieces make one entrance, wide ones get a transition every
+  // maxEntranceWidth
+  std::vector<uint32_t>& created = borderNodes[key];
+  for (size_t first = 0; first < pieces.size();) {
+    size_t last = first + 1;
+    float hi = pieces[first].hi;
+    while (last < pieces.size() && pieces[last].lo <= hi + 0.01f) {
+      hi = std::max(hi, pieces[last].hi);
+      last++;
+    }
+    float lo = pieces[first].lo;
+    int count = std::max(1, (int)std::ceil((hi - lo) / maxEntranceWidth));
+    for (int k = 0; k < count; k++) {
+      float at = lo + (hi - lo) * (k + 0.5f) / count;
+      // the piece containing that spot, or the nearest
+      size_t best = first;
+      float bestGap = UNREACHED;
+      for (size_t i = first; i < last; i++) {
+        float gap =
+            std::max(0.0f, std::max(pieces[i].lo - at, at - pieces[i].hi));
+        if (gap < bestGap) {
+          bestGap = gap;
+          best = i;
+        }
+      }
+      const Piece& piece = pieces[best];
+      float length = piece.b[axis] - piece.a[axis];
+      float t = std::fabs(length) > 1.0e-4f
+                    ? glm::clamp((at - piece.a[axis]) / length, 0.0f, 1.0f)
+                    : 0.5f;
+      glm::vec3 position = piece.a + (piece.b - piece.a) * t;
+      uint32_t a = NewNode(owner, piece.link->poly, position);
+      uint32_t b = NewNode(other, piece.link->target, position);
+      nodes[a].edges.push_back({b, 0.0f, true});
+      nodes[b].edges.push_back({a, 0.0f, true});
+      edgeCount += 2;
+      created.push_back(a);
+      created.push_back(b);
+    }
+    first = last;
+  }
+  if (created.empty()) borderNodes.erase(key);
+}
+
+// The inside edges of a tile, one node a step: the first drops the old
+// ones, then node `index` is joined to the nodes after it. False once the
+// last node is done.
+bool HierarchicalPathfinder::RebuildIntraEdges(ChunkCoord coord,
+                                               size_t index) {
+  auto it = tileNodes.find(coord);
+  if (it == tileNodes.end()) return false;
+  const std::vector<uint32_t>& list = it->second;
+  if (index == 0) {
+    for (uint32_t id : list) {
+      std::vector<Edge>& edges = nodes[id].edges;
+      size_t before = edges.size();
+      edges.erase(std::remove_if(edges.begin(), edges.end(),
+                                 [](const Edge& e) { return !e.inter; }),
+                  edges.end());
+      edgeCount -= (int)(before - edges.size());
+    }
+  }
+  const NavTile* tile = navMesh.GetTile(coord);
+  if (!tile || index >= list.size()) return false;
+
+  const std::vector<glm::vec3>& centers = Centers(coord);
+  Node& from = nodes[list[index]];
+  TileDistances(*tile, centers, from.poly, distance);
+  for (size_t j = index + 1; j < list.size(); j++) {
+    Node& to = nodes[list[j]];
+    if (distance[to.poly] == UNREACHED) continue;
+    float cost = glm::length(centers[from.poly] - from.position) +
+                 distance[to.poly] +
+                 glm::length(to.position - centers[to.poly]);
+    from.edges.push_back({list[j], cost, false});
+    to.edges.push_back({list[index], cost, false});
+    edgeCount += 2;
+  }
+  return index + 1 < list.size();
+}
+
+uint32_t HierarchicalPathfinder::Request(const glm::vec3& start,
+                                         const glm::vec3& goal) {
+  uint32_t handle;
+  if (!freeQueries.empty()) {
+    handle = freeQueries.back();
+    freeQueries.pop_back();
+  } else {
+    handle = (uint32_t)queries.size();
+    queries.emplace_back();
+  }
+  Query& query = queries[handle];
+  query.used = true;
+  query.start = start;
+  query.goal = goal;
+  Reset(query);
+  query.path.clear();
+  pending.push_back(handle);
+  return handle;
+}
+
+void HierarchicalPathfinder::Release(uint32_t handle) {
+  if (handle >= queries.size() || !queries[handle].used) return;
+  queries[handle].used = false;
+  freeQueries.push_back(handle);
+  // still queued searches are skipped when they come up
+}
+
+PathStatus HierarchicalPathfinder::Status(uint32_t handle) const {
+  return queries[handle].status;
+}
+
+const std::vector<glm::vec3>& HierarchicalPathfinder::Path(
+    uint32_t handle) const {
+  return queries[handle].path;
+}
+
+void HierarchicalPathfinder::Update(double budgetUs) {
+  auto start = std::chrono::high_resolution_clock::now();
+  bool stepped = false;
+  auto fits = [&](int kind) {
+    if (!stepped) return budgetUs > 0.0;
+    // a kind not seen yet only runs first thing in a frame
+    return stepUs[kind] > 0.0 &&
+           MicrosecondsSince(start) + stepUs[kind] < 0.9 * budgetUs;
+  };
+  auto timed = [&](int kind, auto step) {
+    auto stepStart = std::chrono::high_resolution_clock::now();
+    bool more = step();
+    double us = MicrosecondsSince(stepStart);
+    worstStepUs = std::max(worstStepUs, us);
+    stepUs[kind] = std::max(us, stepUs[kind] * 0.99);
+    stepped = true;
+    return more;
+  };
+
+  while (!dirty.empty() && fits(0)) {
+    timed(0, [this]() { return RebuildStep(); });
+  }
+
+  while (dirty.empty() && !pending.empty()) {
+    uint32_t handle = pending.front();
+    Query& query = queries[handle];
+    if (!query.used || query.status != PATH_PENDING) {
+      pending.pop_front();
+      continue;
+    }
+    // one the graph changed under starts over with Locate
+    int kind = 1 + (query.version == version ? query.stage : QUERY_LOCATE);
+    if (!fits(kind)) break;
+    if (!timed(kind, [&]() { return Step(query); })) pending.pop_front();
+  }
+  lastUpdateUs = MicrosecondsSince(start);
+}
+
+PathStatus HierarchicalPathfinder::FindPath(const glm::vec3& start,
+                                            const glm::vec3& goal,
+                                            std::vector<glm::vec3>& path) {
+  Query query;
+  query.start = start;
+  query.goal = goal;
+  Reset(query);
+  while (Step(query)) {
+  }
+  path.swap(query.path);
+  return query.status;
+}
+
+void HierarchicalPathfinder::Reset(Query& query) {
+  query.status = PATH_PENDING;
+  query.stage = QUERY_LOCATE;
+  query.startEdges.clear();
+  query.goalEdges.clear();
+  query.open.clear();
+  query.cost.clear();
+  query.parent.clear();
+  query.route.clear();
+  query.hop = 0;
+  query.corridor.clear();
+}
+
+bool HierarchicalPathfinder::Step(Query& query) {
+  // the graph changed under a search: node ids may mean something else now
+  if (query.stage != QUERY_LOCATE && query.version != version) {
+    Reset(query);
+  }
+  switch (query.stage) {
+    case QUERY_LOCATE:
+      return Locate(query);
+    case QUERY_LINK_START:
+    case QUERY_LINK_GOAL:
+      return Link(query);
+    case QUERY_ABSTRACT:
+      return Expand(query);
+    case QUERY_REFINE:
+      return Refine(query);
+    case QUERY_PULL:
+      StringPull(query);
+      return false;
+    default:
+      return false;
+  }
+}
+
+bool HierarchicalPathfinder::Locate(Query& query) {
+  query.version = version;
+  if (!navMesh.FindPoly(query.start, query.startRef) ||
+      !navMesh.FindPoly(query.goal, query.goalRef)) {
+    query.status = PATH_NOT_FOUND;
+    query.stage = QUERY_DONE;
+    return false;
+  }
+
+  // same tile: a plain search inside it, unless the way leaves the tile
+  std::vector<int> polys;
+  const NavTile* startTile = navMesh.GetTile(query.startRef.tile);
+  const std::vector<glm::vec3>& startCenters = Centers(query.startRef.tile);
+  if (query.startRef.tile == query.goalRef.tile &&
+      TilePath(*startTile, startCenters, query.startRef.poly,
+               query.goalRef.poly, polys)) {
+    for (int p : polys) query.corridor.push_back({query.startRef.tile, p});
+    query.stage = QUERY_PULL;
+    return true;
+  }
+  query.stage = QUERY_LINK_START;
+  return true;
+}
+
+// the start, then the goal join the graph through their tile's nodes
+bool HierarchicalPathfinder::Link(Query& query) {
+  bool start = query.stage == QUERY_LINK_START;
+  const NavPolyRef& ref = start ? query.startRef : query.goalRef;
+  const glm::vec3& point = start ? query.start : query.goal;
+  const NavTile* tile = navMesh.GetTile(ref.tile);
+  if (!tile) {
+    query.status = PATH_NOT_FOUND;
+    query.stage = QUERY_DONE;
+    return false;
+  }
+  const std::vector<glm::vec3>& centers = Centers(ref.tile);
+  TileDistances(*tile, centers, ref.poly, distance);
+  auto nodesIn = tileNodes.find(ref.tile);
+  if (nodesIn != tileNodes.end()) {
+    for (uint32_t id : nodesIn->second) {
+      const Node& node = nodes[id];
+      if (distance[node.poly] == UNREACHED) continue;
+      float cost = glm::length(centers[ref.poly] - point) +
+                   distance[node.poly] +
+                   glm::length(node.position - centers[node.poly]);
+      if (start) {
+        query.startEdges.push_back({id, cost});
+      } else {
+        query.goalEdges[id] = cost;
+      }
+    }
+  }
+  if (start) {
+    query.stage = QUERY_LINK_GOAL;
+    return true;
+  }
+
+  // sized for the whole graph here, so no Expand step stalls on a rehash
+  query.cost.reserve(nodes.size() + 2);
+  query.parent.reserve(nodes.size() + 2);
+  query.open.reserve(edgeCount + query.startEdges.size() + 1);
+  query.cost[NODE_START] = 0.0f;
+  PushOpen(query.open, glm::length(query.goal - query.start), NODE_START);
+  query.stage = QUERY_ABSTRACT;
+  return true;
+}
+
+// one node of the abstract A*
+bool HierarchicalPathfinder::Expand(Query& query) {
+  if (query.open.empty()) {
+    query.status = PATH_NOT_FOUND;
+    query.stage = QUERY_DONE;
+    return false;
+  }
+  auto position = [&](uint32_t id) {
+    if (id == NODE_START) return query.start;
+    if (id == NODE_GOAL) return query.goal;
+    return nodes[id].position;
+  };
+  std::pair<float, uint32_t> top = PopOpen(query.open);
+  uint32_t id = top.second;
+  float cost = query.cost[id];
+  if (top.first > cost + glm::length(query.goal - position(id)) + 1e-3f) {
+    return true;  // stale entry
+  }
+
+  if (id == NODE_GOAL) {
+    for (uint32_t at = NODE_GOAL; at != NODE_START; at = query.parent[at]) {
+      query.route.push_back(at);
+    }
+    query.route.push_back(NODE_START);
+    std::reverse(query.route.begin(), query.route.end());
+    query.corridor.push_back(query.startRef);
+    query.hop = 0;
+    query.stage = QUERY_REFINE;
+    return true;
+  }
+
+  auto relax = [&](uint32_t to, float step) {
+    float c = cost + step;
+    auto known = query.cost.find(to);
+    if (known != query.cost.end() && known->second <= c) return;
+    query.cost[to] = c;
+    query.parent[to] = id;
+    PushOpen(query.open, c + glm::length(query.goal - position(to)), to);
+  };
+  if (id == NODE_START) {
+    for (const auto& edge : query.startEdges) relax(edge.first, edge.second);
+  } else {
+    for (const Edge& edge : nodes[id].edges) relax(edge.to, edge.cost);
+    auto toGoal = query.goalEdges.find(id);
+    if (toGoal != query.goalEdges.end()) relax(NODE_GOAL, toGoal->second);
+  }
+  return true;
+}
+
+// one tile of the abstract route into polys: hops across a border are
+// just the linked poly, a hop inside a tile a search through it
+bool HierarchicalPathfinder::Refine(Query& query) {
+  while (query.hop + 1 < query.route.size()) {
+    uint32_t from = query.route[query.hop];
+    uint32_t to = query.route[query.hop + 1];
+    NavPolyRef a = from == NODE_START
+                       ? query.startRef
+                       : NavPolyRef{nodes[from].tile, nodes[from].poly};
+    NavPolyRef b = to == NODE_GOAL
+                       ? query.goalRef
+                       : NavPolyRef{nodes[to].tile, nodes[to].poly};
+    query.hop++;
+    if (!(a.tile == b.tile)) {
+      query.corridor.push_back(b);
+      continue;
+    }
+    const NavTile* tile = navMesh.GetTile(a.tile);
+    std::vector<int> polys;
+    if (!TilePath(*tile, Centers(a.tile), a.poly, b.poly, polys)) {
+      query.status = PATH_NOT_FOUND;
+      query.stage = QUERY_DONE;
+      return false;
+    }
+    for (int p : polys) {
+      const NavPolyRef& last = query.corridor.back();
+      if (last.tile == a.tile && last.poly == p) continue;
+      query.corridor.push_back({a.tile, p});
+    }
+    break;
+  }
+  if (query.hop + 1 >= query.route.size()) query.stage = QUERY_PULL;
+  return true;
+}
+
+// Straight waypoints through the corridor's portals with the simple stupid
+// funnel: keep the funnel from the last corner as narrow as the portals
+// allow, and when a side would cross the other its tip becomes a corner.
+void HierarchicalPathfinder::StringPull(Query& query) {
+  std::vector<glm::vec3> lefts, rights;
+  lefts.push_back(query.start);
+  rights.push_back(query.start);
+  for (size_t i = 0; i + 1 < query.corridor.size(); i++) {
+    glm::vec3 left, right;
+    if (!Portal(navMesh, query.corridor[i], query.corridor[i + 1], left,
+                right)) {
+      query.status = PATH_NOT_FOUND;
+      query.stage = QUERY_DONE;
+      return;
+    }
+    lefts.push_back(left);
+    rights.push_back(right);
+  }
+  lefts.push_back(query.goal);
+  rights.push_back(query.goal);
+
+  std::vector<glm::vec3>& path = query.path;
+  path.clear();
+  path.push_back(query.start);
+  glm::vec3 apex = query.start, left = query.start, right = query.start;
+  size_t apexIndex = 0, leftIndex = 0, rightIndex = 0;
+  for (size_t i = 1; i < lefts.size(); i++) {
+    const glm::vec3& l = lefts[i];
+    const glm::vec3& r = rights[i];
+    if (Area2(apex, right, r) <= 0.0f) {
+      if (SameSpot(apex, right) || Area2(apex, left, r) > 0.0f) {
+        right = r;
+        rightIndex = i;
+      } else {
+        // the right side crossed the left: its tip is a corner
+        apex = left;
+        apexIndex = leftIndex;
+        path.push_back(apex);
+        left = right = apex;
+        leftIndex = rightIndex = apexIndex;
+        i = apexIndex;
+        continue;
+      }
+    }
+    if (Area2(apex, left, l) >= 0.0f) {
+      if (SameSpot(apex, left) || Area2(apex, right, l) < 0.0f) {
+        left = l;
+        leftIndex = i;
+      } else {
+        apex = right;
+        apexIndex = rightIndex;
+        path.push_back(apex);
+        left = right = apex;
+        leftIndex = rightIndex = apexIndex;
+        i = apexIndex;
+        continue;
+      }
+    }
+  }
+  if (!SameSpot(path.back(), query.goal)) path.push_back(query.goal);
+  query.status = PATH_FOUND;
+  query.stage = QUERY_DONE;
+}
+
+double BenchmarkPathfinding(int tiles, int queries, JobSystem& jobs) {
+  NavMeshSettings settings;
+  CollisionWorld world;
+  MakeBenchmarkForest(tiles * settings.tileSize, world);
+  std::mt19937 rng(41);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+  auto start = std::chrono::high_resolution_clock::now();
+  NavMesh mesh(settings, jobs, "");
+  mesh.collision = &world;
+  mesh.maxInFlight = (int)jobs.ThreadCount() + 1;
+  HierarchicalPathfinder pathfinder(mesh);
+  mesh.onTileChanged = [&](ChunkCoord coord) {
+    pathfinder.TileChanged(coord);
+  };
+  for (int z = 0; z < tiles; z++) {
+    for (int x = 0; x < tiles; x++) mesh.RequestTile({x, z});
+  }
+  while (mesh.Queued() || mesh.Building()) {
+    mesh.Update();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  double buildMs = MicrosecondsSince(start) / 1000.0;
+  start = std::chrono::high_resolution_clock::now();
+  pathfinder.Update(1.0e12);
+  double graphMs = MicrosecondsSince(start) / 1000.0;
+
+  // endpoints on random polys anywhere in the forest
+  std::vector<const NavTile*> tileList;
+  for (const auto& entry : mesh.Tiles()) {
+    if (!entry.second->polys.empty()) tileList.push_back(entry.second.get());
+  }
+  if (tileList.empty()) return 0.0;
+  auto randomPoint = [&]() {
+    const NavTile* tile = tileList[(size_t)(unit(rng) * tileList.size()) %
+                                   tileList.size()];
+    int poly = (int)(unit(rng) * tile->polys.size()) % tile->polys.size();
+    return tile->PolyCenter(poly);
+  };
+  std::vector<std::pair<glm::vec3, glm::vec3>> pairs(queries);
+  for (auto& pair : pairs) pair = {randomPoint(), randomPoint()};
+
+  // HPA*
+  std::vector<glm::vec3> path;
+  double hpaTotal = 0.0, hpaWorst = 0.0;
+  int found = 0;
+  for (const auto& pair : pairs) {
+    auto t = std::chrono::high_resolution_clock::now();
+    if (pathfinder.FindPath(pair.first, pair.second, path) == PATH_FOUND) {
+      found++;
+    }
+    double us = MicrosecondsSince(t);
+    hpaTotal += us;
+    hpaWorst = std::max(hpaWorst, us);
+  }
+
+  // plain A* over every poly of the mesh, for comparison
+  std::unordered_map<ChunkCoord, std::vector<glm::vec3>, ChunkCoordHash>
+      centers;
+  for (const auto& entry : mesh.Tiles()) {
+    PolyCenters(*entry.second, centers[entry.first]);
+  }
+  auto polyKey = [](const NavPolyRef& ref) {
+    return ((uint64_t)(uint32_t)ref.tile.x << 40) ^
+           ((uint64_t)(uint32_t)ref.tile.z << 16) ^ (uint64_t)ref.poly;
+  };
+  double plainTotal = 0.0, plainWorst = 0.0;
+  int plainFound = 0;
+  for (const auto& pair : pairs) {
+    auto t = std::chrono::high_resolution_clock::now();
+    NavPolyRef from, to;
+    if (mesh.FindPoly(pair.first, from) && mesh.FindPoly(pair.second, to)) {
+      glm::vec3 goal = centers[to.tile][to.poly];
+      std::vector<std::pair<float, uint64_t>> open;
+      std::unordered_map<uint64_t, NavPolyRef> refs;
+      std::unordered_map<uint64_t, float> cost;
+      uint64_t goalKey = polyKey(to);
+      refs[polyKey(from)] = from;
+      cost[polyKey(from)] = 0.0f;
+      PushOpen(open, 0.0f, polyKey(from));
+      while (!open.empty()) {
+        std::pair<float, uint64_t> top = PopOpen(open);
+        if (top.second == goalKey) {
+          plainFound++;
+          break;
+        }
+        NavPolyRef ref = refs[top.second];
+        glm::vec3 here = centers[ref.tile][ref.poly];
+        float c = cost[top.second];
+        if (top.first > c + glm::length(goal - here) + 1e-3f) continue;
+        auto relax = [&](const NavPolyRef& next) {
+          uint64_t key = polyKey(next);
+          glm::vec3 there = centers[next.tile][next.poly];
+          float nc = c + glm::length(there - here);
+          auto known = cost.find(key);
+          if (known != cost.end() && known->second <= nc) return;
+          cost[key] = nc;
+          refs[key] = next;
+          PushOpen(open, nc + glm::length(goal - there), key);
+        };
+        const NavTile& tile = *mesh.GetTile(ref.tile);
+        const NavPoly& poly = tile.polys[ref.poly];
+        for (int e = 0; e < poly.vertCount; e++) {
+          if (Internal(poly.neighbors[e])) {
+            relax({ref.tile, poly.neighbors[e]});
+          }
+        }
+        for (uint32_t k = tile.linkStart[ref.poly];
+             k < tile.linkStart[ref.poly + 1]; k++) {
+          relax({Across(ref.tile, tile.links[k].side), tile.links[k].target});
+        }
+      }
+    }
+    double us = MicrosecondsSince(t);
+    plainTotal += us;
+    plainWorst = std::max(plainWorst, us);
+  }
+
+  // the same searches time sliced at 500 us a frame, on a graph built
+  // again in slices, with a few tiles changing half way. The budget is wall
+  // time, but whether it's kept is judged on the smaller of that and the
+  // CPU time, and a run over budget gets two more tries, or the odd frame
+  // the OS took the thread away in would count.
+  const double budgetUs = 500.0;
+  int frames = 0, slicedFound = 0, runs = 0;
+  double worstFrameUs = 0.0, worstCpuUs = 0.0;
+  auto sliced = [&]() {
+    for (const auto& entry : mesh.Tiles()) {
+      pathfinder.TileChanged(entry.first);
+    }
+    std::vector<uint32_t> handles;
+    for (const auto& pair : pairs) {
+      handles.push_back(pathfinder.Request(pair.first, pair.second));
+    }
+    frames = 0;
+    worstFrameUs = worstCpuUs = 0.0;
+    bool changed = false;
+    while (pathfinder.Pending() || pathfinder.DirtyTiles()) {
+      double cpu = ThreadMicroseconds();
+      pathfinder.Update(budgetUs);
+      cpu = ThreadMicroseconds() - cpu;
+      double us = pathfinder.LastUpdateUs();
+      worstFrameUs = std::max(worstFrameUs, us);
+      worstCpuUs = std::max(worstCpuUs, std::min(us, cpu));
+      frames++;
+      if (!changed && pathfinder.Pending() < queries / 2) {
+        for (int i = 0; i < 3; i++) {
+          pathfinder.TileChanged({(i * 2 + 1) % tiles, (i * 3 + 1) % tiles});
+        }
+        changed = true;
+      }
+    }
+    slicedFound = 0;
+    for (uint32_t handle : handles) {
+      if (pathfinder.Status(handle) == PATH_FOUND) slicedFound++;
+      pathfinder.Release(handle);
+    }
+  };
+  do {
+    sliced();
+    runs++;
+  } while (worstCpuUs > budgetUs && runs < 3);
+
+  int count = std::max(queries, 1);
+  double rate = hpaTotal > 0.0 ? count / (hpaTotal / 1.0e6) : 0.0;
+  std::cout << "Pathfinding: " << tiles << "x" << tiles << " tiles, "
+            << mesh.PolyCount() << " polys, " << pathfinder.NodeCount()
+            << " nodes, " << pathfinder.EdgeCount() << " edges (mesh "
+            << buildMs << " ms, graph " << graphMs << " ms)" << std::endl;
+  std::cout << "  HPA*: " << found << "/" << queries << " found, " << rate
+            << " queries/s, avg " << hpaTotal / count << " us, worst "
+            << hpaWorst << " us" << std::endl;
+  std::cout << "  A*: " << plainFound << "/" << queries << " found, "
+            << (plainTotal > 0.0 ? count / (plainTotal / 1.0e6) : 0.0)
+            << " queries/s, avg " << plainTotal / count << " us, worst "
+            << plainWorst << " us" << std::endl;
+  std::cout << "  sliced at " << budgetUs << " us: " << slicedFound << "/"
+            << queries << " found, " << frames << " frames, worst frame "
+            << worstFrameUs << " us (" << worstCpuUs << " us on the CPU), "
+            << "worst step " << pathfinder.WorstStepUs() << " us, " << runs
+            << (runs == 1 ? " run" : " runs") << std::endl;
+  if (slicedFound != found) {
+    std::cout << "  wrong: " << slicedFound << " found sliced, " << found
+              << " at once" << std::endl;
+    return 0.0;
+  }
+  if (worstCpuUs > budgetUs) {
+    std::cout << "  wrong: a frame took " << worstCpuUs << " us of "
+              << budgetUs << std::endl;
+    return 0.0;
+  }
+  return rate;
+}
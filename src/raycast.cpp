@@ -0,0 +1,665 @@
+#include "raycast.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <thread>
+
+#include "navmesh.hpp"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#define RAYCAST_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define RAYCAST_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+const int LEAF_SHAPES = 4;
+const int SAH_BINS = 16;
+const int STACK_DEPTH = 64;
+
+double MillisecondsSince(std::chrono::high_resolution_clock::time_point t) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::high_resolution_clock::now() - t)
+      .count();
+}
+
+float Area(const glm::vec3& min, const glm::vec3& max) {
+  glm::vec3 e = glm::max(max - min, glm::vec3(0.0f));
+  return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+// 1 / d, with zero components nudged so the slab test never sees 0 * inf
+float Inverse(float d) {
+  if (std::fabs(d) < 1e-12f) d = d < 0.0f ? -1e-12f : 1e-12f;
+  return 1.0f / d;
+}
+
+// first distance along the ray in [0, maxT] where it meets the shape, or
+// a negative number; a ray starting inside a box hits it at 0
+float Intersect(const CollisionShape& shape, const glm::vec3& o,
+                const glm::vec3& d, float maxT) {
+  if (shape.type == COLLISION_BOX) {
+    glm::vec3 lo = glm::transpose(shape.rotation) * (o - shape.a);
+    glm::vec3 ld = glm::transpose(shape.rotation) * d;
+    float near = 0.0f, far = maxT;
+    for (int i = 0; i < 3; i++) {
+      float inv = Inverse(ld[i]);
+      float t0 = (-shape.b[i] - lo[i]) * inv;
+      float t1 = (shape.b[i] - lo[i]) * inv;
+      near = std::max(near, std::min(t0, t1));
+      far = std::min(far, std::max(t0, t1));
+      if (near > far) return -1.0f;
+    }
+    return near;
+  }
+  // capsule: the side of the cylinder, then the cap on the near end
+  glm::vec3 ba = shape.b - shape.a;
+  glm::vec3 oa = o - shape.a;
+  float baba = glm::dot(ba, ba);
+  float bard = glm::dot(ba, d);
+  float baoa = glm::dot(ba, oa);
+  float rdoa = glm::dot(d, oa);
+  float oaoa = glm::dot(oa, oa);
+  float r2 = shape.radius * shape.radius;
+  float a = baba - bard * bard;
+  float b = baba * rdoa - baoa * bard;
+  float c = baba * oaoa - baoa * baoa - r2 * baba;
+  float y = baoa;
+  if (a > 1e-8f) {
+    float h = b * b - a * c;
+    if (h < 0.0f) return -1.0f;
+    float t = (-b - std::sqrt(h)) / a;
+    y = baoa + t * bard;
+    if (y > 0.0f && y < baba) return t >= 0.0f && t <= maxT ? t : -1.0f;
+  }
+  glm::vec3 oc = y <= 0.0f ? oa : o - shape.b;
+  b = glm::dot(d, oc);
+  c = glm::dot(oc, oc) - r2;
+  float h = b * b - c;
+  if (h <= 0.0f) return -1.0f;
+  float t = -b - std::sqrt(h);
+  return t >= 0.0f && t <= maxT ? t : -1.0f;
+}
+
+}  // namespace
+
+// rays of a packet by component, lanes past the real rays are inactive
+struct RayBvh::Packet {
+  alignas(16) float ox[RAY_PACKET], oy[RAY_PACKET], oz[RAY_PACKET];
+  alignas(16) float ix[RAY_PACKET], iy[RAY_PACKET], iz[RAY_PACKET];
+  alignas(16) float tmax[RAY_PACKET];
+  const Ray* rays;
+  int count;
+};
+
+// lanes of the packet whose ray enters the node's box before its tmax
+static uint32_t HitNode(const RayBvh::Packet& p, const glm::vec3& min,
+                        const glm::vec3& max, uint32_t active);
+
+const char* RayBvh::SimdName() {
+#ifdef RAYCAST_X86
+  return "SSE2";
+#elif defined(RAYCAST_NEON)
+  return "NEON";
+#else
+  return "scalar";
+#endif
+}
+
+#ifdef RAYCAST_X86
+static uint32_t HitNode(const RayBvh::Packet& p, const glm::vec3& min,
+                        const glm::vec3& max, uint32_t active) {
+  const __m128 minX = _mm_set1_ps(min.x), maxX = _mm_set1_ps(max.x);
+  const __m128 minY = _mm_set1_ps(min.y), maxY = _mm_set1_ps(max.y);
+  const __m128 minZ = _mm_set1_ps(min.z), maxZ = _mm_set1_ps(max.z);
+  const __m128 zero = _mm_setzero_ps();
+  uint32_t mask = 0;
+  for (int half = 0; half < RAY_PACKET; half += 4) {
+    if (!((active >> half) & 0xf)) continue;
+    __m128 ox = _mm_load_ps(p.ox + half), ix = _mm_load_ps(p.ix + half);
+    __m128 t0 = _mm_mul_ps(_mm_sub_ps(minX, ox), ix);
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(maxX, ox), ix);
+    __m128 near = _mm_min_ps(t0, t1), far = _mm_max_ps(t0, t1);
+    __m128 oy = _mm_load_ps(p.oy + half), iy = _mm_load_ps(p.iy + half);
+    t0 = _mm_mul_ps(_mm_sub_ps(minY, oy), iy);
+    t1 = _mm_mul_ps(_mm_sub_ps(maxY, oy), iy);
+    near = _mm_max_ps(near, _mm_min_ps(t0, t1));
+    far = _mm_min_ps(far, _mm_max_ps(t0, t1));
+    __m128 oz = _mm_load_ps(p.oz + half), iz = _mm_load_ps(p.iz + half);
+    t0 = _mm_mul_ps(_mm_sub_ps(minZ, oz), iz);
+    t1 = _mm_mul_ps(_mm_sub_ps(maxZ, oz), iz);
+    near = _mm_max_ps(near, _mm_min_ps(t0, t1));
+    far = _mm_min_ps(far, _mm_max_ps(t0, t1));
+    // the box is somewhere in [0, tmax] along the ray
+    near = _mm_max_ps(near, zero);
+    far = _mm_min_ps(far, _mm_load_ps(p.tmax + half));
+    mask |= (uint32_t)_mm_movemask_ps(_mm_cmple_ps(near, far)) << half;
+  }
+  return mask & active;
+}
+#elif defined(RAYCAST_NEON)
+static uint32_t HitNode(const RayBvh::Packet& p, const glm::vec3& min,
+                        const glm::vec3& max, uint32_t active) {
+  static const uint32_t bits[4] = {1, 2, 4, 8};
+  const uint32x4_t laneBit = vld1q_u32(bits);
+  const float32x4_t minX = vdupq_n_f32(min.x), maxX = vdupq_n_f32(max.x);
+  const float32x4_t minY = vdupq_n_f32(min.y), maxY = vdupq_n_f32(max.y);
+  const float32x4_t minZ = vdupq_n_f32(min.z), maxZ = vdupq_n_f32(max.z);
+  const float32x4_t zero = vdupq_n_f32(0.0f);
+  uint32_t mask = 0;
+  for (int half = 0; half < RAY_PACKET; half += 4) {
+    if (!((active >> half) & 0xf)) continue;
+    float32x4_t ox = vld1q_f32(p.ox + half), ix = vld1q_f32(p.ix + half);
+    float32x4_t t0 = vmulq_f32(vsubq_f32(minX, ox), ix);
+    float32x4_t t1 = vmulq_f32(vsubq_f32(maxX, ox), ix);
+    float32x4_t near = vminq_f32(t0, t1), far = vmaxq_f32(t0, t1);
+    float32x4_t oy = vld1q_f32(p.oy + half), iy = vld1q_f32(p.iy + half);
+    t0 = vmulq_f32(vsubq_f32(minY, oy), iy);
+    t1 = vmulq_f32(vsubq_f32(maxY, oy), iy);
+    near = vmaxq_f32(near, vminq_f32(t0, t1));
+    far = vminq_f32(far, vmaxq_f32(t0, t1));
+    float32x4_t oz = vld1q_f32(p.oz + half), iz = vld1q_f32(p.iz + half);
+    t0 = vmulq_f32(vsubq_f32(minZ, oz), iz);
+    t1 = vmulq_f32(vsubq_f32(maxZ, oz), iz);
+    near = vmaxq_f32(near, vminq_f32(t0, t1));
+    far = vminq_f32(far, vmaxq_f32(t0, t1));
+    // the box is somewhere in [0, tmax] along the ray
+    near = vmaxq_f32(near, zero);
+    far = vminq_f32(far, vld1q_f32(p.tmax + half));
+    mask |= vaddvq_u32(vandq_u32(vcleq_f32(near, far), laneBit)) << half;
+  }
+  return mask & active;
+}
+#else
+static uint32_t HitNode(const RayBvh::Packet& p, const glm::vec3& min,
+                        const glm::vec3& max, uint32_t active) {
+  uint32_t mask = 0;
+  for (int i = 0; i < RAY_PACKET; i++) {
+    if (!(active & (1u << i))) continue;
+    float t0 = (min.x - p.ox[i]) * p.ix[i], t1 = (max.x - p.ox[i]) * p.ix[i];
+    float near = std::min(t0, t1), far = std::max(t0, t1);
+    t0 = (min.y - p.oy[i]) * p.iy[i];
+    t1 = (max.y - p.oy[i]) * p.iy[i];
+    near = std::max(near, std::min(t0, t1));
+    far = std::min(far, std::max(t0, t1));
+    t0 = (min.z - p.oz[i]) * p.iz[i];
+    t1 = (max.z - p.oz[i]) * p.iz[i];
+    near = std::max(near, std::min(t0, t1));
+    far = std::min(far, std::max(t0, t1));
+    if (std::max(near, 0.0f) <= std::min(far, p.tmax[i])) mask |= 1u << i;
+  }
+  return mask;
+}
+#endif
+
+void RayBvh::Build(const CollisionWorld& world) {
+  std::vector<CollisionShape> copies;
+  std::vector<uint32_t> copyIds;
+  for (size_t id = 0; id < world.SlotCount(); id++) {
+    if (world.Shape((uint32_t)id).type == COLLISION_NONE) continue;
+    copies.push_back(world.Shape((uint32_t)id));
+    copyIds.push_back((uint32_t)id);
+  }
+  Build(std::move(copies), std::move(copyIds), world.groundHeight);
+}
+
+void RayBvh::Build(std::vector<CollisionShape> input,
+                   std::vector<uint32_t> inputIds,
+                   std::function<float(float, float)> ground) {
+  auto start = std::chrono::high_resolution_clock::now();
+  groundHeight = std::move(ground);
+  nodes.clear();
+  shapes.clear();
+  ids.clear();
+  std::vector<uint32_t> order(input.size());
+  std::vector<glm::vec3> centers(input.size());
+  for (size_t i = 0; i < input.size(); i++) {
+    order[i] = (uint32_t)i;
+    centers[i] = (input[i].boundsMin + input[i].boundsMax) * 0.5f;
+  }
+  // the build orders `order` into leaf order, the shapes follow
+  shapes.swap(input);
+  if (!order.empty()) BuildNode(order, 0, (uint32_t)order.size(), centers);
+  std::vector<CollisionShape> sorted(order.size());
+  ids.resize(order.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    sorted[i] = shapes[order[i]];
+    ids[i] = inputIds[order[i]];
+  }
+  shapes.swap(sorted);
+  buildMs = MillisecondsSince(start);
+}
+
+uint32_t RayBvh::BuildNode(std::vector<uint32_t>& order, uint32_t begin,
+                           uint32_t end,
+                           const std::vector<glm::vec3>& centers) {
+  uint32_t index = (uint32_t)nodes.size();
+  nodes.push_back(Node());
+  glm::vec3 min(std::numeric_limits<float>::max());
+  glm::vec3 max(-std::numeric_limits<float>::max());
+  glm::vec3 centerMin = min, centerMax = max;
+  for (uint32_t i = begin; i < end; i++) {
+    min = glm::min(min, shapes[order[i]].boundsMin);
+    max = glm::max(max, shapes[order[i]].boundsMax);
+    centerMin = glm::min(centerMin, centers[order[i]]);
+    centerMax = glm::max(centerMax, centers[order[i]]);
+  }
+  nodes[index].min = min;
+  nodes[index].max = max;
+
+  // binned SAH over the centers' longest axis
+  uint32_t count = end - begin;
+  glm::vec3 extent = centerMax - centerMin;
+  int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2)
+                                 : (extent.y > extent.z ? 1 : 2);
+  int split = -1;
+  if (count > (uint32_t)LEAF_SHAPES && extent[axis] > 0.0f) {
+    struct Bin {
+      glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+      glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+      uint32_t count = 0;
+    } bins[SAH_BINS];
+    float scale = SAH_BINS / extent[axis];
+    for (uint32_t i = begin; i < end; i++) {
+      int b = std::min(SAH_BINS - 1,
+                       (int)((centers[order[i]][axis] - centerMin[axis]) *
+                             scale));
+      bins[b].min = glm::min(bins[b].min, shapes[order[i]].boundsMin);
+      bins[b].max = glm::max(bins[b].max, shapes[order[i]].boundsMax);
+      bins[b].count++;
+    }
+    // cost of each split from both ends, a leaf costs one test per shape
+    float rightCost[SAH_BINS] = {};
+    Bin right;
+    for (int b = SAH_BINS - 1; b > 0; b--) {
+      right.min = glm::min(right.min, bins[b].min);
+      right.max = glm::max(right.max, bins[b].max);
+      right.count += bins[b].count;
+      rightCost[b] = right.count ? Area(right.min, right.max) * right.count
+                                 : 0.0f;
+    }
+    float best = Area(min, max) * count;
+    Bin left;
+    for (int b = 0; b + 1 < SAH_BINS; b++) {
+      left.min = glm::min(left.min, bins[b].min);
+      left.max = glm::max(left.max, bins[b].max);
+      left.count += bins[b].count;
+      if (!left.count || left.count == count) continue;
+      float cost = Area(left.min, left.max) * left.count + rightCost[b + 1];
+      if (cost < best) {
+        best = cost;
+        split = b;
+      }
+    }
+    // a leaf can't hold too many, split in the middle instead
+    if (split < 0 && count > 4 * (uint32_t)LEAF_SHAPES) split = SAH_BINS / 2;
+    if (split >= 0) {
+      float at = centerMin[axis] + (split + 1) / scale;
+      uint32_t* mid = std::partition(
+          order.data() + begin, order.data() + end,
+          [&](uint32_t i) { return centers[i][axis] < at; });
+      uint32_t middle = (uint32_t)(mid - order.data());
+      if (middle == begin || middle == end) middle = begin + count / 2;
+      BuildNode(order, begin, middle, centers);
+      uint32_t second = BuildNode(order, middle, end, centers);
+      nodes[index].offset = second;
+      nodes[index].count = 0;
+      nodes[index].axis = (uint16_t)axis;
+      return index;
+    }
+  }
+  nodes[index].offset = begin;
+  nodes[index].count = (uint16_t)count;
+  nodes[index].axis = 0;
+  return index;
+}
+
+void RayBvh::TracePacket(Packet& p, RayHit* hits, RayQueryType type) const {
+  uint32_t active = (1u << p.count) - 1;
+  if (nodes.empty()) return;
+  uint32_t stack[STACK_DEPTH];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0 && active) {
+    const Node& node = nodes[stack[--top]];
+    uint32_t mask = HitNode(p, node.min, node.max, active);
+    if (!mask) continue;
+    if (node.count == 0) {
+      // near child on top, going by the first ray that's still in
+      int lane = 0;
+      while (!(mask & (1u << lane))) lane++;
+      const float* inverse = node.axis == 0 ? p.ix
+                             : node.axis == 1 ? p.iy
+                                              : p.iz;
+      uint32_t first = (uint32_t)(&node - nodes.data()) + 1;
+      uint32_t second = node.offset;
+      if (inverse[lane] < 0.0f) std::swap(first, second);
+      if (top + 2 > STACK_DEPTH) continue;
+      stack[top++] = second;
+      stack[top++] = first;
+      continue;
+    }
+    for (uint32_t s = node.offset; s < node.offset + node.count; s++) {
+      const CollisionShape& shape = shapes[s];
+      for (uint32_t lanes = mask & active; lanes; lanes &= lanes - 1) {
+        int i = __builtin_ctz(lanes);
+        const Ray& ray = p.rays[i];
+        float t = Intersect(shape, ray.origin, ray.direction, p.tmax[i]);
+        if (t < 0.0f) continue;
+        p.tmax[i] = t;
+        hits[i].distance = t;
+        hits[i].shape = ids[s];
+        if (type == RAY_ANY_HIT) active &= ~(1u << i);
+      }
+    }
+  }
+}
+
+void RayBvh::TraceGround(const Ray& ray, RayHit& hit) const {
+  if (!groundHeight || groundStep <= 0.0f) return;
+  auto above = [&](float t) {
+    glm::vec3 p = ray.origin + ray.direction * t;
+    return p.y - groundHeight(p.x, p.z);
+  };
+  float end = hit.distance;
+  float t0 = 0.0f, h0 = above(0.0f);
+  if (h0 < 0.0f) return;  // starts underground, e.g. a cave; let it be
+  while (t0 < end) {
+    float t1 = std::min(t0 + groundStep, end);
+    float h1 = above(t1);
+    if (h1 < 0.0f) {
+      hit.distance = t0 + (t1 - t0) * h0 / (h0 - h1);
+      hit.shape = RAY_GROUND;
+      return;
+    }
+    t0 = t1;
+    h0 = h1;
+  }
+}
+
+void RayBvh::Trace(const Ray* rays, RayHit* hits, int count,
+                   RayQueryType type) const {
+  for (int first = 0; first < count; first += RAY_PACKET) {
+    Packet p;
+    p.rays = rays + first;
+    p.count = std::min(RAY_PACKET, count - first);
+    for (int i = 0; i < RAY_PACKET; i++) {
+      // spare lanes repeat the last ray, they're masked off anyway
+      const Ray& ray = rays[first + std::min(i, p.count - 1)];
+      p.ox[i] = ray.origin.x;
+      p.oy[i] = ray.origin.y;
+      p.oz[i] = ray.origin.z;
+      p.ix[i] = Inverse(ray.direction.x);
+      p.iy[i] = Inverse(ray.direction.y);
+      p.iz[i] = Inverse(ray.direction.z);
+      p.tmax[i] = ray.maxDistance;
+      if (i < p.count) hits[first + i] = {ray.maxDistance, RAY_MISS};
+    }
+    TracePacket(p, hits + first, type);
+    for (int i = 0; i < p.count; i++) {
+      TraceGround(rays[first + i], hits[first + i]);
+    }
+  }
+}
+
+void RayBvh::TraceSingle(const Ray* rays, RayHit* hits, int count,
+                         RayQueryType type) const {
+  for (int r = 0; r < count; r++) {
+    const Ray& ray = rays[r];
+    RayHit& hit = hits[r];
+    hit = {ray.maxDistance, RAY_MISS};
+    glm::vec3 inverse(Inverse(ray.direction.x), Inverse(ray.direction.y),
+                      Inverse(ray.direction.z));
+    uint32_t stack[STACK_DEPTH];
+    int top = 0;
+    if (!nodes.empty()) stack[top++] = 0;
+    bool done = false;
+    while (top > 0 && !done) {
+      const Node& node = nodes[stack[--top]];
+      glm::vec3 t0 = (node.min - ray.origin) * inverse;
+      glm::vec3 t1 = (node.max - ray.origin) * inverse;
+      glm::vec3 lo = glm::min(t0, t1), hi = glm::max(t0, t1);
+      float near = std::max(std::max(lo.x, lo.y), std::max(lo.z, 0.0f));
+      float far = std::min(std::min(hi.x, hi.y), std::min(hi.z, hit.distance));
+      if (near > far) continue;
+      if (node.count == 0) {
+        uint32_t first = (uint32_t)(&node - nodes.data()) + 1;
+        uint32_t second = node.offset;
+        if (inverse[node.axis] < 0.0f) std::swap(first, second);
+        if (top + 2 > STACK_DEPTH) continue;
+        stack[top++] = second;
+        stack[top++] = first;
+        continue;
+      }
+      for (uint32_t s = node.offset; s < node.offset + node.count; s++) {
+        float t = Intersect(shapes[s], ray.origin, ray.direction,
+                            hit.distance);
+        if (t < 0.0f) continue;
+        hit.distance = t;
+        hit.shape = ids[s];
+        if (type == RAY_ANY_HIT) {
+          done = true;
+          break;
+        }
+      }
+    }
+    TraceGround(ray, hit);
+  }
+}
+
+RaycastQueue::RaycastQueue(JobSystem& jobs) : jobs(jobs) {}
+
+RaycastQueue::~RaycastQueue() {
+  jobs.Wait(counter);
+  jobs.Wait(buildCounter);
+}
+
+RayTicket RaycastQueue::Submit(const Ray* rays, int count,
+                               RayQueryType type) {
+  std::lock_guard<std::mutex> lock(submitMutex);
+  RayTicket ticket;
+  ticket.tick = tick;
+  ticket.first = (uint32_t)submitted.size();
+  ticket.count = (uint32_t)count;
+  submitted.insert(submitted.end(), rays, rays + count);
+  submittedBatches.push_back({ticket.first, ticket.count, type});
+  return ticket;
+}
+
+void RaycastQueue::Collect() {
+  jobs.Wait(counter);
+  if (!tracingTick) return;
+  readyHits.swap(tracingHits);
+  readyTick = tracingTick;
+  tracingTick = 0;
+  traceMs = tracedMs;
+}
+
+void RaycastQueue::Dispatch() {
+  jobs.Wait(counter);  // Collect should have, but don't trace over it
+  {
+    std::lock_guard<std::mutex> lock(submitMutex);
+    tracing.swap(submitted);
+    tracingBatches.swap(submittedBatches);
+    submitted.clear();
+    submittedBatches.clear();
+    tracingTick = tick++;
+  }
+  // nothing traces now, so a finished spare can take the current tree's place
+  if (building && buildCounter.Done()) {
+    std::swap(bvh, spare);
+    building = false;
+    hasTree = true;
+  }
+  // the world only changes on this thread, so copy it now and build later
+  if (!building && collision && collision->Revision() != builtRevision) {
+    builtRevision = collision->Revision();
+    buildShapes.clear();
+    buildIds.clear();
+    for (size_t id = 0; id < collision->SlotCount(); id++) {
+      const CollisionShape& shape = collision->Shape((uint32_t)id);
+      if (shape.type == COLLISION_NONE) continue;
+      buildShapes.push_back(shape);
+      buildIds.push_back((uint32_t)id);
+    }
+    buildGround = collision->groundHeight;
+    building = true;
+    jobs.SubmitBackground(
+        [this] {
+          spare.Build(std::move(buildShapes), std::move(buildIds),
+                      std::move(buildGround));
+        },
+        &buildCounter);
+  }
+  if (!hasTree) tracingTick = 0;  // nothing to trace against yet
+  bvh.groundStep = groundStep;
+  tracingHits.resize(tracing.size());
+  if (tracing.empty() || !hasTree) return;
+
+  jobs.Submit(
+      [this] {
+        auto start = std::chrono::high_resolution_clock::now();
+        // pieces of whole packets, a few per thread
+        const int piece = 16 * RAY_PACKET;
+        std::vector<std::pair<uint32_t, uint32_t>> pieces;
+        for (const Batch& batch : tracingBatches) {
+          for (uint32_t at = 0; at < batch.count; at += piece) {
+            pieces.push_back({batch.first + at,
+                              std::min<uint32_t>(piece, batch.count - at)});
+          }
+        }
+        std::vector<RayQueryType> types(pieces.size());
+        size_t b = 0;
+        for (size_t i = 0; i < pieces.size(); i++) {
+          while (pieces[i].first >=
+                 tracingBatches[b].first + tracingBatches[b].count) {
+            b++;
+          }
+          types[i] = tracingBatches[b].type;
+        }
+        jobs.ParallelFor(
+            (int)pieces.size(), 1, [&](int begin, int end) {
+              for (int i = begin; i < end; i++) {
+                bvh.Trace(tracing.data() + pieces[i].first,
+                          tracingHits.data() + pieces[i].first,
+                          (int)pieces[i].second, types[i]);
+              }
+            });
+        tracedMs = MillisecondsSince(start);
+      },
+      &counter);
+}
+
+const RayHit* RaycastQueue::Results(const RayTicket& ticket) const {
+  if (ticket.tick != readyTick || !ticket.count ||
+      ticket.first + ticket.count > readyHits.size()) {
+    return nullptr;
+  }
+  return readyHits.data() + ticket.first;
+}
+
+double BenchmarkRaycasts(float size, int rays, JobSystem& jobs) {
+  CollisionWorld world;
+  MakeBenchmarkForest(size, world);
+
+  // eyes at head height casting a packet each at points up to 40 m around,
+  // like a monster looking for the player and the flashlight beam
+  std::mt19937 rng(43);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  std::vector<Ray> lines(rays);
+  for (int i = 0; i < rays; i += RAY_PACKET) {
+    glm::vec3 eye(unit(rng) * size, 0.0f, unit(rng) * size);
+    eye.y = world.GroundHeight(eye.x, eye.z) + 1.8f;
+    float heading = unit(rng) * 6.2831853f;
+    float range = 5.0f + 35.0f * unit(rng);
+    for (int j = i; j < std::min(rays, i + RAY_PACKET); j++) {
+      float angle = heading + 0.3f * (unit(rng) - 0.5f);
+      glm::vec3 target = eye + glm::vec3(std::cos(angle) * range,
+                                         0.0f, std::sin(angle) * range);
+      target.y = world.GroundHeight(target.x, target.z) + 1.0f +
+                 0.8f * unit(rng);
+      glm::vec3 to = target - eye;
+      lines[j] = {eye, glm::normalize(to), glm::length(to)};
+    }
+  }
+
+  RayBvh bvh;
+  bvh.Build(world);
+  bvh.groundStep = 0.0f;
+  std::vector<RayHit> single(rays), packets(rays);
+  auto start = std::chrono::high_resolution_clock::now();
+  bvh.TraceSingle(lines.data(), single.data(), rays, RAY_ANY_HIT);
+  double singleMs = MillisecondsSince(start);
+  start = std::chrono::high_resolution_clock::now();
+  bvh.Trace(lines.data(), packets.data(), rays, RAY_ANY_HIT);
+  double packetMs = MillisecondsSince(start);
+  int blocked = 0, differ = 0;
+  for (int i = 0; i < rays; i++) {
+    if (packets[i].shape != RAY_MISS) blocked++;
+    if ((packets[i].shape == RAY_MISS) != (single[i].shape == RAY_MISS)) {
+      differ++;
+    }
+  }
+  start = std::chrono::high_resolution_clock::now();
+  bvh.Trace(lines.data(), packets.data(), rays, RAY_CLOSEST_HIT);
+  double closestMs = MillisecondsSince(start);
+
+  // through the queue, submitted by a handful of "AI" jobs at once
+  RaycastQueue queue(jobs);
+  queue.collision = &world;
+  queue.groundStep = 0.0f;
+  auto building = std::chrono::high_resolution_clock::now();
+  do {  // the tree is built in the background
+    queue.Dispatch();
+    queue.Collect();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  } while (!queue.HasTree() &&
+           std::chrono::high_resolution_clock::now() - building <
+               std::chrono::seconds(30));
+  start = std::chrono::high_resolution_clock::now();
+  JobCounter submitters;
+  const int jobCount = 8;
+  for (int j = 0; j < jobCount; j++) {
+    jobs.Submit(
+        [&, j] {
+          int from = rays / jobCount * j;
+          int to = j + 1 == jobCount ? rays : rays / jobCount * (j + 1);
+          for (int i = from; i < to; i += RAY_PACKET) {
+            queue.Submit(lines.data() + i, std::min(RAY_PACKET, to - i),
+                         RAY_ANY_HIT);
+          }
+        },
+        &submitters);
+  }
+  jobs.Wait(submitters);
+  queue.Dispatch();
+  queue.Collect();
+  double queueMs = MillisecondsSince(start);
+
+  bvh.groundStep = 2.0f;
+  start = std::chrono::high_resolution_clock::now();
+  bvh.Trace(lines.data(), packets.data(), rays, RAY_ANY_HIT);
+  double groundMs = MillisecondsSince(start);
+
+  auto rate = [&](double ms) { return ms > 0.0 ? rays / (ms / 1000.0) : 0.0; };
+  std::cout << "Raycasts: " << bvh.ShapeCount() << " shapes, "
+            << bvh.NodeCount() << " nodes (" << bvh.BuildMs()
+            << " ms build), " << rays << " lines of sight, " << blocked
+            << " blocked, " << differ << " differ" << std::endl;
+  std::cout << "  single: " << rate(singleMs) / 1e6 << " M rays/s, "
+            << RayBvh::SimdName() << " packets: " << rate(packetMs) / 1e6
+            << " M rays/s (closest hit " << rate(closestMs) / 1e6 << ")"
+            << std::endl;
+  std::cout << "  queue on " << jobs.ThreadCount() + 1
+            << " threads: " << rate(queueMs) / 1e6
+            << " M rays/s, with ground: " << rate(groundMs) / 1e6
+            << " M rays/s" << std::endl;
+  return rate(queueMs);
+}
@@ -0,0 +1,80 @@
+#include "render_target.hpp"
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+RenderTarget::RenderTarget(int width, int height)
+    : width(width), height(height) {
+  glGenFramebuffers(1, &FBO);
+  glGenTextures(1, &colorTexture);
+  glGenTextures(1, &depthTexture);
+  Allocate();
+}
+
+RenderTarget::~RenderTarget() {
+  glDeleteFramebuffers(1, &FBO);
+  glDeleteTextures(1, &colorTexture);
+  glDeleteTextures(1, &depthTexture);
+}
+
+void RenderTarget::Allocate() {
+  if (width < 1) width = 1;
+  if (height < 1) height = 1;
+
+  glBindTexture(GL_TEXTURE_2D, colorTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  glBindTexture(GL_TEXTURE_2D, depthTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0,
+               GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         colorTexture, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D,
+                         depthTexture, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "ERROR::FRAMEBUFFER:: scene target is not complete"
+              << std::endl;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void RenderTarget::Resize(int newWidth, int newHeight) {
+  if (newWidth == width && newHeight == height) return;
+  width = newWidth;
+  height = newHeight;
+  Allocate();
+}
+
+void RenderTarget::Bind() {
+  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+  glViewport(0, 0, width, height);
+}
+
+void RenderTarget::BlitToScreen() {
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                    GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void DrawFullscreenTriangle() {
+  // core profile needs some VAO bound even without attributes
+  static unsigned int emptyVAO = 0;
+  if (emptyVAO == 0) glGenVertexArrays(1, &emptyVAO);
+  glBindVertexArray(emptyVAO);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
+}
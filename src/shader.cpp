@@ -5,6 +5,8 @@
 #include <sstream>
 #include <iostream>
 
+#include "gl_ext.hpp"
+
 Shader::Shader(const char* vertexPath, const char* fragmentPath)
 {
     std::string vertexCode;
@@ -27,8 +29,8 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
         vShaderFile.close();
         fShaderFile.close();
 
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
+        vertexCode = expandIncludes(vShaderStream.str(), vertexPath);
+        fragmentCode = expandIncludes(fShaderStream.str(), fragmentPath);
     }
     catch (const std::ifstream::failure& e)
     {
@@ -64,6 +66,83 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
     glDeleteShader(fragment);
 }
 
+Shader::Shader(const char* computePath)
+{
+    std::string computeCode;
+    std::ifstream cShaderFile;
+
+    cShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+
+    try
+    {
+        cShaderFile.open(computePath);
+
+        std::stringstream cShaderStream;
+        cShaderStream << cShaderFile.rdbuf();
+
+        cShaderFile.close();
+
+        computeCode = expandIncludes(cShaderStream.str(), computePath);
+    }
+    catch (const std::ifstream::failure& e)
+    {
+        std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: "
+            << e.what() << std::endl;
+    }
+
+    const char* cShaderCode = computeCode.c_str();
+
+    // Compute shader, GL_COMPUTE_SHADER comes from gl_ext.hpp
+    unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(compute, 1, &cShaderCode, nullptr);
+    glCompileShader(compute);
+    checkCompileErrors(compute, "COMPUTE");
+
+    // Shader program
+    ID = glCreateProgram();
+    glAttachShader(ID, compute);
+    glLinkProgram(ID);
+    checkCompileErrors(ID, "PROGRAM");
+
+    glDeleteShader(compute);
+}
+
+std::string Shader::expandIncludes(const std::string& code,
+    const std::string& path)
+{
+    const std::string directive = "#include \"";
+    std::string folder = path.substr(0, path.find_last_of("/\\") + 1);
+    std::istringstream lines(code);
+    std::string expanded;
+    std::string line;
+    int number = 0;
+    while (std::getline(lines, line))
+    {
+        number++;
+        if (line.compare(0, directive.size(), directive) != 0)
+        {
+            expanded += line + "\n";
+            continue;
+        }
+        std::string name = line.substr(directive.size());
+        name = name.substr(0, name.find('"'));
+        std::ifstream includedFile(folder + name);
+        if (!includedFile)
+        {
+            std::cout << "ERROR::SHADER::INCLUDE_NOT_FOUND: "
+                << folder + name << std::endl;
+            continue;
+        }
+        std::stringstream includedStream;
+        includedStream << includedFile.rdbuf();
+        // source string 1 for the included lines, so compile errors in
+        // them read 1:<line>, then back to the stage's own numbering
+        expanded += "#line 1 1\n" + includedStream.str() + "\n#line " +
+            std::to_string(number + 1) + " 0\n";
+    }
+    return expanded;
+}
+
 void Shader::use()
 {
     glUseProgram(ID);
@@ -0,0 +1,228 @@
+#include "spotlight.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+// up vector for lookAt that doesn't degenerate looking straight up or down
+glm::vec3 UpFor(const glm::vec3& direction) {
+  return std::abs(direction.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f)
+                                       : glm::vec3(0.0f, 1.0f, 0.0f);
+}
+
+}  // namespace
+
+void SpotLight::Follow(const Camera& camera) {
+  glm::vec3 right =
+      glm::normalize(glm::cross(camera.cameraFront, camera.cameraUp));
+  glm::vec3 up = glm::cross(right, camera.cameraFront);
+  position = camera.cameraPos + right * offset.x + up * offset.y +
+             camera.cameraFront * offset.z;
+  direction = camera.cameraFront;
+}
+
+glm::mat4 SpotLight::ViewProjection() const {
+  glm::mat4 projection = glm::perspective(glm::radians(2.0f * outerAngle),
+                                          1.0f, 0.05f, range);
+  return projection *
+         glm::lookAt(position, position + direction, UpFor(direction));
+}
+
+unsigned int CreateFlashlightCookie(int size) {
+  std::mt19937 rng(46);
+  std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+  // smudges: a few soft blobs that dim the lens
+  glm::vec3 smudges[6];
+  for (glm::vec3& s : smudges) {
+    s = glm::vec3(noise(rng) * 0.6f, noise(rng) * 0.6f,
+                  0.1f + 0.1f * (noise(rng) + 1.0f));
+  }
+  std::vector<unsigned char> texels((size_t)size * size);
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      glm::vec2 p((x + 0.5f) / size * 2.0f - 1.0f,
+                  (y + 0.5f) / size * 2.0f - 1.0f);
+      float r = glm::length(p);
+      float hot = std::exp(-r * r * 9.0f);
+      float bandAt = (r - 0.55f) * 9.0f;
+      float ringAt = (r - 0.85f) * 14.0f;
+      float band = 0.55f - 0.2f * std::exp(-bandAt * bandAt);
+      float ring = 0.25f * std::exp(-ringAt * ringAt);
+      float value = 0.45f * hot + band + ring;
+      for (const glm::vec3& s : smudges) {
+        float d = glm::length(p - glm::vec2(s.x, s.y)) / s.z;
+        value *= 1.0f - 0.15f * std::exp(-d * d);
+      }
+      value *= 1.0f + 0.04f * noise(rng);
+      // nothing past the rim, so the cone edge comes from the cookie too
+      value *= glm::clamp((1.0f - r) * 8.0f, 0.0f, 1.0f);
+      texels[(size_t)y * size + x] =
+          (unsigned char)(glm::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+  }
+
+  unsigned int cookie;
+  glGenTextures(1, &cookie);
+  glBindTexture(GL_TEXTURE_2D, cookie);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, size, size, 0, GL_RED,
+               GL_UNSIGNED_BYTE, texels.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glGenerateMipmap(GL_TEXTURE_2D);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+  float black[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, black);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return cookie;
+}
+
+SpotShadow::SpotShadow(const SpotShadowSettings& settings)
+    : settings(settings),
+      depthShader("Shader/shadow_depth.vs", "Shader/shadow_depth.fs") {
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, settings.size,
+               settings.size, 2, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+  // linear + compare gives 2x2 PCF per tap for free
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE,
+                  GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+  glGenFramebuffers(1, &FBO);
+  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0,
+                            0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "ERROR::FRAMEBUFFER:: spot shadow map is not complete"
+              << std::endl;
+  }
+  // both layers start empty, nothing casts until the first Update
+  for (int layer = 0; layer < 2; layer++) {
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture,
+                              0, layer);
+    glClear(GL_DEPTH_BUFFER_BIT);
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+SpotShadow::~SpotShadow() {
+  glDeleteFramebuffers(1, &FBO);
+  glDeleteTextures(1, &texture);
+  glDeleteProgram(depthShader.ID);
+}
+
+void SpotShadow::Invalidate(const glm::vec3& min, const glm::vec3& max) {
+  if (!dirty && frustum.IntersectsAABB(min, max)) dirty = true;
+}
+
+void SpotShadow::DrawLayer(
+    int layer,
+    const std::function<int(const Frustum&, const glm::vec3&,
+                            const glm::vec3&)>& draw,
+    int& casters) {
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0,
+                            layer);
+  glClear(GL_DEPTH_BUFFER_BIT);
+  casters = draw ? draw(frustum, boxMin, boxMax) : 0;
+}
+
+void SpotShadow::Update(const SpotLight& light) {
+  redrewStatic = false;
+  if (!light.on) return;
+
+  // the cached layer still covers the cone if the light hasn't moved and
+  // the cone's edge is inside the margin
+  float turned = glm::degrees(std::acos(glm::clamp(
+      glm::dot(light.direction, cachedDirection), -1.0f, 1.0f)));
+  bool covered =
+      glm::length(light.position - cachedPosition) <= settings.moveTolerance &&
+      turned + light.outerAngle <= cachedHalfAngle &&
+      light.range == cachedRange;
+  if (dirty || !covered) {
+    cachedPosition = light.position;
+    cachedDirection = light.direction;
+    cachedHalfAngle = std::min(light.outerAngle + settings.margin, 80.0f);
+    cachedRange = light.range;
+    // far enough back that a ball of moveTolerance around the light is in
+    // the cone: the beam from anywhere in it, turned no further than the
+    // margin, stays inside
+    float back = settings.moveTolerance /
+                 std::sin(glm::radians(cachedHalfAngle));
+    glm::vec3 eye = light.position - light.direction * back;
+    glm::mat4 projection = glm::perspective(
+        glm::radians(2.0f * cachedHalfAngle), 1.0f, settings.nearPlane,
+        light.range + back + settings.moveTolerance);
+    viewProjection =
+        projection *
+        glm::lookAt(eye, eye + light.direction, UpFor(light.direction));
+    frustum = Frustum(viewProjection);
+    glm::mat4 inverse = glm::inverse(viewProjection);
+    boxMin = glm::vec3(1e30f);
+    boxMax = glm::vec3(-1e30f);
+    for (int i = 0; i < 8; i++) {
+      glm::vec4 p = inverse * glm::vec4((i & 1) ? 1.0f : -1.0f,
+                                        (i & 2) ? 1.0f : -1.0f,
+                                        (i & 4) ? 1.0f : -1.0f, 1.0f);
+      glm::vec3 world = glm::vec3(p) / p.w;
+      boxMin = glm::min(boxMin, world);
+      boxMax = glm::max(boxMax, world);
+    }
+    dirty = false;
+    redrewStatic = true;
+  }
+
+  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+  glViewport(0, 0, settings.size, settings.size);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  glEnable(GL_DEPTH_TEST);
+  glDepthMask(GL_TRUE);
+  // slope scaled bias at render time, so receivers need only a small one
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(2.0f, 4.0f);
+  depthShader.use();
+  depthShader.setMat4("lightViewProjection", viewProjection);
+  depthShader.setMat4("model", glm::mat4(1.0f));
+
+  if (redrewStatic) {
+    DrawLayer(0, drawStatic, staticCasters);
+    staticRedraws++;
+  }
+  // an empty layer stays empty, only clear it if last frame drew into it
+  if (dynamicInLayer || redrewStatic) {
+    DrawLayer(1, drawDynamic, dynamicCasters);
+  } else {
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture,
+                              0, 1);
+    dynamicCasters = drawDynamic ? drawDynamic(frustum, boxMin, boxMax) : 0;
+  }
+  dynamicInLayer = dynamicCasters > 0;
+
+  glDisable(GL_POLYGON_OFFSET_FILL);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void SpotShadow::Bind(const Shader& shader, int unit) const {
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+  glActiveTexture(GL_TEXTURE0);
+  shader.setInt("spotShadow", unit);
+  shader.setMat4("spotShadowMatrix", viewProjection);
+  shader.setBool("spotShadowDynamic", dynamicInLayer);
+}
@@ -0,0 +1,170 @@
+#include "stream_buffer.hpp"
+
+#include <GLFW/glfw3.h>
+
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "gl_ext.hpp"
+
+StreamBuffer::StreamBuffer(GLenum target, GLsizeiptr regionSize,
+                           int regionCount)
+    : target(target), regionSize(regionSize) {
+  if (regionCount < 1) regionCount = 1;
+  if (regionCount > MAX_REGIONS) regionCount = MAX_REGIONS;
+  this->regionCount = regionCount;
+  Create();
+}
+
+StreamBuffer::~StreamBuffer() { Destroy(); }
+
+void StreamBuffer::Create() {
+  GLsizeiptr totalSize = regionSize * regionCount;
+  glGenBuffers(1, &ID);
+  glBindBuffer(target, ID);
+
+  persistent = glExt.bufferStorage;
+  if (persistent) {
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glExt.BufferStorage(target, totalSize, nullptr, flags);
+    persistentPtr =
+        (unsigned char*)glMapBufferRange(target, 0, totalSize, flags);
+    if (!persistentPtr) {
+      std::cout << "StreamBuffer: persistent map failed, falling back"
+                << std::endl;
+      // immutable storage can't be respecified, start over with a new name
+      glDeleteBuffers(1, &ID);
+      glGenBuffers(1, &ID);
+      glBindBuffer(target, ID);
+      persistent = false;
+    }
+  }
+  if (!persistent) {
+    glBufferData(target, totalSize, nullptr, GL_STREAM_DRAW);
+  }
+  glBindBuffer(target, 0);
+}
+
+void StreamBuffer::Destroy() {
+  for (GLsync& fence : fences) {
+    if (fence) glDeleteSync(fence);
+    fence = nullptr;
+  }
+  if (persistentPtr || mapped) {
+    glBindBuffer(target, ID);
+    glUnmapBuffer(target);
+  }
+  glDeleteBuffers(1, &ID);
+  persistentPtr = nullptr;
+  mapped = false;
+}
+
+void StreamBuffer::WaitForRegion(int r) {
+  GLsync fence = fences[r];
+  if (!fence) return;
+
+  // first try without blocking, then flush and wait in 1ms steps
+  GLenum result = glClientWaitSync(fence, 0, 0);
+  while (result == GL_TIMEOUT_EXPIRED) {
+    result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+  }
+  if (result == GL_WAIT_FAILED) {
+    std::cout << "StreamBuffer: glClientWaitSync failed" << std::endl;
+  }
+  glDeleteSync(fence);
+  fences[r] = nullptr;
+}
+
+void* StreamBuffer::Allocate(GLsizeiptr size, GLintptr& offset,
+                             GLsizeiptr alignment) {
+  if (!regionReady) {
+    WaitForRegion(region);
+    regionReady = true;
+  }
+
+  GLsizeiptr start = (used + alignment - 1) / alignment * alignment;
+  if (size <= 0) return nullptr;
+  demand += start - used + size;
+  if (start + size > regionSize) {
+    failed++;
+    return nullptr;
+  }
+
+  used = start + size;
+  offset = region * regionSize + start;
+
+  if (persistent) return persistentPtr + offset;
+
+  glBindBuffer(target, ID);
+  void* ptr = glMapBufferRange(target, offset, size,
+                               GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                                   GL_MAP_INVALIDATE_RANGE_BIT);
+  mapped = ptr != nullptr;
+  return ptr;
+}
+
+void StreamBuffer::Commit() {
+  if (!mapped) return;
+  glBindBuffer(target, ID);
+  glUnmapBuffer(target);
+  mapped = false;
+}
+
+GLintptr StreamBuffer::Upload(const void* data, GLsizeiptr size,
+                              GLsizeiptr alignment) {
+  GLintptr offset = 0;
+  void* ptr = Allocate(size, offset, alignment);
+  if (!ptr) return -1;
+  std::memcpy(ptr, data, size);
+  Commit();
+  return offset;
+}
+
+void StreamBuffer::EndFrame() {
+  Commit();
+  if (used > 0) {
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+  lastFrameBytes = used;
+  failedLastFrame = failed;
+  region = (region + 1) % regionCount;
+  regionReady = false;
+
+  // something didn't fit: start over with regions that hold this frame's
+  // demand and a quarter more. GL keeps the old storage alive until the
+  // draws reading it are done, so nothing in flight has to be waited on.
+  if (failed > 0) {
+    Destroy();
+    GLsizeiptr grown = demand + demand / 4;
+    regionSize = (grown + (64 << 10) - 1) / (64 << 10) * (64 << 10);
+    region = 0;
+    Create();
+    grows++;
+  }
+  used = 0;
+  demand = 0;
+  failed = 0;
+}
+
+double BenchmarkStreamUpload(GLsizeiptr totalBytes, GLsizeiptr chunkSize) {
+  const int regions = 3;
+  const int chunksPerRegion = 4;
+  StreamBuffer stream(GL_ARRAY_BUFFER, chunkSize * chunksPerRegion, regions);
+  std::vector<unsigned char> source(chunkSize, 0x5a);
+
+  double start = glfwGetTime();
+  GLsizeiptr uploaded = 0;
+  while (uploaded < totalBytes) {
+    for (int i = 0; i < chunksPerRegion && uploaded < totalBytes; i++) {
+      stream.Upload(source.data(), chunkSize);
+      uploaded += chunkSize;
+    }
+    stream.EndFrame();
+  }
+  glFinish();
+  double seconds = glfwGetTime() - start;
+
+  return seconds > 0.0 ? (uploaded / (1024.0 * 1024.0)) / seconds : 0.0;
+}
@@ -0,0 +1,366 @@
+#include "terrain.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+namespace {
+
+uint32_t Hash(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+float Lattice(uint32_t seed, int x, int z) {
+  uint32_t h = Hash(seed ^ Hash((uint32_t)x * 0x9e3779b9U ^ Hash((uint32_t)z)));
+  return (h >> 8) * (1.0f / 16777216.0f);
+}
+
+float ValueNoise(uint32_t seed, float x, float z) {
+  int ix = (int)std::floor(x);
+  int iz = (int)std::floor(z);
+  float fx = x - ix;
+  float fz = z - iz;
+  fx = fx * fx * (3.0f - 2.0f * fx);
+  fz = fz * fz * (3.0f - 2.0f * fz);
+  float a = Lattice(seed, ix, iz);
+  float b = Lattice(seed, ix + 1, iz);
+  float c = Lattice(seed, ix, iz + 1);
+  float d = Lattice(seed, ix + 1, iz + 1);
+  float top = a + (b - a) * fx;
+  float bottom = c + (d - c) * fx;
+  return top + (bottom - top) * fz;
+}
+
+float Smoothstep(float edge0, float edge1, float x) {
+  float t = std::min(std::max((x - edge0) / (edge1 - edge0), 0.0f), 1.0f);
+  return t * t * (3.0f - 2.0f * t);
+}
+
+// vertices morph toward the next level over the outer part of their ring,
+// must match Shader/terrain.vs
+const float MORPH_START = 0.8f;
+
+}  // namespace
+
+Terrain::Terrain(const TerrainSettings& settings, JobSystem* jobs)
+    : settings(settings) {
+  origin = glm::vec2(-settings.size * 0.5f);
+  spacing = settings.size / (settings.resolution - 1);
+  levelCount = 1;
+  while ((LEAF_SIZE << (levelCount - 1)) < settings.size) levelCount++;
+
+  Generate(jobs);
+  BuildMinMax();
+
+  // heights are fetched texel by texel and filtered in the shader, so the
+  // CPU query gets bit for bit the same surface
+  glGenTextures(1, &heightTexture);
+  glBindTexture(GL_TEXTURE_2D, heightTexture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, settings.resolution,
+               settings.resolution, 0, GL_RED, GL_FLOAT, heights.data());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  // the shared grid: (GRID + 1)^2 vertices over the unit square
+  std::vector<glm::vec2> grid;
+  for (int z = 0; z <= GRID; z++) {
+    for (int x = 0; x <= GRID; x++) {
+      grid.push_back(glm::vec2(x, z) / (float)GRID);
+    }
+  }
+  std::vector<unsigned int> indices;
+  for (int step = 1; step <= 2; step++) {
+    for (int z = 0; z < GRID; z += step) {
+      for (int x = 0; x < GRID; x += step) {
+        unsigned int a = z * (GRID + 1) + x;
+        unsigned int b = a + step;
+        unsigned int c = a + step * (GRID + 1);
+        unsigned int d = c + step;
+        // counter-clockwise seen from above (+y)
+        indices.insert(indices.end(), {a, c, d, a, d, b});
+      }
+    }
+    if (step == 1) fullIndexCount = (int)indices.size();
+  }
+  halfIndexCount = (int)indices.size() - fullIndexCount;
+
+  glGenVertexArrays(1, &VAO);
+  glGenBuffers(1, &VBO);
+  glGenBuffers(1, &EBO);
+  glBindVertexArray(VAO);
+  glBindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, grid.size() * sizeof(glm::vec2), grid.data(),
+               GL_STATIC_DRAW);
+  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)0);
+  glEnableVertexAttribArray(0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
+               indices.data(), GL_STATIC_DRAW);
+  // per node: origin, size, level
+  glEnableVertexAttribArray(1);
+  glVertexAttribDivisor(1, 1);
+  glBindVertexArray(0);
+
+  nodeStream = new StreamBuffer(GL_ARRAY_BUFFER, 64 << 10);
+}
+
+Terrain::~Terrain() {
+  delete nodeStream;
+  glDeleteTextures(1, &heightTexture);
+  glDeleteVertexArrays(1, &VAO);
+  glDeleteBuffers(1, &VBO);
+  glDeleteBuffers(1, &EBO);
+}
+
+void Terrain::Generate(JobSystem* jobs) {
+  int res = settings.resolution;
+  heights.resize((size_t)res * res);
+  auto rows = [&](int begin, int end) {
+    for (int z = begin; z < end; z++) {
+      for (int x = 0; x < res; x++) {
+        float wx = origin.x + x * spacing;
+        float wz = origin.y + z * spacing;
+
+        float h = 0.0f;
+        float amplitude = 1.0f;
+        float frequency = settings.frequency;
+        float total = 0.0f;
+        for (int octave = 0; octave < 5; octave++) {
+          h += ValueNoise(settings.seed + octave, wx * frequency,
+                          wz * frequency) *
+               amplitude;
+          total += amplitude;
+          amplitude *= 0.5f;
+          frequency *= 2.0f;
+        }
+        h /= total;
+
+        // flat spawn area, hills rise around it
+        float fromPlaza =
+            std::max(std::abs(wx), std::abs(wz)) - settings.plazaExtent;
+        float blend = Smoothstep(0.0f, settings.plazaBlend, fromPlaza);
+        heights[(size_t)z * res + x] =
+            settings.plazaHeight + blend * settings.amplitude * h;
+      }
+    }
+  };
+  if (jobs) {
+    jobs->ParallelFor(res, 32, rows);
+  } else {
+    rows(0, res);
+  }
+}
+
+void Terrain::BuildMinMax() {
+  minMax.resize(levelCount);
+  int res = settings.resolution;
+  int leaves = std::max(1, (int)std::ceil(settings.size / LEAF_SIZE));
+  minMax[0].assign((size_t)leaves * leaves,
+                   glm::vec2(1e30f, -1e30f));
+  for (int z = 0; z < leaves; z++) {
+    for (int x = 0; x < leaves; x++) {
+      // samples touching the leaf, inclusive on both edges
+      int x0 = std::max(0, (int)std::floor(x * LEAF_SIZE / spacing));
+      int z0 = std::max(0, (int)std::floor(z * LEAF_SIZE / spacing));
+      int x1 = std::min(res - 1, (int)std::ceil((x + 1) * LEAF_SIZE / spacing));
+      int z1 = std::min(res - 1, (int)std::ceil((z + 1) * LEAF_SIZE / spacing));
+      glm::vec2& range = minMax[0][(size_t)z * leaves + x];
+      for (int sz = z0; sz <= z1; sz++) {
+        for (int sx = x0; sx <= x1; sx++) {
+          float h = heights[(size_t)sz * res + sx];
+          range.x = std::min(range.x, h);
+          range.y = std::max(range.y, h);
+        }
+      }
+    }
+  }
+
+  for (int level = 1; level < levelCount; level++) {
+    int childCount = std::max(1, leaves >> (level - 1));
+    int count = std::max(1, leaves >> level);
+    minMax[level].assign((size_t)count * count, glm::vec2(1e30f, -1e30f));
+    for (int z = 0; z < childCount; z++) {
+      for (int x = 0; x < childCount; x++) {
+        const glm::vec2& child = minMax[level - 1][(size_t)z * childCount + x];
+        glm::vec2& parent =
+            minMax[level][(size_t)std::min(z / 2, count - 1) * count +
+                          std::min(x / 2, count - 1)];
+        parent.x = std::min(parent.x, child.x);
+        parent.y = std::max(parent.y, child.y);
+      }
+    }
+  }
+}
+
+float Terrain::HeightAt(float x, float z) const {
+  int res = settings.resolution;
+  float tx = std::min(std::max((x - origin.x) / spacing, 0.0f), res - 1.0f);
+  float tz = std::min(std::max((z - origin.y) / spacing, 0.0f), res - 1.0f);
+  int ix = std::min((int)tx, res - 2);
+  int iz = std::min((int)tz, res - 2);
+  float fx = tx - ix;
+  float fz = tz - iz;
+  const float* row = &heights[(size_t)iz * res + ix];
+  float top = row[0] + (row[1] - row[0]) * fx;
+  float bottom = row[res] + (row[res + 1] - row[res]) * fx;
+  return top + (bottom - top) * fz;
+}
+
+glm::vec3 Terrain::NormalAt(float x, float z) const {
+  float dx = HeightAt(x + spacing, z) - HeightAt(x - spacing, z);
+  float dz = HeightAt(x, z + spacing) - HeightAt(x, z - spacing);
+  return glm::normalize(glm::vec3(-dx, 2.0f * spacing, -dz));
+}
+
+void Terrain::HeightRange(const glm::vec2& min, const glm::vec2& max,
+                          float& low, float& high) const {
+  int leaves = (int)std::sqrt((double)minMax[0].size());
+  // outside the map the edge heights carry on, so clamp to the edge leaves
+  auto leaf = [&](float v, float o) {
+    return std::min(std::max((int)std::floor((v - o) / LEAF_SIZE), 0),
+                    leaves - 1);
+  };
+  int x0 = leaf(min.x, origin.x);
+  int z0 = leaf(min.y, origin.y);
+  int x1 = leaf(max.x, origin.x);
+  int z1 = leaf(max.y, origin.y);
+  low = 1e30f;
+  high = -1e30f;
+  for (int z = z0; z <= z1; z++) {
+    for (int x = x0; x <= x1; x++) {
+      const glm::vec2& range = minMax[0][(size_t)z * leaves + x];
+      low = std::min(low, range.x);
+      high = std::max(high, range.y);
+    }
+  }
+}
+
+void Terrain::OccluderBoxes(
+    const glm::vec3& eye, float reach,
+    std::vector<std::pair<glm::vec3, glm::vec3>>& boxes) const {
+  int leaves = (int)std::sqrt((double)minMax[0].size());
+  int x0 = std::max(0, (int)std::floor((eye.x - reach - origin.x) / LEAF_SIZE));
+  int z0 = std::max(0, (int)std::floor((eye.z - reach - origin.y) / LEAF_SIZE));
+  int x1 = std::min(leaves - 1,
+                    (int)std::floor((eye.x + reach - origin.x) / LEAF_SIZE));
+  int z1 = std::min(leaves - 1,
+                    (int)std::floor((eye.z + reach - origin.y) / LEAF_SIZE));
+  for (int z = z0; z <= z1; z++) {
+    for (int x = x0; x <= x1; x++) {
+      glm::vec3 min, max;
+      NodeBounds(0, x, z, min, max);
+      glm::vec2 nearest = glm::clamp(glm::vec2(eye.x, eye.z),
+                                     glm::vec2(min.x, min.z),
+                                     glm::vec2(max.x, max.z));
+      if (glm::length(nearest - glm::vec2(eye.x, eye.z)) > reach) continue;
+      // the node's lowest sample is under the bilinear surface everywhere
+      max.y = min.y;
+      min.y -= (float)LEAF_SIZE;
+      boxes.push_back({min, max});
+    }
+  }
+}
+
+void Terrain::BindHeightMap(const Shader& shader, int unit) const {
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_2D, heightTexture);
+  glActiveTexture(GL_TEXTURE0);
+  shader.setInt("heightMap", unit);
+  glUniform2f(glGetUniformLocation(shader.ID, "terrainOrigin"), origin.x,
+              origin.y);
+  shader.setFloat("terrainSpacing", spacing);
+  shader.setInt("terrainResolution", settings.resolution);
+}
+
+void Terrain::NodeBounds(int level, int x, int z, glm::vec3& min,
+                         glm::vec3& max) const {
+  float size = (float)(LEAF_SIZE << level);
+  int count = (int)std::sqrt((double)minMax[level].size());
+  const glm::vec2& range =
+      minMax[level][(size_t)std::min(z, count - 1) * count +
+                    std::min(x, count - 1)];
+  min = glm::vec3(origin.x + x * size, range.x, origin.y + z * size);
+  max = glm::vec3(min.x + size, range.y, min.z + size);
+}
+
+namespace {
+
+bool BoxInSphere(const glm::vec3& min, const glm::vec3& max,
+                 const glm::vec3& center, float radius) {
+  glm::vec3 nearest = glm::clamp(center, min, max);
+  glm::vec3 d = nearest - center;
+  return glm::dot(d, d) <= radius * radius;
+}
+
+}  // namespace
+
+void Terrain::Select(int level, int x, int z, const Frustum& frustum,
+                     const glm::vec3& cameraPos) {
+  glm::vec3 min, max;
+  NodeBounds(level, x, z, min, max);
+  if (!frustum.IntersectsAABB(min, max)) return;
+  float size = (float)(LEAF_SIZE << level);
+
+  float finerRange = level > 0 ? lodDistance * (float)(1 << (level - 1)) : 0;
+  if (level == 0 || !BoxInSphere(min, max, cameraPos, finerRange)) {
+    fullNodes.push_back({glm::vec2(min.x, min.z), size, (float)level});
+    return;
+  }
+  for (int child = 0; child < 4; child++) {
+    int cx = x * 2 + (child & 1);
+    int cz = z * 2 + (child >> 1);
+    glm::vec3 childMin, childMax;
+    NodeBounds(level - 1, cx, cz, childMin, childMax);
+    if (BoxInSphere(childMin, childMax, cameraPos, finerRange)) {
+      Select(level - 1, cx, cz, frustum, cameraPos);
+    } else if (frustum.IntersectsAABB(childMin, childMax)) {
+      // a quarter of this node at this node's density
+      halfNodes.push_back(
+          {glm::vec2(childMin.x, childMin.z), size * 0.5f, (float)level});
+    }
+  }
+}
+
+void Terrain::Draw(const Frustum& frustum, const glm::vec3& cameraPos,
+                   const Shader& shader) {
+  fullNodes.clear();
+  halfNodes.clear();
+  Select(levelCount - 1, 0, 0, frustum, cameraPos);
+  nodesDrawn = (int)(fullNodes.size() + halfNodes.size());
+  trianglesDrawn = (int)(fullNodes.size() * fullIndexCount +
+                         halfNodes.size() * halfIndexCount) /
+                   3;
+
+  BindHeightMap(shader, 3);
+  shader.setFloat("lodDistance", lodDistance);
+  shader.setFloat("morphStart", MORPH_START);
+  shader.setFloat("gridCellsPerLeaf", GRID / (float)LEAF_SIZE);
+
+  glBindVertexArray(VAO);
+  const std::vector<Node>* lists[2] = {&fullNodes, &halfNodes};
+  for (int i = 0; i < 2; i++) {
+    const std::vector<Node>& nodes = *lists[i];
+    if (nodes.empty()) continue;
+    GLintptr offset =
+        nodeStream->Upload(nodes.data(), nodes.size() * sizeof(Node));
+    if (offset < 0) continue;
+    glBindBuffer(GL_ARRAY_BUFFER, nodeStream->ID);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(Node),
+                          (void*)offset);
+    int first = i == 0 ? 0 : fullIndexCount;
+    int count = i == 0 ? fullIndexCount : halfIndexCount;
+    glDrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_INT,
+                            (void*)(first * sizeof(unsigned int)),
+                            (int)nodes.size());
+  }
+  glBindVertexArray(0);
+  nodeStream->EndFrame();
+}
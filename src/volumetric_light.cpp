@@ -0,0 +1,274 @@
+#include "volumetric_light.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <glm/gtc/type_ptr.hpp>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "render_target.hpp"
+
+namespace {
+
+const int BLUE_NOISE_SIZE = 64;
+
+// Ranks of a void and cluster blue noise tile (Ulichney), `size` square and
+// tiling: a sparse random pattern is relaxed by moving its tightest point
+// into the largest hole until that's the same spot, then points are taken
+// out of the tightest clusters for the low ranks and put into the largest
+// holes for the rest. Clusters and holes are measured with a wrapped
+// Gaussian kept up to date as points come and go.
+std::vector<float> BlueNoise(int size, uint32_t seed) {
+  const int n = size * size;
+  const int reach = 6;
+  const float sigma = 1.9f;
+  std::vector<float> kernel((2 * reach + 1) * (2 * reach + 1));
+  for (int y = -reach; y <= reach; y++) {
+    for (int x = -reach; x <= reach; x++) {
+      kernel[(y + reach) * (2 * reach + 1) + x + reach] =
+          std::exp(-(x * x + y * y) / (2.0f * sigma * sigma));
+    }
+  }
+  std::vector<float> energy(n, 0.0f);
+  std::vector<char> on(n, 0);
+  auto splat = [&](int p, float sign) {
+    int px = p % size, py = p / size;
+    for (int y = -reach; y <= reach; y++) {
+      int row = ((py + y) % size + size) % size * size;
+      for (int x = -reach; x <= reach; x++) {
+        energy[row + ((px + x) % size + size) % size] +=
+            sign * kernel[(y + reach) * (2 * reach + 1) + x + reach];
+      }
+    }
+  };
+  auto tightest = [&] {
+    int best = -1;
+    for (int p = 0; p < n; p++) {
+      if (on[p] && (best < 0 || energy[p] > energy[best])) best = p;
+    }
+    return best;
+  };
+  auto largestVoid = [&] {
+    int best = -1;
+    for (int p = 0; p < n; p++) {
+      if (!on[p] && (best < 0 || energy[p] < energy[best])) best = p;
+    }
+    return best;
+  };
+
+  std::mt19937 rng(seed);
+  std::vector<int> order(n);
+  for (int p = 0; p < n; p++) order[p] = p;
+  std::shuffle(order.begin(), order.end(), rng);
+  const int initial = n / 10;
+  for (int i = 0; i < initial; i++) {
+    on[order[i]] = 1;
+    splat(order[i], 1.0f);
+  }
+  for (int i = 0; i < n; i++) {
+    int cluster = tightest();
+    on[cluster] = 0;
+    splat(cluster, -1.0f);
+    int hole = largestVoid();
+    on[hole] = 1;
+    splat(hole, 1.0f);
+    if (hole == cluster) break;
+  }
+  std::vector<char> relaxed = on;
+  std::vector<float> relaxedEnergy = energy;
+
+  std::vector<int> rank(n);
+  for (int count = initial; count > 0;) {
+    int cluster = tightest();
+    on[cluster] = 0;
+    splat(cluster, -1.0f);
+    rank[cluster] = --count;
+  }
+  on = relaxed;
+  energy = relaxedEnergy;
+  for (int count = initial; count < n; count++) {
+    int hole = largestVoid();
+    on[hole] = 1;
+    splat(hole, 1.0f);
+    rank[hole] = count;
+  }
+
+  std::vector<float> noise(n);
+  for (int p = 0; p < n; p++) noise[p] = (rank[p] + 0.5f) / n;
+  return noise;
+}
+
+}  // namespace
+
+VolumetricLight::VolumetricLight(const VolumetricSettings& settings)
+    : settings(settings),
+      shader("Shader/fullscreen.vs", "Shader/volumetric_march.fs"),
+      temporalShader("Shader/fullscreen.vs", "Shader/volumetric_temporal.fs"),
+      upsampleShader("Shader/fullscreen.vs",
+                     "Shader/volumetric_upsample.fs") {
+  std::vector<float> noise = BlueNoise(BLUE_NOISE_SIZE, 50);
+  std::vector<unsigned char> texels(noise.size());
+  for (size_t i = 0; i < noise.size(); i++) {
+    texels[i] = (unsigned char)(noise[i] * 256.0f);
+  }
+  glGenTextures(1, &blueNoise);
+  glBindTexture(GL_TEXTURE_2D, blueNoise);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, BLUE_NOISE_SIZE, BLUE_NOISE_SIZE, 0,
+               GL_RED, GL_UNSIGNED_BYTE, texels.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenFramebuffers(1, &FBO);
+  glGenTextures(1, &marched);
+  glGenTextures(2, history);
+}
+
+VolumetricLight::~VolumetricLight() {
+  glDeleteFramebuffers(1, &FBO);
+  glDeleteTextures(1, &blueNoise);
+  glDeleteTextures(1, &marched);
+  glDeleteTextures(2, history);
+  glDeleteProgram(shader.ID);
+  glDeleteProgram(temporalShader.ID);
+  glDeleteProgram(upsampleShader.ID);
+}
+
+void VolumetricLight::Allocate(int w, int h) {
+  width = w;
+  height = h;
+  unsigned int targets[3] = {marched, history[0], history[1]};
+  for (unsigned int target : targets) {
+    glBindTexture(GL_TEXTURE_2D, target);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA,
+                 GL_FLOAT, nullptr);
+    // linear for the reprojected history reads
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         marched, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "ERROR::FRAMEBUFFER:: volumetric target is not complete"
+              << std::endl;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  historyValid = false;
+}
+
+void VolumetricLight::Render(unsigned int depthTexture, int sceneWidth,
+                             int sceneHeight, const glm::mat4& view,
+                             const glm::mat4& projection, float nearPlane,
+                             float farPlane) {
+  int divisor = std::max(1, settings.divisor);
+  int w = std::max(1, (sceneWidth + divisor - 1) / divisor);
+  int h = std::max(1, (sceneHeight + divisor - 1) / divisor);
+  if (w != width || h != height) Allocate(w, h);
+  this->nearPlane = nearPlane;
+  this->farPlane = farPlane;
+
+  marchTimer.Begin();
+  glm::mat4 viewProjection = projection * view;
+  glm::mat4 inverseViewProjection = glm::inverse(viewProjection);
+  glm::mat4 inverseView = glm::inverse(view);
+  glm::vec3 eye = glm::vec3(inverseView[3]);
+  glm::vec3 front = -glm::vec3(inverseView[2]);
+  // golden ratio steps walk the noise through all offsets evenly
+  float offset = (float)std::fmod(frame * 0.6180339887, 1.0);
+  frame++;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+  glViewport(0, 0, width, height);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_BLEND);
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+  // march into `marched`
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         marched, 0);
+  shader.use();
+  glActiveTexture(GL_TEXTURE11);
+  glBindTexture(GL_TEXTURE_2D, depthTexture);
+  glActiveTexture(GL_TEXTURE12);
+  glBindTexture(GL_TEXTURE_2D, blueNoise);
+  shader.setInt("sceneDepth", 11);
+  shader.setInt("blueNoise", 12);
+  shader.setInt("volScale", divisor);
+  shader.setInt("volSteps", std::max(1, settings.steps));
+  shader.setFloat("volDistance", settings.distance);
+  shader.setFloat("volOffset", offset);
+  shader.setFloat("volScattering", settings.scattering);
+  shader.setFloat("volAnisotropy", settings.anisotropy);
+  glUniform2f(glGetUniformLocation(shader.ID, "volPlanes"), nearPlane,
+              farPlane);
+  glUniform3fv(glGetUniformLocation(shader.ID, "volEye"), 1,
+               glm::value_ptr(eye));
+  glUniform3fv(glGetUniformLocation(shader.ID, "volFront"), 1,
+               glm::value_ptr(front));
+  shader.setMat4("volInverseViewProjection", inverseViewProjection);
+  DrawFullscreenTriangle();
+
+  // resolve against the history into the other one
+  int previous = current;
+  current = 1 - current;
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         history[current], 0);
+  temporalShader.use();
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, marched);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, history[previous]);
+  temporalShader.setInt("marched", 0);
+  temporalShader.setInt("history", 1);
+  temporalShader.setBool("historyValid", historyValid);
+  temporalShader.setFloat("historyWeight", settings.history);
+  glUniform3fv(glGetUniformLocation(temporalShader.ID, "volEye"), 1,
+               glm::value_ptr(eye));
+  glUniform3fv(glGetUniformLocation(temporalShader.ID, "volFront"), 1,
+               glm::value_ptr(front));
+  temporalShader.setMat4("volInverseViewProjection", inverseViewProjection);
+  temporalShader.setMat4("volPreviousViewProjection", previousViewProjection);
+  DrawFullscreenTriangle();
+  previousViewProjection = viewProjection;
+  historyValid = true;
+
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glActiveTexture(GL_TEXTURE0);
+  glEnable(GL_DEPTH_TEST);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  marchTimer.End();
+}
+
+void VolumetricLight::Composite(unsigned int depthTexture, int sceneWidth,
+                                int sceneHeight) {
+  compositeTimer.Begin();
+  glViewport(0, 0, sceneWidth, sceneHeight);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE);
+  upsampleShader.use();
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, depthTexture);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, history[current]);
+  glActiveTexture(GL_TEXTURE0);
+  upsampleShader.setInt("sceneDepth", 0);
+  upsampleShader.setInt("resolved", 1);
+  glUniform2f(glGetUniformLocation(upsampleShader.ID, "volPlanes"), nearPlane,
+              farPlane);
+  DrawFullscreenTriangle();
+  glDisable(GL_BLEND);
+  glEnable(GL_DEPTH_TEST);
+  compositeTimer.End();
+}
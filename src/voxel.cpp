@@ -0,0 +1,148 @@
+#include "voxel.hpp"
+
+#include <algorithm>
+
+VoxelWorld::VoxelWorld(float blockSize) : blockSize(blockSize) {}
+
+VoxelWorld::~VoxelWorld() {
+  for (auto& entry : chunks) {
+    Entry& e = entry.second;
+    if (!e.VAO) continue;
+    glDeleteVertexArrays(1, &e.VAO);
+    glDeleteBuffers(1, &e.VBO);
+    glDeleteBuffers(1, &e.EBO);
+  }
+}
+
+const VoxelChunk* VoxelWorld::Find(Coord c) const {
+  auto it = chunks.find(c);
+  return it != chunks.end() ? &it->second.voxels : nullptr;
+}
+
+void VoxelWorld::MarkDirty(Coord c) {
+  auto it = chunks.find(c);
+  if (it != chunks.end()) it->second.dirty = true;
+}
+
+BlockId VoxelWorld::Get(int x, int y, int z) const {
+  Coord c = {FloorDiv(x), FloorDiv(y), FloorDiv(z)};
+  const VoxelChunk* chunk = Find(c);
+  if (!chunk) return 0;
+  return chunk->Get(x - c.x * VOXEL_CHUNK, y - c.y * VOXEL_CHUNK,
+                    z - c.z * VOXEL_CHUNK);
+}
+
+void VoxelWorld::Set(int x, int y, int z, BlockId block) {
+  Coord c = {FloorDiv(x), FloorDiv(y), FloorDiv(z)};
+  if (!block && !Find(c)) return;  // air in a chunk that doesn't exist
+  Entry& entry = chunks[c];
+  int lx = x - c.x * VOXEL_CHUNK;
+  int ly = y - c.y * VOXEL_CHUNK;
+  int lz = z - c.z * VOXEL_CHUNK;
+  entry.voxels.Set(lx, ly, lz, block);
+  entry.dirty = true;
+
+  // border blocks change what the neighbour shows
+  const int last = VOXEL_CHUNK - 1;
+  if (lx == 0) MarkDirty({c.x - 1, c.y, c.z});
+  if (lx == last) MarkDirty({c.x + 1, c.y, c.z});
+  if (ly == 0) MarkDirty({c.x, c.y - 1, c.z});
+  if (ly == last) MarkDirty({c.x, c.y + 1, c.z});
+  if (lz == 0) MarkDirty({c.x, c.y, c.z - 1});
+  if (lz == last) MarkDirty({c.x, c.y, c.z + 1});
+}
+
+void VoxelWorld::FillBox(const glm::ivec3& min, const glm::ivec3& max,
+                         BlockId block) {
+  for (int y = min.y; y <= max.y; y++) {
+    for (int z = min.z; z <= max.z; z++) {
+      for (int x = min.x; x <= max.x; x++) Set(x, y, z, block);
+    }
+  }
+}
+
+int VoxelWorld::Remesh(JobSystem* jobs) {
+  std::vector<std::pair<Coord, Entry*>> dirty;
+  for (auto& entry : chunks) {
+    if (entry.second.dirty) dirty.push_back({entry.first, &entry.second});
+  }
+  if (dirty.empty()) return 0;
+
+  // meshing only reads voxels, so chunks can go in parallel
+  std::vector<VoxelMeshData> meshes(dirty.size());
+  auto meshRange = [&](int begin, int end) {
+    for (int i = begin; i < end; i++) {
+      Coord c = dirty[i].first;
+      const VoxelChunk* neighbors[6] = {
+          Find({c.x - 1, c.y, c.z}), Find({c.x + 1, c.y, c.z}),
+          Find({c.x, c.y - 1, c.z}), Find({c.x, c.y + 1, c.z}),
+          Find({c.x, c.y, c.z - 1}), Find({c.x, c.y, c.z + 1})};
+      GreedyMesh(dirty[i].second->voxels, neighbors, meshes[i]);
+    }
+  };
+  if (jobs) {
+    jobs->ParallelFor((int)dirty.size(), 1, meshRange);
+  } else {
+    meshRange(0, (int)dirty.size());
+  }
+
+  for (size_t i = 0; i < dirty.size(); i++) {
+    Entry& e = *dirty[i].second;
+    const VoxelMeshData& mesh = meshes[i];
+    quadCount -= e.indexCount / 6;
+    e.dirty = false;
+    e.indexCount = (int)mesh.indices.size();
+    quadCount += e.indexCount / 6;
+    if (mesh.indices.empty()) continue;
+
+    if (!e.VAO) {
+      glGenVertexArrays(1, &e.VAO);
+      glGenBuffers(1, &e.VBO);
+      glGenBuffers(1, &e.EBO);
+      glBindVertexArray(e.VAO);
+      glBindBuffer(GL_ARRAY_BUFFER, e.VBO);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, e.EBO);
+      glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(VoxelVertex),
+                             (void*)0);
+      glEnableVertexAttribArray(0);
+    }
+    glBindVertexArray(e.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, e.VBO);
+    glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * sizeof(VoxelVertex),
+                 mesh.vertices.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 mesh.indices.size() * sizeof(unsigned int),
+                 mesh.indices.data(), GL_STATIC_DRAW);
+  }
+  glBindVertexArray(0);
+  return (int)dirty.size();
+}
+
+void VoxelWorld::Draw(const Frustum& frustum, const Shader& shader) {
+  chunksDrawn = 0;
+  int originLoc = glGetUniformLocation(shader.ID, "origin");
+  glUniform1f(glGetUniformLocation(shader.ID, "blockSize"), blockSize);
+  float extent = VOXEL_CHUNK * blockSize;
+  for (auto& entry : chunks) {
+    const Entry& e = entry.second;
+    if (!e.indexCount) continue;
+    // blocks are centered on their coordinate, so the grid starts half a
+    // block early
+    glm::vec3 origin =
+        (glm::vec3(entry.first.x, entry.first.y, entry.first.z) *
+             (float)VOXEL_CHUNK -
+         0.5f) *
+        blockSize;
+    if (!frustum.IntersectsAABB(origin, origin + glm::vec3(extent))) continue;
+    glUniform3f(originLoc, origin.x, origin.y, origin.z);
+    glBindVertexArray(e.VAO);
+    glDrawElements(GL_TRIANGLES, e.indexCount, GL_UNSIGNED_INT, (void*)0);
+    chunksDrawn++;
+  }
+}
+
+size_t VoxelWorld::VoxelBytes() const {
+  size_t bytes = 0;
+  for (const auto& entry : chunks) bytes += entry.second.voxels.MemoryBytes();
+  return bytes;
+}
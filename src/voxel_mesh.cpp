@@ -0,0 +1,316 @@
+#include "voxel.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <set>
+
+namespace {
+
+const int VOLUME = VOXEL_CHUNK * VOXEL_CHUNK * VOXEL_CHUNK;
+
+uint32_t PackVertex(int x, int y, int z, int face, BlockId block) {
+  return (uint32_t)x | ((uint32_t)y << 6) | ((uint32_t)z << 12) |
+         ((uint32_t)face << 18) | ((uint32_t)(block & 0x7ff) << 21);
+}
+
+}  // namespace
+
+VoxelChunk::VoxelChunk() : palette(1, 0) {}
+
+BlockId VoxelChunk::Get(int x, int y, int z) const {
+  if (bitsPerIndex == 0) return palette[0];
+  int bit = Index(x, y, z) * bitsPerIndex;
+  uint64_t mask = (1ull << bitsPerIndex) - 1;
+  return palette[(bits[bit >> 6] >> (bit & 63)) & mask];
+}
+
+void VoxelChunk::Set(int x, int y, int z, BlockId block) {
+  size_t slot =
+      std::find(palette.begin(), palette.end(), block) - palette.begin();
+  if (slot == palette.size()) {
+    palette.push_back(block);
+    int needed = 0;
+    while ((1u << needed) < palette.size()) needed = needed ? needed * 2 : 1;
+    if (needed != bitsPerIndex) Repack(needed);
+  }
+  if (bitsPerIndex == 0) return;  // single block type, nothing stored
+  int bit = Index(x, y, z) * bitsPerIndex;
+  uint64_t mask = (1ull << bitsPerIndex) - 1;
+  uint64_t& word = bits[bit >> 6];
+  word = (word & ~(mask << (bit & 63))) | ((uint64_t)slot << (bit & 63));
+}
+
+void VoxelChunk::Repack(int newBits) {
+  // indices fit their word exactly because the widths are powers of two
+  std::vector<uint64_t> packed((size_t)VOLUME * newBits / 64, 0);
+  uint64_t oldMask = bitsPerIndex ? (1ull << bitsPerIndex) - 1 : 0;
+  for (int i = 0; i < VOLUME; i++) {
+    uint64_t slot = 0;
+    if (bitsPerIndex) {
+      int bit = i * bitsPerIndex;
+      slot = (bits[bit >> 6] >> (bit & 63)) & oldMask;
+    }
+    int bit = i * newBits;
+    packed[bit >> 6] |= slot << (bit & 63);
+  }
+  bits.swap(packed);
+  bitsPerIndex = newBits;
+}
+
+size_t VoxelChunk::MemoryBytes() const {
+  return sizeof(VoxelChunk) + palette.capacity() * sizeof(BlockId) +
+         bits.capacity() * sizeof(uint64_t);
+}
+
+void GreedyMesh(const VoxelChunk& chunk, const VoxelChunk* const neighbors[6],
+                VoxelMeshData& out) {
+  const int N = VOXEL_CHUNK;
+  // signed face per cell of a slice: +id faces +axis, -id faces -axis
+  std::vector<int> mask(N * N);
+
+  // unpack once into a grid with a one block border from the neighbours,
+  // the slices below then only do plain array reads
+  const int P = N + 2;
+  std::vector<BlockId> padded((size_t)P * P * P, 0);
+  auto pad = [&](int x, int y, int z) -> BlockId& {
+    return padded[((size_t)(y + 1) * P + (z + 1)) * P + (x + 1)];
+  };
+  for (int y = 0; y < N; y++) {
+    for (int z = 0; z < N; z++) {
+      for (int x = 0; x < N; x++) pad(x, y, z) = chunk.Get(x, y, z);
+    }
+  }
+  for (int axis = 0; axis < 3; axis++) {
+    for (int side = 0; side < 2; side++) {
+      const VoxelChunk* other = neighbors[axis * 2 + side];
+      if (!other) continue;
+      int p[3];
+      p[axis] = side ? N : -1;
+      int a = (axis + 1) % 3;
+      int b = (axis + 2) % 3;
+      for (p[b] = 0; p[b] < N; p[b]++) {
+        for (p[a] = 0; p[a] < N; p[a]++) {
+          int q[3] = {p[0], p[1], p[2]};
+          q[axis] = side ? 0 : N - 1;
+          pad(p[0], p[1], p[2]) = other->Get(q[0], q[1], q[2]);
+        }
+      }
+    }
+  }
+  auto blockAt = [&](const int p[3]) { return pad(p[0], p[1], p[2]); };
+
+  for (int d = 0; d < 3; d++) {
+    int u = (d + 1) % 3;
+    int v = (d + 2) % 3;
+    int x[3] = {0, 0, 0};
+
+    // slice s is the plane between layers s - 1 and s along d
+    for (int s = 0; s <= N; s++) {
+      for (x[v] = 0; x[v] < N; x[v]++) {
+        for (x[u] = 0; x[u] < N; x[u]++) {
+          x[d] = s - 1;
+          BlockId a = blockAt(x);
+          x[d] = s;
+          BlockId b = blockAt(x);
+          int face = 0;
+          // only faces of our own blocks, the neighbour emits the rest
+          if (a && !b && s > 0) face = a;
+          if (b && !a && s < N) face = -(int)b;
+          mask[x[v] * N + x[u]] = face;
+        }
+      }
+
+      for (int j = 0; j < N; j++) {
+        for (int i = 0; i < N;) {
+          int face = mask[j * N + i];
+          if (face == 0) {
+            i++;
+            continue;
+          }
+          int width = 1;
+          while (i + width < N && mask[j * N + i + width] == face) width++;
+          int height = 1;
+          for (; j + height < N; height++) {
+            bool row = true;
+            for (int k = 0; k < width; k++) {
+              if (mask[(j + height) * N + i + k] != face) {
+                row = false;
+                break;
+              }
+            }
+            if (!row) break;
+          }
+
+          int corner[4][3];
+          for (int c = 0; c < 4; c++) {
+            corner[c][d] = s;
+            corner[c][u] = i + ((c == 1 || c == 2) ? width : 0);
+            corner[c][v] = j + ((c == 2 || c == 3) ? height : 0);
+          }
+          int faceIndex = d * 2 + (face > 0 ? 1 : 0);  // -x, +x, -y, ...
+          BlockId block = (BlockId)(face > 0 ? face : -face);
+          unsigned int base = (unsigned int)out.vertices.size();
+          for (int c = 0; c < 4; c++) {
+            out.vertices.push_back({PackVertex(corner[c][0], corner[c][1],
+                                               corner[c][2], faceIndex,
+                                               block)});
+          }
+          // u x v = d, so 0-1-2-3 winds counter-clockwise seen from +d
+          if (face > 0) {
+            out.indices.insert(out.indices.end(),
+                               {base, base + 1, base + 2, base, base + 2,
+                                base + 3});
+          } else {
+            out.indices.insert(out.indices.end(),
+                               {base, base + 2, base + 1, base, base + 3,
+                                base + 2});
+          }
+
+          for (int h = 0; h < height; h++) {
+            std::fill_n(mask.begin() + (j + h) * N + i, width, 0);
+          }
+          i += width;
+        }
+      }
+    }
+  }
+}
+
+
+namespace {
+
+// a unit face: direction (-x, +x, -y, ...), the corner it starts at, block
+typedef std::array<int, 5> Face;
+
+// every visible face of the chunk's own blocks, one by one
+void NaiveFaces(const VoxelChunk& chunk, const VoxelChunk* const neighbors[6],
+                std::multiset<Face>& faces) {
+  const int N = VOXEL_CHUNK;
+  auto blockAt = [&](int p[3]) -> BlockId {
+    for (int axis = 0; axis < 3; axis++) {
+      if (p[axis] >= 0 && p[axis] < N) continue;
+      const VoxelChunk* other = neighbors[axis * 2 + (p[axis] < 0 ? 0 : 1)];
+      if (!other) return 0;
+      int q[3] = {p[0], p[1], p[2]};
+      q[axis] = p[axis] < 0 ? N - 1 : 0;
+      return other->Get(q[0], q[1], q[2]);
+    }
+    return chunk.Get(p[0], p[1], p[2]);
+  };
+  for (int y = 0; y < N; y++) {
+    for (int z = 0; z < N; z++) {
+      for (int x = 0; x < N; x++) {
+        BlockId block = chunk.Get(x, y, z);
+        if (!block) continue;
+        for (int face = 0; face < 6; face++) {
+          int p[3] = {x, y, z};
+          p[face / 2] += face % 2 ? 1 : -1;
+          if (blockAt(p)) continue;
+          int corner[3] = {x, y, z};
+          if (face % 2) corner[face / 2]++;
+          faces.insert({face, corner[0], corner[1], corner[2], block});
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+int VerifyGreedyMesh(int chunkCount) {
+  const int N = VOXEL_CHUNK;
+  std::mt19937 rng(36);
+  std::uniform_int_distribution<int> block(1, 4);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+  // rolling ground of a few block types with caves and loose blocks, the
+  // kind of chunk the greedy mesher is meant for
+  auto generate = [&](VoxelChunk& chunk) {
+    float phase = unit(rng) * 6.28f, holes = 0.002f + 0.02f * unit(rng);
+    for (int z = 0; z < N; z++) {
+      for (int x = 0; x < N; x++) {
+        int height = (int)(N / 2 + 6.0f * std::sin(x * 0.2f + phase) +
+                           4.0f * std::cos(z * 0.15f - phase));
+        BlockId top = (BlockId)block(rng);
+        for (int y = 0; y < N; y++) {
+          BlockId b = y < height - 3 ? 1 : y < height ? top : 0;
+          if (unit(rng) < holes) b = b ? 0 : (BlockId)block(rng);
+          if (b) chunk.Set(x, y, z, b);
+        }
+      }
+    }
+  };
+
+  int differ = 0, wound = 0;
+  size_t quads = 0, naive = 0;
+  for (int c = 0; c < chunkCount; c++) {
+    VoxelChunk chunk;
+    generate(chunk);
+    // some sides have a neighbour, the rest are open air
+    VoxelChunk around[6];
+    const VoxelChunk* neighbors[6];
+    for (int side = 0; side < 6; side++) {
+      neighbors[side] = nullptr;
+      if (unit(rng) < 0.5f) continue;
+      generate(around[side]);
+      neighbors[side] = &around[side];
+    }
+
+    VoxelMeshData mesh;
+    GreedyMesh(chunk, neighbors, mesh);
+    std::multiset<Face> expected, covered;
+    NaiveFaces(chunk, neighbors, expected);
+    for (size_t q = 0; q < mesh.vertices.size(); q += 4) {
+      int corner[4][3], face = 0, id = 0;
+      for (int k = 0; k < 4; k++) {
+        uint32_t v = mesh.vertices[q + k].packed;
+        corner[k][0] = v & 63;
+        corner[k][1] = (v >> 6) & 63;
+        corner[k][2] = (v >> 12) & 63;
+        face = (v >> 18) & 7;
+        id = (int)(v >> 21);
+      }
+      // the first triangle has to face out of the block
+      const unsigned int* t = &mesh.indices[q / 4 * 6];
+      int e1[3], e2[3];
+      for (int k = 0; k < 3; k++) {
+        e1[k] = corner[t[1] - q][k] - corner[t[0] - q][k];
+        e2[k] = corner[t[2] - q][k] - corner[t[0] - q][k];
+      }
+      int d = face / 2, u = (d + 1) % 3, v = (d + 2) % 3;
+      int normal = e1[u] * e2[v] - e1[v] * e2[u];
+      if ((normal > 0) != (face % 2 == 1)) wound++;
+      // corners 0 and 2 are opposite, every unit face between them counts
+      for (int j = corner[0][v]; j < corner[2][v]; j++) {
+        for (int i = corner[0][u]; i < corner[2][u]; i++) {
+          int p[3];
+          p[d] = corner[0][d];
+          p[u] = i;
+          p[v] = j;
+          covered.insert({face, p[0], p[1], p[2], id});
+        }
+      }
+    }
+    // faces covered twice, covered but not visible, or visible but missed
+    std::vector<Face> difference;
+    std::set_symmetric_difference(expected.begin(), expected.end(),
+                                  covered.begin(), covered.end(),
+                                  std::back_inserter(difference));
+    differ += (int)difference.size();
+    quads += mesh.vertices.size() / 4;
+    naive += expected.size();
+  }
+  differ += wound;
+
+  std::cout << "Greedy mesh: " << chunkCount << " chunks, " << quads
+            << " quads for " << naive << " visible faces ("
+            << (naive ? 100.0 * quads / naive : 0.0) << "%), " << wound
+            << " wound the wrong way, " << differ << " differ" << std::endl;
+  // merging has to pay off on chunks like these
+  if (quads >= naive) differ++;
+  return differ;
+}
@@ -0,0 +1,69 @@
+#include "world.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+void Chunk::FinalizeTrees(const glm::vec3& meshMin, const glm::vec3& meshMax) {
+  treeMatrices.clear();
+  treeMatrices.reserve(trees.size());
+  treeLod.assign(trees.size(), LodState());
+
+  for (const TreeInstance& tree : trees) {
+    glm::mat4 model = glm::translate(glm::mat4(1.0f), tree.position);
+    model = glm::rotate(model, tree.yaw, glm::vec3(0.0f, 1.0f, 0.0f));
+    model = glm::scale(model, glm::vec3(tree.scale));
+    treeMatrices.push_back(model);
+
+    // rotation about y only, so a circle around the mesh covers any yaw
+    float reach = std::max(std::max(std::abs(meshMin.x), std::abs(meshMax.x)),
+                           std::max(std::abs(meshMin.z), std::abs(meshMax.z)));
+    reach *= tree.scale * 1.4143f;
+    glm::vec3 lo = tree.position +
+                   glm::vec3(-reach, meshMin.y * tree.scale, -reach);
+    glm::vec3 hi = tree.position +
+                   glm::vec3(reach, meshMax.y * tree.scale, reach);
+    boundsMin = glm::min(boundsMin, lo);
+    boundsMax = glm::max(boundsMax, hi);
+  }
+}
+
+size_t Chunk::MemoryBytes() const {
+  return sizeof(Chunk) + trees.capacity() * sizeof(TreeInstance) +
+         treeMatrices.capacity() * sizeof(glm::mat4) +
+         treeLod.capacity() * sizeof(LodState);
+}
+
+World::World(float chunkSize) : chunkSize(chunkSize) {}
+
+ChunkCoord World::ChunkAt(float x, float z) const {
+  return {(int)std::floor(x / chunkSize), (int)std::floor(z / chunkSize)};
+}
+
+glm::vec2 World::ChunkOrigin(ChunkCoord c) const {
+  return glm::vec2(c.x * chunkSize, c.z * chunkSize);
+}
+
+Chunk& World::GetChunk(ChunkCoord c) {
+  auto it = chunks.find(c);
+  if (it != chunks.end()) return it->second;
+
+  Chunk& chunk = chunks[c];
+  chunk.coord = c;
+  glm::vec2 origin = ChunkOrigin(c);
+  // flat until something taller lands in it
+  chunk.boundsMin = glm::vec3(origin.x, 0.0f, origin.y);
+  chunk.boundsMax = glm::vec3(origin.x + chunkSize, 0.0f, origin.y + chunkSize);
+  return chunk;
+}
+
+Chunk* World::FindChunk(ChunkCoord c) {
+  auto it = chunks.find(c);
+  return it != chunks.end() ? &it->second : nullptr;
+}
+
+size_t World::TreeCount() const {
+  size_t count = 0;
+  for (const auto& entry : chunks) count += entry.second.trees.size();
+  return count;
+}
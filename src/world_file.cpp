@@ -0,0 +1,267 @@
+#include "world_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "block_compress.hpp"
+
+namespace {
+
+const size_t BLOB_ALIGN = 64;
+const size_t SECTION_ALIGN = 16;
+
+size_t AlignUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+bool CoordLess(const WorldFileChunk& a, int x, int z) {
+  return a.x < x || (a.x == x && a.z < z);
+}
+
+}  // namespace
+
+bool WriteWorldFile(const std::string& path, const World& world,
+                    bool compress) {
+  std::string tempPath = path + ".tmp";
+  std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    std::cout << "ERROR::WORLD_FILE::CANNOT_WRITE " << tempPath << std::endl;
+    return false;
+  }
+
+  // sorted so readers can binary search the directory
+  std::vector<const Chunk*> chunks;
+  for (const auto& entry : world.chunks) chunks.push_back(&entry.second);
+  std::sort(chunks.begin(), chunks.end(), [](const Chunk* a, const Chunk* b) {
+    return a->coord.x < b->coord.x ||
+           (a->coord.x == b->coord.x && a->coord.z < b->coord.z);
+  });
+
+  WorldFileHeader header = {};
+  std::memcpy(header.magic, "HWLD", 4);
+  header.version = WORLD_FILE_VERSION;
+  header.chunkSize = world.chunkSize;
+  header.chunkCount = (uint32_t)chunks.size();
+  file.write((const char*)&header, sizeof(header));
+
+  std::vector<WorldFileChunk> directory;
+  std::vector<uint8_t> blob;
+  const char padding[BLOB_ALIGN] = {};
+  size_t position = sizeof(header);
+  for (const Chunk* chunk : chunks) {
+    // only trees for now, vertices/indices are reserved for baked meshes
+    WorldFileSection section = {};
+    section.type = WORLD_SECTION_TREES;
+    section.elementSize = sizeof(TreeInstance);
+    section.offset = AlignUp(sizeof(WorldFileSection), SECTION_ALIGN);
+    section.count = chunk->trees.size();
+
+    size_t dataSize = section.count * sizeof(TreeInstance);
+    blob.assign(section.offset + dataSize, 0);
+    std::memcpy(blob.data(), &section, sizeof(section));
+    if (dataSize) {
+      std::memcpy(blob.data() + section.offset, chunk->trees.data(), dataSize);
+    }
+
+    WorldFileChunk entry = {};
+    entry.x = chunk->coord.x;
+    entry.z = chunk->coord.z;
+    entry.rawSize = blob.size();
+    entry.sectionCount = 1;
+    entry.compression = WORLD_COMPRESSION_NONE;
+    if (compress) {
+      std::vector<uint8_t> packed = CompressLZ4(blob.data(), blob.size());
+      if (packed.size() < blob.size()) {
+        blob.swap(packed);
+        entry.compression = WORLD_COMPRESSION_LZ4;
+      }
+    }
+    entry.storedSize = blob.size();
+
+    size_t aligned = AlignUp(position, BLOB_ALIGN);
+    file.write(padding, aligned - position);
+    entry.offset = aligned;
+    file.write((const char*)blob.data(), blob.size());
+    position = aligned + blob.size();
+    directory.push_back(entry);
+  }
+
+  size_t directoryOffset = AlignUp(position, 8);
+  file.write(padding, directoryOffset - position);
+  file.write((const char*)directory.data(),
+             directory.size() * sizeof(WorldFileChunk));
+  header.directoryOffset = directoryOffset;
+  file.seekp(0);
+  file.write((const char*)&header, sizeof(header));
+  file.close();
+  if (!file) {
+    std::cout << "ERROR::WORLD_FILE::CANNOT_WRITE " << tempPath << std::endl;
+    return false;
+  }
+
+  if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+    std::cout << "ERROR::WORLD_FILE::CANNOT_RENAME " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+WorldFileReader::~WorldFileReader() { Close(); }
+
+bool WorldFileReader::Open(const std::string& path) {
+  Close();
+  fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;  // no file is fine, the world gets generated
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(WorldFileHeader)) {
+    std::cout << "ERROR::WORLD_FILE::TOO_SMALL " << path << std::endl;
+    Close();
+    return false;
+  }
+  fileSize = (size_t)info.st_size;
+  void* address = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (address == MAP_FAILED) {
+    std::cout << "ERROR::WORLD_FILE::MMAP_FAILED " << path << std::endl;
+    Close();
+    return false;
+  }
+  mapping = (const uint8_t*)address;
+  header = (const WorldFileHeader*)mapping;
+
+  if (std::memcmp(header->magic, "HWLD", 4) != 0 ||
+      header->version != WORLD_FILE_VERSION) {
+    std::cout << "ERROR::WORLD_FILE::BAD_VERSION " << path << std::endl;
+    Close();
+    return false;
+  }
+  size_t directoryBytes = (size_t)header->chunkCount * sizeof(WorldFileChunk);
+  if (header->directoryOffset % 8 != 0 || header->directoryOffset > fileSize ||
+      fileSize - header->directoryOffset < directoryBytes) {
+    std::cout << "ERROR::WORLD_FILE::BAD_DIRECTORY " << path << std::endl;
+    Close();
+    return false;
+  }
+  directory = (const WorldFileChunk*)(mapping + header->directoryOffset);
+  for (int i = 0; i < ChunkCount(); i++) {
+    const WorldFileChunk& entry = directory[i];
+    bool raw = entry.compression == WORLD_COMPRESSION_NONE;
+    if (entry.offset > fileSize || fileSize - entry.offset < entry.storedSize ||
+        entry.offset % BLOB_ALIGN != 0 ||
+        (raw && entry.storedSize != entry.rawSize)) {
+      std::cout << "ERROR::WORLD_FILE::BAD_CHUNK " << path << std::endl;
+      Close();
+      return false;
+    }
+  }
+  return true;
+}
+
+void WorldFileReader::Close() {
+  if (mapping) munmap((void*)mapping, fileSize);
+  if (fd >= 0) close(fd);
+  fd = -1;
+  mapping = nullptr;
+  header = nullptr;
+  directory = nullptr;
+  fileSize = 0;
+}
+
+int WorldFileReader::Find(ChunkCoord coord) const {
+  if (!mapping) return -1;
+  const WorldFileChunk* end = directory + header->chunkCount;
+  const WorldFileChunk* it = std::lower_bound(
+      directory, end, coord, [](const WorldFileChunk& a, ChunkCoord c) {
+        return CoordLess(a, c.x, c.z);
+      });
+  if (it == end || it->x != coord.x || it->z != coord.z) return -1;
+  return (int)(it - directory);
+}
+
+const uint8_t* WorldFileReader::FindSection(int chunk, uint32_t type,
+                                            size_t elementSize,
+                                            std::vector<uint8_t>& scratch,
+                                            size_t& count) const {
+  count = 0;
+  if (!mapping || chunk < 0 || chunk >= ChunkCount()) return nullptr;
+  const WorldFileChunk& entry = directory[chunk];
+
+  const uint8_t* blob = mapping + entry.offset;
+  if (entry.compression == WORLD_COMPRESSION_LZ4) {
+    scratch.resize(entry.rawSize);
+    if (!DecompressLZ4(blob, entry.storedSize, scratch.data(),
+                       scratch.size())) {
+      std::cout << "ERROR::WORLD_FILE::CORRUPT_CHUNK " << entry.x << ", "
+                << entry.z << std::endl;
+      return nullptr;
+    }
+    blob = scratch.data();
+  } else if (entry.compression != WORLD_COMPRESSION_NONE) {
+    return nullptr;
+  }
+
+  size_t tableBytes = (size_t)entry.sectionCount * sizeof(WorldFileSection);
+  if (tableBytes > entry.rawSize) return nullptr;
+  const WorldFileSection* sections = (const WorldFileSection*)blob;
+  for (uint32_t i = 0; i < entry.sectionCount; i++) {
+    const WorldFileSection& section = sections[i];
+    if (section.type != type) continue;
+    if (section.elementSize != elementSize ||
+        section.offset % SECTION_ALIGN != 0 || section.offset > entry.rawSize ||
+        (entry.rawSize - section.offset) / elementSize < section.count) {
+      return nullptr;
+    }
+    count = (size_t)section.count;
+    return blob + section.offset;
+  }
+  return nullptr;
+}
+
+double BenchmarkWorldFileLoad(const std::string& path) {
+  auto start = std::chrono::high_resolution_clock::now();
+  WorldFileReader reader;
+  if (!reader.Open(path)) return 0.0;
+
+  std::vector<uint8_t> scratch;
+  size_t bytes = 0;
+  float checksum = 0.0f;  // touch the data so the reads can't be skipped
+  for (int i = 0; i < reader.ChunkCount(); i++) {
+    Span<TreeInstance> trees =
+        reader.Section<TreeInstance>(i, WORLD_SECTION_TREES, scratch);
+    for (const TreeInstance& tree : trees) checksum += tree.scale;
+    bytes += trees.size * sizeof(TreeInstance);
+  }
+  double seconds = std::chrono::duration<double>(
+                       std::chrono::high_resolution_clock::now() - start)
+                       .count();
+  if (checksum < 0.0f) std::cout << checksum;
+  return seconds > 0.0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
+int VerifyWorldFile(const std::string& path, const World& world) {
+  WorldFileReader reader;
+  if (!reader.Open(path)) return -1;
+
+  std::vector<uint8_t> scratch;
+  int mismatched = 0;
+  for (const auto& entry : world.chunks) {
+    const Chunk& chunk = entry.second;
+    Span<TreeInstance> trees = reader.Section<TreeInstance>(
+        reader.Find(chunk.coord), WORLD_SECTION_TREES, scratch);
+    if (trees.size != chunk.trees.size() ||
+        (trees.size && std::memcmp(trees.data, chunk.trees.data(),
+                                   trees.size * sizeof(TreeInstance)) != 0)) {
+      mismatched++;
+    }
+  }
+  return mismatched;
+}